@@ -25,6 +25,7 @@
 #include "focusrite_cmd.h"
 
 #include "libutil/ByteSwap.h"
+#include "libutil/PosixThread.h"
 
 namespace BeBoB {
 namespace Focusrite {
@@ -33,16 +34,39 @@ FocusriteDevice::FocusriteDevice( DeviceManager& d, std::auto_ptr<ConfigRom>( co
     : BeBoB::Device( d, configRom)
     , m_cmd_time_interval( 0 )
     , m_earliest_next_cmd_time( 0 )
+    , m_write_in_progress( false )
+    , m_write_behind_stop( false )
+    , m_write_behind_task( NULL )
+    , m_write_behind_thread( NULL )
+    , m_nb_queued_writes( 0 )
+    , m_nb_coalesced_writes( 0 )
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Created BeBoB::Focusrite::FocusriteDevice (NodeID %d)\n",
                  getConfigRom().getNodeId() );
     addOption(Util::OptionContainer::Option("useAvcForParameters", false));
+
+    pthread_mutex_init(&m_cmd_lock, NULL);
+    pthread_mutex_init(&m_queue_lock, NULL);
+    pthread_cond_init(&m_queue_cond, NULL);
+}
+
+FocusriteDevice::~FocusriteDevice()
+{
+    stopWriteBehind();
+    pthread_cond_destroy(&m_queue_cond);
+    pthread_mutex_destroy(&m_queue_lock);
+    pthread_mutex_destroy(&m_cmd_lock);
 }
 
 void
 FocusriteDevice::showDevice()
 {
     debugOutput(DEBUG_LEVEL_NORMAL, "This is a BeBoB::Focusrite::FocusriteDevice\n");
+    pthread_mutex_lock(&m_queue_lock);
+    debugOutput(DEBUG_LEVEL_NORMAL, " Queued parameter writes: %u (%u coalesced), %zd pending, %zd failed\n",
+                m_nb_queued_writes, m_nb_coalesced_writes, m_shadow_values.size(),
+                m_failed_writes.size());
+    pthread_mutex_unlock(&m_queue_lock);
     BeBoB::Device::showDevice();
 }
 
@@ -57,31 +81,203 @@ FocusriteDevice::setVerboseLevel(int l)
 bool
 FocusriteDevice::setSpecificValue(uint32_t id, uint32_t v)
 {
-    debugOutput(DEBUG_LEVEL_VERBOSE, "Writing parameter address space id 0x%08X (%u), data: 0x%08X\n",
+    // keep the order with respect to the queued writes
+    pthread_mutex_lock(&m_queue_lock);
+    waitForQueuedWrites();
+    pthread_mutex_unlock(&m_queue_lock);
+
+    return doSetSpecificValue(id, v);
+}
+
+bool
+FocusriteDevice::getSpecificValue(uint32_t id, uint32_t *v)
+{
+    pthread_mutex_lock(&m_queue_lock);
+    std::map<uint32_t, uint32_t>::iterator it = m_shadow_values.find(id);
+    if (it != m_shadow_values.end()) {
+        *v = it->second;
+        pthread_mutex_unlock(&m_queue_lock);
+        debugOutput(DEBUG_LEVEL_VERBOSE,"Read parameter address space id 0x%08X (%u): %08X (pending)\n", id, id, *v);
+        return true;
+    }
+    pthread_mutex_unlock(&m_queue_lock);
+
+    return doGetSpecificValue(id, v);
+}
+
+bool
+FocusriteDevice::queueSpecificValue(uint32_t id, uint32_t v)
+{
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Queueing write to parameter address space id 0x%08X (%u), data: 0x%08X\n",
         id, id, v);
-    bool use_avc = false;
-    if(!getOption("useAvcForParameters", use_avc)) {
-        debugWarning("Could not retrieve useAvcForParameters parameter, defaulting to false\n");
+
+    pthread_mutex_lock(&m_queue_lock);
+    bool previous_failed = (m_failed_writes.erase(id) > 0);
+    if (previous_failed) {
+        debugWarning("Previous write to parameter 0x%08X failed\n", id);
+    }
+    if (m_write_behind_thread == NULL) {
+        m_write_behind_stop = false;
+        m_write_behind_task = new WriteBehindTask(*this);
+        m_write_behind_thread = new Util::PosixThread(m_write_behind_task, "FRWB", false,
+                                                      0, PTHREAD_CANCEL_DEFERRED);
+        if (m_write_behind_thread->Start() != 0) {
+            debugError("Could not start write-behind thread\n");
+            delete m_write_behind_thread;
+            m_write_behind_thread = NULL;
+            delete m_write_behind_task;
+            m_write_behind_task = NULL;
+            pthread_mutex_unlock(&m_queue_lock);
+            return setSpecificValue(id, v) && !previous_failed;
+        }
     }
 
-    // rate control
+    m_nb_queued_writes++;
+    if (m_queued_values.find(id) == m_queued_values.end()) {
+        m_queue_order.push_back(id);
+    } else {
+        // last value wins
+        m_nb_coalesced_writes++;
+    }
+    m_queued_values[id] = v;
+    m_shadow_values[id] = v;
+    pthread_cond_broadcast(&m_queue_cond);
+    pthread_mutex_unlock(&m_queue_lock);
+    return !previous_failed;
+}
+
+// m_queue_lock is held
+void
+FocusriteDevice::waitForQueuedWrites()
+{
+    while (m_write_behind_thread && (!m_queue_order.empty() || m_write_in_progress)) {
+        pthread_cond_wait(&m_queue_cond, &m_queue_lock);
+    }
+}
+
+bool
+FocusriteDevice::flushSpecificValues()
+{
+    pthread_mutex_lock(&m_queue_lock);
+    waitForQueuedWrites();
+    bool result = m_failed_writes.empty();
+    m_failed_writes.clear();
+    pthread_mutex_unlock(&m_queue_lock);
+    return result;
+}
+
+void
+FocusriteDevice::invalidateSpecificValues()
+{
+    flushSpecificValues();
+}
+
+bool
+FocusriteDevice::executeQueuedWrite()
+{
+    pthread_mutex_lock(&m_queue_lock);
+    while (m_queue_order.empty() && !m_write_behind_stop) {
+        pthread_cond_wait(&m_queue_cond, &m_queue_lock);
+    }
+    if (m_queue_order.empty()) {
+        // stop requested
+        pthread_mutex_unlock(&m_queue_lock);
+        return false;
+    }
+    uint32_t id = m_queue_order.front();
+    m_queue_order.pop_front();
+    uint32_t v = m_queued_values[id];
+    m_queued_values.erase(id);
+    m_write_in_progress = true;
+    pthread_mutex_unlock(&m_queue_lock);
+
+    bool result = doSetSpecificValue(id, v);
+
+    pthread_mutex_lock(&m_queue_lock);
+    if (!result) {
+        debugError("Queued write to parameter 0x%08X failed\n", id);
+        m_failed_writes.insert(id);
+    }
+    // from now on the device has the value, unless another write is queued
+    if (m_queued_values.find(id) == m_queued_values.end()) {
+        m_shadow_values.erase(id);
+    }
+    m_write_in_progress = false;
+    pthread_cond_broadcast(&m_queue_cond);
+    pthread_mutex_unlock(&m_queue_lock);
+    return true;
+}
+
+void
+FocusriteDevice::stopWriteBehind()
+{
+    if (m_write_behind_thread == NULL) return;
+    // execute the writes that are still queued
+    flushSpecificValues();
+
+    pthread_mutex_lock(&m_queue_lock);
+    m_write_behind_stop = true;
+    pthread_cond_broadcast(&m_queue_cond);
+    pthread_mutex_unlock(&m_queue_lock);
+
+    m_write_behind_thread->Stop();
+    delete m_write_behind_thread;
+    m_write_behind_thread = NULL;
+    delete m_write_behind_task;
+    m_write_behind_task = NULL;
+}
+
+FocusriteDevice::WriteBehindTask::WriteBehindTask(FocusriteDevice& parent)
+    : m_parent( parent )
+{
+}
+
+bool
+FocusriteDevice::WriteBehindTask::Execute()
+{
+    return m_parent.executeQueuedWrite();
+}
+
+// wait until the device accepts the next command, m_cmd_lock is held
+void
+FocusriteDevice::waitForCmdInterval()
+{
     ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
     if(m_cmd_time_interval && (m_earliest_next_cmd_time > now)) {
         ffado_microsecs_t wait = m_earliest_next_cmd_time - now;
         debugOutput( DEBUG_LEVEL_VERBOSE, "Rate control... %" PRIu64 "\n", wait );
         Util::SystemTimeSource::SleepUsecRelative(wait);
+        now = m_earliest_next_cmd_time;
     }
     m_earliest_next_cmd_time = now + m_cmd_time_interval;
+}
+
+bool
+FocusriteDevice::doSetSpecificValue(uint32_t id, uint32_t v)
+{
+    bool retval;
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Writing parameter address space id 0x%08X (%u), data: 0x%08X\n",
+        id, id, v);
+    bool use_avc = false;
+    if(!getOption("useAvcForParameters", use_avc)) {
+        debugWarning("Could not retrieve useAvcForParameters parameter, defaulting to false\n");
+    }
+
+    pthread_mutex_lock(&m_cmd_lock);
+    // rate control
+    waitForCmdInterval();
 
     if (use_avc) {
-        return setSpecificValueAvc(id, v);
+        retval = setSpecificValueAvc(id, v);
     } else {
-        return setSpecificValueARM(id, v);
+        retval = setSpecificValueARM(id, v);
     }
+    pthread_mutex_unlock(&m_cmd_lock);
+    return retval;
 }
 
 bool
-FocusriteDevice::getSpecificValue(uint32_t id, uint32_t *v)
+FocusriteDevice::doGetSpecificValue(uint32_t id, uint32_t *v)
 {
     bool retval;
     bool use_avc = false;
@@ -89,14 +285,9 @@ FocusriteDevice::getSpecificValue(uint32_t id, uint32_t *v)
         debugWarning("Could not retrieve useAvcForParameters parameter, defaulting to false\n");
     }
 
+    pthread_mutex_lock(&m_cmd_lock);
     // rate control
-    ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
-    if(m_cmd_time_interval && (m_earliest_next_cmd_time > now)) {
-        ffado_microsecs_t wait = m_earliest_next_cmd_time - now;
-        debugOutput( DEBUG_LEVEL_VERBOSE, "Rate control... %" PRIu64 "\n", wait );
-        Util::SystemTimeSource::SleepUsecRelative(wait);
-    }
-    m_earliest_next_cmd_time = now + m_cmd_time_interval;
+    waitForCmdInterval();
 
     // execute
     if (use_avc) {
@@ -104,6 +295,7 @@ FocusriteDevice::getSpecificValue(uint32_t id, uint32_t *v)
     } else {
         retval = getSpecificValueARM(id, v);
     }
+    pthread_mutex_unlock(&m_cmd_lock);
     debugOutput(DEBUG_LEVEL_VERBOSE,"Read parameter address space id 0x%08X (%u): %08X\n", id, id, *v);
     return retval;
 }
@@ -265,8 +457,8 @@ BinaryControl::setValue(int v)
     debugOutput(DEBUG_LEVEL_VERBOSE, "setValue for id %d to %d (reg: 0x%08X => 0x%08X)\n", 
                                      m_cmd_id, v, old_reg, reg);
 
-    if ( !m_Parent.setSpecificValue(m_cmd_id, reg) ) {
-        debugError( "setSpecificValue failed\n" );
+    if ( !m_Parent.queueSpecificValue(m_cmd_id, reg) ) {
+        debugError( "queueSpecificValue failed\n" );
         return false;
     } else return true;
 }
@@ -314,8 +506,8 @@ VolumeControl::setValue(int v)
     debugOutput(DEBUG_LEVEL_VERBOSE, "setValue for id %d to %d\n", 
                                      m_cmd_id, v);
 
-    if ( !m_Parent.setSpecificValue(m_cmd_id, v) ) {
-        debugError( "setSpecificValue failed\n" );
+    if ( !m_Parent.queueSpecificValue(m_cmd_id, v) ) {
+        debugError( "queueSpecificValue failed\n" );
         return false;
     } else return true;
 }
@@ -448,8 +640,8 @@ VolumeControlLowRes::setValue(int v)
     debugOutput(DEBUG_LEVEL_VERBOSE, "setValue for id %d to %d, shift %d (reg: 0x%08X => 0x%08X)\n", 
                                      m_cmd_id, v, m_bit_shift, old_reg, reg);
 
-    if ( !m_Parent.setSpecificValue(m_cmd_id, reg) ) {
-        debugError( "setSpecificValue failed\n" );
+    if ( !m_Parent.queueSpecificValue(m_cmd_id, reg) ) {
+        debugError( "queueSpecificValue failed\n" );
         return false;
     } else return true;
 }
@@ -581,8 +773,8 @@ double FocusriteMatrixMixer::setValue( const int row, const int col, const doubl
     if (v>0x07FFF) v=0x07FFF;
     else if (v<0) v=0;
 
-    if ( !m_Parent.setSpecificValue(c.address, v) ) {
-        debugError( "setSpecificValue failed\n" );
+    if ( !m_Parent.queueSpecificValue(c.address, v) ) {
+        debugError( "queueSpecificValue failed\n" );
         return false;
     } else return true;
 }
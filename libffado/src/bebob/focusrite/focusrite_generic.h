@@ -32,6 +32,12 @@
 #include "libcontrol/MatrixMixer.h"
 
 #include "libutil/SystemTimeSource.h"
+#include "libutil/Thread.h"
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <set>
 
 #define FR_PARAM_SPACE_START 0x000100000000LL
 
@@ -227,7 +233,7 @@ protected:
 class FocusriteDevice : public BeBoB::Device {
 public:
     FocusriteDevice(DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ));
-    virtual ~FocusriteDevice() {};
+    virtual ~FocusriteDevice();
 
     virtual void showDevice();
     virtual void setVerboseLevel(int l);
@@ -236,20 +242,92 @@ public:
     bool setSpecificValue(uint32_t id, uint32_t v);
     bool getSpecificValue(uint32_t id, uint32_t *v);
 
+    /**
+     * @brief write a parameter in the background
+     *
+     * The write is executed by the write-behind thread, at the rate the
+     * device allows. Queued writes to the same parameter are coalesced,
+     * only the last value is written. While the write is pending,
+     * getSpecificValue() returns the queued value without accessing the
+     * device.
+     *
+     * A write that fails in the background is reported by the next
+     * call for the same parameter, which returns false. Its value is
+     * queued nevertheless.
+     *
+     * @param id parameter id
+     * @param v value
+     * @return false if the value could not be queued, or if the previous
+     *         queued write to this parameter failed
+     */
+    bool queueSpecificValue(uint32_t id, uint32_t v);
+    /**
+     * @brief wait until all queued parameter writes are executed
+     * @return false if one of the queued writes failed since the last flush
+     */
+    bool flushSpecificValues();
+    /**
+     * @brief wait for the queued writes and forget their failures
+     *
+     * Should be called when the device changes its parameters, e.g.
+     * when it reboots.
+     */
+    void invalidateSpecificValues();
+
 protected:
     int convertDefToSr( uint32_t def );
     uint32_t convertSrToDef( int sr );
 
 private:
+    bool doSetSpecificValue(uint32_t id, uint32_t v);
+    bool doGetSpecificValue(uint32_t id, uint32_t *v);
+    void waitForCmdInterval();
+
     bool setSpecificValueAvc(uint32_t id, uint32_t v);
     bool getSpecificValueAvc(uint32_t id, uint32_t *v);
 
     bool setSpecificValueARM(uint32_t id, uint32_t v);
     bool getSpecificValueARM(uint32_t id, uint32_t *v);
 
+    class WriteBehindTask : public Util::RunnableInterface
+    {
+    public:
+        WriteBehindTask(FocusriteDevice& parent);
+        virtual ~WriteBehindTask() {};
+
+        bool Execute();
+    private:
+        FocusriteDevice& m_parent;
+    };
+    bool executeQueuedWrite();
+    void waitForQueuedWrites();
+    void stopWriteBehind();
+
 protected:
     ffado_microsecs_t m_cmd_time_interval;
     ffado_microsecs_t m_earliest_next_cmd_time;
+
+private:
+    // serializes the device accesses (and the rate control)
+    pthread_mutex_t     m_cmd_lock;
+
+    // protects the write-behind state
+    pthread_mutex_t     m_queue_lock;
+    pthread_cond_t      m_queue_cond;
+    // the parameters with a queued write, in order of queueing
+    std::deque<uint32_t>            m_queue_order;
+    std::map<uint32_t, uint32_t>    m_queued_values;
+    // the values that are queued or being written, these are returned
+    // by getSpecificValue() instead of the device value
+    std::map<uint32_t, uint32_t>    m_shadow_values;
+    // the parameters for which a queued write failed
+    std::set<uint32_t>              m_failed_writes;
+    bool                m_write_in_progress;
+    bool                m_write_behind_stop;
+    WriteBehindTask    *m_write_behind_task;
+    Util::Thread       *m_write_behind_thread;
+    unsigned int        m_nb_queued_writes;
+    unsigned int        m_nb_coalesced_writes;
 };
 
 } // namespace Focusrite
@@ -794,6 +794,8 @@ SaffireProDevice::rebootDevice() {
                            FR_SAFFIREPRO_CMD_REBOOT_CODE ) ) {
         debugError( "setSpecificValue failed\n" );
     }
+    // the device restores its parameters
+    invalidateSpecificValues();
 }
 
 void
@@ -471,7 +471,7 @@ Device::stopStreamByIndex(int i) {
 int Device::allocateIsoChannel(unsigned int packet_size) {
     unsigned int bandwidth=8+packet_size;
 
-    int ch=get1394Service().allocateIsoChannelGeneric(bandwidth);
+    int ch=get1394Service().allocateIsoChannelGeneric(bandwidth, getNodeId());
 
     debugOutput(DEBUG_LEVEL_VERBOSE, "allocated channel %d, bandwidth %d\n",
         ch, bandwidth);
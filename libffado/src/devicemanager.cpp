@@ -39,6 +39,7 @@
 #include "debugmodule/debugmodule.h"
 
 #include "libutil/PosixMutex.h"
+#include "libutil/StreamStatistics.h"
 
 #ifdef ENABLE_BEBOB
 #include "bebob/bebob_avdevice.h"
@@ -81,6 +82,10 @@
 #include <sstream>
 
 #include <algorithm>
+#include <map>
+#include <set>
+
+#include <unistd.h>
 
 using namespace std;
 
@@ -99,6 +104,9 @@ DeviceManager::DeviceManager()
 {
     addOption(Util::OptionContainer::Option("slaveMode", false));
     addOption(Util::OptionContainer::Option("snoopMode", false));
+
+    // the streams and iso handlers publish their statistics in here
+    Streaming::StreamStatistics::createSegment();
 }
 
 DeviceManager::~DeviceManager()
@@ -146,6 +154,9 @@ DeviceManager::~DeviceManager()
     delete m_DeviceListLock;
     delete m_BusResetLock;
     delete m_deviceStringParser;
+
+    // everything that used the statistics segment is gone now
+    Streaming::StreamStatistics::destroySegment();
 }
 
 bool
@@ -253,6 +264,9 @@ DeviceManager::busresetHandler(Ieee1394Service &service)
 
     // FIXME: what if the devices are gone? (device should detect this!)
     // propagate the bus reset to all avDevices
+    std::map<fb_nodeid_t, fb_nodeid_t> node_map;
+    std::map<FFADODevice *, fb_nodeid_t> old_node_ids;
+    std::vector<fb_octlet_t> not_found;
     m_DeviceListLock->Lock(); // make sure nobody is using this
     for ( FFADODeviceVectorIterator it = m_avDevices.begin();
           it != m_avDevices.end();
@@ -262,15 +276,86 @@ DeviceManager::busresetHandler(Ieee1394Service &service)
             debugOutput(DEBUG_LEVEL_NORMAL,
                         "issue busreset on device GUID %s\n",
                         (*it)->getConfigRom().getGuidString().c_str());
-            (*it)->handleBusReset();
+            ConfigRom &configRom = (*it)->getConfigRom();
+            fb_nodeid_t old_node_id = configRom.getNodeId();
+            if (!(*it)->handleBusReset()) {
+                // the device is gone, or its config rom isn't ready yet.
+                // there is no time to wait for it here.
+                not_found.push_back(configRom.getGuid());
+            }
+            // a device that left the bus maps to INVALID_NODE_ID
+            if (old_node_id != INVALID_NODE_ID) {
+                node_map[old_node_id] = configRom.getNodeId();
+            }
+            old_node_ids[*it] = old_node_id;
+
+            // the streams of the device can continue if it is the
+            // same device as before the bus reset
+            bool survived = configRom.isPresentOnBus();
+            fb_octlet_t guid;
+            fb_byte_t generation;
+            if (survived
+                && (!ConfigRom::readGuidAndGeneration(service, configRom.getNodeId(), guid, generation)
+                    || generation != configRom.getGeneration())) {
+                debugOutput(DEBUG_LEVEL_NORMAL,
+                            "config rom of device GUID %s changed\n",
+                            configRom.getGuidString().c_str());
+                survived = false;
+            }
+            (*it)->setStreamsSurvivedBusReset(survived);
         } else {
             debugOutput(DEBUG_LEVEL_NORMAL,
                         "skipping device GUID %s since not on service %p\n",
                         (*it)->getConfigRom().getGuidString().c_str(), &service);
         }
     }
+
+    // the iso resources have to be restored within one second after the
+    // bus reset. only the streams of the devices that lost a channel have
+    // to be restarted.
+    std::set<fb_nodeid_t> failed_nodes;
+    if(!service.restoreIsoChannels(node_map, failed_nodes)) {
+        debugWarning("Could not restore all iso channels\n");
+    }
+    for ( std::map<FFADODevice *, fb_nodeid_t>::iterator it = old_node_ids.begin();
+          it != old_node_ids.end();
+          ++it )
+    {
+        FFADODevice *device = it->first;
+        if (device->streamsSurvivedBusReset()
+            && !Ieee1394Service::isoChannelsSurvived(node_map, failed_nodes, it->second)) {
+            debugOutput(DEBUG_LEVEL_NORMAL,
+                        "device GUID %s lost its iso channels, streams will be restarted\n",
+                        device->getConfigRom().getGuidString().c_str());
+            device->setStreamsSurvivedBusReset(false);
+        }
+    }
     m_DeviceListLock->Unlock();
 
+    // look again for the devices that were not found, their streams
+    // don't survive anyway. don't keep others from using the list
+    // while waiting for them.
+    if (!not_found.empty()) {
+        sleep(1);
+        m_DeviceListLock->Lock();
+        // the list can have changed in the mean time
+        for ( FFADODeviceVectorIterator it = m_avDevices.begin();
+              it != m_avDevices.end();
+              ++it )
+        {
+            if (std::find(not_found.begin(), not_found.end(),
+                          (*it)->getConfigRom().getGuid()) == not_found.end()) {
+                continue;
+            }
+            if (!(*it)->handleBusReset()) {
+                debugOutput(DEBUG_LEVEL_NORMAL,
+                            "device GUID %s is not on the bus anymore\n",
+                            (*it)->getConfigRom().getGuidString().c_str());
+            }
+        }
+        m_DeviceListLock->Unlock();
+    }
+
     // now that the devices have been updates, we can request to update the iso streams
     if(!service.getIsoHandlerManager().handleBusReset()) {
         debugError("IsoHandlerManager failed to handle busreset\n");
@@ -368,6 +453,8 @@ DeviceManager::discover( bool useCache, bool rediscover )
     // FIXME: it could be that a 1394service has disappeared (cardbus)
 
     ConfigRomVector configRoms;
+    // GUIDs of the known devices that are still on the bus, unchanged
+    std::vector<fb_octlet_t> unchanged_guids;
     // build a list of configroms on the bus.
     for ( Ieee1394ServiceVectorIterator it = m_1394Services.begin();
         it != m_1394Services.end();
@@ -385,6 +472,29 @@ DeviceManager::discover( bool useCache, bool rediscover )
                 continue;
             }
 
+            // when rediscovering, only read the complete config rom of
+            // nodes that are new or whose config rom has changed.
+            fb_octlet_t guid;
+            fb_byte_t generation;
+            if ( rediscover
+                 && ConfigRom::readGuidAndGeneration( *portService, nodeId, guid, generation ) ) {
+                bool unchanged = false;
+                for ( FFADODeviceVectorIterator it_dev = m_avDevices.begin();
+                    it_dev != m_avDevices.end();
+                    ++it_dev )
+                {
+                    if ((*it_dev)->getConfigRom().getGuid() == guid) {
+                        unchanged = ((*it_dev)->getConfigRom().getGeneration() == generation);
+                        break;
+                    }
+                }
+                if ( unchanged ) {
+                    debugOutput( DEBUG_LEVEL_VERBOSE, "Node %d is a known device, config rom unchanged\n", nodeId );
+                    unchanged_guids.push_back(guid);
+                    continue;
+                }
+            }
+
             ConfigRom * configRom = new ConfigRom( *portService, nodeId );
             if ( !configRom->initialize() ) {
                 // \todo If a PHY on the bus is in power safe mode then
@@ -413,13 +523,11 @@ DeviceManager::discover( bool useCache, bool rediscover )
             it != m_avDevices.end();
             ++it )
         {
-            bool seen_device = false;
-            for ( ConfigRomVectorIterator it2 = configRoms.begin();
-                it2 != configRoms.end();
-                ++it2 )
-            {
-                seen_device |= ((*it)->getConfigRom().getGuid() == (*it2)->getGuid());
-            }
+            // devices with a changed config rom are removed and
+            // discovered again as a new device
+            bool seen_device = (std::find(unchanged_guids.begin(), unchanged_guids.end(),
+                                          (*it)->getConfigRom().getGuid())
+                                != unchanged_guids.end());
 
             if(seen_device) {
                 debugOutput( DEBUG_LEVEL_VERBOSE,
@@ -429,7 +537,7 @@ DeviceManager::discover( bool useCache, bool rediscover )
                 discovered_devices_on_bus.push_back(*it);
             } else {
                 debugOutput( DEBUG_LEVEL_VERBOSE,
-                            "Device with GUID: %s disappeared from bus, removing...\n",
+                            "Device with GUID: %s disappeared from bus or changed, removing...\n",
                             (*it)->getConfigRom().getGuidString().c_str() );
 
                 // the device has disappeared, remove it from the control tree
@@ -458,15 +566,6 @@ DeviceManager::discover( bool useCache, bool rediscover )
         m_avDevices.clear();
     }
 
-    // delete the config rom list entries
-    // FIXME: we should reuse it
-    for ( ConfigRomVectorIterator it = configRoms.begin();
-        it != configRoms.end();
-        ++it )
-    {
-        delete *it;
-    }
-
     assert(m_deviceStringParser);
     // show the spec strings we're going to use
     if(getDebugLevel() >= DEBUG_LEVEL_VERBOSE) {
@@ -481,7 +580,13 @@ DeviceManager::discover( bool useCache, bool rediscover )
             ++it_dev )
         {
             FFADODevice* avDevice = *it_dev;
-            if(avDevice->needsRediscovery()) {
+            if(rediscover && avDevice->streamsSurvivedBusReset()
+               && avDevice->getStreamingState() != FFADODevice::eSS_Idle) {
+                // don't pull the configuration from under the running streams
+                debugOutput( DEBUG_LEVEL_NORMAL,
+                             "Device with GUID %s is streaming, not rediscovering...\n",
+                             avDevice->getConfigRom().getGuidString().c_str());
+            } else if(avDevice->needsRediscovery()) {
                 debugOutput( DEBUG_LEVEL_NORMAL,
                              "Device with GUID %s requires rediscovery (state changed)...\n",
                              avDevice->getConfigRom().getGuidString().c_str());
@@ -544,119 +649,99 @@ DeviceManager::discover( bool useCache, bool rediscover )
         m_avDevices = to_keep;
 
         // pick up new devices
-        for ( Ieee1394ServiceVectorIterator it = m_1394Services.begin();
-            it != m_1394Services.end();
+        for ( ConfigRomVectorIterator it = configRoms.begin();
+            it != configRoms.end();
             ++it )
         {
-            Ieee1394Service *portService = *it;
-            for ( fb_nodeid_t nodeId = 0;
-                nodeId < portService->getNodeCount();
-                ++nodeId )
+            ConfigRom *configRom = *it;
+            fb_nodeid_t nodeId = configRom->getNodeId();
+
+            bool already_in_vector = false;
+            for ( FFADODeviceVectorIterator it_dev = m_avDevices.begin();
+                it_dev != m_avDevices.end();
+                ++it_dev )
             {
-                debugOutput( DEBUG_LEVEL_VERBOSE, "Probing node %d...\n", nodeId );
-    
-                if (nodeId == portService->getLocalNodeId()) {
-                    debugOutput( DEBUG_LEVEL_VERBOSE, "Skipping local node (%d)...\n", nodeId );
-                    continue;
+                if ((*it_dev)->getConfigRom().getGuid() == configRom->getGuid()) {
+                    already_in_vector = true;
+                    break;
                 }
-    
-                ConfigRom *configRom = new ConfigRom( *portService, nodeId );
-                if ( !configRom->initialize() ) {
-                    // \todo If a PHY on the bus is in power safe mode then
-                    // the config rom is missing. So this might be just
-                    // such this case and we can safely skip it. But it might
-                    // be there is a real software problem on our side.
-                    // This should be handlede more carefuly.
-                    debugOutput( DEBUG_LEVEL_NORMAL,
-                                "Could not read config rom from device (node id %d). "
-                                "Skip device discovering for this node\n",
-                                nodeId );
-                    continue;
+            }
+            if(already_in_vector) {
+                if(!rediscover) {
+                    debugWarning("Device with GUID %s already discovered on other port, skipping device...\n",
+                                configRom->getGuidString().c_str());
                 }
+                delete configRom;
+                continue;
+            }
 
-                bool already_in_vector = false;
-                for ( FFADODeviceVectorIterator it_dev = m_avDevices.begin();
-                    it_dev != m_avDevices.end();
-                    ++it_dev )
-                {
-                    if ((*it_dev)->getConfigRom().getGuid() == configRom->getGuid()) {
-                        already_in_vector = true;
-                        break;
-                    }
-                }
-                if(already_in_vector) {
-                    if(!rediscover) {
-                        debugWarning("Device with GUID %s already discovered on other port, skipping device...\n",
-                                    configRom->getGuidString().c_str());
-                    }
-                    continue;
-                }
+            if(getDebugLevel() >= DEBUG_LEVEL_VERBOSE) {
+                configRom->printConfigRomDebug();
+            }
 
-                if(getDebugLevel() >= DEBUG_LEVEL_VERBOSE) {
-                    configRom->printConfigRomDebug();
-                }
+            // if spec strings are given, only add those devices
+            // that match the spec string(s).
+            // if no (valid) spec strings are present, grab all
+            // supported devices.
+            if(m_deviceStringParser->countDeviceStrings() &&
+              !m_deviceStringParser->match(*configRom)) {
+                debugOutput(DEBUG_LEVEL_VERBOSE, "Device doesn't match any of the spec strings. skipping...\n");
+                delete configRom;
+                continue;
+            }
+
+            // find a driver
+            FFADODevice* avDevice = getDriverForDevice( configRom,
+                                                        nodeId );
 
-                // if spec strings are given, only add those devices
-                // that match the spec string(s).
-                // if no (valid) spec strings are present, grab all
-                // supported devices.
-                if(m_deviceStringParser->countDeviceStrings() &&
-                  !m_deviceStringParser->match(*configRom)) {
-                    debugOutput(DEBUG_LEVEL_VERBOSE, "Device doesn't match any of the spec strings. skipping...\n");
+            if ( avDevice ) {
+                debugOutput( DEBUG_LEVEL_NORMAL,
+                            "driver found for device %d\n",
+                            nodeId );
+
+                avDevice->setVerboseLevel( getDebugLevel() );
+                bool isFromCache = false;
+                if ( useCache && avDevice->loadFromCache() ) {
+                    debugOutput( DEBUG_LEVEL_VERBOSE, "could load from cache\n" );
+                    isFromCache = true;
+                    // restore the debug level for everything that was loaded
+                    avDevice->setVerboseLevel( getDebugLevel() );
+                } else if ( avDevice->discover() ) {
+                    debugOutput( DEBUG_LEVEL_VERBOSE, "discovery successful\n" );
+                } else {
+                    debugError( "could not discover device\n" );
+                    delete avDevice;
                     continue;
                 }
 
-                // find a driver
-                FFADODevice* avDevice = getDriverForDevice( configRom,
-                                                            nodeId );
-
-                if ( avDevice ) {
-                    debugOutput( DEBUG_LEVEL_NORMAL,
-                                "driver found for device %d\n",
-                                nodeId );
+                if (snoopMode) {
+                    debugOutput( DEBUG_LEVEL_VERBOSE,
+                                "Enabling snoop mode on node %d...\n", nodeId );
 
-                    avDevice->setVerboseLevel( getDebugLevel() );
-                    bool isFromCache = false;
-                    if ( useCache && avDevice->loadFromCache() ) {
-                        debugOutput( DEBUG_LEVEL_VERBOSE, "could load from cache\n" );
-                        isFromCache = true;
-                        // restore the debug level for everything that was loaded
-                        avDevice->setVerboseLevel( getDebugLevel() );
-                    } else if ( avDevice->discover() ) {
-                        debugOutput( DEBUG_LEVEL_VERBOSE, "discovery successful\n" );
-                    } else {
-                        debugError( "could not discover device\n" );
+                    if(!avDevice->setOption("snoopMode", snoopMode)) {
+                        debugWarning("Could not set snoop mode for device on node %d\n", nodeId);
                         delete avDevice;
                         continue;
                     }
+                }
 
-                    if (snoopMode) {
-                        debugOutput( DEBUG_LEVEL_VERBOSE,
-                                    "Enabling snoop mode on node %d...\n", nodeId );
-
-                        if(!avDevice->setOption("snoopMode", snoopMode)) {
-                            debugWarning("Could not set snoop mode for device on node %d\n", nodeId);
-                            delete avDevice;
-                            continue;
-                        }
-                    }
-
-                    if ( !isFromCache && !avDevice->saveCache() ) {
-                        debugOutput( DEBUG_LEVEL_VERBOSE, "No cached version of AVC model created\n" );
-                    }
-                    m_avDevices.push_back( avDevice );
-
-                    if (!addElement(avDevice)) {
-                        debugWarning("failed to add Device to Control::Container\n");
-                    }
+                if ( !isFromCache && !avDevice->saveCache() ) {
+                    debugOutput( DEBUG_LEVEL_VERBOSE, "No cached version of AVC model created\n" );
+                }
+                m_avDevices.push_back( avDevice );
 
-                    debugOutput( DEBUG_LEVEL_NORMAL, "discovery of node %d on port %d done...\n", nodeId, portService->getPort() );
-                } else {
-                    // we didn't get a device, hence we have to delete the configrom ptr manually
-                    delete configRom;
+                if (!addElement(avDevice)) {
+                    debugWarning("failed to add Device to Control::Container\n");
                 }
+
+                debugOutput( DEBUG_LEVEL_NORMAL, "discovery of node %d on port %d done...\n", nodeId, avDevice->get1394Service().getPort() );
+            } else {
+                // we didn't get a device, hence we have to delete the configrom ptr manually
+                delete configRom;
             }
         }
+        // the config roms are owned by the devices now, or deleted
+        configRoms.clear();
 
         debugOutput( DEBUG_LEVEL_NORMAL, "Discovery finished...\n" );
         // FIXME: do better sorting
@@ -703,6 +788,14 @@ DeviceManager::discover( bool useCache, bool rediscover )
         showDeviceInfo();
 
     } else { // slave mode
+        for ( ConfigRomVectorIterator it = configRoms.begin();
+            it != configRoms.end();
+            ++it )
+        {
+            delete *it;
+        }
+        configRoms.clear();
+
         // notify any clients
         signalNotifiers(m_preUpdateNotifiers);
         Ieee1394Service *portService = m_1394Services.at(0);
@@ -1009,8 +1102,7 @@ DeviceManager::setPeriodSize(unsigned int period) {
     if (!m_processorManager->streamingParamsOk(period, -1, -1)) {
         return false;
     }
-    m_processorManager->setPeriodSize(period);
-    return true;
+    return m_processorManager->setPeriodSize(period);
 }
 
 bool
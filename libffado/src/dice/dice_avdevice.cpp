@@ -78,6 +78,8 @@ Device::Device( DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ))
     , m_nb_rx (0xFFFFFFFFLU)
     , m_rx_size (0xFFFFFFFFLU)
     , m_notifier (NULL)
+    , m_flash_target (*this)
+    , m_flash (m_flash_target, DICE_FL_OP_TIMEOUT_MSECS)
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Created Dice::Device (NodeID %d)\n",
                  getConfigRom().getNodeId() );
@@ -1394,7 +1396,7 @@ Device::startstopStreamByIndex(int i, const bool start) {
                  * Just use the already registered ISO channel.
                  */
                 // ask the IRM to use this channel
-                if (get1394Service().allocateFixedIsoChannelGeneric(reg_isoch,p->getMaxPacketSize()) < 0) {
+                if (get1394Service().allocateFixedIsoChannelGeneric(reg_isoch, p->getMaxPacketSize(), getNodeId()) < 0) {
                     debugError("Cannot allocate iso channel (0x%08" PRIX32 ") for ATX %d\n", reg_isoch, n); 
                 }
 #endif
@@ -1461,7 +1463,7 @@ Device::stopStreamByIndex(int i) {
 int Device::allocateIsoChannel(unsigned int packet_size) {
     unsigned int bandwidth=8+packet_size;
 
-    int ch=get1394Service().allocateIsoChannelGeneric(bandwidth);
+    int ch=get1394Service().allocateIsoChannelGeneric(bandwidth, getNodeId());
 
     debugOutput(DEBUG_LEVEL_VERBOSE, "allocated channel %d, bandwidth %d\n",
         ch, bandwidth);
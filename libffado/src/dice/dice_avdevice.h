@@ -38,6 +38,8 @@
 
 #include "libieee1394/ieee1394service.h"
 
+#include "libutil/FlashProgrammer.h"
+
 #include "libcontrol/Element.h"
 #include "libcontrol/MatrixMixer.h"
 #include "libcontrol/CrossbarRouter.h"
@@ -258,6 +260,29 @@ public:
     // notification
     Notifier *m_notifier;
 
+private:
+    /**
+     * the firmware loader interface: an operation is busy as long as
+     * the top bit of the opcode register is set
+     */
+    class FlashTarget : public Util::FlashProgrammer::Target
+    {
+    public:
+        FlashTarget(Device &parent) : m_parent( parent ) {};
+        virtual ~FlashTarget() {};
+
+        virtual bool isBusy(bool &busy);
+        virtual unsigned int getBlockSizeQuads();
+
+        virtual bool startRead(Util::FlashProgrammer::BlockVector &blocks);
+        virtual bool readNeedsBusyWait() {return true;};
+        virtual bool completeRead(Util::FlashProgrammer::BlockVector &blocks);
+    private:
+        Device &m_parent;
+    };
+    FlashTarget m_flash_target;
+    Util::FlashProgrammer m_flash;
+
 
 
 };
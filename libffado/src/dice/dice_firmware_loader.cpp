@@ -67,10 +67,10 @@ Device::showDiceInfoFL() {
 
 	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_GET_RUNNING_IMAGE_VINFO);
 
-	do {
-		usleep(10000);
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
+	if (!m_flash.waitWhileBusy(DICE_FL_OP_TIMEOUT_MSECS)) {
+		printMessage("in showDiceInfoFL(): timeout waiting for the device\nSTOP.\n");
+		return false;
+	}
 
 	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -108,28 +108,14 @@ Device::dumpFirmwareFL(const char* filename) {
 			printMessage("Please wait, dumping will take about a minute\n");
 			printMessage("Dump in progress ...\n");
 			while (start<end) {
-				memory.uiLen = min<uint32_t>(end-start, sizeof(memory.ReadBuffer));
-				memory.uiStartAddress = start;
-
-				writeRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &memory, sizeof(memory));
-
-				writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_READ_MEMORY);
-
-				do {
-					usleep(4000);
-					readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-				} while (tmp_quadlet & (1UL<<31));
-
-				readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
+				uint32_t len = min<uint32_t>(end-start, sizeof(memory.ReadBuffer));
 
-				if (tmp_quadlet == DICE_FL_RETURN_NO_ERROR) {
-					readRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &memory, sizeof(memory));
-					file.write(memory.ReadBuffer, memory.uiLen);
-				} else {
-					printMessage("in dumpFirmwareFL, unknown error =  0x%X \nSTOP.\n", tmp_quadlet);
+				if (!m_flash.read(start, (len+3)/4, (uint32_t*) memory.ReadBuffer)) {
+					printMessage("in dumpFirmwareFL, cannot read flash at 0x%X\nSTOP.\n", start);
 					return false;
 				}
-				start += memory.uiLen;
+				file.write(memory.ReadBuffer, len);
+				start += len;
 			}
 		}
 		file.close();
@@ -149,10 +135,11 @@ Device::showFlashInfoFL(bool v) {
 
 	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_GET_FLASH_INFO);
 
-	do {
-		usleep(10000);
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
+	if (!m_flash.waitWhileBusy(DICE_FL_OP_TIMEOUT_MSECS)) {
+		printMessage("in showFlashInfoFL(): timeout waiting for the device\nSTOP.\n");
+		delete pflash_info;
+		return NULL;
+	}
 
 	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -183,10 +170,10 @@ Device::showImgInfoFL() {
 		writeReg(DICE_FL_OFFSET + DICE_FL_PARAMETER, imageID);
 
 		writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_GET_IMAGE_DESC);
-		do {
-			usleep(100);
-			readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-		} while (tmp_quadlet & (1UL<<31));
+		if (!m_flash.waitWhileBusy(DICE_FL_OP_TIMEOUT_MSECS)) {
+			printMessage("in showImgInfoFL(): timeout waiting for the device\nSTOP.\n");
+			return false;
+		}
 
 		readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -225,10 +212,10 @@ Device::showAppInfoFL() {
 
 	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_GET_APP_INFO);
 
-	do {
-		usleep(10000);
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
+	if (!m_flash.waitWhileBusy(DICE_FL_OP_TIMEOUT_MSECS)) {
+		printMessage("in showAppInfoFL(): timeout waiting for the device\nSTOP.\n");
+		return false;
+	}
 
 	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -283,10 +270,10 @@ Device::testDiceFL(int action) {
 
 			writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_TEST_ACTION);
 
-			do {
-				usleep(10000);
-				readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-			} while (tmp_quadlet & (1UL<<31));
+			if (!m_flash.waitWhileBusy(DICE_FL_OP_TIMEOUT_MSECS)) {
+				printMessage("in testDiceFL(): timeout waiting for the device\nSTOP.\n");
+				return false;
+			}
 
 			readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -312,10 +299,10 @@ Device::testDiceFL(int action) {
 
 			writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_TEST_ACTION);
 
-			do {
-				usleep(10000);
-				readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-			} while (tmp_quadlet & (1UL<<31));
+			if (!m_flash.waitWhileBusy(DICE_FL_OP_TIMEOUT_MSECS)) {
+				printMessage("in testDiceFL(): timeout waiting for the device\nSTOP.\n");
+				return false;
+			}
 
 			readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -351,10 +338,10 @@ Device::deleteImgFL(const char* image, bool v) {
 
 	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_DELETE_IMAGE);
 
-	do {
-		usleep(300000);
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
+	if (!m_flash.waitWhileBusy(DICE_FL_FLASH_TIMEOUT_MSECS)) {
+		printMessage("in deleteImgFL(): timeout waiting for the device\nSTOP.\n");
+		return false;
+	}
 
 	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -427,10 +414,10 @@ Device::flashDiceFL(const char* filename, const char* image) {
 
 				writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_UPLOAD);
 
-				do {
-					usleep(100);
-					readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-				} while (tmp_quadlet & (1UL<<31));
+				if (!m_flash.waitWhileBusy(DICE_FL_OP_TIMEOUT_MSECS)) {
+					printMessage("in flashDiceFL(): timeout waiting for the device\nSTOP.\n");
+					return false;
+				}
 
 				readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -461,10 +448,10 @@ Device::flashDiceFL(const char* filename, const char* image) {
 
 	writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_UPLOAD_STAT);
 
-	do {
-		usleep(1000000); //take care on polling, depends on dice-image size (to low values lead to a read error)
-		readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-	} while (tmp_quadlet & (1UL<<31));
+	if (!m_flash.waitWhileBusy(DICE_FL_FLASH_TIMEOUT_MSECS, DICE_FL_UPLOAD_STAT_POLL_USECS, DICE_FL_UPLOAD_STAT_POLL_USECS)) {
+		printMessage("in flashDiceFL(): timeout waiting for the device\nSTOP.\n");
+		return false;
+	}
 
 	readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -515,10 +502,10 @@ Device::flashDiceFL(const char* filename, const char* image) {
 
 			writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_CREATE_IMAGE);
 
-			do {
-				usleep(300000);
-				readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &tmp_quadlet);
-			} while (tmp_quadlet & (1UL<<31));
+			if (!m_flash.waitWhileBusy(DICE_FL_FLASH_TIMEOUT_MSECS)) {
+				printMessage("in flashDiceFL(): timeout waiting for the device\nSTOP.\n");
+				return false;
+			}
 
 			readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &tmp_quadlet);
 
@@ -552,4 +539,55 @@ Device::flashDiceFL(const char* filename, const char* image) {
 	}
 }
 
+/*****************
+ * FLASH TARGET
+ *****************/
+
+bool
+Device::FlashTarget::isBusy(bool &busy) {
+	fb_quadlet_t opcode;
+	if (!m_parent.readReg(DICE_FL_OFFSET + DICE_FL_OPCODE, &opcode)) {
+		return false;
+	}
+	busy = (opcode & (1UL<<31)) != 0;
+	return true;
+}
+
+unsigned int
+Device::FlashTarget::getBlockSizeQuads() {
+	return sizeof(((DICE_FL_READ_MEMORY*) 0)->ReadBuffer) / 4;
+}
+
+bool
+Device::FlashTarget::startRead(Util::FlashProgrammer::BlockVector &blocks) {
+	DICE_FL_READ_MEMORY memory;
+	Util::FlashProgrammer::sBlock &b = blocks.at(0);
+
+	memory.uiLen = b.nb_quads * 4;
+	memory.uiStartAddress = b.address;
+
+	if (!m_parent.writeRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &memory, sizeof(memory))) {
+		return false;
+	}
+	return m_parent.writeReg(DICE_FL_OFFSET + DICE_FL_OPCODE, (1UL<<31) | DICE_FL_OP_READ_MEMORY);
+}
+
+bool
+Device::FlashTarget::completeRead(Util::FlashProgrammer::BlockVector &blocks) {
+	DICE_FL_READ_MEMORY memory;
+	Util::FlashProgrammer::sBlock &b = blocks.at(0);
+	fb_quadlet_t status;
+
+	m_parent.readReg(DICE_FL_OFFSET + DICE_FL_RETURN_STATUS, &status);
+	if (status != DICE_FL_RETURN_NO_ERROR) {
+		printMessage("in completeRead(): unknown error =  0x%X\n", status);
+		return false;
+	}
+	if (!m_parent.readRegBlock(DICE_FL_OFFSET + DICE_FL_PARAMETER, (fb_quadlet_t*) &memory, sizeof(memory))) {
+		return false;
+	}
+	memcpy(b.data, memory.ReadBuffer, b.nb_quads * 4);
+	return true;
+}
+
 } //namespace Dice
@@ -47,6 +47,11 @@
 
 #define DICE_FL_BUFFER			0x34 //offset for Upload buffer
 
+/* maximum time the loader is busy with an operation (in ms) */
+#define DICE_FL_OP_TIMEOUT_MSECS		5000
+#define DICE_FL_FLASH_TIMEOUT_MSECS		120000	//erasing and programming the flash
+#define DICE_FL_UPLOAD_STAT_POLL_USECS	1000000	//the loader fails on faster polling
+
 /* Opcode IDs for implemented functions (firmware dependent) */
 #define	DICE_FL_OP_GET_IMAGE_DESC			0x0		// parameters: imageId  return: imageDesc
 #define	DICE_FL_OP_DELETE_IMAGE				0x1		// parameters: name  return: none
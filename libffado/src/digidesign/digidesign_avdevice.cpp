@@ -303,7 +303,7 @@ Device::prepare() {
     // with the required amount of bandwidth.
 
     if (iso_tx_channel < 0) {
-        iso_tx_channel = get1394Service().allocateIsoChannelGeneric(bandwidth);
+        iso_tx_channel = get1394Service().allocateIsoChannelGeneric(bandwidth, getNodeId());
     }
     if (iso_tx_channel < 0) {
         debugFatal("Could not allocate iso tx channel\n");
@@ -311,7 +311,7 @@ Device::prepare() {
     }
 
     if (iso_rx_channel < 0) {
-        iso_rx_channel = get1394Service().allocateIsoChannelGeneric(bandwidth);
+        iso_rx_channel = get1394Service().allocateIsoChannelGeneric(bandwidth, getNodeId());
     }
     if (iso_rx_channel < 0) {
         debugFatal("Could not allocate iso rx channel\n");
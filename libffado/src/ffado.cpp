@@ -26,6 +26,7 @@
  * Implementation of the FFADO external C API
  */
 
+#include "config.h"
 #include "version.h"
 
 #include "../libffado/ffado.h"
@@ -288,6 +289,96 @@ int ffado_streaming_transfer_buffers(ffado_device_t *dev) {
     return dev->m_deviceManager->getStreamProcessorManager().transfer();
 }
 
+int ffado_streaming_get_latency(ffado_device_t *dev, enum ffado_direction direction,
+    int i, ffado_streaming_latency_t *latency) {
+    Streaming::Port::E_Direction d = (direction == FFADO_PLAYBACK ?
+                                      Streaming::Port::E_Playback : Streaming::Port::E_Capture);
+    Streaming::Port *p = dev->m_deviceManager->getStreamProcessorManager().getPortByIndex(i, d);
+    if(!p) {
+        debugWarning("Could not get %s port at index %d\n",
+            (d==Streaming::Port::E_Playback?"Playback":"Capture"),i);
+        return -1;
+    }
+    Streaming::StreamProcessor *sp = dynamic_cast<Streaming::StreamProcessor *>(&p->getManager());
+    if(!sp) {
+        debugError("Port %d doesn't belong to a stream processor\n", i);
+        return -1;
+    }
+    memset(latency, 0, sizeof(*latency));
+    latency->nominal = sp->getNominalLatency();
+    latency->measured = sp->getMeasuredLatency();
+    latency->measured_max = sp->getMaxMeasuredLatency();
+    if(sp->isLatencyCalibrated()) {
+        int calibrated = (int)latency->nominal + sp->getLatencyCorrection();
+        latency->calibrated = (calibrated > 0 ? calibrated : 0);
+    }
+    return 0;
+}
+
+int ffado_streaming_calibrate_latency(ffado_device_t *dev, int capture_number,
+    int playback_number) {
+    Streaming::StreamProcessorManager &spm = dev->m_deviceManager->getStreamProcessorManager();
+    Streaming::Port *c = spm.getPortByIndex(capture_number, Streaming::Port::E_Capture);
+    Streaming::Port *p = spm.getPortByIndex(playback_number, Streaming::Port::E_Playback);
+    if(!c || !p) {
+        debugWarning("Could not get capture port %d or playback port %d\n",
+            capture_number, playback_number);
+        return -1;
+    }
+    if(!spm.calibrateLatency(c, p, STREAMPROCESSORMANAGER_CALIBRATION_IMPULSES)) {
+        debugError("Latency calibration failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+int ffado_streaming_get_xrun_report(ffado_device_t *dev,
+    ffado_streaming_xrun_report_t *report) {
+    Streaming::StreamProcessorManager &spm = dev->m_deviceManager->getStreamProcessorManager();
+    const Streaming::StreamProcessorManager::sXrunReport &r = spm.getLastXrunReport();
+
+    memset(report, 0, sizeof(*report));
+    report->count = r.count;
+    report->period = r.period;
+    switch(r.phase) {
+        case Streaming::StreamProcessorManager::eXP_KernelLate:
+            report->phase = ffado_xrun_kernel_late; break;
+        case Streaming::StreamProcessorManager::eXP_ClientLate:
+            report->phase = ffado_xrun_client_late; break;
+        case Streaming::StreamProcessorManager::eXP_DeviceLate:
+            report->phase = ffado_xrun_device_late; break;
+        default:
+            report->phase = ffado_xrun_none; break;
+    }
+    report->direction = FFADO_CAPTURE;
+    report->number = -1;
+    report->cycle = r.cycle;
+    report->dropped_cycles = r.dropped_cycles;
+    report->max_lateness_usecs = r.max_lateness_usecs;
+    report->max_iterate_nsecs = r.max_iterate_nsecs;
+    report->max_packet_nsecs = r.max_packet_data_nsecs;
+    report->delayed_usecs = r.delayed_usecs;
+    if(r.culprit == NULL) {
+        strncpy(report->cause, "unknown", sizeof(report->cause) - 1);
+        return 0;
+    }
+    strncpy(report->cause, r.culprit->eXCToString(r.cause), sizeof(report->cause) - 1);
+
+    // the culprit is named by its first stream
+    Streaming::Port::E_Direction d = (r.culprit->getType() == Streaming::StreamProcessor::ePT_Transmit ?
+                                      Streaming::Port::E_Playback : Streaming::Port::E_Capture);
+    report->direction = (d == Streaming::Port::E_Playback ? FFADO_PLAYBACK : FFADO_CAPTURE);
+    int nb_ports = spm.getPortCount(d);
+    for(int i = 0; i < nb_ports; i++) {
+        Streaming::Port *p = spm.getPortByIndex(i, d);
+        if(p && &p->getManager() == r.culprit) {
+            report->number = i;
+            break;
+        }
+    }
+    return 0;
+}
+
 int ffado_streaming_get_nb_capture_streams(ffado_device_t *dev) {
     return dev->m_deviceManager->getStreamProcessorManager().getPortCount(Streaming::Port::E_Capture);
 }
@@ -377,6 +468,27 @@ int ffado_streaming_set_audio_datatype(ffado_device_t *dev,
                 return -1;
             }
             break;
+        case ffado_audio_datatype_int32:
+            if(!dev->m_deviceManager->getStreamProcessorManager().setAudioDataType(
+               Streaming::StreamProcessorManager::eADT_Int32)) {
+                debugError("Could not set datatype\n");
+                return -1;
+            }
+            break;
+        case ffado_audio_datatype_int16:
+            if(!dev->m_deviceManager->getStreamProcessorManager().setAudioDataType(
+               Streaming::StreamProcessorManager::eADT_Int16)) {
+                debugError("Could not set datatype\n");
+                return -1;
+            }
+            break;
+        case ffado_audio_datatype_float64:
+            if(!dev->m_deviceManager->getStreamProcessorManager().setAudioDataType(
+               Streaming::StreamProcessorManager::eADT_Float64)) {
+                debugError("Could not set datatype\n");
+                return -1;
+            }
+            break;
         default:
             debugError("Invalid audio datatype\n");
             return -1;
@@ -390,6 +502,12 @@ ffado_streaming_audio_datatype ffado_streaming_get_audio_datatype(ffado_device_t
             return ffado_audio_datatype_int24;
         case Streaming::StreamProcessorManager::eADT_Float:
             return ffado_audio_datatype_float;
+        case Streaming::StreamProcessorManager::eADT_Int32:
+            return ffado_audio_datatype_int32;
+        case Streaming::StreamProcessorManager::eADT_Int16:
+            return ffado_audio_datatype_int16;
+        case Streaming::StreamProcessorManager::eADT_Float64:
+            return ffado_audio_datatype_float64;
         default:
             debugError("Invalid audio datatype\n");
             return ffado_audio_datatype_error;
@@ -426,6 +544,7 @@ int ffado_streaming_set_capture_stream_buffer(ffado_device_t *dev, int i, char *
     // it should already have failed before, if not correct
     assert(p);
     p->setBufferAddress((void *)buff);
+    p->setBufferStride(1);
     return 0;
 }
 
@@ -435,5 +554,95 @@ int ffado_streaming_set_playback_stream_buffer(ffado_device_t *dev, int i, char
     // it should already have failed before, if not correct
     assert(p);
     p->setBufferAddress((void *)buff);
+    p->setBufferStride(1);
     return 0;
 }
+
+static int
+ffado_streaming_set_stream_buffer_interleaved(ffado_device_t *dev, int i,
+    char *buff, unsigned int stride, enum Streaming::Port::E_Direction direction) {
+    Streaming::Port *p = dev->m_deviceManager->getStreamProcessorManager().getPortByIndex(i, direction);
+    if(!p) {
+        debugWarning("Could not get %s port at index %d\n",
+            (direction==Streaming::Port::E_Playback?"Playback":"Capture"),i);
+        return -1;
+    }
+    // only the audio ports know about sample strides
+    if(p->getPortType() != Streaming::Port::E_Audio || stride == 0) {
+        debugError("Port %d can't use an interleaved buffer\n", i);
+        return -1;
+    }
+    p->setBufferAddress((void *)buff);
+    p->setBufferStride(stride);
+    return 0;
+}
+
+int ffado_streaming_set_capture_stream_buffer_interleaved(ffado_device_t *dev, int i,
+    char *buff, unsigned int stride) {
+    return ffado_streaming_set_stream_buffer_interleaved(dev, i, buff, stride, Streaming::Port::E_Capture);
+}
+
+int ffado_streaming_set_playback_stream_buffer_interleaved(ffado_device_t *dev, int i,
+    char *buff, unsigned int stride) {
+    return ffado_streaming_set_stream_buffer_interleaved(dev, i, buff, stride, Streaming::Port::E_Playback);
+}
+
+static Streaming::Port *
+ffado_streaming_get_midi_port(ffado_device_t *dev, int i,
+    enum Streaming::Port::E_Direction direction) {
+    Streaming::Port *p = dev->m_deviceManager->getStreamProcessorManager().getPortByIndex(i, direction);
+    if(!p) {
+        debugWarning("Could not get %s port at index %d\n",
+            (direction==Streaming::Port::E_Playback?"Playback":"Capture"),i);
+        return NULL;
+    }
+    if(p->getPortType() != Streaming::Port::E_Midi) {
+        debugError("Port %d is not a MIDI port\n", i);
+        return NULL;
+    }
+    if(p->getBufferAddress() == NULL) {
+        debugError("Port %d has no buffer\n", i);
+        return NULL;
+    }
+    return p;
+}
+
+int ffado_streaming_write_midi_events(ffado_device_t *dev, int i,
+    const ffado_midi_event_t *events, unsigned int nevents) {
+    Streaming::Port *p = ffado_streaming_get_midi_port(dev, i, Streaming::Port::E_Playback);
+    if(!p) return -1;
+
+    unsigned int period = dev->m_deviceManager->getStreamProcessorManager().getPeriodSize();
+    uint32_t *buffer = (uint32_t *)p->getBufferAddress();
+    memset(buffer, 0, period * sizeof(*buffer));
+
+    // the first frame that is still free
+    unsigned int frame = 0;
+    unsigned int n;
+    for(n = 0; n < nevents; n++) {
+        if(events[n].offset > frame) {
+            frame = events[n].offset;
+        }
+        if(frame >= period) break;
+        buffer[frame++] = 0x01000000 | events[n].data;
+    }
+    return n;
+}
+
+int ffado_streaming_read_midi_events(ffado_device_t *dev, int i,
+    ffado_midi_event_t *events, unsigned int maxevents) {
+    Streaming::Port *p = ffado_streaming_get_midi_port(dev, i, Streaming::Port::E_Capture);
+    if(!p) return -1;
+
+    unsigned int period = dev->m_deviceManager->getStreamProcessorManager().getPeriodSize();
+    uint32_t *buffer = (uint32_t *)p->getBufferAddress();
+    unsigned int n = 0;
+    for(unsigned int frame = 0; frame < period && n < maxevents; frame++) {
+        if(buffer[frame] & 0xFF000000) {
+            events[n].offset = frame;
+            events[n].data = buffer[frame] & 0xFF;
+            n++;
+        }
+    }
+    return n;
+}
@@ -44,6 +44,7 @@ FFADODevice::FFADODevice( DeviceManager& d, std::auto_ptr<ConfigRom>( configRom
     : Control::Container(&d)
     , m_pConfigRom( configRom )
     , m_pDeviceManager( d )
+    , m_streams_survived_busreset( false )
 {
     addOption(Util::OptionContainer::Option("id",m_pConfigRom->getGuidString()));
 
@@ -184,17 +185,16 @@ FFADODevice::canChangeNickname()
     return false;
 }
 
-void
+bool
 FFADODevice::handleBusReset()
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Handle bus reset...\n");
 
-    // update the config rom node id
-    sleep(1);
-
     Util::MutexLockHelper lock(m_DeviceMutex);
     getConfigRom().setVerboseLevel(getDebugLevel());
-    getConfigRom().updatedNodeId();
+
+    // update the config rom node id
+    return getConfigRom().updatedNodeId();
 }
 
 void
@@ -466,11 +466,30 @@ public:
      * @brief handle a bus reset
      *
      * Called whenever a bus reset is detected. Handle everything
-     * that has to be done to cope with a bus reset.
+     * that has to be done to cope with a bus reset. This doesn't wait
+     * for the device, since the iso resources have to be restored
+     * shortly after the bus reset.
      *
+     * @return false if the device could not be found on the bus (yet)
      */
     // FIXME: not virtual?
-    void handleBusReset();
+    bool handleBusReset();
+
+    /**
+     * @brief indicates whether the streams of this device survived the last bus reset
+     *
+     * The streams survive a bus reset if the device is still on the bus,
+     * its configuration did not change and the iso resources used by the
+     * streams could be restored. This is determined by the DeviceManager
+     * when handling the bus reset, and used by the StreamProcessors to
+     * decide whether they can continue.
+     *
+     * @return true if the streams can continue
+     */
+    bool streamsSurvivedBusReset()
+        {return m_streams_survived_busreset;};
+    void setStreamsSurvivedBusReset(bool b)
+        {m_streams_survived_busreset = b;};
 
     // the Control::Container functions
     virtual std::string getName();
@@ -483,6 +502,7 @@ private:
     std::auto_ptr<ConfigRom>( m_pConfigRom );
     DeviceManager& m_pDeviceManager;
     Control::Container* m_genericContainer;
+    bool m_streams_survived_busreset;
 protected:
     DECLARE_DEBUG_MODULE;
     Util::PosixMutex m_DeviceMutex;
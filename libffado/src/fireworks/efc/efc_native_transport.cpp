@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "efc_native_transport.h"
+#include "efc_cmd.h"
+
+#include "libutil/ByteSwap.h"
+#include "libutil/cmd_serialize.h"
+
+#include <cstring>
+#include <errno.h>
+#include <time.h>
+
+namespace FireWorks {
+
+IMPL_DEBUG_MODULE( EfcNativeTransport, EfcNativeTransport, DEBUG_LEVEL_NORMAL );
+
+EfcNativeTransport::transport_map_t EfcNativeTransport::m_transports;
+pthread_mutex_t EfcNativeTransport::m_transports_lock = PTHREAD_MUTEX_INITIALIZER;
+
+EfcNativeTransport *
+EfcNativeTransport::acquire(Ieee1394Service &service)
+{
+    EfcNativeTransport *t = NULL;
+    pthread_mutex_lock(&m_transports_lock);
+    transport_map_t::iterator it = m_transports.find(&service);
+    if (it != m_transports.end()) {
+        t = it->second;
+    } else {
+        t = new EfcNativeTransport(service);
+        if (!t->init()) {
+            delete t;
+            t = NULL;
+        } else {
+            m_transports[&service] = t;
+        }
+    }
+    if (t) {
+        t->m_refcount++;
+    }
+    pthread_mutex_unlock(&m_transports_lock);
+    return t;
+}
+
+void
+EfcNativeTransport::release(EfcNativeTransport *t)
+{
+    if (t == NULL) return;
+    pthread_mutex_lock(&m_transports_lock);
+    if (--t->m_refcount == 0) {
+        m_transports.erase(&t->m_service);
+        delete t;
+    }
+    pthread_mutex_unlock(&m_transports_lock);
+}
+
+EfcNativeTransport::EfcNativeTransport(Ieee1394Service &service)
+    : m_service( service )
+    , m_handler( NULL )
+    , m_refcount( 0 )
+    , m_seqnum( 0 )
+    , m_nb_transactions( 0 )
+    , m_nb_timeouts( 0 )
+    , m_nb_unmatched( 0 )
+    , m_max_outstanding( 0 )
+{
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+EfcNativeTransport::~EfcNativeTransport()
+{
+    if (m_handler) {
+        m_service.unregisterARMHandler(m_handler);
+        delete m_handler;
+    }
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_lock);
+}
+
+bool
+EfcNativeTransport::init()
+{
+    m_handler = new ResponseHandler(*this);
+    if (!m_service.registerARMHandler(m_handler)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE,
+                    "Could not register the EFC response address on port %d\n",
+                    m_service.getPort());
+        delete m_handler;
+        m_handler = NULL;
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Native EFC transport on port %d\n",
+                m_service.getPort());
+    return true;
+}
+
+bool
+EfcNativeTransport::submit(fb_nodeid_t node, EfcCmd &cmd, struct sTransaction &t)
+{
+    quadlet_t buf[EFC_NATIVE_MAX_BYTES/4];
+    memset(buf, 0, sizeof(buf));
+
+    Util::Cmd::BufferSerialize se( (unsigned char *)buf, sizeof(buf) );
+    if (!cmd.serialize(se)) {
+        debugError("Could not serialize %s\n", cmd.getCmdName());
+        return false;
+    }
+    unsigned int nb_quads = (se.getNrOfProducesBytes() + 3) / 4;
+
+    t.node = node;
+    t.done = false;
+    t.length = 0;
+
+    // replace the sequence number with one of our own. The commands use
+    // even numbers, the response carries the odd number following it.
+    pthread_mutex_lock(&m_lock);
+    t.seqnum = m_seqnum;
+    m_seqnum += 2;
+    if (m_seqnum >= 0xFFFFFFFE) m_seqnum = 0;
+    m_pending[t.seqnum | 1] = &t;
+    if (m_pending.size() > m_max_outstanding) {
+        m_max_outstanding = m_pending.size();
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    cmd.m_header.seqnum = t.seqnum;
+    buf[2] = CondSwapToBus32(t.seqnum);
+
+    debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "Sending %s to node %d, seqnum %u, %u quadlets\n",
+                cmd.getCmdName(), node, t.seqnum, nb_quads);
+
+    if (!m_service.write(0xffc0 | node, EFC_NATIVE_COMMAND_ADDRESS, nb_quads, buf)) {
+        debugError("Could not write %s to node %d\n", cmd.getCmdName(), node);
+        pthread_mutex_lock(&m_lock);
+        m_pending.erase(t.seqnum | 1);
+        pthread_mutex_unlock(&m_lock);
+        return false;
+    }
+    return true;
+}
+
+bool
+EfcNativeTransport::complete(EfcCmd &cmd, struct sTransaction &t)
+{
+    struct timespec timeout;
+    // pthread_cond_timedwait() uses CLOCK_REALTIME to evaluate its
+    // timeout argument.
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_nsec += (FIREWORKS_NATIVE_EFC_TIMEOUT_MSEC % 1000) * 1000000L;
+    timeout.tv_sec += FIREWORKS_NATIVE_EFC_TIMEOUT_MSEC / 1000 + timeout.tv_nsec / 1000000000L;
+    timeout.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&m_lock);
+    int err = 0;
+    while (!t.done && err != ETIMEDOUT) {
+        err = pthread_cond_timedwait(&m_cond, &m_lock, &timeout);
+    }
+    m_pending.erase(t.seqnum | 1);
+    if (t.done) {
+        m_nb_transactions++;
+    } else {
+        m_nb_timeouts++;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    if (!t.done) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Timeout waiting for the response to %s (seqnum %u)\n",
+                    cmd.getCmdName(), t.seqnum);
+        return false;
+    }
+
+    Util::Cmd::BufferDeserialize de( (unsigned char *)t.response, t.length );
+    if (!cmd.deserialize(de)) {
+        debugError("Could not deserialize the response to %s\n", cmd.getCmdName());
+        return false;
+    }
+    return true;
+}
+
+bool
+EfcNativeTransport::doTransaction(fb_nodeid_t node, EfcCmd &cmd)
+{
+    struct sTransaction t;
+    if (!submit(node, cmd, t)) {
+        return false;
+    }
+    return complete(cmd, t);
+}
+
+bool
+EfcNativeTransport::doTransactions(fb_nodeid_t node, std::vector<EfcCmd *> &cmds)
+{
+    unsigned int nb_cmds = cmds.size();
+    std::vector<struct sTransaction> transactions(nb_cmds);
+    bool result = true;
+
+    // keep up to FIREWORKS_NATIVE_EFC_MAX_OUTSTANDING commands in flight
+    unsigned int next_submit = 0;
+    unsigned int next_complete = 0;
+    while (next_complete < next_submit || (result && next_submit < nb_cmds)) {
+        if (result && next_submit < nb_cmds
+            && next_submit - next_complete < FIREWORKS_NATIVE_EFC_MAX_OUTSTANDING) {
+            if (submit(node, *cmds.at(next_submit), transactions.at(next_submit))) {
+                next_submit++;
+            } else {
+                result = false;
+            }
+        } else {
+            // completes the outstanding commands, also when something failed
+            result &= complete(*cmds.at(next_complete), transactions.at(next_complete));
+            next_complete++;
+        }
+    }
+    return result;
+}
+
+void
+EfcNativeTransport::handleResponse(struct raw1394_arm_request *req)
+{
+    if (req->buffer_length < EFC_HEADER_LENGTH_QUADLETS * 4) {
+        debugWarning("EFC response too short (%u bytes)\n", req->buffer_length);
+        return;
+    }
+    quadlet_t *data = (quadlet_t *)req->buffer;
+    uint32_t seqnum = CondSwapFromBus32(data[2]);
+
+    pthread_mutex_lock(&m_lock);
+    transaction_map_t::iterator it = m_pending.find(seqnum | 1);
+    if (it == m_pending.end()
+        || (it->second->node & 0x3f) != (req->source_nodeid & 0x3f)) {
+        m_nb_unmatched++;
+        pthread_mutex_unlock(&m_lock);
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Unexpected EFC response from node %d, seqnum %u\n",
+                    req->source_nodeid & 0x3f, seqnum);
+        return;
+    }
+    struct sTransaction *t = it->second;
+    t->length = req->buffer_length;
+    if (t->length > EFC_NATIVE_MAX_BYTES) {
+        t->length = EFC_NATIVE_MAX_BYTES;
+    }
+    memcpy(t->response, req->buffer, t->length);
+    t->done = true;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_lock);
+}
+
+void
+EfcNativeTransport::setVerboseLevel(int l)
+{
+    setDebugLevel(l);
+}
+
+void
+EfcNativeTransport::show()
+{
+    pthread_mutex_lock(&m_lock);
+    debugOutput(DEBUG_LEVEL_NORMAL, "Native EFC transport on port %d\n", m_service.getPort());
+    debugOutput(DEBUG_LEVEL_NORMAL, " Devices           : %d\n", m_refcount);
+    debugOutput(DEBUG_LEVEL_NORMAL, " Transactions      : %u\n", m_nb_transactions);
+    debugOutput(DEBUG_LEVEL_NORMAL, " Timeouts          : %u\n", m_nb_timeouts);
+    debugOutput(DEBUG_LEVEL_NORMAL, " Unmatched         : %u\n", m_nb_unmatched);
+    debugOutput(DEBUG_LEVEL_NORMAL, " Max outstanding   : %u\n", m_max_outstanding);
+    pthread_mutex_unlock(&m_lock);
+}
+
+// the response handler
+
+EfcNativeTransport::ResponseHandler::ResponseHandler(EfcNativeTransport &t)
+    : Ieee1394Service::ARMHandler(t.m_service, EFC_NATIVE_RESPONSE_ADDRESS,
+                                  EFC_NATIVE_MAX_BYTES,
+                                  RAW1394_ARM_WRITE, // allowed operations
+                                  RAW1394_ARM_WRITE, // operations to be notified of
+                                  0)                 // operations that are replied to by us (instead of kernel)
+    , m_transport(t)
+{
+}
+
+bool
+EfcNativeTransport::ResponseHandler::handleWrite(struct raw1394_arm_request *req)
+{
+    m_transport.handleResponse(req);
+    return true;
+}
+
+} // namespace FireWorks
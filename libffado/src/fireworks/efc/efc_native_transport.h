@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FIREWORKS_EFC_NATIVE_TRANSPORT_H
+#define FIREWORKS_EFC_NATIVE_TRANSPORT_H
+
+#include "debugmodule/debugmodule.h"
+#include "libieee1394/ieee1394service.h"
+
+#include <pthread.h>
+#include <vector>
+#include <map>
+
+// the device listens for EFC commands at this address
+#define EFC_NATIVE_COMMAND_ADDRESS      0xECC000000000ULL
+// and writes the responses to this address of the node that sent them
+#define EFC_NATIVE_RESPONSE_ADDRESS     0xECC080000000ULL
+// the maximum size of a command or response
+#define EFC_NATIVE_MAX_BYTES            0x200
+
+namespace FireWorks {
+
+class EfcCmd;
+
+/**
+ * @brief Transport for EFC commands without AV/C
+ *
+ * The commands are written to the EFC command address of the device,
+ * and the device writes the response to the EFC response address of
+ * the host. The responses are matched to the commands by their sequence
+ * number, so that many commands can be outstanding.
+ *
+ * The response address is the same for all devices on a bus, hence there
+ * is one transport per Ieee1394Service, shared by all devices on it.
+ */
+class EfcNativeTransport
+{
+public:
+    /**
+     * @brief get the transport for a 1394 service
+     *
+     * Creates the transport when needed.
+     *
+     * @return the transport, NULL when the response address can't be
+     *         registered (e.g. when it is used by another driver)
+     */
+    static EfcNativeTransport *acquire(Ieee1394Service &service);
+    /**
+     * @brief release a transport obtained with acquire()
+     */
+    static void release(EfcNativeTransport *t);
+
+    /**
+     * @brief execute one EFC command
+     * @param node the node id of the device
+     * @param cmd the command, contains the response when successful
+     * @return true if a response was received
+     */
+    bool doTransaction(fb_nodeid_t node, EfcCmd &cmd);
+    /**
+     * @brief execute EFC commands, keeping several of them outstanding
+     *
+     * The commands are sent in order, the device executes them in order.
+     *
+     * @param node the node id of the device
+     * @param cmds the commands, contain the responses when successful
+     * @return true if a response was received for all commands
+     */
+    bool doTransactions(fb_nodeid_t node, std::vector<EfcCmd *> &cmds);
+
+    void setVerboseLevel(int l);
+    void show();
+
+private:
+    EfcNativeTransport(Ieee1394Service &service);
+    ~EfcNativeTransport();
+
+    bool init();
+
+    struct sTransaction {
+        fb_nodeid_t node;
+        uint32_t    seqnum;
+        bool        done;
+        // the response, in bus order
+        unsigned int length;
+        quadlet_t   response[EFC_NATIVE_MAX_BYTES/4];
+    };
+    // the pending transactions, by the sequence number of their response
+    typedef std::map<uint32_t, struct sTransaction *> transaction_map_t;
+
+    bool submit(fb_nodeid_t node, EfcCmd &cmd, struct sTransaction &t);
+    bool complete(EfcCmd &cmd, struct sTransaction &t);
+    void handleResponse(struct raw1394_arm_request *req);
+
+    class ResponseHandler : public Ieee1394Service::ARMHandler
+    {
+    public:
+        ResponseHandler(EfcNativeTransport &t);
+        virtual ~ResponseHandler() {};
+
+        virtual bool handleWrite(struct raw1394_arm_request *);
+    private:
+        EfcNativeTransport &m_transport;
+    };
+
+    Ieee1394Service    &m_service;
+    ResponseHandler    *m_handler;
+    int                 m_refcount;
+
+    // protects the sequence number, the pending transactions and the
+    // statistics
+    pthread_mutex_t     m_lock;
+    pthread_cond_t      m_cond;
+    uint32_t            m_seqnum;
+    transaction_map_t   m_pending;
+
+    unsigned int        m_nb_transactions;
+    unsigned int        m_nb_timeouts;
+    unsigned int        m_nb_unmatched;
+    unsigned int        m_max_outstanding;
+
+    typedef std::map<Ieee1394Service *, EfcNativeTransport *> transport_map_t;
+    static transport_map_t  m_transports;
+    static pthread_mutex_t  m_transports_lock;
+
+    DECLARE_DEBUG_MODULE;
+};
+
+} // namespace FireWorks
+
+#endif // FIREWORKS_EFC_NATIVE_TRANSPORT_H
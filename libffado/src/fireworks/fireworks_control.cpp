@@ -103,7 +103,7 @@ double MonitorControl::setValue( const int row, const int col, const double val
         setCmd.m_input = row;
         setCmd.m_output = col;
         setCmd.m_value = (uint32_t)val;
-        if (!m_ParentDevice.doEfcOverAVC(setCmd)) 
+        if (!m_ParentDevice.doEfc(setCmd)) 
         {
             debugError("Cmd failed\n");
         }
@@ -117,7 +117,7 @@ double MonitorControl::setValue( const int row, const int col, const double val
         setCmd.m_input = row;
         setCmd.m_output = col;
         setCmd.m_value = (uint32_t)val;
-        if (!m_ParentDevice.doEfcOverAVC(setCmd)) 
+        if (!m_ParentDevice.doEfc(setCmd)) 
         {
             debugError("Cmd failed\n");
         }
@@ -131,7 +131,7 @@ double MonitorControl::setValue( const int row, const int col, const double val
         setCmd.m_input = row;
         setCmd.m_output = col;
         setCmd.m_value = (uint32_t)val;
-        if (!m_ParentDevice.doEfcOverAVC(setCmd))
+        if (!m_ParentDevice.doEfc(setCmd))
         {
             debugError("Cmd failed\n");
         }
@@ -149,7 +149,7 @@ double MonitorControl::setValue( const int row, const int col, const double val
         setCmd.m_input = row;
         setCmd.m_output = col;
         setCmd.m_value = (uint32_t)val;
-        if (!m_ParentDevice.doEfcOverAVC(setCmd)) 
+        if (!m_ParentDevice.doEfc(setCmd)) 
         {
             debugError("Cmd failed\n");
         }
@@ -192,7 +192,7 @@ double MonitorControl::getValue( const int row, const int col )
         EfcGetMonitorGainCmd getCmd;
         getCmd.m_input=row;
         getCmd.m_output=col;
-        if (!m_ParentDevice.doEfcOverAVC(getCmd)) 
+        if (!m_ParentDevice.doEfc(getCmd)) 
         {
             debugError("Cmd failed\n");
         }
@@ -203,7 +203,7 @@ double MonitorControl::getValue( const int row, const int col )
         EfcGetMonitorPanCmd getCmd;
         getCmd.m_input=row;
         getCmd.m_output=col;
-        if (!m_ParentDevice.doEfcOverAVC(getCmd)) 
+        if (!m_ParentDevice.doEfc(getCmd)) 
         {
             debugError("Cmd failed\n");
         }
@@ -214,7 +214,7 @@ double MonitorControl::getValue( const int row, const int col )
         EfcGetMonitorMuteCmd getCmd;
         getCmd.m_input=row;
         getCmd.m_output=col;
-        if (!m_ParentDevice.doEfcOverAVC(getCmd)) 
+        if (!m_ParentDevice.doEfc(getCmd)) 
         {
             debugError("Cmd failed\n");
         }
@@ -225,7 +225,7 @@ double MonitorControl::getValue( const int row, const int col )
         EfcGetMonitorSoloCmd getCmd;
         getCmd.m_input=row;
         getCmd.m_output=col;
-        if (!m_ParentDevice.doEfcOverAVC(getCmd)) 
+        if (!m_ParentDevice.doEfc(getCmd)) 
         {
             debugError("Cmd failed\n");
         }
@@ -291,7 +291,7 @@ bool SimpleControl::setValue( const double val )
     if(m_Slave) {
         m_Slave->setType(eCT_Set);
         m_Slave->m_value = (uint32_t)val;
-        if (!m_ParentDevice.doEfcOverAVC(*m_Slave)) 
+        if (!m_ParentDevice.doEfc(*m_Slave)) 
         {
             debugError("Cmd failed\n");
             return 0.0;
@@ -333,7 +333,7 @@ double SimpleControl::getValue( )
 {
     if(m_Slave) {
         m_Slave->setType(eCT_Get);
-        if (!m_ParentDevice.doEfcOverAVC(*m_Slave)) 
+        if (!m_ParentDevice.doEfc(*m_Slave)) 
         {
             debugError("Cmd failed\n");
             return 0.0;
@@ -402,7 +402,7 @@ bool BinaryControl::setValue( const int val )
     
         m_Slave->setType(eCT_Set);
         m_Slave->m_value=reg;
-        if (!m_ParentDevice.doEfcOverAVC(*m_Slave)) 
+        if (!m_ParentDevice.doEfc(*m_Slave)) 
         {
             debugError("Cmd failed\n");
             return 0;
@@ -471,7 +471,7 @@ int BinaryControl::getValue( )
             return val;
         }
         m_Slave->setType(eCT_Get);
-        if (!m_ParentDevice.doEfcOverAVC(*m_Slave)) 
+        if (!m_ParentDevice.doEfc(*m_Slave)) 
         {
             debugError("Cmd failed\n");
             return 0;
@@ -520,7 +520,7 @@ bool SpdifModeControl::setValue( const int val )
     }
     debugOutput(DEBUG_LEVEL_VERBOSE, "setValue val: %d setmask: %08X, clear: %08X\n", 
                                       val, setCmd.m_setmask, setCmd.m_clearmask);
-    if (!m_ParentDevice.doEfcOverAVC(setCmd))
+    if (!m_ParentDevice.doEfc(setCmd))
     {
         debugError("Cmd failed\n");
         return false;
@@ -531,7 +531,7 @@ bool SpdifModeControl::setValue( const int val )
 int SpdifModeControl::getValue( )
 {
     EfcGetFlagsCmd getCmd;
-    if (!m_ParentDevice.doEfcOverAVC(getCmd))
+    if (!m_ParentDevice.doEfc(getCmd))
     {
         debugError("Cmd failed\n");
         return 0;
@@ -577,7 +577,7 @@ bool IOConfigControl::setValue( const int val )
     if(m_Slave) {
         m_Slave->setType(eCT_Set);
         m_Slave->m_value=val;
-        if (!m_ParentDevice.doEfcOverAVC(*m_Slave)) 
+        if (!m_ParentDevice.doEfc(*m_Slave)) 
         {
             debugError("Cmd failed\n");
             return 0;
@@ -594,7 +594,7 @@ int IOConfigControl::getValue( )
 {
     if(m_Slave) {
         m_Slave->setType(eCT_Get);
-        if (!m_ParentDevice.doEfcOverAVC(*m_Slave)) 
+        if (!m_ParentDevice.doEfc(*m_Slave)) 
         {
             debugError("Cmd failed\n");
             return 0;
@@ -639,7 +639,7 @@ bool PlaybackRoutingControl::GetState(EfcIsocMapIOConfigCmd *cmd)
     cmd->m_playmap[2] = 0;
 
     cmd->setType(eCT_Get);
-    if (!m_ParentDevice.doEfcOverAVC(*cmd))
+    if (!m_ParentDevice.doEfc(*cmd))
         return false;
 
     return true;
@@ -666,7 +666,7 @@ bool PlaybackRoutingControl::setValue(int idx, int v)
     setCmd.m_playmap[idx] = value;
 
     setCmd.setType(eCT_Set);
-    if (!m_ParentDevice.doEfcOverAVC(setCmd)) {
+    if (!m_ParentDevice.doEfc(setCmd)) {
         debugError("Cmd failed\n");
         return false;
     }
@@ -776,7 +776,7 @@ bool MultiControl::setValue(const int v)
         debugOutput(DEBUG_LEVEL_VERBOSE, "indentify device\n");
         {
             EfcIdentifyCmd cmd;
-            if (!m_ParentDevice.doEfcOverAVC(cmd)) 
+            if (!m_ParentDevice.doEfc(cmd)) 
             {
                 debugError("Cmd failed\n");
                 return false;
@@ -21,11 +21,12 @@
  *
  */
 
-// #include "config.h"
+#include "config.h"
 #include "devicemanager.h"
 #include "fireworks_device.h"
 #include "efc/efc_avc_cmd.h"
 #include "efc/efc_cmds_flash.h"
+#include "efc/efc_native_transport.h"
 
 #include "audiofire/audiofire_device.h"
 
@@ -44,6 +45,7 @@
 #include <sstream>
 #include <unistd.h>
 #include <cstdio>
+#include <cstring>
 using namespace std;
 
 // FireWorks is the platform used and developed by ECHO AUDIO
@@ -53,6 +55,10 @@ Device::Device(DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ))
     : GenericAVC::Device( d, configRom)
     , m_poll_lock( new Util::PosixMutex("DEVPOLL") )
     , m_efc_discovery_done ( false )
+    , m_efc_transport ( NULL )
+    , m_session_base ( 0 )
+    , m_flash_target ( *this )
+    , m_flash ( m_flash_target, ECHO_FLASH_ERASE_TIMEOUT_MILLISECS )
     , m_MixerContainer ( NULL )
     , m_HwInfoContainer ( NULL )
 {
@@ -63,6 +69,7 @@ Device::Device(DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ))
 Device::~Device()
 {
     destroyMixer();
+    EfcNativeTransport::release(m_efc_transport);
 }
 
 void
@@ -75,6 +82,10 @@ Device::showDevice()
         }
     }
     m_HwInfo.showEfcCmd();
+    if (m_efc_transport) {
+        m_efc_transport->show();
+    }
+    m_flash.show();
     GenericAVC::Device::showDevice();
 }
 
@@ -157,6 +168,31 @@ Device::discoverUsingEFC()
     m_efc_discovery_done = false;
     m_HwInfo.setVerboseLevel(getDebugLevel());
 
+#if FIREWORKS_NATIVE_EFC
+    if (m_efc_transport == NULL) {
+        // the native transport can be disabled per device
+        Util::Configuration &config = getDeviceManager().getConfiguration();
+        int native_efc = 1;
+        config.getValueForDeviceSetting(getConfigRom().getNodeVendorId(), getConfigRom().getModelId(),
+                                        "native_efc", native_efc);
+        if (native_efc) {
+            m_efc_transport = EfcNativeTransport::acquire(get1394Service());
+        }
+    }
+    if (m_efc_transport
+        && !m_efc_transport->doTransaction(getConfigRom().getNodeId(), m_HwInfo)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "No response to native EFC, using EFC over AV/C\n");
+        EfcNativeTransport::release(m_efc_transport);
+        m_efc_transport = NULL;
+    }
+    if (m_efc_transport) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Using native EFC\n");
+        if (!checkEfcResult(m_HwInfo)) {
+            debugError("Could not read hardware capabilities\n");
+            return false;
+        }
+    } else
+#endif
     if (!doEfcOverAVC(m_HwInfo)) {
         debugError("Could not read hardware capabilities\n");
         return false;
@@ -176,6 +212,7 @@ Device::discoverUsingEFC()
     }
 
     m_current_clock = -1;
+    m_session_base = 0;
 
     m_efc_discovery_done = true;
     return true;
@@ -215,16 +252,54 @@ bool Device::doEfcOverAVC(EfcCmd &c)
         return false;
     }
 
+    return checkEfcResult(c);
+}
+
+bool Device::checkEfcResult(EfcCmd &c)
+{
     if (   c.m_header.retval != EfcCmd::eERV_Ok
         && c.m_header.retval != EfcCmd::eERV_FlashBusy) {
         debugError( "EFC command failed\n" );
         c.showEfcCmd();
         return false;
     }
-
     return true;
 }
 
+bool Device::doEfc(EfcCmd &c)
+{
+    if (m_efc_transport == NULL) {
+        return doEfcOverAVC(c);
+    }
+
+    if (!m_efc_transport->doTransaction(getConfigRom().getNodeId(), c)) {
+        debugError( "Native EFC command failed\n" );
+        c.showEfcCmd();
+        return false;
+    }
+    return checkEfcResult(c);
+}
+
+bool Device::doEfcs(std::vector<EfcCmd *> &cmds)
+{
+    bool result = true;
+    if (m_efc_transport == NULL) {
+        for (unsigned int i = 0; i < cmds.size(); i++) {
+            result &= doEfcOverAVC(*cmds.at(i));
+        }
+        return result;
+    }
+
+    if (!m_efc_transport->doTransactions(getConfigRom().getNodeId(), cmds)) {
+        debugError( "Native EFC commands failed\n" );
+        return false;
+    }
+    for (unsigned int i = 0; i < cmds.size(); i++) {
+        result &= checkEfcResult(*cmds.at(i));
+    }
+    return result;
+}
+
 bool
 Device::buildMixer()
 {
@@ -439,9 +514,19 @@ Device::loadSession()
  * contents of response against this command.
  */
 bool
-Device::updatePolledValues() {
+Device::updatePolledValues(EfcGetClockCmd *gccmd) {
     Util::MutexLockHelper lock(*m_poll_lock);
-    return doEfcOverAVC(m_Polled);
+    if (gccmd == NULL) {
+        return doEfc(m_Polled);
+    }
+    // the clock settings are mostly needed along with the detected clocks
+    std::vector<EfcCmd *> cmds;
+    cmds.push_back(&m_Polled);
+    cmds.push_back(gccmd);
+    if (!doEfcs(cmds)) {
+        return false;
+    }
+    return checkClock(*gccmd);
 }
 
 #define ECHO_CHECK_AND_ADD_SR(v, x) \
@@ -472,7 +557,13 @@ Device::getSupportedClockSources() {
         return r;
     }
 
-    uint32_t active_clock = getClockSrc();
+    EfcGetClockCmd gccmd;
+    uint32_t active_clock = EFC_CMD_HW_CLOCK_UNSPECIFIED;
+    if (updatePolledValues(&gccmd)) {
+        active_clock = gccmd.m_clock;
+    } else {
+        debugError("Could not update polled values\n");
+    }
 
     if(EFC_CMD_HW_CHECK_FLAG(m_HwInfo.m_supported_clocks, EFC_CMD_HW_CLOCK_INTERNAL)) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "Internal clock supported\n");
@@ -524,6 +615,13 @@ Device::isClockValid(uint32_t id) {
         debugError("Could not update polled values\n");
         return false;
     }
+    return isClockDetected(id);
+}
+
+bool
+Device::isClockDetected(uint32_t id) {
+    if (id==EFC_CMD_HW_CLOCK_INTERNAL)
+        return true;
     return EFC_CMD_HW_CHECK_FLAG(m_Polled.m_status,id);
 }
 
@@ -546,7 +644,7 @@ Device::setActiveClockSource(ClockSource s) {
     // with a new descriptor."
 
 //     EfcPhyReconnectCmd rccmd;
-//     if(!doEfcOverAVC(rccmd)) {
+//     if(!doEfc(rccmd)) {
 //         debugError("Phy reconnect failed\n");
 //     } else {
 //         // sleep for one second such that the phy can get reconnected
@@ -559,8 +657,12 @@ Device::setActiveClockSource(ClockSource s) {
 FFADODevice::ClockSource
 Device::getActiveClockSource() {
     ClockSource s;
-    uint32_t active_clock = getClockSrc();
-    s=clockIdToClockSource(active_clock);
+    EfcGetClockCmd gccmd;
+    if (!updatePolledValues(&gccmd)) {
+        debugError("Could not update polled values\n");
+        return s;
+    }
+    s=clockIdToClockSource(gccmd.m_clock);
     s.active=true;
     return s;
 }
@@ -613,16 +715,20 @@ Device::clockIdToClockSource(uint32_t clockid) {
     }
 
     s.id=clockid;
-    s.valid=isClockValid(clockid);
+    s.valid=isClockDetected(clockid);
 
     return s;
 }
 
 bool Device::getClock(EfcGetClockCmd &gccmd)
 {
-    if (!doEfcOverAVC(gccmd))
+    if (!doEfc(gccmd))
         return false;
+    return checkClock(gccmd);
+}
 
+bool Device::checkClock(EfcGetClockCmd &gccmd)
+{
     /*
      * NOTE:
      * Firmware version 5.0 or later for AudioFire12 returns invalid
@@ -654,7 +760,7 @@ bool Device::getClock(EfcGetClockCmd &gccmd)
             sccmd.m_samplerate = gccmd.m_samplerate;
             sccmd.m_index = 0;
 
-            if (!doEfcOverAVC(sccmd)) {
+            if (!doEfc(sccmd)) {
                 debugOutput(DEBUG_LEVEL_NORMAL, "Fallback failed\n");
                 return false;
             }
@@ -669,17 +775,6 @@ bool Device::getClock(EfcGetClockCmd &gccmd)
 
     return true;
 }
-uint32_t Device::getClockSrc()
-{
-    EfcGetClockCmd gccmd;
-    if (!getClock(gccmd))
-        return EFC_CMD_HW_CLOCK_UNSPECIFIED;
-
-    debugOutput(DEBUG_LEVEL_VERBOSE, "Get current clock source: %d\n",
-                gccmd.m_clock);
-
-    return gccmd.m_clock;
-}
 int Device::getSamplingFrequency()
 {
     EfcGetClockCmd gccmd;
@@ -694,7 +789,7 @@ int Device::getSamplingFrequency()
 
 bool Device::setClock(EfcSetClockCmd sccmd)
 {
-    if (!doEfcOverAVC(sccmd)) {
+    if (!doEfc(sccmd)) {
         debugError("Could not set clock info\n");
         return false;
     }
@@ -758,7 +853,7 @@ Device::lockFlash(bool lock) {
     EfcFlashLockCmd cmd;
     cmd.m_lock = lock;
 
-    if(!doEfcOverAVC(cmd)) {
+    if(!doEfc(cmd)) {
         debugError("Flash lock failed\n");
         return false;
     }
@@ -777,27 +872,9 @@ Device::writeFlash(uint32_t start, uint32_t len, uint32_t* buffer) {
         return false;
     }
 
-    uint32_t start_addr = start;
-    uint32_t stop_addr = start + len*4;
-    uint32_t *target_buffer = buffer;
-
-    EfcFlashWriteCmd cmd;
-    // write EFC_FLASH_SIZE_BYTES at a time
-    for(start_addr = start; start_addr < stop_addr; start_addr += EFC_FLASH_SIZE_BYTES) {
-        cmd.m_address = start_addr;
-        unsigned int quads_to_write = (stop_addr - start_addr)/4;
-        if (quads_to_write > EFC_FLASH_SIZE_QUADS) {
-            quads_to_write = EFC_FLASH_SIZE_QUADS;
-        }
-        cmd.m_nb_quadlets = quads_to_write;
-        for(unsigned int i=0; i<quads_to_write; i++) {
-            cmd.m_data[i] = *target_buffer;
-            target_buffer++;
-        }
-        if(!doEfcOverAVC(cmd)) {
-            debugError("Flash write failed for block 0x%08X (%d quadlets)\n", start_addr, quads_to_write);
-            return false;
-        }
+    if(!m_flash.write(start, len, buffer)) {
+        debugError("Flash write failed for 0x%08X (%u quadlets)\n", start, len);
+        return false;
     }
     return true;
 }
@@ -814,45 +891,9 @@ Device::readFlash(uint32_t start, uint32_t len, uint32_t* buffer) {
         return false;
     }
 
-    uint32_t start_addr = start;
-    uint32_t stop_addr = start + len*4;
-    uint32_t *target_buffer = buffer;
-
-    EfcFlashReadCmd cmd;
-    // read EFC_FLASH_SIZE_BYTES at a time
-    for(start_addr = start; start_addr < stop_addr; start_addr += EFC_FLASH_SIZE_BYTES) {
-        unsigned int quads_to_read = (stop_addr - start_addr)/4;
-        if (quads_to_read > EFC_FLASH_SIZE_QUADS) {
-            quads_to_read = EFC_FLASH_SIZE_QUADS;
-        }
-        uint32_t quadlets_read = 0;
-        int ntries = 10000;
-        do {
-            cmd.m_address = start_addr + quadlets_read*4;
-            unsigned int new_to_read = quads_to_read - quadlets_read;
-            cmd.m_nb_quadlets = new_to_read;
-            if(!doEfcOverAVC(cmd)) {
-                debugError("Flash read failed for block 0x%08X (%d quadlets)\n", start_addr, quads_to_read);
-                return false;
-            }
-            if(cmd.m_nb_quadlets != new_to_read) {
-                debugOutput(DEBUG_LEVEL_VERBOSE,
-                            "Flash read didn't return enough data (%u/%u) \n",
-                            cmd.m_nb_quadlets, new_to_read);
-                // continue trying
-            }
-            quadlets_read += cmd.m_nb_quadlets;
-
-            // copy content
-            for(unsigned int i=0; i<cmd.m_nb_quadlets; i++) {
-                *target_buffer = cmd.m_data[i];
-                target_buffer++;
-            }
-        } while(quadlets_read < quads_to_read && ntries--);
-        if(ntries==0) {
-            debugError("deadlock while reading flash\n");
-            return false;
-        }
+    if(!m_flash.read(start, len, buffer)) {
+        debugError("Flash read failed for 0x%08X (%u quadlets)\n", start, len);
+        return false;
     }
     return true;
 }
@@ -865,7 +906,7 @@ Device::eraseFlash(uint32_t addr) {
     }
     EfcFlashEraseCmd cmd;
     cmd.m_address = addr;
-    if(!doEfcOverAVC(cmd)) {
+    if(!doEfc(cmd)) {
         if (cmd.m_header.retval == EfcCmd::eERV_FlashBusy) {
             return true;
         }
@@ -949,43 +990,162 @@ Device::eraseFlashBlocks(uint32_t start_address, unsigned int nb_quads)
 bool
 Device::waitForFlash(unsigned int msecs)
 {
-    bool ready;
-
-    EfcFlashGetStatusCmd statusCmd;
-    const unsigned int time_to_sleep_usecs = 10000;
-    int wait_cycles = msecs * 1000 / time_to_sleep_usecs;
-
-    do {
-        if (!doEfcOverAVC(statusCmd)) {
-            debugError("Could not read flash status\n");
-            return false;
-        }
-        if (statusCmd.m_header.retval == EfcCmd::eERV_FlashBusy) {
-            ready = false;
-        } else {
-            ready = statusCmd.m_ready;
-        }
-        usleep(time_to_sleep_usecs);
-    } while (!ready && wait_cycles--);
-
-    if(wait_cycles == 0) {
+    if (!m_flash.waitWhileBusy(msecs)) {
         debugError("Timeout while waiting for flash\n");
         return false;
     }
-
-    return ready;
+    return true;
 }
 
 uint32_t
 Device::getSessionBase()
 {
+    // the session block doesn't move unless the firmware changes
+    if (m_session_base) {
+        return m_session_base;
+    }
     EfcFlashGetSessionBaseCmd cmd;
-    if(!doEfcOverAVC(cmd)) {
+    if(!doEfc(cmd)) {
         debugError("Could not get session base address\n");
         return 0; // FIXME: arbitrary
     }
-    return cmd.m_address;
+    m_session_base = cmd.m_address;
+    return m_session_base;
+}
+
+
+// the flash target
+
+bool
+Device::FlashTarget::isBusy(bool &busy)
+{
+    EfcFlashGetStatusCmd statusCmd;
+    if (!m_parent.doEfc(statusCmd)) {
+        return false;
+    }
+    if (statusCmd.m_header.retval == EfcCmd::eERV_FlashBusy) {
+        busy = true;
+    } else {
+        busy = !statusCmd.m_ready;
+    }
+    return true;
+}
+
+unsigned int
+Device::FlashTarget::getBlockSizeQuads()
+{
+    return EFC_FLASH_SIZE_QUADS;
+}
+
+unsigned int
+Device::FlashTarget::getMaxOutstandingBlocks()
+{
+    // only the native transport can keep commands outstanding
+    if (m_parent.m_efc_transport) {
+        return FIREWORKS_NATIVE_EFC_MAX_OUTSTANDING;
+    }
+    return 1;
+}
+
+bool
+Device::FlashTarget::startWrite(Util::FlashProgrammer::BlockVector &blocks)
+{
+    std::vector<EfcFlashWriteCmd> cmds(blocks.size());
+    std::vector<EfcCmd *> cmd_ptrs;
+    for (unsigned int i = 0; i < blocks.size(); i++) {
+        struct Util::FlashProgrammer::sBlock &b = blocks.at(i);
+        cmds.at(i).m_address = b.address;
+        cmds.at(i).m_nb_quadlets = b.nb_quads;
+        memcpy(cmds.at(i).m_data, b.data, b.nb_quads * 4);
+        cmd_ptrs.push_back(&cmds.at(i));
+    }
+    if (!m_parent.doEfcs(cmd_ptrs)) {
+        return false;
+    }
+    // a block that finds the flash busy is not written. wait until the
+    // flash is ready and resend it.
+    for (unsigned int i = 0; i < cmds.size(); i++) {
+        EfcFlashWriteCmd &cmd = cmds.at(i);
+        int ntries = 10;
+        while (cmd.m_header.retval == EfcCmd::eERV_FlashBusy) {
+            if (ntries-- == 0) {
+                debugError("Flash stays busy for block at 0x%08X\n", cmd.m_address);
+                return false;
+            }
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Flash busy, resending block at 0x%08X\n",
+                        cmd.m_address);
+            if (!m_parent.waitForFlash(ECHO_FLASH_ERASE_TIMEOUT_MILLISECS)) {
+                return false;
+            }
+            if (!m_parent.doEfc(cmd)) {
+                return false;
+            }
+        }
+        if (cmd.m_header.retval != EfcCmd::eERV_Ok) {
+            debugError("Flash write failed for block at 0x%08X\n", cmd.m_address);
+            return false;
+        }
+    }
+    return true;
 }
 
+bool
+Device::FlashTarget::startRead(Util::FlashProgrammer::BlockVector &blocks)
+{
+    std::vector<EfcFlashReadCmd> cmds(blocks.size());
+    std::vector<EfcCmd *> cmd_ptrs;
+    for (unsigned int i = 0; i < blocks.size(); i++) {
+        cmds.at(i).m_address = blocks.at(i).address;
+        cmds.at(i).m_nb_quadlets = blocks.at(i).nb_quads;
+        cmd_ptrs.push_back(&cmds.at(i));
+    }
+    if (!m_parent.doEfcs(cmd_ptrs)) {
+        return false;
+    }
+    for (unsigned int i = 0; i < blocks.size(); i++) {
+        struct Util::FlashProgrammer::sBlock &b = blocks.at(i);
+        unsigned int nb_read = cmds.at(i).m_nb_quadlets;
+        if (nb_read > b.nb_quads) {
+            nb_read = b.nb_quads;
+        }
+        memcpy(b.data, cmds.at(i).m_data, nb_read * 4);
+        if (nb_read != b.nb_quads) {
+            debugOutput(DEBUG_LEVEL_VERBOSE,
+                        "Flash read didn't return enough data (%u/%u) \n",
+                        nb_read, b.nb_quads);
+            if (!readRemaining(b, nb_read)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool
+Device::FlashTarget::readRemaining(struct Util::FlashProgrammer::sBlock &block,
+                                   unsigned int quadlets_read)
+{
+    // the device sometimes returns less data than requested, read the
+    // rest of the block one command at a time
+    EfcFlashReadCmd cmd;
+    int ntries = 10000;
+    while (quadlets_read < block.nb_quads && ntries--) {
+        cmd.m_address = block.address + quadlets_read*4;
+        cmd.m_nb_quadlets = block.nb_quads - quadlets_read;
+        if (!m_parent.doEfc(cmd)) {
+            return false;
+        }
+        if (cmd.m_nb_quadlets > block.nb_quads - quadlets_read) {
+            cmd.m_nb_quadlets = block.nb_quads - quadlets_read;
+        }
+        memcpy(block.data + quadlets_read, cmd.m_data, cmd.m_nb_quadlets * 4);
+        quadlets_read += cmd.m_nb_quadlets;
+    }
+    if (quadlets_read < block.nb_quads) {
+        debugError("deadlock while reading flash\n");
+        return false;
+    }
+    return true;
+}
 
 } // FireWorks
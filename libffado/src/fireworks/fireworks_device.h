@@ -36,12 +36,15 @@
 
 #include <pthread.h>
 #include "libutil/Mutex.h"
+#include "libutil/FlashProgrammer.h"
 
 class ConfigRom;
 class Ieee1394Service;
 
 namespace FireWorks {
 
+class EfcNativeTransport;
+
 class Device : public GenericAVC::Device {
     friend class MonitorControl;
     friend class SimpleControl;
@@ -74,6 +77,27 @@ public:
 
 // protected: //?
     bool doEfcOverAVC(EfcCmd& c);
+
+    /**
+     * @brief execute an EFC command
+     *
+     * Uses the native EFC transport when available, EFC over AV/C
+     * otherwise.
+     *
+     * @param c the command, contains the response when successful
+     * @return true if successful
+     */
+    bool doEfc(EfcCmd& c);
+    /**
+     * @brief execute a series of EFC commands
+     *
+     * The native EFC transport keeps several of them outstanding, which
+     * is a lot faster than executing them one by one.
+     *
+     * @param cmds the commands, contain the responses when successful
+     * @return true if all commands were successful
+     */
+    bool doEfcs(std::vector<EfcCmd *>& cmds);
     
     /**
      * @brief Read flash
@@ -135,12 +159,16 @@ public:
 private:
     
     bool discoverUsingEFC();
+    bool checkEfcResult(EfcCmd &c);
 
     FFADODevice::ClockSource clockIdToClockSource(uint32_t clockflag);
     bool isClockValid(uint32_t id);
+    // uses the last polled values
+    bool isClockDetected(uint32_t id);
 
     bool getClock(EfcGetClockCmd &gccmd);
-    uint32_t getClockSrc();
+    // works around bogus clock info in the response
+    bool checkClock(EfcGetClockCmd &gccmd);
 
     bool setClock(EfcSetClockCmd sccmd);
     bool setClockSrc(uint32_t clock);
@@ -153,11 +181,41 @@ private:
 
     EfcHardwareInfoCmd  m_HwInfo;
 
-    bool updatePolledValues();
+    /**
+     * @brief poll the device status
+     * @param gccmd if not NULL, the clock settings are queried along
+     * @return true if successful
+     */
+    bool updatePolledValues(EfcGetClockCmd *gccmd = NULL);
     Util::Mutex*        m_poll_lock;
     EfcPolledValuesCmd  m_Polled;
 
     bool                m_efc_discovery_done;
+    EfcNativeTransport *m_efc_transport;
+    uint32_t            m_session_base;
+
+    // the flash is accessed through EFC commands
+    class FlashTarget : public Util::FlashProgrammer::Target
+    {
+    public:
+        FlashTarget(Device &parent) : m_parent( parent ) {};
+        virtual ~FlashTarget() {};
+
+        virtual bool isBusy(bool &busy);
+        virtual unsigned int getBlockSizeQuads();
+        virtual unsigned int getMaxOutstandingBlocks();
+
+        virtual bool startWrite(Util::FlashProgrammer::BlockVector &blocks);
+        // the response to a write is sent when the data is in flash
+        virtual bool writeNeedsBusyWait() {return false;};
+        virtual bool startRead(Util::FlashProgrammer::BlockVector &blocks);
+    private:
+        bool readRemaining(struct Util::FlashProgrammer::sBlock &block,
+                           unsigned int quadlets_read);
+        Device &m_parent;
+    };
+    FlashTarget             m_flash_target;
+    Util::FlashProgrammer   m_flash;
 
 protected:
     Session             m_session;
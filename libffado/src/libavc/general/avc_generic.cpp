@@ -260,11 +260,11 @@ AVCCommand::fire()
 
         }
         debugOutputShort( DEBUG_LEVEL_VERY_VERBOSE, "\n" );
-        m_p1394Service->transactionBlockClose();
+        m_p1394Service->transactionBlockClose( m_nodeId );
     } else {
         debugOutput( DEBUG_LEVEL_VERBOSE, "no response\n" );
         result = false;
-        m_p1394Service->transactionBlockClose();
+        m_p1394Service->transactionBlockClose( m_nodeId );
     }
 
     return result;
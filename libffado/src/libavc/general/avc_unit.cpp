@@ -168,6 +168,10 @@ bool
 Unit::discover()
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Discovering AVC::Unit...\n");
+
+    // discovery sends lots of identical inquiries, answer repeats from cache
+    Ieee1394Service::FcpCacheSession fcp_cache( get1394Service() );
+
     if( !clean() ) {
         debugError( "Could not clean unit data structures\n" );
         return false;
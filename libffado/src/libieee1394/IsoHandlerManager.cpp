@@ -37,6 +37,7 @@
 #include <cstring>
 #include <unistd.h>
 #include <assert.h>
+#include <inttypes.h>
 
 IMPL_DEBUG_MODULE( IsoHandlerManager, IsoHandlerManager, DEBUG_LEVEL_NORMAL );
 IMPL_DEBUG_MODULE( IsoHandlerManager::IsoTask, IsoTask, DEBUG_LEVEL_NORMAL );
@@ -53,6 +54,7 @@ IsoHandlerManager::IsoTask::IsoTask(IsoHandlerManager& manager, enum IsoHandler:
     , m_running( false )
     , m_in_busreset( false )
     , m_activity_wait_timeout_nsec (ISOHANDLERMANAGER_ISO_TASK_WAIT_TIMEOUT_USECS * 1000LL)
+    , m_faults( t == IsoHandler::eHT_Transmit ? "Iso transmit thread" : "Iso receive thread" )
 {
 }
 
@@ -235,6 +237,8 @@ IsoHandlerManager::IsoTask::Execute()
     m_last_loop_entry = now;
     #endif
 
+    m_faults.sample();
+
     // if some other thread requested a shadow map update, do it
     if(request_update) {
         updateShadowMapHelper();
@@ -593,6 +597,64 @@ IsoHandlerManager::setThreadParameters(bool rt, int priority) {
     return true;
 }
 
+void
+IsoHandlerManager::updateThreadDeadlines()
+{
+    Util::Configuration *config = m_service.getConfiguration();
+    int sched_deadline = THREAD_USE_SCHED_DEADLINE;
+    int runtime_percent = ISOHANDLERMANAGER_SCHED_DEADLINE_RUNTIME_PERCENT;
+    if(config) {
+        config->getValueForSetting("ieee1394.isomanager.sched_deadline", sched_deadline);
+        config->getValueForSetting("ieee1394.isomanager.sched_deadline_runtime_percent", runtime_percent);
+    }
+    if (!sched_deadline) {
+        return;
+    }
+    if (runtime_percent <= 0 || runtime_percent > 100) {
+        debugWarning("Bogus deadline runtime percentage: %d\n", runtime_percent);
+        runtime_percent = ISOHANDLERMANAGER_SCHED_DEADLINE_RUNTIME_PERCENT;
+    }
+
+    // a thread has to run at least once per interrupt of each of its handlers
+    int irq_interval_xmit = 0;
+    int irq_interval_recv = 0;
+    for ( IsoHandlerVectorIterator it = m_IsoHandlers.begin();
+      it != m_IsoHandlers.end();
+      ++it )
+    {
+        int irq_interval = (*it)->getIrqInterval();
+        if (irq_interval <= 0) continue;
+        if ((*it)->getType() == IsoHandler::eHT_Transmit) {
+            if (irq_interval_xmit == 0 || irq_interval < irq_interval_xmit) {
+                irq_interval_xmit = irq_interval;
+            }
+        } else {
+            if (irq_interval_recv == 0 || irq_interval < irq_interval_recv) {
+                irq_interval_recv = irq_interval;
+            }
+        }
+    }
+
+    // one iso cycle takes 125us
+    uint64_t period_xmit = irq_interval_xmit * 125000ULL;
+    uint64_t period_recv = irq_interval_recv * 125000ULL;
+    debugOutput( DEBUG_LEVEL_VERBOSE, "Iso thread deadline periods: xmit %" PRIu64 " ns, recv %" PRIu64 " ns\n",
+                 period_xmit, period_recv);
+
+    if (m_IsoThreadTransmit) {
+        m_IsoThreadTransmit->SetParams(period_xmit, period_xmit * runtime_percent / 100, period_xmit);
+        if (m_realtime) {
+            m_IsoThreadTransmit->AcquireRealTime();
+        }
+    }
+    if (m_IsoThreadReceive) {
+        m_IsoThreadReceive->SetParams(period_recv, period_recv * runtime_percent / 100, period_recv);
+        if (m_realtime) {
+            m_IsoThreadReceive->AcquireRealTime();
+        }
+    }
+}
+
 bool IsoHandlerManager::init()
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Initializing ISO manager %p...\n", this);
@@ -681,15 +743,19 @@ bool IsoHandlerManager::init()
 void
 IsoHandlerManager::signalActivityTransmit()
 {
-    assert(m_IsoTaskTransmit);
-    m_IsoTaskTransmit->signalActivity();
+    // the tasks only exist once the manager is initialized. Streams can
+    // be driven without them, e.g. when replaying a packet capture.
+    if (m_IsoTaskTransmit) {
+        m_IsoTaskTransmit->signalActivity();
+    }
 }
 
 void
 IsoHandlerManager::signalActivityReceive()
 {
-    assert(m_IsoTaskReceive);
-    m_IsoTaskReceive->signalActivity();
+    if (m_IsoTaskReceive) {
+        m_IsoTaskReceive->signalActivity();
+    }
 }
 
 bool IsoHandlerManager::registerHandler(IsoHandler *handler)
@@ -762,13 +828,11 @@ bool IsoHandlerManager::registerStream(StreamProcessor *stream)
         Util::Configuration *config = m_service.getConfiguration();
         int receive_mode_setting = DEFAULT_ISO_RECEIVE_MODE;
         int bufferfill_mode_threshold = BUFFERFILL_MODE_THRESHOLD;
-        int min_interrupts_per_period = MINIMUM_INTERRUPTS_PER_PERIOD;
         int max_nb_buffers_recv = MAX_RECV_NB_BUFFERS;
         int min_packetsize_recv = MIN_RECV_PACKET_SIZE;
         if(config) {
             config->getValueForSetting("ieee1394.isomanager.iso_receive_mode", receive_mode_setting);
             config->getValueForSetting("ieee1394.isomanager.bufferfill_mode_threshold", bufferfill_mode_threshold);
-            config->getValueForSetting("ieee1394.isomanager.min_interrupts_per_period", min_interrupts_per_period);
             config->getValueForSetting("ieee1394.isomanager.max_nb_buffers_recv", max_nb_buffers_recv);
             config->getValueForSetting("ieee1394.isomanager.min_packetsize_recv", min_packetsize_recv);
         }
@@ -820,19 +884,13 @@ bool IsoHandlerManager::registerStream(StreamProcessor *stream)
         // apparently a too small value causes issues too
         if(max_packet_size < 200) max_packet_size = 200;
 
-        // the interrupt/wakeup interval prediction of raw1394 is a mess...
-        int irq_interval = (packets_per_period-1) / min_interrupts_per_period;
-        if(irq_interval <= 0) irq_interval=1;
-
         // the receive buffer size doesn't matter for the latency,
         // it does seem to be confined to a certain region for correct
         // operation. However it is not clear how many.
         int buffers = max_nb_buffers_recv;
 
-        // ensure at least 2 hardware interrupts per ISO buffer wraparound
-        if(irq_interval > buffers/2) {
-            irq_interval = buffers/2;
-        }
+        // the interrupt/wakeup interval prediction of raw1394 is a mess...
+        int irq_interval = getIrqIntervalForPeriod(packets_per_period, buffers);
 
         // create the actual handler
         debugOutput( DEBUG_LEVEL_VERBOSE, " creating IsoRecvHandler\n");
@@ -849,12 +907,10 @@ bool IsoHandlerManager::registerStream(StreamProcessor *stream)
     } else if (stream->getType()==StreamProcessor::ePT_Transmit) {
         // grab the options from the parent
         Util::Configuration *config = m_service.getConfiguration();
-        int min_interrupts_per_period = MINIMUM_INTERRUPTS_PER_PERIOD;
         int max_nb_buffers_xmit = MAX_XMIT_NB_BUFFERS;
         int max_packetsize_xmit = MAX_XMIT_PACKET_SIZE;
         int min_packetsize_xmit = MIN_XMIT_PACKET_SIZE;
         if(config) {
-            config->getValueForSetting("ieee1394.isomanager.min_interrupts_per_period", min_interrupts_per_period);
             config->getValueForSetting("ieee1394.isomanager.max_nb_buffers_xmit", max_nb_buffers_xmit);
             config->getValueForSetting("ieee1394.isomanager.max_packetsize_xmit", max_packetsize_xmit);
             config->getValueForSetting("ieee1394.isomanager.min_packetsize_xmit", min_packetsize_xmit);
@@ -878,12 +934,7 @@ bool IsoHandlerManager::registerStream(StreamProcessor *stream)
         int buffers = max_nb_buffers_xmit;
         unsigned int packets_per_period = stream->getPacketsPerPeriod();
 
-        int irq_interval = (packets_per_period-1) / min_interrupts_per_period;
-        if(irq_interval <= 0) irq_interval=1;
-        // ensure at least 2 hardware interrupts per ISO buffer wraparound
-        if(irq_interval > buffers/2) {
-            irq_interval = buffers/2;
-        }
+        int irq_interval = getIrqIntervalForPeriod(packets_per_period, buffers);
 
         debugOutput( DEBUG_LEVEL_VERBOSE, " creating IsoXmitHandler\n");
 
@@ -919,6 +970,7 @@ bool IsoHandlerManager::registerStream(StreamProcessor *stream)
     m_StreamProcessors.push_back(stream);
     debugOutput( DEBUG_LEVEL_VERBOSE, " %zd streams, %zd handlers registered\n",
                                       m_StreamProcessors.size(), m_IsoHandlers.size());
+    updateThreadDeadlines();
     return true;
 }
 
@@ -943,6 +995,7 @@ bool IsoHandlerManager::unregisterStream(StreamProcessor *stream)
 
     // clean up all handlers that aren't used
     pruneHandlers();
+    updateThreadDeadlines();
 
     // remove the stream from the registered streams list
     for ( StreamProcessorVectorIterator it = m_StreamProcessors.begin();
@@ -1011,6 +1064,56 @@ IsoHandlerManager::getPacketLatencyForStream(Streaming::StreamProcessor *stream)
     return 0;
 }
 
+bool
+IsoHandlerManager::getIsoStatsForStream(Streaming::StreamProcessor *stream, int &max_lateness_usecs,
+                                        int &max_iterate_nsecs, unsigned int &dropped_cycles) {
+    IsoHandler *h = getHandlerForStream(stream);
+    if (h == NULL) return false;
+    Streaming::StreamStatistics &lateness = h->getLatenessStatistics();
+    Streaming::StreamStatistics &iterate = h->getIterateStatistics();
+    max_lateness_usecs = (lateness.m_count ? (int)lateness.m_max : 0);
+    max_iterate_nsecs = (iterate.m_count ? (int)iterate.m_max : 0);
+    dropped_cycles = h->getDroppedCycles();
+    return true;
+}
+
+bool
+IsoHandlerManager::canServePeriodForStream(Streaming::StreamProcessor *stream,
+                                           unsigned int packets_per_period) {
+    IsoHandler *h = getHandlerForStream(stream);
+    if (h == NULL) return false;
+    int irq_interval = getIrqIntervalForPeriod(packets_per_period, h->getNbBuffers());
+    if (h->getIrqInterval() > irq_interval) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Handler %p interrupts every %d packets, %u packets need %d\n",
+                    h, h->getIrqInterval(), packets_per_period, irq_interval);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief the interrupt interval for a period
+ * @param packets_per_period the number of packets in a period
+ * @param buffers the number of packets in the ISO buffer of the handler
+ * @return the interrupt interval in packets
+ */
+int
+IsoHandlerManager::getIrqIntervalForPeriod(unsigned int packets_per_period, int buffers) {
+    Util::Configuration *config = m_service.getConfiguration();
+    int min_interrupts_per_period = MINIMUM_INTERRUPTS_PER_PERIOD;
+    if(config) {
+        config->getValueForSetting("ieee1394.isomanager.min_interrupts_per_period", min_interrupts_per_period);
+    }
+
+    int irq_interval = (packets_per_period-1) / min_interrupts_per_period;
+    if(irq_interval <= 0) irq_interval=1;
+    // ensure at least 2 hardware interrupts per ISO buffer wraparound
+    if(irq_interval > buffers/2) {
+        irq_interval = buffers/2;
+    }
+    return irq_interval;
+}
+
 IsoHandlerManager::IsoHandler *
 IsoHandlerManager::getHandlerForStream(Streaming::StreamProcessor *stream) {
     for ( IsoHandlerVectorIterator it = m_IsoHandlers.begin();
@@ -1051,7 +1154,9 @@ void IsoHandlerManager::setIsoStartCycleForStream(Streaming::StreamProcessor *st
     // requestEnable() doesn't set it.  This allows the override configured
     // by this function to take effect.
     IsoHandler *h = getHandlerForStream(stream);
-    h->setIsoStartCycle(cycle);
+    if (h) {
+        h->setIsoStartCycle(cycle);
+    }
 }
 
 bool
@@ -1202,6 +1307,8 @@ void IsoHandlerManager::dumpInfo() {
         (*it)->dumpInfo();
     }
     #endif
+    if (m_IsoTaskTransmit) m_IsoTaskTransmit->m_faults.show();
+    if (m_IsoTaskReceive) m_IsoTaskReceive->m_faults.show();
 }
 
 const char *
@@ -1259,6 +1366,7 @@ IsoHandlerManager::IsoHandler::IsoHandler(IsoHandlerManager& manager, enum EHand
    , m_State( eHS_Stopped )
    , m_NextState( eHS_Stopped )
    , m_switch_on_cycle(0)
+   , m_dropped_cycles( 0 )
 #ifdef DEBUG
    , m_packets ( 0 )
    , m_dropped( 0 )
@@ -1286,6 +1394,7 @@ IsoHandlerManager::IsoHandler::IsoHandler(IsoHandlerManager& manager, enum EHand
    , m_State( eHS_Stopped )
    , m_NextState( eHS_Stopped )
    , m_switch_on_cycle(0)
+   , m_dropped_cycles( 0 )
 #ifdef DEBUG
    , m_packets ( 0 )
    , m_dropped( 0 )
@@ -1314,6 +1423,7 @@ IsoHandlerManager::IsoHandler::IsoHandler(IsoHandlerManager& manager, enum EHand
    , m_State( eHS_Stopped )
    , m_NextState( eHS_Stopped )
    , m_switch_on_cycle(0)
+   , m_dropped_cycles( 0 )
 #ifdef DEBUG
    , m_packets( 0 )
    , m_dropped( 0 )
@@ -1400,11 +1510,13 @@ IsoHandlerManager::IsoHandler::iterate(uint32_t cycle_timer_now) {
         }
         #endif
 
+        uint64_t start = Util::SystemTimeSource::getCurrentTimeAsNsecs();
         if(raw1394_loop_iterate(m_handle)) {
             debugError( "IsoHandler (%p): Failed to iterate handler: %s\n",
                         this, strerror(errno));
             return false;
         }
+        m_iterate_stats.mark((int)(Util::SystemTimeSource::getCurrentTimeAsNsecs() - start));
         debugOutputExtreme(DEBUG_LEVEL_VERY_VERBOSE, "(%p, %s) done interating ISO handler...\n",
                            this, getTypeString());
         return true;
@@ -1482,7 +1594,27 @@ void IsoHandlerManager::IsoHandler::dumpInfo()
     debugOutputShort( DEBUG_LEVEL_NORMAL, "  Last cycle, dropped.........: %4d, %4u, %4u\n",
             m_last_cycle, m_dropped, m_skipped);
     #endif
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "  Dropped cycles..............: %4u\n",
+            m_dropped_cycles);
+    m_lateness_stats.dumpInfo();
+    m_packet_stats.dumpInfo();
+    m_iterate_stats.dumpInfo();
+}
 
+/**
+ * @brief record how late the handler runs w.r.t. the cycle of the packet
+ *
+ * @param diff_cycles the packet's cycle minus the cycle of the last iterate()
+ *
+ * Transmit packets are normally queued ahead of time, so their lateness
+ * is negative.
+ */
+void IsoHandlerManager::IsoHandler::markLateness(int64_t diff_cycles)
+{
+    if (m_last_now == 0xFFFFFFFF) return;
+    int64_t ticks = CYCLE_TIMER_GET_OFFSET(m_last_now)
+                    - diff_cycles * (int64_t)TICKS_PER_CYCLE;
+    m_lateness_stats.mark((int)(ticks * 1000000LL / TICKS_PER_SECOND));
 }
 
 void IsoHandlerManager::IsoHandler::setVerboseLevel(int l)
@@ -1526,6 +1658,9 @@ enum raw1394_iso_disposition IsoHandlerManager::IsoHandler::putPacket(
     int dropped_cycles = 0;
     if (m_last_cycle != (int)cycle && m_last_cycle != -1 && m_manager.m_MissedCyclesOK == false) {
         dropped_cycles = diffCycles(cycle, m_last_cycle) - 1;
+        if (dropped_cycles > 0) {
+            m_dropped_cycles += dropped_cycles;
+        }
         #ifdef DEBUG
         if (dropped_cycles < 0) {
             debugWarning("(%p) dropped < 1 (%d), cycle: %d, last_cycle: %d, dropped: %d\n", 
@@ -1561,6 +1696,7 @@ enum raw1394_iso_disposition IsoHandlerManager::IsoHandler::putPacket(
     tmp += diff_cycles * (int64_t)TICKS_PER_CYCLE;
     uint64_t pkt_ctr_ticks = wrapAtMinMaxTicks(tmp);
     uint32_t pkt_ctr = TICKS_TO_CYCLE_TIMER(pkt_ctr_ticks);
+    markLateness(diff_cycles);
     #ifdef DEBUG
     if( (now_cycles < cycle)
         && diffCycles(now_cycles, cycle) < 0
@@ -1620,8 +1756,13 @@ enum raw1394_iso_disposition IsoHandlerManager::IsoHandler::putPacket(
     #endif
 
     // iterate the client if required
-    if(m_Client)
-        return m_Client->putPacket(data, length, channel, tag, sy, pkt_ctr, dropped_cycles);
+    if(m_Client) {
+        uint64_t start = Util::SystemTimeSource::getCurrentTimeAsNsecs();
+        enum raw1394_iso_disposition retval;
+        retval = m_Client->putPacket(data, length, channel, tag, sy, pkt_ctr, dropped_cycles);
+        m_packet_stats.mark((int)(Util::SystemTimeSource::getCurrentTimeAsNsecs() - start));
+        return retval;
+    }
 
     return RAW1394_ISO_OK;
 }
@@ -1656,6 +1797,7 @@ IsoHandlerManager::IsoHandler::getPacket(unsigned char *data, unsigned int *leng
         tmp += diff_cycles * (int64_t)TICKS_PER_CYCLE;
         uint64_t pkt_ctr_ticks = wrapAtMinMaxTicks(tmp);
         pkt_ctr = TICKS_TO_CYCLE_TIMER(pkt_ctr_ticks);
+        markLateness(diff_cycles);
 
 //debugOutput(DEBUG_LEVEL_VERBOSE, "cy=%d, now_cy=%d, diff_cy=%lld, tmp=%lld, pkt_ctr_ticks=%lld, pkt_ctr=%d\n",
 //  cycle, now_cycles, diff_cycles, tmp, pkt_ctr_ticks, pkt_ctr);
@@ -1720,6 +1862,9 @@ IsoHandlerManager::IsoHandler::getPacket(unsigned char *data, unsigned int *leng
             m_deferred_cycles = 0;
         else
             dropped_cycles -= m_deferred_cycles;
+        if (dropped_cycles > 0) {
+            m_dropped_cycles += dropped_cycles;
+        }
 
         #ifdef DEBUG
         if(skipped) {
@@ -1756,7 +1901,9 @@ IsoHandlerManager::IsoHandler::getPacket(unsigned char *data, unsigned int *leng
 
     if(m_Client) {
         enum raw1394_iso_disposition retval;
+        uint64_t start = Util::SystemTimeSource::getCurrentTimeAsNsecs();
         retval = m_Client->getPacket(data, length, tag, sy, pkt_ctr, dropped_cycles, skipped, m_max_packet_size);
+        m_packet_stats.mark((int)(Util::SystemTimeSource::getCurrentTimeAsNsecs() - start));
         #ifdef DEBUG
         if (*length > m_max_packet_size) {
             debugWarning("(%p, %s) packet too large: len=%u max=%u\n",
@@ -1820,6 +1967,25 @@ IsoHandlerManager::IsoHandler::enable(int cycle)
     m_last_now = 0xFFFFFFFF;
     m_last_packet_handled_at = 0xFFFFFFFF;
 
+    // start fresh histograms and make them visible to the monitoring tools
+    char owner[40];
+    snprintf(owner, sizeof(owner), "Port %d ch %d %s handler",
+             m_manager.get1394Service().getPort(),
+             m_Client ? m_Client->getChannel() : -1, getTypeString());
+    m_lateness_stats.setName("wake-up lateness");
+    m_lateness_stats.setUnit("us");
+    m_packet_stats.setName("packet time");
+    m_packet_stats.setUnit("ns");
+    m_iterate_stats.setName("iterate time");
+    m_iterate_stats.setUnit("ns");
+    m_lateness_stats.reset();
+    m_packet_stats.reset();
+    m_iterate_stats.reset();
+    m_dropped_cycles = 0;
+    m_lateness_stats.publish(owner);
+    m_packet_stats.publish(owner);
+    m_iterate_stats.publish(owner);
+
     // prepare the handler, allocate the resources
     debugOutput( DEBUG_LEVEL_VERBOSE, "Preparing iso handler (%p, client=%p)\n", this, m_Client);
     dumpInfo();
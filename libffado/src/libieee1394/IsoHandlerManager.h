@@ -29,6 +29,8 @@
 #include "debugmodule/debugmodule.h"
 
 #include "libutil/Thread.h"
+#include "libutil/RtMemory.h"
+#include "libutil/StreamStatistics.h"
 
 #include <sys/poll.h>
 #include <errno.h>
@@ -182,6 +184,13 @@ class IsoHandlerManager
      */
             uint32_t getLastIterateTime() {return m_last_now;};
 
+    /**
+             * @brief the number of cycles dropped since the handler was enabled
+     */
+            unsigned int getDroppedCycles() {return m_dropped_cycles;};
+            Streaming::StreamStatistics &getLatenessStatistics() {return m_lateness_stats;};
+            Streaming::StreamStatistics &getIterateStatistics() {return m_iterate_stats;};
+
     /**
              * @brief returns the CTR value saved at the last iterate handler call
              * @return CTR value saved at last iterate handler call
@@ -225,6 +234,14 @@ class IsoHandlerManager
 
             pthread_mutex_t m_disable_lock;
 
+            // wake-up lateness w.r.t. the packet's cycle (us), the
+            // time spent in the client per packet (ns) and per iterate() (ns)
+            Streaming::StreamStatistics m_lateness_stats;
+            Streaming::StreamStatistics m_packet_stats;
+            Streaming::StreamStatistics m_iterate_stats;
+            unsigned int m_dropped_cycles;
+            void markLateness(int64_t diff_cycles);
+
         public:
             unsigned int    m_packets;
 #ifdef DEBUG
@@ -314,6 +331,9 @@ class IsoHandlerManager
             sem_t m_activity_semaphore;
             long long int m_activity_wait_timeout_nsec;
 
+        // page faults in the iso thread
+            Util::RtMemory::FaultMonitor m_faults;
+
         // debug stuff
             DECLARE_DEBUG_MODULE;
     };
@@ -368,6 +388,30 @@ class IsoHandlerManager
          */
         int getPacketLatencyForStream(Streaming::StreamProcessor *);
 
+        /**
+         * @brief check whether the handler of a stream can serve a period size
+         *
+         * The interrupt interval of a handler is fixed once it runs. A
+         * period needs at least min_interrupts_per_period interrupts, so
+         * the interval that the handler has been set up with has to be
+         * no larger than the one that would be used for the period.
+         *
+         * @param packets_per_period the number of packets in the period
+         * @return false if the handler interrupts too seldom for the period
+         */
+        bool canServePeriodForStream(Streaming::StreamProcessor *,
+                                     unsigned int packets_per_period);
+
+        /**
+         * @brief the iso side figures of the handler of this stream
+         * @param max_lateness_usecs the largest wake-up lateness of the handler since it was started
+         * @param max_iterate_nsecs the longest iterate() of the handler since it was started
+         * @param dropped_cycles the number of cycles the handler dropped
+         * @return false if the stream has no handler
+         */
+        bool getIsoStatsForStream(Streaming::StreamProcessor *, int &max_lateness_usecs,
+                                  int &max_iterate_nsecs, unsigned int &dropped_cycles);
+
         /**
          * Enables the isohandler manager to ignore missed packets.  This
          * behaviour is needed by some interfaces which don't send empty
@@ -377,6 +421,7 @@ class IsoHandlerManager
 
     private:
         IsoHandler * getHandlerForStream(Streaming::StreamProcessor *stream);
+        int getIrqIntervalForPeriod(unsigned int packets_per_period, int buffers);
         void requestShadowMapUpdate();
     public:
         Ieee1394Service& get1394Service() {return m_service;};
@@ -414,6 +459,10 @@ class IsoHandlerManager
         bool unregisterHandler(IsoHandler *);
         void pruneHandlers();
 
+        // derives the SCHED_DEADLINE parameters of the iso threads
+        // from the interrupt intervals of the handlers
+        void updateThreadDeadlines();
+
         // the collection of streams
         Streaming::StreamProcessorVector m_StreamProcessors;
 
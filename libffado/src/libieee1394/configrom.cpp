@@ -34,9 +34,12 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <inttypes.h>
 
 #include <iostream>
 #include <iomanip>
+#include <map>
 
 using namespace std;
 
@@ -58,11 +61,67 @@ static struct csr1212_bus_ops configrom_csr1212_ops = {
     getMaxRom
 };
 
+// the bus info block of the general config rom format
+#define CONFIGROM_BUS_INFO_QUADS    5
+#define CONFIGROM_IMAGE_QUADS       (CSR1212_CONFIG_ROM_SPACE_SIZE / 4)
+
+// (part of) the config rom of a node, in bus order
+struct config_rom_image {
+    fb_quadlet_t data[CONFIGROM_IMAGE_QUADS];
+    bool         valid[CONFIGROM_IMAGE_QUADS];
+};
+
 struct config_csr_info {
     Ieee1394Service* service;
     fb_nodeid_t      nodeId;
+    // the reads are served from here when possible
+    struct config_rom_image* image;
 };
 
+#if IEEE1394SERVICE_CONFIGROM_CACHE
+// the config roms read so far, by GUID. shared by all ports.
+typedef std::map<fb_octlet_t, struct config_rom_image> config_rom_cache_t;
+static config_rom_cache_t config_rom_cache;
+static pthread_mutex_t config_rom_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static bool
+imageGet( struct config_rom_image* image, u_int64_t addr,
+          unsigned int nb_quads, void* buffer )
+{
+    if ( addr < CSR1212_CONFIG_ROM_SPACE_BASE ) {
+        return false;
+    }
+    u_int64_t first = ( addr - CSR1212_CONFIG_ROM_SPACE_BASE ) / 4;
+    if ( first + nb_quads > CONFIGROM_IMAGE_QUADS ) {
+        return false;
+    }
+    for ( unsigned int i = 0; i < nb_quads; i++ ) {
+        if ( !image->valid[first + i] ) {
+            return false;
+        }
+    }
+    memcpy( buffer, &image->data[first], nb_quads * 4 );
+    return true;
+}
+
+static void
+imagePut( struct config_rom_image* image, u_int64_t addr,
+          unsigned int nb_quads, const void* buffer )
+{
+    if ( addr < CSR1212_CONFIG_ROM_SPACE_BASE ) {
+        return;
+    }
+    u_int64_t first = ( addr - CSR1212_CONFIG_ROM_SPACE_BASE ) / 4;
+    if ( first + nb_quads > CONFIGROM_IMAGE_QUADS ) {
+        return;
+    }
+    memcpy( &image->data[first], buffer, nb_quads * 4 );
+    for ( unsigned int i = 0; i < nb_quads; i++ ) {
+        image->valid[first + i] = true;
+    }
+}
+
 //-------------------------------------------------------------
 
 ConfigRom::ConfigRom( Ieee1394Service& ieee1394service, fb_nodeid_t nodeId )
@@ -83,6 +142,7 @@ ConfigRom::ConfigRom( Ieee1394Service& ieee1394service, fb_nodeid_t nodeId )
     , m_isBusManagerCapable( false )
     , m_cycleClkAcc( 0 )
     , m_maxRec( 0 )
+    , m_generation( 0 )
     , m_nodeVendorId( 0 )
     , m_chipIdHi( 0 )
     , m_chipIdLow( 0 )
@@ -110,6 +170,7 @@ ConfigRom::ConfigRom()
     , m_isBusManagerCapable( false )
     , m_cycleClkAcc( 0 )
     , m_maxRec( 0 )
+    , m_generation( 0 )
     , m_nodeVendorId( 0 )
     , m_chipIdHi( 0 )
     , m_chipIdLow( 0 )
@@ -139,9 +200,14 @@ ConfigRom::compareGUID( const ConfigRom& a, const ConfigRom& b ) {
 bool
 ConfigRom::initialize()
 {
+     struct config_rom_image image;
+     memset( &image, 0, sizeof( image ) );
+     loadRomImage( image );
+
      struct config_csr_info csr_info;
      csr_info.service = &m_1394Service;
      csr_info.nodeId = 0xffc0 | m_nodeId;
+     csr_info.image = &image;
 
      m_csr = csr1212_create_csr( &configrom_csr1212_ops,
                                  5 * sizeof(fb_quadlet_t),   // XXX Why 5 ?!?
@@ -162,6 +228,7 @@ ConfigRom::initialize()
     m_isBusManagerCapable = ( CSR1212_BE32_TO_CPU(m_csr->bus_info_data[2] ) >> 28 ) & 0x1;
     m_cycleClkAcc = ( CSR1212_BE32_TO_CPU(m_csr->bus_info_data[2] ) >> 16 ) & 0xff;
     m_maxRec = ( CSR1212_BE32_TO_CPU( m_csr->bus_info_data[2] ) >> 12 ) & 0xf;
+    m_generation = ( CSR1212_BE32_TO_CPU( m_csr->bus_info_data[2] ) >> 4 ) & 0xf;
     m_nodeVendorId = ( CSR1212_BE32_TO_CPU( m_csr->bus_info_data[3] ) >> 8 );
     m_chipIdHi = ( CSR1212_BE32_TO_CPU( m_csr->bus_info_data[3] ) ) & 0xff;
     m_chipIdLow = CSR1212_BE32_TO_CPU( m_csr->bus_info_data[4] );
@@ -211,6 +278,8 @@ ConfigRom::initialize()
     m_guid = ((u_int64_t)CSR1212_BE32_TO_CPU(m_csr->bus_info_data[3]) << 32)
              | CSR1212_BE32_TO_CPU(m_csr->bus_info_data[4]);
 
+    storeRomImage( image );
+
     if ( m_vendorNameKv ) {
         csr1212_release_keyval( m_vendorNameKv );
         m_vendorNameKv = 0;
@@ -235,6 +304,11 @@ busRead( struct csr1212_csr* csr,
 {
     struct config_csr_info* csr_info = (struct config_csr_info*) private_data;
 
+    if ( csr_info->image
+         && imageGet( csr_info->image, addr, length/4, buffer ) ) {
+        return 0;
+    }
+
     int nb_retries = 5;
 
     while ( nb_retries-- 
@@ -247,10 +321,102 @@ busRead( struct csr1212_csr* csr,
     }
     Util::SystemTimeSource::SleepUsecRelative(IEEE1394SERVICE_CONFIGROM_READ_WAIT_USECS);
 
-    if (nb_retries > -1) return 0; // success
+    if (nb_retries > -1) {
+        if ( csr_info->image ) {
+            imagePut( csr_info->image, addr, length/4, buffer );
+        }
+        return 0; // success
+    }
     else return -1; // failure
 }
 
+bool
+ConfigRom::loadRomImage( struct config_rom_image& image )
+{
+    fb_nodeid_t nodeId = 0xffc0 | m_nodeId;
+
+    // like csr1212, read the bus info block one quadlet at a time since
+    // not all devices support block reads on it
+    for ( int i = 0; i < CONFIGROM_BUS_INFO_QUADS; i++ ) {
+        if ( !m_1394Service.read_quadlet( nodeId,
+                                          CSR1212_CONFIG_ROM_SPACE_BASE + i * 4,
+                                          &image.data[i] ) ) {
+            // leave it to csr1212, which retries
+            debugOutput( DEBUG_LEVEL_VERBOSE,
+                         "Could not read bus info block of node %d\n", m_nodeId );
+            return false;
+        }
+        image.valid[i] = true;
+    }
+
+#if IEEE1394SERVICE_CONFIGROM_CACHE
+    // the bus info block contains the CRC and the generation of the rom,
+    // if it didn't change the rom didn't either.
+    fb_octlet_t guid = ((u_int64_t)CSR1212_BE32_TO_CPU(image.data[3]) << 32)
+                       | CSR1212_BE32_TO_CPU(image.data[4]);
+    pthread_mutex_lock( &config_rom_cache_lock );
+    config_rom_cache_t::iterator it = config_rom_cache.find( guid );
+    if ( it != config_rom_cache.end()
+         && memcmp( it->second.data, image.data,
+                    CONFIGROM_BUS_INFO_QUADS * sizeof( fb_quadlet_t ) ) == 0 ) {
+        image = it->second;
+        pthread_mutex_unlock( &config_rom_cache_lock );
+        debugOutput( DEBUG_LEVEL_VERBOSE,
+                     "Using cached config rom for node %d (GUID 0x%016" PRIX64 ")\n",
+                     m_nodeId, guid );
+        return true;
+    }
+    pthread_mutex_unlock( &config_rom_cache_lock );
+#endif
+
+    // read the rest of the rom with block reads. the rom length is taken
+    // from the crc_length in quadlet 0, which can be short of the actual
+    // rom when the CRC only covers the bus info block. csr1212 reads what
+    // is missing quadlet by quadlet, as it does when a node doesn't
+    // support block reads.
+    unsigned int rom_quads = 1 + ( ( CSR1212_BE32_TO_CPU( image.data[0] ) >> 16 ) & 0xff );
+    if ( rom_quads > CONFIGROM_IMAGE_QUADS ) {
+        rom_quads = CONFIGROM_IMAGE_QUADS;
+    }
+    unsigned int max_rec = ( CSR1212_BE32_TO_CPU( image.data[2] ) >> 12 ) & 0xf;
+    unsigned int block_quads = ( 1 << ( max_rec + 1 ) ) / 4;
+    if ( block_quads > IEEE1394SERVICE_CONFIGROM_BLOCK_READ_QUADS ) {
+        block_quads = IEEE1394SERVICE_CONFIGROM_BLOCK_READ_QUADS;
+    }
+    if ( block_quads < 2 ) {
+        return false;
+    }
+    for ( unsigned int q = CONFIGROM_BUS_INFO_QUADS; q < rom_quads; q += block_quads ) {
+        unsigned int nb_quads = rom_quads - q;
+        if ( nb_quads > block_quads ) {
+            nb_quads = block_quads;
+        }
+        if ( !m_1394Service.read( nodeId,
+                                  CSR1212_CONFIG_ROM_SPACE_BASE + q * 4,
+                                  nb_quads, &image.data[q] ) ) {
+            debugOutput( DEBUG_LEVEL_VERBOSE,
+                         "Block read of config rom of node %d failed at quadlet %u\n",
+                         m_nodeId, q );
+            break;
+        }
+        for ( unsigned int i = 0; i < nb_quads; i++ ) {
+            image.valid[q + i] = true;
+        }
+        Util::SystemTimeSource::SleepUsecRelative(IEEE1394SERVICE_CONFIGROM_READ_WAIT_USECS);
+    }
+    return false;
+}
+
+void
+ConfigRom::storeRomImage( const struct config_rom_image& image )
+{
+#if IEEE1394SERVICE_CONFIGROM_CACHE
+    pthread_mutex_lock( &config_rom_cache_lock );
+    config_rom_cache[m_guid] = image;
+    pthread_mutex_unlock( &config_rom_cache_lock );
+#endif
+}
+
 static int
 getMaxRom( u_int32_t* bus_info_data,
            void* /*private_data*/)
@@ -523,6 +689,28 @@ ConfigRom::getUnitVersion() const
     return m_unit_version;
 }
 
+bool
+ConfigRom::readGuidAndGeneration( Ieee1394Service& service,
+                                  fb_nodeid_t nodeId,
+                                  fb_octlet_t& guid,
+                                  fb_byte_t& generation )
+{
+    // quadlets 2 to 4 of the bus info block contain the generation and the GUID
+    fb_quadlet_t bus_info[3];
+    for ( int i = 0; i < 3; i++ ) {
+        if ( !service.read_quadlet( 0xffc0 | nodeId,
+                                    CSR1212_CONFIG_ROM_SPACE_BASE + ( i + 2 ) * sizeof( fb_quadlet_t ),
+                                    &bus_info[i] ) ) {
+            return false;
+        }
+    }
+
+    generation = ( CSR1212_BE32_TO_CPU( bus_info[0] ) >> 4 ) & 0xf;
+    guid = ((u_int64_t)CSR1212_BE32_TO_CPU(bus_info[1]) << 32)
+           | CSR1212_BE32_TO_CPU(bus_info[2]);
+    return true;
+}
+
 bool
 ConfigRom::updatedNodeId()
 {
@@ -530,32 +718,30 @@ ConfigRom::updatedNodeId()
                  "Checking for updated node id for device with GUID 0x%016" PRIX64 "...\n",
                  getGuid());
 
-    struct csr1212_csr* csr = NULL;
-    for ( fb_nodeid_t nodeId = 0;
-          nodeId < m_1394Service.getNodeCount();
-          ++nodeId )
+    // most of the time a device keeps its node id, hence look there first
+    fb_nodeid_t nodeCount = m_1394Service.getNodeCount();
+    fb_nodeid_t oldNodeId = getNodeId();
+    for ( int i = -1; i < (int)nodeCount; i++ )
     {
-        struct config_csr_info csr_info;
-        csr_info.service = &m_1394Service;
-        csr_info.nodeId = 0xffc0 | nodeId;
-        debugOutput( DEBUG_LEVEL_VERBOSE, "Looking at node %d...\n", nodeId);
-
-        csr = csr1212_create_csr( &configrom_csr1212_ops,
-                                  5 * sizeof(fb_quadlet_t),   // XXX Why 5 ?!?
-                                  &csr_info );
-
-        if (!csr || csr1212_parse_csr( csr ) != CSR1212_SUCCESS) {
-            debugWarning( "Failed to get/parse CSR\n");
-            if (csr) {
-                csr1212_destroy_csr(csr);
-                csr = NULL;
+        fb_nodeid_t nodeId;
+        if ( i < 0 ) {
+            if ( oldNodeId >= nodeCount ) {
+                continue;
             }
+            nodeId = oldNodeId;
+        } else if ( (fb_nodeid_t)i == oldNodeId ) {
             continue;
+        } else {
+            nodeId = i;
         }
+        debugOutput( DEBUG_LEVEL_VERBOSE, "Looking at node %d...\n", nodeId);
 
-        octlet_t guid =
-            ((u_int64_t)CSR1212_BE32_TO_CPU(csr->bus_info_data[3]) << 32)
-            | CSR1212_BE32_TO_CPU(csr->bus_info_data[4]);
+        fb_octlet_t guid;
+        fb_byte_t generation;
+        if ( !readGuidAndGeneration( m_1394Service, nodeId, guid, generation ) ) {
+            debugWarning( "Failed to read bus info block of node %d\n", nodeId );
+            continue;
+        }
 
         debugOutput( DEBUG_LEVEL_VERBOSE,
                         " Node has GUID 0x%016" PRIX64 "\n",
@@ -577,18 +763,15 @@ ConfigRom::updatedNodeId()
                              getGuid(),
                              getNodeId());
             }
-            if (csr) {
-                csr1212_destroy_csr(csr);
-                csr = NULL;
+            if ( generation != m_generation ) {
+                debugOutput( DEBUG_LEVEL_VERBOSE,
+                             "Config rom generation changed from %d to %d\n",
+                             m_generation, generation );
             }
             return true;
         }
     }
 
-    if (csr) {
-        csr1212_destroy_csr(csr);
-    }
-
     debugOutput( DEBUG_LEVEL_VERBOSE,
                  "Device with GUID 0x%016" PRIX64 " could not be found on "
                  "the bus anymore (removed?)\n",
@@ -37,6 +37,7 @@
 #include <string>
 
 class Ieee1394Service;
+struct config_rom_image;
 
 class ConfigRom
     : public Control::Element
@@ -75,6 +76,9 @@ class ConfigRom
         { return m_cycleClkAcc; }
     fb_byte_t getMaxRec() const
         { return m_maxRec; }
+    /// generation of the config rom contents, changes when the contents change
+    fb_byte_t getGeneration() const
+        { return m_generation; }
     unsigned short getAsyMaxPayload() const;
 
     fb_quadlet_t getNodeVendorId() const
@@ -82,6 +86,24 @@ class ConfigRom
 
     bool updatedNodeId();
     bool setNodeId( fb_nodeid_t nodeId );
+
+    /**
+     * @brief Reads the GUID and config rom generation of a node
+     *
+     * This only reads the relevant quadlets of the bus info block, which
+     * is a lot cheaper than parsing the complete config rom. It allows
+     * to check whether a node still is the device we know.
+     *
+     * @param service the service of the port the node is on
+     * @param nodeId the node to read from
+     * @param guid will contain the GUID of the node
+     * @param generation will contain the config rom generation
+     * @return true if successful
+     */
+    static bool readGuidAndGeneration( Ieee1394Service& service,
+                                       fb_nodeid_t nodeId,
+                                       fb_octlet_t& guid,
+                                       fb_byte_t& generation );
     
     /**
      * @brief Compares the GUID of two ConfigRom's
@@ -121,6 +143,9 @@ class ConfigRom
 
     void processRootDirectory( struct csr1212_csr* csr );
 
+    bool loadRomImage( struct config_rom_image& image );
+    void storeRomImage( const struct config_rom_image& image );
+
     Ieee1394Service& m_1394Service;
     fb_nodeid_t      m_nodeId;
     bool             m_avcDevice;
@@ -137,6 +162,7 @@ class ConfigRom
     bool             m_isBusManagerCapable;
     fb_byte_t        m_cycleClkAcc;
     fb_byte_t        m_maxRec;
+    fb_byte_t        m_generation;
     fb_quadlet_t     m_nodeVendorId;
     fb_byte_t        m_chipIdHi;
     fb_quadlet_t     m_chipIdLow;
@@ -81,6 +81,10 @@ Ieee1394Service::Ieee1394Service()
     , m_have_new_ctr_read ( false )
     , m_filterFCPResponse ( false )
     , m_pWatchdog ( new Util::Watchdog() )
+    , m_fcp_listeners( 0 )
+    , m_fcp_cache_sessions( 0 )
+    , m_fcp_cache_hits( 0 )
+    , m_fcp_cache_misses( 0 )
 {
     for (unsigned int i=0; i<64; i++) {
         m_channels[i].channel=-1;
@@ -91,6 +95,11 @@ Ieee1394Service::Ieee1394Service()
         m_channels[i].recv_node=0xFFFF;
         m_channels[i].recv_plug=-1;
     }
+    m_channels_local_node_id = INVALID_NODE_ID;
+    for (unsigned int i=0; i<MAX_FCP_NODES; i++) {
+        memset(&m_fcp_blocks[i], 0, sizeof(m_fcp_blocks[i]));
+        m_fcp_locks[i] = new Util::PosixMutex("FCPBLK");
+    }
 }
 
 Ieee1394Service::Ieee1394Service(bool rt, int prio)
@@ -111,6 +120,10 @@ Ieee1394Service::Ieee1394Service(bool rt, int prio)
     , m_have_new_ctr_read ( false )
     , m_filterFCPResponse ( false )
     , m_pWatchdog ( new Util::Watchdog() )
+    , m_fcp_listeners( 0 )
+    , m_fcp_cache_sessions( 0 )
+    , m_fcp_cache_hits( 0 )
+    , m_fcp_cache_misses( 0 )
 {
     for (unsigned int i=0; i<64; i++) {
         m_channels[i].channel=-1;
@@ -121,6 +134,11 @@ Ieee1394Service::Ieee1394Service(bool rt, int prio)
         m_channels[i].recv_node=0xFFFF;
         m_channels[i].recv_plug=-1;
     }
+    m_channels_local_node_id = INVALID_NODE_ID;
+    for (unsigned int i=0; i<MAX_FCP_NODES; i++) {
+        memset(&m_fcp_blocks[i], 0, sizeof(m_fcp_blocks[i]));
+        m_fcp_locks[i] = new Util::PosixMutex("FCPBLK");
+    }
 }
 
 Ieee1394Service::~Ieee1394Service()
@@ -128,9 +146,10 @@ Ieee1394Service::~Ieee1394Service()
     delete m_pIsoManager;
     delete m_pCTRHelper;
 
-    m_resetHelper->Stop();
-    m_armHelperNormal->Stop();
-    m_armHelperRealtime->Stop();
+    // the helpers only exist when the service has been initialized
+    if(m_resetHelper) m_resetHelper->Stop();
+    if(m_armHelperNormal) m_armHelperNormal->Stop();
+    if(m_armHelperRealtime) m_armHelperRealtime->Stop();
 
     for ( arm_handler_vec_t::iterator it = m_armHandlers.begin();
           it != m_armHandlers.end();
@@ -153,6 +172,9 @@ Ieee1394Service::~Ieee1394Service()
         raw1394_destroy_handle( m_handle );
     }
     delete m_handle_lock;
+    for (unsigned int i=0; i<MAX_FCP_NODES; i++) {
+        delete m_fcp_locks[i];
+    }
 
     if(m_resetHelper) delete m_resetHelper;
     if(m_armHelperNormal) delete m_armHelperNormal;
@@ -481,6 +503,10 @@ Ieee1394Service::getNodeCount()
 
 nodeid_t Ieee1394Service::getLocalNodeId() {
     Util::MutexLockHelper lock(*m_handle_lock);
+    if (m_handle == NULL) {
+        // not attached to a port, e.g. when replaying a capture
+        return 0x3F;
+    }
     return raw1394_get_local_id(m_handle) & 0x3F;
 }
 
@@ -643,6 +669,8 @@ Ieee1394Service::write( fb_nodeid_t nodeId,
                         fb_quadlet_t* data )
 {
     Util::MutexLockHelper lock(*m_handle_lock);
+    // the write might change what the node responds to inquiries
+    fcpCacheInvalidateNode(nodeId);
     return writeNoLock(nodeId, addr, length, data);
 }
 
@@ -714,6 +742,7 @@ Ieee1394Service::lockCompareSwap64( fb_nodeid_t nodeId,
     // do separate locking here (no MutexLockHelper) since 
     // we use read_octlet in the DEBUG code in this function
     m_handle_lock->Lock();
+    fcpCacheInvalidateNode(nodeId);
     int retval=raw1394_lock64(m_handle, nodeId, addr,
                               RAW1394_EXTCODE_COMPARE_SWAP,
                               swap_value, compare_value, result);
@@ -748,26 +777,33 @@ Ieee1394Service::transactionBlock( fb_nodeid_t nodeId,
         return NULL;
     }
     // NOTE: this expects a call to transactionBlockClose to unlock
-    m_handle_lock->Lock();
+    m_fcp_locks[nodeId & 0x3F]->Lock();
+    struct sFcpBlock &b = m_fcp_blocks[nodeId & 0x3F];
 
     // clear the request & response memory
-    memset(&m_fcp_block, 0, sizeof(m_fcp_block));
+    memset(&b, 0, sizeof(b));
 
     // make a local copy of the request
     if(len < MAX_FCP_BLOCK_SIZE_QUADS) {
-        memcpy(m_fcp_block.request, buf, len*sizeof(quadlet_t));
-        m_fcp_block.request_length = len;
+        memcpy(b.request, buf, len*sizeof(quadlet_t));
+        b.request_length = len;
     } else {
         debugWarning("Truncating FCP request\n");
-        memcpy(m_fcp_block.request, buf, MAX_FCP_BLOCK_SIZE_BYTES);
-        m_fcp_block.request_length = MAX_FCP_BLOCK_SIZE_QUADS;
+        memcpy(b.request, buf, MAX_FCP_BLOCK_SIZE_BYTES);
+        b.request_length = MAX_FCP_BLOCK_SIZE_QUADS;
     }
-    m_fcp_block.target_nodeid = 0xffc0 | nodeId;
+    b.target_nodeid = 0xffc0 | nodeId;
 
-    bool success = doFcpTransaction();
+    bool success = fcpCacheLookup(b);
+    if(!success) {
+        success = doFcpTransaction(b);
+        if(success) {
+            fcpCacheStore(b);
+        }
+    }
     if(success) {
-        *resp_len = m_fcp_block.response_length;
-        return m_fcp_block.response;
+        *resp_len = b.response_length;
+        return b.response;
     } else {
         debugWarning("FCP transaction failed\n");
         *resp_len = 0;
@@ -776,18 +812,18 @@ Ieee1394Service::transactionBlock( fb_nodeid_t nodeId,
 }
 
 bool
-Ieee1394Service::transactionBlockClose()
+Ieee1394Service::transactionBlockClose( fb_nodeid_t nodeId )
 {
-    m_handle_lock->Unlock();
+    m_fcp_locks[nodeId & 0x3F]->Unlock();
     return true;
 }
 
 // FCP code
 bool
-Ieee1394Service::doFcpTransaction()
+Ieee1394Service::doFcpTransaction(struct sFcpBlock &b)
 {
     for(int i=0; i < IEEE1394SERVICE_FCP_MAX_TRIES; i++) {
-        if(doFcpTransactionTry()) {
+        if(doFcpTransactionTry(b)) {
             return true;
         } else {
             debugOutput(DEBUG_LEVEL_VERBOSE, "FCP transaction try %d failed\n", i);
@@ -801,6 +837,10 @@ Ieee1394Service::doFcpTransaction()
 #define FCP_COMMAND_ADDR   0xFFFFF0000B00ULL
 #define FCP_RESPONSE_ADDR  0xFFFFF0000D00ULL
 
+/* AV/C FCP command types */
+#define FCP_CTYPE_STATUS 0x01000000
+#define FCP_CTYPE_SPECIFIC_INQUIRY 0x02000000
+
 /* AV/C FCP response codes */
 #define FCP_RESPONSE_NOT_IMPLEMENTED 0x08000000
 #define FCP_RESPONSE_ACCEPTED 0x09000000
@@ -825,82 +865,118 @@ Ieee1394Service::doFcpTransaction()
 #define FCP_MASK_RESPONSE_OPERAND(x, n) ((x) & (0xFF000000 >> (((n)%4)*8)))
 
 bool
-Ieee1394Service::doFcpTransactionTry()
+Ieee1394Service::doFcpTransactionTry(struct sFcpBlock &b)
 {
-    // NOTE that access to this is protected by the m_handle lock
+    // NOTE: the m_handle lock is only held while accessing the handle,
+    //       such that other nodes can be served while we wait
     int err;
     bool retval = true;
-    uint64_t timeout;
+    enum eFcpStatus status;
+
+    m_handle_lock->Lock();
 
     // prepare an fcp response handler
     raw1394_set_fcp_handler(m_handle, _avc_fcp_handler);
 
     // start listening for FCP requests
     // this fails if some other program is listening for a FCP response
-    err = raw1394_start_fcp_listen(m_handle);
-    if(err) {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "could not start FCP listen (err=%d, errno=%d)\n", err, errno);
-        retval = false;
-        goto out;
+    if(m_fcp_listeners == 0) {
+        err = raw1394_start_fcp_listen(m_handle);
+        if(err) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "could not start FCP listen (err=%d, errno=%d)\n", err, errno);
+            m_handle_lock->Unlock();
+            return false;
+        }
     }
+    m_fcp_listeners++;
 
-    m_fcp_block.status = eFS_Waiting;
+    b.status = eFS_Waiting;
 
     #ifdef DEBUG
     debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"fcp request: node 0x%hX, length = %d bytes\n",
-                m_fcp_block.target_nodeid, m_fcp_block.request_length*4);
-    printBuffer(DEBUG_LEVEL_VERY_VERBOSE, m_fcp_block.request_length, m_fcp_block.request );
+                b.target_nodeid, b.request_length*4);
+    printBuffer(DEBUG_LEVEL_VERY_VERBOSE, b.request_length, b.request );
     #endif
 
     // write the FCP request
-    if(!writeNoLock( m_fcp_block.target_nodeid, FCP_COMMAND_ADDR,
-                     m_fcp_block.request_length, m_fcp_block.request)) {
+    if(!writeNoLock( b.target_nodeid, FCP_COMMAND_ADDR,
+                     b.request_length, b.request)) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "write of FCP request failed\n");
         retval = false;
         goto out;
     }
+    m_handle_lock->Unlock();
 
     // wait for the response to arrive
-    struct pollfd raw1394_poll;
-    raw1394_poll.fd = raw1394_get_fd(m_handle);
-    raw1394_poll.events = POLLIN;
+    status = waitForFcpResponse(b, Util::SystemTimeSource::getCurrentTimeAsUsecs() +
+                                   IEEE1394SERVICE_FCP_RESPONSE_TIMEOUT_USEC);
 
-    timeout = Util::SystemTimeSource::getCurrentTimeAsUsecs() +
-              IEEE1394SERVICE_FCP_RESPONSE_TIMEOUT_USEC;
-
-    while(m_fcp_block.status == eFS_Waiting 
-          && Util::SystemTimeSource::getCurrentTimeAsUsecs() < timeout) {
-        if(poll( &raw1394_poll, 1, IEEE1394SERVICE_FCP_POLL_TIMEOUT_MSEC) > 0) {
-            if (raw1394_poll.revents & POLLIN) {
-                raw1394_loop_iterate(m_handle);
-            }
-        }
-    }
+    m_handle_lock->Lock();
 
     // check the request and figure out what happened
-    if(m_fcp_block.status == eFS_Waiting) {
+    if(status == eFS_Waiting) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response timed out\n");
         retval = false;
         goto out;
     }
-    if(m_fcp_block.status == eFS_Error) {
+    if(status == eFS_Error) {
         debugError("FCP request/response error\n");
         retval = false;
         goto out;
     }
 
 out:
-    // stop listening for FCP responses
-    err = raw1394_stop_fcp_listen(m_handle);
-    if(err) {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "could not stop FCP listen (err=%d, errno=%d)\n", err, errno);
-        retval = false;
+    // stop listening for FCP responses once nobody waits anymore
+    if(--m_fcp_listeners == 0) {
+        err = raw1394_stop_fcp_listen(m_handle);
+        if(err) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "could not stop FCP listen (err=%d, errno=%d)\n", err, errno);
+            retval = false;
+        }
     }
 
-    m_fcp_block.status = eFS_Empty;
+    b.status = eFS_Empty;
+    m_handle_lock->Unlock();
     return retval;
 }
 
+/**
+ * Wait for the response to the request in block b. Any waiting thread
+ * can pick up responses from the handle, they are delivered to the
+ * block of the node that sent them.
+ *
+ * @return the final status of the block, eFS_Waiting on timeout
+ */
+enum Ieee1394Service::eFcpStatus
+Ieee1394Service::waitForFcpResponse(struct sFcpBlock &b, uint64_t timeout)
+{
+    struct pollfd raw1394_poll;
+    raw1394_poll.fd = raw1394_get_fd(m_handle);
+    raw1394_poll.events = POLLIN;
+
+    enum eFcpStatus status = eFS_Waiting;
+    while(true) {
+        if(poll( &raw1394_poll, 1, IEEE1394SERVICE_FCP_POLL_TIMEOUT_MSEC) > 0
+           && (raw1394_poll.revents & POLLIN)) {
+            m_handle_lock->Lock();
+            // someone else might have handled the event in the meantime,
+            // and raw1394_loop_iterate blocks when there is nothing to read
+            if(poll( &raw1394_poll, 1, 0) > 0 && (raw1394_poll.revents & POLLIN)) {
+                raw1394_loop_iterate(m_handle);
+            }
+            status = b.status;
+            m_handle_lock->Unlock();
+        } else {
+            Util::MutexLockHelper lock(*m_handle_lock);
+            status = b.status;
+        }
+        if(status != eFS_Waiting
+           || Util::SystemTimeSource::getCurrentTimeAsUsecs() >= timeout) {
+            return status;
+        }
+    }
+}
+
 int
 Ieee1394Service::_avc_fcp_handler(raw1394handle_t handle, nodeid_t nodeid, 
                                   int response, size_t length,
@@ -937,10 +1013,15 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
         if(FCP_MASK_RESPONSE(first_quadlet) == FCP_RESPONSE_INTERIM) {
             debugOutput(DEBUG_LEVEL_VERBOSE, "INTERIM\n");
         } else {
-            // it's an actual response, check if it matches our request
-            if(nodeid != m_fcp_block.target_nodeid) {
+            // it's an actual response, check if it matches the request
+            // that is pending for the node that sent it
+            struct sFcpBlock &b = m_fcp_blocks[nodeid & 0x3F];
+            if(b.status != eFS_Waiting) {
+                debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response from node 0x%hX without pending request\n",
+                                                 nodeid);
+            } else if(nodeid != b.target_nodeid) {
                 debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response node id's don't match! (%x, %x)\n",
-                                                 m_fcp_block.target_nodeid, nodeid);
+                                                 b.target_nodeid, nodeid);
             } else if (first_quadlet == 0) {
                 debugWarning("Bogus FCP response\n");
                 printBuffer(DEBUG_LEVEL_WARNING, (length+3)/4, data_quads );
@@ -950,10 +1031,10 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
                 printBuffer(DEBUG_LEVEL_WARNING, (length+3)/4, data_quads );
 #endif
             } else if(FCP_MASK_SUBUNIT_AND_OPCODE(first_quadlet) 
-                      != FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(m_fcp_block.request[0]))) {
+                      != FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(b.request[0]))) {
                 debugOutput(DEBUG_LEVEL_VERBOSE, "FCP response not for this request: %08X != %08X\n",
                              FCP_MASK_SUBUNIT_AND_OPCODE(first_quadlet),
-                             FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(m_fcp_block.request[0])));
+                             FCP_MASK_SUBUNIT_AND_OPCODE(CondSwapFromBus32(b.request[0])));
             } else if(m_filterFCPResponse && (memcmp(fcp_block_last.response, data, length) == 0)) {
                 // This is workaround for the Edirol FA-101. The device tends to send more than
                 // one responde to one request. This seems to happen when discovering 
@@ -964,18 +1045,135 @@ Ieee1394Service::handleFcpResponse(nodeid_t nodeid,
                 // the same FCP twice.
                 debugWarning("Received duplicate FCP response. Ignore it\n");
             } else {
-                m_fcp_block.response_length = (length + sizeof(quadlet_t) - 1) / sizeof(quadlet_t);
-                memcpy(m_fcp_block.response, data, length);
+                b.response_length = (length + sizeof(quadlet_t) - 1) / sizeof(quadlet_t);
+                memcpy(b.response, data, length);
                 if (m_filterFCPResponse) {
                     memcpy(fcp_block_last.response, data, length);
                 }
-                m_fcp_block.status = eFS_Responded;
+                b.status = eFS_Responded;
             }
        }
     }
     return 0;
 }
 
+// FCP response cache
+void
+Ieee1394Service::openFcpCacheSession()
+{
+    #if IEEE1394SERVICE_FCP_USE_RESPONSE_CACHE
+    Util::MutexLockHelper lock(*m_handle_lock);
+    if (m_fcp_cache_sessions++ == 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Start caching FCP responses\n");
+        m_fcp_cache.clear();
+    }
+    #endif
+}
+
+void
+Ieee1394Service::closeFcpCacheSession()
+{
+    #if IEEE1394SERVICE_FCP_USE_RESPONSE_CACHE
+    Util::MutexLockHelper lock(*m_handle_lock);
+    if (m_fcp_cache_sessions == 0) {
+        debugWarning("No FCP cache session open\n");
+        return;
+    }
+    if (--m_fcp_cache_sessions == 0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE,
+                    "Stop caching FCP responses: %zd entries, %u transactions saved, %u sent\n",
+                    m_fcp_cache.size(), m_fcp_cache_hits, m_fcp_cache_misses);
+        m_fcp_cache.clear();
+    }
+    #endif
+}
+
+/**
+ * Only STATUS and SPECIFIC INQUIRY commands have responses that don't
+ * depend on (and don't change) the device state.
+ */
+bool
+Ieee1394Service::fcpCacheIsCacheable(struct sFcpBlock &b)
+{
+    quadlet_t first_quadlet = CondSwapFromBus32(b.request[0]);
+    quadlet_t ctype = FCP_MASK_CTYPE(first_quadlet);
+    return ctype == FCP_CTYPE_STATUS
+           || ctype == FCP_CTYPE_SPECIFIC_INQUIRY;
+}
+
+std::string
+Ieee1394Service::fcpCacheKey(struct sFcpBlock &b)
+{
+    std::string key((char *)&b.target_nodeid, sizeof(b.target_nodeid));
+    key.append((char *)b.request, b.request_length * sizeof(quadlet_t));
+    return key;
+}
+
+bool
+Ieee1394Service::fcpCacheLookup(struct sFcpBlock &b)
+{
+    Util::MutexLockHelper lock(*m_handle_lock);
+    if (m_fcp_cache_sessions == 0) {
+        return false;
+    }
+    if (!fcpCacheIsCacheable(b)) {
+        // a control command can change the answers to inquiries
+        fcpCacheInvalidateNode(b.target_nodeid);
+        return false;
+    }
+
+    fcp_cache_map_t::iterator it = m_fcp_cache.find(fcpCacheKey(b));
+    if (it == m_fcp_cache.end()) {
+        m_fcp_cache_misses++;
+        return false;
+    }
+
+    std::vector<quadlet_t> &response = it->second;
+    b.response_length = response.size();
+    memcpy(b.response, &response[0], response.size() * sizeof(quadlet_t));
+    m_fcp_cache_hits++;
+    debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "FCP response for node 0x%hX from cache\n",
+                b.target_nodeid);
+    return true;
+}
+
+void
+Ieee1394Service::fcpCacheStore(struct sFcpBlock &b)
+{
+    Util::MutexLockHelper lock(*m_handle_lock);
+    if (m_fcp_cache_sessions == 0 || !fcpCacheIsCacheable(b)) {
+        return;
+    }
+    // only remember definitive answers
+    quadlet_t response = FCP_MASK_RESPONSE(CondSwapFromBus32(b.response[0]));
+    if (response != FCP_RESPONSE_IMPLEMENTED
+        && response != FCP_RESPONSE_NOT_IMPLEMENTED
+        && response != FCP_RESPONSE_REJECTED) {
+        return;
+    }
+    m_fcp_cache[fcpCacheKey(b)].assign(b.response,
+                                       b.response + b.response_length);
+}
+
+void
+Ieee1394Service::fcpCacheInvalidateNode(fb_nodeid_t nodeId)
+{
+    if (m_fcp_cache.empty()) {
+        return;
+    }
+    nodeid_t target = 0xffc0 | (nodeId & 0x3f);
+    std::string prefix((char *)&target, sizeof(target));
+
+    fcp_cache_map_t::iterator it = m_fcp_cache.begin();
+    while (it != m_fcp_cache.end()) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            m_fcp_cache.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
 bool
 Ieee1394Service::setSplitTimeoutUsecs(fb_nodeid_t nodeId, unsigned int timeout)
 {
@@ -1100,6 +1298,8 @@ Ieee1394Service::resetHandler( unsigned int generation )
 
     m_handle_lock->Lock();
     raw1394_update_generation(m_handle, generation);
+    // node id's might have changed
+    m_fcp_cache.clear();
     m_handle_lock->Unlock();
 
     // do a simple read on ourself in order to update the internal structures
@@ -1309,9 +1509,11 @@ Ieee1394Service::remBusResetHandler( Util::Functor* functor )
  * bug or it's omitted since that's the channel preferred by video devices.
  *
  * @param bandwidth the bandwidth to allocate for this channel
+ * @param node the node of the device that uses the channel. A bus reset
+ *             that loses the channel only affects the streams of that device.
  * @return the channel number
  */
-signed int Ieee1394Service::allocateIsoChannelGeneric(unsigned int bandwidth) {
+signed int Ieee1394Service::allocateIsoChannelGeneric(unsigned int bandwidth, nodeid_t node) {
     debugOutput(DEBUG_LEVEL_VERBOSE, "Allocating ISO channel using generic method...\n" );
 
     Util::MutexLockHelper lock(*m_handle_lock);
@@ -1338,6 +1540,7 @@ signed int Ieee1394Service::allocateIsoChannelGeneric(unsigned int bandwidth) {
             cinfo.xmit_plug=-1;
             cinfo.recv_node=-1;
             cinfo.recv_plug=-1;
+            cinfo.node=node;
 
             if (registerIsoChannel(c, cinfo)) {
                 return c;
@@ -1366,10 +1569,11 @@ signed int Ieee1394Service::allocateIsoChannelGeneric(unsigned int bandwidth) {
  *
  * @chan the channel number being requested
  * @param bandwidth the bandwidth to allocate for this channel
+ * @param node the node of the device that uses the channel
  * @return the channel number
  */
 signed int Ieee1394Service::allocateFixedIsoChannelGeneric(
-    unsigned int chan, unsigned int bandwidth
+    unsigned int chan, unsigned int bandwidth, nodeid_t node
     ) {
     debugOutput(DEBUG_LEVEL_VERBOSE, "Allocating ISO channel %d using generic method...\n", chan );
 
@@ -1391,6 +1595,7 @@ signed int Ieee1394Service::allocateFixedIsoChannelGeneric(
             cinfo.xmit_plug=-1;
             cinfo.recv_node=-1;
             cinfo.recv_plug=-1;
+            cinfo.node=node;
 
             if (registerIsoChannel(chan, cinfo)) {
                 return chan;
@@ -1472,6 +1677,7 @@ signed int Ieee1394Service::allocateIsoChannelCMP(
     cinfo.xmit_plug=xmit_plug;
     cinfo.recv_node=recv_node;
     cinfo.recv_plug=recv_plug;
+    cinfo.node=INVALID_NODE_ID;
 
     if (registerIsoChannel(c, cinfo)) {
         return c;
@@ -1547,6 +1753,115 @@ bool Ieee1394Service::freeIsoChannel(signed int c) {
     return false;
 }
 
+fb_nodeid_t
+Ieee1394Service::mapNodeId(const std::map<fb_nodeid_t, fb_nodeid_t> &node_map, fb_nodeid_t node)
+{
+    std::map<fb_nodeid_t, fb_nodeid_t>::const_iterator it = node_map.find(node & 0x3F);
+    if (it == node_map.end()) {
+        return node;
+    }
+    if (it->second == INVALID_NODE_ID) {
+        return INVALID_NODE_ID;
+    }
+    return (node & 0xFFC0) | it->second;
+}
+
+bool
+Ieee1394Service::isoChannelsSurvived(const std::map<fb_nodeid_t, fb_nodeid_t> &node_map,
+                                     const std::set<fb_nodeid_t> &failed_nodes,
+                                     fb_nodeid_t node)
+{
+    if (mapNodeId(node_map, node) == INVALID_NODE_ID) {
+        // removed from the bus
+        return false;
+    }
+    if (failed_nodes.find(INVALID_NODE_ID) != failed_nodes.end()) {
+        // we don't know whose channel was lost
+        return false;
+    }
+    return failed_nodes.find(node & 0x3F) == failed_nodes.end();
+}
+
+bool Ieee1394Service::restoreIsoChannels(const std::map<fb_nodeid_t, fb_nodeid_t> &node_map,
+                                         std::set<fb_nodeid_t> &failed_nodes) {
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Restoring ISO channels after bus reset...\n" );
+    Util::MutexLockHelper lock(*m_handle_lock);
+
+    // the local node can have moved too
+    std::map<fb_nodeid_t, fb_nodeid_t> node_ids = node_map;
+    fb_nodeid_t local_node_id = raw1394_get_local_id(m_handle) & 0x3F;
+    if (m_channels_local_node_id != INVALID_NODE_ID) {
+        node_ids[m_channels_local_node_id] = local_node_id;
+    }
+    m_channels_local_node_id = local_node_id;
+
+    bool retval = true;
+    for (unsigned int c = 0; c < 63; c++) {
+        struct ChannelInfo &cinfo = m_channels[c];
+        switch (cinfo.alloctype) {
+            default:
+            case AllocFree:
+                break;
+
+            case AllocGeneric:
+                if (cinfo.node != INVALID_NODE_ID
+                    && mapNodeId(node_ids, cinfo.node) == INVALID_NODE_ID) {
+                    // the IRM has forgotten the allocation already
+                    debugOutput(DEBUG_LEVEL_VERBOSE, " channel %d: node left the bus\n", c );
+                    unregisterIsoChannel(c);
+                    break;
+                }
+                debugOutput(DEBUG_LEVEL_VERBOSE, " reallocating channel %d with %d bandwidth units...\n",
+                            c, cinfo.bandwidth );
+                if (raw1394_channel_modify (m_handle, c, RAW1394_MODIFY_ALLOC) != 0) {
+                    debugWarning("Could not reallocate channel %d\n", c);
+                    failed_nodes.insert(cinfo.node == INVALID_NODE_ID ? INVALID_NODE_ID : (cinfo.node & 0x3F));
+                    unregisterIsoChannel(c);
+                    retval = false;
+                } else if (raw1394_bandwidth_modify(m_handle, cinfo.bandwidth, RAW1394_MODIFY_ALLOC) < 0) {
+                    debugWarning("Could not reallocate bandwidth of %d for channel %d\n", cinfo.bandwidth, c);
+                    failed_nodes.insert(cinfo.node == INVALID_NODE_ID ? INVALID_NODE_ID : (cinfo.node & 0x3F));
+                    raw1394_channel_modify (m_handle, c, RAW1394_MODIFY_FREE);
+                    unregisterIsoChannel(c);
+                    retval = false;
+                } else if (cinfo.node != INVALID_NODE_ID) {
+                    cinfo.node = mapNodeId(node_ids, cinfo.node);
+                }
+                break;
+
+            case AllocCMP:
+                {
+                    nodeid_t xmit_node = mapNodeId(node_ids, cinfo.xmit_node);
+                    nodeid_t recv_node = mapNodeId(node_ids, cinfo.recv_node);
+                    if (xmit_node == INVALID_NODE_ID || recv_node == INVALID_NODE_ID) {
+                        debugOutput(DEBUG_LEVEL_VERBOSE, " channel %d: node left the bus\n", c );
+                        unregisterIsoChannel(c);
+                        break;
+                    }
+                    debugOutput(DEBUG_LEVEL_VERBOSE, " reconnecting channel %d from %04X:%02d to %04X:%02d...\n",
+                                c, xmit_node, cinfo.xmit_plug, recv_node, cinfo.recv_plug );
+                    int bandwidth = cinfo.bandwidth;
+                    if (iec61883_cmp_reconnect(m_handle,
+                                               xmit_node | 0xffc0, &cinfo.xmit_plug,
+                                               recv_node | 0xffc0, &cinfo.recv_plug,
+                                               &bandwidth, c) < 0) {
+                        debugWarning("Could not do CMP reconnect for channel %d\n", c);
+                        // one of both is the local node, no device has its id
+                        failed_nodes.insert(cinfo.xmit_node & 0x3F);
+                        failed_nodes.insert(cinfo.recv_node & 0x3F);
+                        unregisterIsoChannel(c);
+                        retval = false;
+                        break;
+                    }
+                    cinfo.xmit_node = xmit_node;
+                    cinfo.recv_node = recv_node;
+                }
+                break;
+        }
+    }
+    return retval;
+}
+
 /**
  * Registers a channel as managed by this ieee1394service
  * @param c channel number
@@ -1561,6 +1876,7 @@ bool Ieee1394Service::registerIsoChannel(unsigned int c, struct ChannelInfo cinf
         }
 
         memcpy(&m_channels[c], &cinfo, sizeof(struct ChannelInfo));
+        m_channels_local_node_id = raw1394_get_local_id(m_handle) & 0x3F;
 
     } else return false;
     return true;
@@ -1638,6 +1954,8 @@ Ieee1394Service::show()
                 (unsigned int)TICKS_TO_SECS( ctr ),
                 (unsigned int)TICKS_TO_CYCLES( ctr ),
                 (unsigned int)TICKS_TO_OFFSET( ctr ) );
+    debugOutput( DEBUG_LEVEL_VERBOSE, " FCP cache: %u transactions saved, %u sent\n",
+                 m_fcp_cache_hits, m_fcp_cache_misses );
     debugOutputShort( DEBUG_LEVEL_NORMAL, "Iso handler info:\n");
     #endif
     if (m_pIsoManager) m_pIsoManager->dumpInfo();
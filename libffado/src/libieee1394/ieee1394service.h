@@ -39,11 +39,14 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <set>
 #include <stdint.h>
 
 
 #define MAX_FCP_BLOCK_SIZE_BYTES (512)
 #define MAX_FCP_BLOCK_SIZE_QUADS (MAX_FCP_BLOCK_SIZE_BYTES / 4)
+#define MAX_FCP_NODES (64)
 
 class IsoHandlerManager;
 class CycleTimerHelper;
@@ -243,6 +246,12 @@ public:
 
     /**
      * initiate AV/C transaction
+     *
+     * Transactions to different nodes can be in progress at the same
+     * time, transactions to the same node are serialized. The returned
+     * response buffer stays valid until transactionBlockClose() is called
+     * for the same node.
+     *
      * @param nodeId 
      * @param buf 
      * @param len 
@@ -256,13 +265,10 @@ public:
 
     /**
      * close AV/C transaction.
-     * @param nodeId 
-     * @param buf 
-     * @param len 
-     * @param resp_len 
+     * @param nodeId node the transaction was initiated for
      * @return 
      */
-    bool transactionBlockClose();
+    bool transactionBlockClose( fb_nodeid_t nodeId );
 
     int getVerboseLevel();
 
@@ -355,16 +361,94 @@ public:
      */
     void setFCPResponseFiltering(bool enable);
 
+    /**
+     * @brief open a FCP response cache session
+     *
+     * While at least one session is open, the responses to STATUS and
+     * SPECIFIC INQUIRY commands are remembered per node and request,
+     * and an identical request is answered from the cache instead of
+     * being sent again. Any other command or an async write to a node
+     * drops the cached responses of that node, a bus reset drops all of
+     * them. The cache is emptied when the last session is closed.
+     *
+     * This is meant for device discovery, which issues the same inquiries
+     * many times.
+     */
+    void openFcpCacheSession();
+    void closeFcpCacheSession();
+
+    /// FCP transactions answered from the cache
+    unsigned int getFcpCacheHits() {return m_fcp_cache_hits;};
+    /// cacheable FCP transactions that had to go to the bus
+    unsigned int getFcpCacheMisses() {return m_fcp_cache_misses;};
+
+    /**
+     * @brief helper to keep a FCP cache session open within a scope
+     */
+    class FcpCacheSession
+    {
+    public:
+        FcpCacheSession(Ieee1394Service &s) : m_service(s)
+            {m_service.openFcpCacheSession();};
+        ~FcpCacheSession()
+            {m_service.closeFcpCacheSession();};
+    private:
+        Ieee1394Service &m_service;
+    };
+
 // ISO channel stuff
 public:
     signed int getAvailableBandwidth();
-    signed int allocateIsoChannelGeneric(unsigned int bandwidth);
+    signed int allocateIsoChannelGeneric(unsigned int bandwidth,
+                                         nodeid_t node = INVALID_NODE_ID);
     signed int allocateFixedIsoChannelGeneric(
-        unsigned int chan, unsigned int bandwidth);
+        unsigned int chan, unsigned int bandwidth,
+        nodeid_t node = INVALID_NODE_ID);
     signed int allocateIsoChannelCMP(nodeid_t xmit_node, int xmit_plug,
                                      nodeid_t recv_node, int recv_plug);
     bool freeIsoChannel(signed int channel);
 
+    /**
+     * @brief re-establish the iso channels managed by this service after a bus reset
+     *
+     * The IRM forgets about all channel and bandwidth allocations on a bus
+     * reset, and the owner of a point-to-point connection has to restore it
+     * within one second. Channels that can't be restored are unregistered.
+     * The channels of a node that left the bus are dropped, that is not
+     * a failure.
+     *
+     * @param node_map maps the node id's from before the bus reset to the
+     *                 current ones. Nodes that left the bus map to
+     *                 INVALID_NODE_ID, nodes that are not in the map are
+     *                 assumed to have kept their id. The local node is
+     *                 taken care of internally.
+     * @param failed_nodes is filled with the node id's (from before the bus
+     *                     reset) of the devices that lost a channel.
+     *                     INVALID_NODE_ID means that a channel of unknown
+     *                     use was lost.
+     * @return true if all channels of the nodes that are still on the bus
+     *         were restored
+     */
+    bool restoreIsoChannels(const std::map<fb_nodeid_t, fb_nodeid_t> &node_map,
+                            std::set<fb_nodeid_t> &failed_nodes);
+    /**
+     * @brief whether the iso channels of a node are still usable after a bus reset
+     * @param node_map the node map that was passed to restoreIsoChannels()
+     * @param failed_nodes the failed nodes restoreIsoChannels() returned
+     * @param node the node id from before the bus reset
+     * @return false if the node left the bus, or if a channel it uses
+     *         (or one of unknown use) was lost
+     */
+    static bool isoChannelsSurvived(const std::map<fb_nodeid_t, fb_nodeid_t> &node_map,
+                                    const std::set<fb_nodeid_t> &failed_nodes,
+                                    fb_nodeid_t node);
+    /**
+     * @brief translate a node id (including the bus id) with a bus reset node map
+     * @return the new node id, INVALID_NODE_ID if the node left the bus
+     */
+    static fb_nodeid_t mapNodeId(const std::map<fb_nodeid_t, fb_nodeid_t> &node_map,
+                                 fb_nodeid_t node);
+
     IsoHandlerManager& getIsoHandlerManager() {return *m_pIsoManager;};
 private:
     enum EAllocType {
@@ -381,10 +465,14 @@ private:
         int xmit_plug;
         nodeid_t recv_node;
         int recv_plug;
+        // the node of the device that uses a generic channel
+        nodeid_t node;
     };
 
     // the info for the channels we manage
     struct ChannelInfo m_channels[64];
+    // the local node id the channel info refers to
+    fb_nodeid_t m_channels_local_node_id;
 
     bool unregisterIsoChannel(unsigned int c);
     bool registerIsoChannel(unsigned int c, struct ChannelInfo cinfo);
@@ -509,10 +597,32 @@ private: // unsorted
         unsigned int response_length;
         quadlet_t response[MAX_FCP_BLOCK_SIZE_QUADS];
     };
-    struct sFcpBlock m_fcp_block;
-
-    bool doFcpTransaction();
-    bool doFcpTransactionTry();
+    // one block per node, such that transactions to different nodes
+    // can run in parallel. the block of a node is owned by whoever holds
+    // its lock, except for the status and response that are written by
+    // the FCP handler under the m_handle lock.
+    struct sFcpBlock m_fcp_blocks[MAX_FCP_NODES];
+    Util::Mutex*     m_fcp_locks[MAX_FCP_NODES];
+    // nb of transactions listening for FCP responses, protected by the
+    // m_handle lock
+    int              m_fcp_listeners;
+
+    bool doFcpTransaction(struct sFcpBlock &b);
+    bool doFcpTransactionTry(struct sFcpBlock &b);
+    enum eFcpStatus waitForFcpResponse(struct sFcpBlock &b, uint64_t timeout);
+
+    // FCP response cache, protected by the m_handle lock
+    typedef std::map< std::string, std::vector<quadlet_t> > fcp_cache_map_t;
+    fcp_cache_map_t m_fcp_cache;
+    int             m_fcp_cache_sessions;
+    unsigned int    m_fcp_cache_hits;
+    unsigned int    m_fcp_cache_misses;
+
+    bool fcpCacheIsCacheable(struct sFcpBlock &b);
+    std::string fcpCacheKey(struct sFcpBlock &b);
+    bool fcpCacheLookup(struct sFcpBlock &b);
+    void fcpCacheStore(struct sFcpBlock &b);
+    void fcpCacheInvalidateNode(fb_nodeid_t nodeId);
 
 public:
     void setVerboseLevel(int l);
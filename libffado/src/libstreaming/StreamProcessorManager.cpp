@@ -26,7 +26,10 @@
 #include "StreamProcessorManager.h"
 #include "generic/StreamProcessor.h"
 #include "generic/Port.h"
+#include "generic/IsoStreamCapture.h"
+#include "generic/SampleConversion.h"
 #include "libieee1394/cycletimer.h"
+#include "libieee1394/IsoHandlerManager.h"
 
 #include "devicemanager.h"
 
@@ -35,6 +38,10 @@
 #include <errno.h>
 #include <assert.h>
 #include <math.h>
+#include <cstring>
+
+#include <vector>
+#include <algorithm>
 
 namespace Streaming {
 
@@ -50,6 +57,7 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p)
     , m_parent( p )
     , m_xrun_happened( false )
     , m_activity_wait_timeout_nsec( 0 ) // dynamically set
+    , m_client_faults( "Client thread" )
     , m_nb_buffers( 0 )
     , m_period( 0 )
     , m_sync_delay( 0 )
@@ -60,9 +68,18 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p)
     , m_nbperiods(0)
     , m_WaitLock( new Util::PosixMutex("SPMWAIT") )
     , m_max_diff_ticks( 50 ) 
+    , m_fast_xrun_resync( false )
+    , m_max_live_period_size( 0 )
+    , m_xmit_prebuffer_frames( 0 )
+    , m_time_of_wakeup( 0 )
+    , m_fast_start( false )
+    , m_last_start_usecs( 0 )
+    , m_PeriodChangeLock( new Util::PosixMutex("SPMPERIOD") )
+    , m_pending_period( 0 )
 {
     addOption(Util::OptionContainer::Option("slaveMode",false));
     sem_init(&m_activity_semaphore, 0, 0);
+    memset(&m_last_xrun_report, 0, sizeof(m_last_xrun_report));
 }
 
 StreamProcessorManager::StreamProcessorManager(DeviceManager &p, unsigned int period,
@@ -76,6 +93,7 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p, unsigned int pe
     , m_parent( p )
     , m_xrun_happened( false )
     , m_activity_wait_timeout_nsec( 0 ) // dynamically set
+    , m_client_faults( "Client thread" )
     , m_nb_buffers(nb_buffers)
     , m_period(period)
     , m_sync_delay( 0 )
@@ -86,15 +104,25 @@ StreamProcessorManager::StreamProcessorManager(DeviceManager &p, unsigned int pe
     , m_nbperiods(0)
     , m_WaitLock( new Util::PosixMutex("SPMWAIT") )
     , m_max_diff_ticks( 50 )
+    , m_fast_xrun_resync( false )
+    , m_max_live_period_size( 0 )
+    , m_xmit_prebuffer_frames( 0 )
+    , m_time_of_wakeup( 0 )
+    , m_fast_start( false )
+    , m_last_start_usecs( 0 )
+    , m_PeriodChangeLock( new Util::PosixMutex("SPMPERIOD") )
+    , m_pending_period( 0 )
 {
     addOption(Util::OptionContainer::Option("slaveMode",false));
     sem_init(&m_activity_semaphore, 0, 0);
+    memset(&m_last_xrun_report, 0, sizeof(m_last_xrun_report));
 }
 
 StreamProcessorManager::~StreamProcessorManager() {
     sem_post(&m_activity_semaphore);
     sem_destroy(&m_activity_semaphore);
     delete m_WaitLock;
+    delete m_PeriodChangeLock;
 }
 
 // void
@@ -357,7 +385,7 @@ bool StreamProcessorManager::streamingParamsOk(signed int period, signed int rat
     return true;
 }
 
-void StreamProcessorManager::setPeriodSize(unsigned int period) {
+bool StreamProcessorManager::setPeriodSize(unsigned int period) {
     // This method is called early in the initialisation sequence to set the
     // initial period size.  However, at that point in time the stream
     // processors haven't been registered so they won't have their buffers
@@ -368,8 +396,25 @@ void StreamProcessorManager::setPeriodSize(unsigned int period) {
     // if the change comes about due to a runtime change in the buffer size,
     // as happens via jack's setbufsize facility for example.
 
+    //
+    // While streaming, the change is done without stopping the streams, see
+    // requestPeriodSizeChange().
+
     if (period == m_period)
-        return;
+        return true;
+
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it )
+    {
+        if (!(*it)->isStopped()) return requestPeriodSizeChange(period);
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it )
+    {
+        if (!(*it)->isStopped()) return requestPeriodSizeChange(period);
+    }
 
     debugOutput( DEBUG_LEVEL_VERBOSE, "Setting period size to %d (was %d)\n", period, m_period);
     m_period = period;
@@ -396,6 +441,170 @@ void StreamProcessorManager::setPeriodSize(unsigned int period) {
         debugOutput(DEBUG_LEVEL_VERBOSE, "setting activity timeout to %d\n", timeout_usec);
         setActivityWaitTimeoutUsec(timeout_usec);
     }
+    return true;
+}
+
+/**
+ * @brief the smallest period size that can be set while streaming
+ *
+ * The ISO handlers are set up for this period size when the streams are
+ * registered, since their interrupt interval can't be changed while they
+ * run. Smaller period sizes require streaming to be restarted.
+ *
+ * @return the period size in frames
+ */
+unsigned int StreamProcessorManager::getMinLivePeriodSize() {
+    int min_live_period_size = STREAMPROCESSORMANAGER_MIN_LIVE_PERIOD_SIZE;
+    m_parent.getConfiguration().getValueForSetting("streaming.spm.min_live_period_size", min_live_period_size);
+    if (min_live_period_size <= 0 || (unsigned int)min_live_period_size > m_period) {
+        return m_period;
+    }
+    return min_live_period_size;
+}
+
+/**
+ * @brief Request a period size change while streaming
+ *
+ * The streams keep running, only the client side buffering changes. The
+ * new scratch buffers are allocated here, the switch itself is made by
+ * applyPeriodSizeChange() from the client thread, at the start of the
+ * next waitForPeriod(). Hence it never happens during a transfer(), and
+ * both directions switch at the same period boundary. The client gets
+ * periods of the new size from the next waitForPeriod() on.
+ *
+ * The transmit buffers are brought to the amount of frames they hold at
+ * start for the new period size (nb_buffers * period + prebuffer frames).
+ * Going to a larger period adds silence, going to a smaller one skips the
+ * frames in excess at the head of the buffers, such that the transmit
+ * latency goes down with the period.
+ *
+ * The ISO handlers keep the interrupt interval that they were set up with
+ * (see getMinLivePeriodSize()). A period size that needs more interrupts
+ * is refused.
+ *
+ * @param period the new period size
+ * @return true if the change will be made, false if the streams need to be restarted
+ */
+bool StreamProcessorManager::requestPeriodSizeChange(unsigned int period) {
+    debugOutput( DEBUG_LEVEL_VERBOSE, "Changing period size from %d to %d while streaming\n",
+                 m_period, period);
+    if (m_SyncSource == NULL) return false;
+    if (period > m_max_live_period_size) {
+        debugWarning("Period size %u is larger than %u, can't change it while streaming\n",
+                     period, m_max_live_period_size);
+        return false;
+    }
+
+    // the client thread doesn't touch the pending change meanwhile
+    Util::MutexLockHelper lock(*m_PeriodChangeLock);
+    m_pending_period = 0;
+
+    unsigned int old_period = m_period;
+    m_pending_silence_periods.assign(m_TransmitProcessors.size(), 0);
+    m_pending_xmit_extra_frames.assign(m_TransmitProcessors.size(), 0);
+    m_pending_xmit_skip_frames.assign(m_TransmitProcessors.size(), 0);
+    int i;
+
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it ) {
+        if (!(*it)->isRunning()) {
+            debugWarning("RECV SP %p is not running\n", *it);
+            return false;
+        }
+        if (!(*it)->preparePeriodSizeChange(period, (*it)->getExtraBufferFrames())) {
+            debugWarning("RECV SP %p can't change the period size\n", *it);
+            return false;
+        }
+    }
+    i = 0;
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it, ++i ) {
+        if (!(*it)->isRunning()) {
+            debugWarning("XMIT SP %p is not running\n", *it);
+            return false;
+        }
+        int extra = (*it)->getExtraBufferFrames();
+        extra += m_nb_buffers * old_period;
+        extra -= m_nb_buffers * period;
+        if (extra > (int)m_xmit_prebuffer_frames) {
+            // skip whole packets, such that the MIDI positions stay consistent
+            unsigned int frames_per_packet = (*it)->getNominalFramesPerPacket();
+            unsigned int skip = extra - m_xmit_prebuffer_frames;
+            skip -= skip % frames_per_packet;
+            m_pending_xmit_skip_frames[i] = skip;
+            extra -= skip;
+        }
+        while (extra < (int)m_xmit_prebuffer_frames) {
+            extra += old_period;
+            m_pending_silence_periods[i]++;
+        }
+        m_pending_xmit_extra_frames[i] = extra;
+        if (!(*it)->preparePeriodSizeChange(period, m_pending_xmit_extra_frames[i])) {
+            debugWarning("XMIT SP %p can't change the period size\n", *it);
+            return false;
+        }
+    }
+
+    m_pending_period = period;
+    return true;
+}
+
+/**
+ * @brief Switch to the requested period size
+ *
+ * Called by the client thread at a period boundary, with the wait lock
+ * held. No transfer() is running, and no frames of the next period have
+ * been transferred yet.
+ */
+void StreamProcessorManager::applyPeriodSizeChange() {
+    Util::MutexLockHelper lock(*m_PeriodChangeLock);
+    unsigned int period = m_pending_period;
+    if (period == 0) return;
+    m_pending_period = 0;
+
+    unsigned int old_period = m_period;
+    float rate = m_SyncSource->getTicksPerFrame();
+    int64_t old_period_ticks = (int64_t)(((float)old_period) * rate);
+
+    int i = 0;
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it, ++i ) {
+        // the silence continues the timeline of the old period size
+        ffado_timestamp_t ts_tail;
+        signed int fc;
+        (*it)->getBufferTailTimestamp(&ts_tail, &fc);
+        uint64_t ts = (uint64_t)ts_tail;
+        for (int j = 0; j < m_pending_silence_periods[i]; j++) {
+            ts = addTicks(ts, old_period_ticks);
+            if(!(*it)->putSilenceFrames(old_period, ts)) {
+                debugWarning("could not putSilenceFrames(%u,%" PRIu64 ") to stream processor (%p)\n",
+                             old_period, ts, *it);
+            }
+        }
+        // the next putFrames() is presented nb_buffers * period + extra
+        // frames after the transfer, the excess frames make room for it
+        if(m_pending_xmit_skip_frames[i] && !(*it)->skipFrames(m_pending_xmit_skip_frames[i])) {
+            debugWarning("could not skipFrames(%u) from stream processor (%p)\n",
+                         m_pending_xmit_skip_frames[i], *it);
+        }
+        (*it)->commitPeriodSizeChange(period, m_pending_xmit_extra_frames[i]);
+    }
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it ) {
+        (*it)->commitPeriodSizeChange(period, (*it)->getExtraBufferFrames());
+    }
+    m_period = period;
+    debugOutput( DEBUG_LEVEL_VERBOSE, "Period size now %u\n", m_period);
+
+    if (m_nominal_framerate > 0) {
+        int timeout_usec = 2*1000LL * 1000LL * m_period / m_nominal_framerate;
+        debugOutput(DEBUG_LEVEL_VERBOSE, "setting activity timeout to %d\n", timeout_usec);
+        setActivityWaitTimeoutUsec(timeout_usec);
+    }
 }
 
 bool StreamProcessorManager::setSyncSource(StreamProcessor *s) {
@@ -414,6 +623,18 @@ bool StreamProcessorManager::prepare() {
 
     m_shutdown_needed=false;
 
+    // the buffers of the SP's are allocated from locked memory
+    int rt_memory_hugepages = RTMEMORY_USE_HUGEPAGES;
+    m_parent.getConfiguration().getValueForSetting("streaming.spm.rt_memory_hugepages", rt_memory_hugepages);
+    Util::RtMemory::setUseHugePages(rt_memory_hugepages != 0);
+
+    int max_live_period_size = STREAMPROCESSORMANAGER_MAX_LIVE_PERIOD_SIZE;
+    m_parent.getConfiguration().getValueForSetting("streaming.spm.max_live_period_size", max_live_period_size);
+    m_max_live_period_size = (max_live_period_size > 0 ? max_live_period_size : 0);
+    if (m_max_live_period_size < m_period) {
+        m_max_live_period_size = m_period;
+    }
+
     // if no sync source is set, select one here
     if(m_SyncSource == NULL) {
        debugWarning("Sync Source is not set. Defaulting to first StreamProcessor.\n");
@@ -439,6 +660,10 @@ bool StreamProcessorManager::prepare() {
         }
     }
 
+    // let the SP DLL's adapt their bandwidth
+    int dll_adaptive = STREAMPROCESSOR_DLL_ADAPTIVE;
+    m_parent.getConfiguration().getValueForSetting("streaming.spm.dll_adaptive", dll_adaptive);
+
     // now do the actual preparation of the SP's
     debugOutput( DEBUG_LEVEL_VERBOSE, "Prepare Receive processors...\n");
     for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
@@ -448,6 +673,7 @@ bool StreamProcessorManager::prepare() {
         if(!(*it)->setOption("slaveMode", m_is_slave)) {
             debugOutput(DEBUG_LEVEL_VERBOSE, " note: could not set slaveMode option for (%p)...\n",(*it));
         }
+        (*it)->setDllAdaptive(dll_adaptive != 0);
 
         if(!(*it)->prepare()) {
             debugFatal(  " could not prepare (%p)...\n",(*it));
@@ -461,12 +687,37 @@ bool StreamProcessorManager::prepare() {
         if(!(*it)->setOption("slaveMode", m_is_slave)) {
             debugOutput(DEBUG_LEVEL_VERBOSE, " note: could not set slaveMode option for (%p)...\n",(*it));
         }
+        (*it)->setDllAdaptive(dll_adaptive != 0);
         if(!(*it)->prepare()) {
             debugFatal( " could not prepare (%p)...\n",(*it));
             return false;
         }
     }
 
+    // optionally record the received packets for offline replay
+    int capture_packets = STREAMPROCESSORMANAGER_CAPTURE_PACKETS;
+    Util::Configuration &config = m_parent.getConfiguration();
+    config.getValueForSetting("streaming.spm.capture_packets", capture_packets);
+    if (capture_packets > 0) {
+        for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+            it != m_ReceiveProcessors.end();
+            ++it ) {
+            if(!(*it)->enablePacketCapture(capture_packets)) {
+                debugWarning(" could not enable packet capture for (%p)\n", *it);
+            }
+        }
+    }
+
+    int fast_xrun_resync = STREAMPROCESSORMANAGER_FAST_XRUN_RESYNC;
+    config.getValueForSetting("streaming.spm.fast_xrun_resync", fast_xrun_resync);
+    m_fast_xrun_resync = (fast_xrun_resync != 0);
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Fast xrun resync: %s\n", (m_fast_xrun_resync ? "on" : "off"));
+
+    int fast_start = STREAMPROCESSORMANAGER_FAST_START;
+    config.getValueForSetting("streaming.spm.fast_start", fast_start);
+    m_fast_start = (fast_start != 0);
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Fast start: %s\n", (m_fast_start ? "on" : "off"));
+
     // if there are no stream processors registered,
     // fail
     if (m_ReceiveProcessors.size() + m_TransmitProcessors.size() == 0) {
@@ -565,6 +816,7 @@ StreamProcessorManager::startDryRunning()
 
 bool StreamProcessorManager::syncStartAll() {
     if(m_SyncSource == NULL) return false;
+    int64_t time_of_start = Util::SystemTimeSource::getCurrentTime();
 
     // get the options
     int signal_delay_ticks = STREAMPROCESSORMANAGER_SIGNAL_DELAY_TICKS;
@@ -581,6 +833,13 @@ bool StreamProcessorManager::syncStartAll() {
     config.getValueForSetting("streaming.spm.prestart_cycles_for_xmit", prestart_cycles_for_xmit);
     config.getValueForSetting("streaming.spm.prestart_cycles_for_recv", prestart_cycles_for_recv);
 
+    int dll_tolerance_ticks = STREAMPROCESSORMANAGER_FAST_START_DLL_TOLERANCE_TICKS;
+    int rate_tolerance_ppm = STREAMPROCESSORMANAGER_FAST_START_RATE_TOLERANCE_PPM;
+    int settle_periods = STREAMPROCESSORMANAGER_FAST_START_SETTLE_PERIODS;
+    config.getValueForSetting("streaming.spm.fast_start_dll_tolerance_ticks", dll_tolerance_ticks);
+    config.getValueForSetting("streaming.spm.fast_start_rate_tolerance_ppm", rate_tolerance_ppm);
+    config.getValueForSetting("streaming.spm.fast_start_settle_periods", settle_periods);
+
     // figure out when to get the SP's running.
     // the xmit SP's should also know the base timestamp
     // streams should be aligned here
@@ -623,11 +882,17 @@ bool StreamProcessorManager::syncStartAll() {
     // DLL to have a decent sync (FIXME: does the DLL get updated when dry-running)?
     debugOutput( DEBUG_LEVEL_VERBOSE, "Waiting for sync...\n");
 
+    // in fast start mode this is only the upper bound, we proceed as soon
+    // as the DLL's have settled
     unsigned int nb_sync_runs = (sync_wait_time_msec * getNominalRate());
     nb_sync_runs /= 1000;
     nb_sync_runs /= getPeriodSize();
 
-    while(nb_sync_runs--) { // or while not sync-ed?
+    unsigned int nb_sync_periods = 0;
+    int nb_settled_periods = 0;
+    float prev_tpf = m_SyncSource->getTicksPerFrame();
+
+    while(nb_sync_runs--) {
         // check if we were woken up too soon
         uint64_t ticks_at_period = m_SyncSource->getTimeAtPeriod();
         uint64_t ticks_at_period_margin = ticks_at_period + m_sync_delay;
@@ -646,6 +911,19 @@ bool StreamProcessorManager::syncStartAll() {
         now = Util::SystemTimeSource::getCurrentTime();
         debugOutputExtreme(DEBUG_LEVEL_VERBOSE, "POSTWAIT pred: %" PRId64 ", now: %" PRId64 ", excess: %" PRId64 "\n", pred_system_time_at_xfer, now, now-pred_system_time_at_xfer );
         #endif
+        nb_sync_periods++;
+
+        if(m_fast_start) {
+            if(dllsSettled(prev_tpf, dll_tolerance_ticks, rate_tolerance_ppm)) {
+                nb_settled_periods++;
+            } else {
+                nb_settled_periods = 0;
+            }
+            if(nb_settled_periods >= settle_periods) {
+                debugOutput( DEBUG_LEVEL_VERBOSE, " DLL's settled after %u periods\n", nb_sync_periods);
+                break;
+            }
+        }
     }
 
     debugOutput( DEBUG_LEVEL_VERBOSE, "Propagate sync info...\n");
@@ -730,6 +1008,7 @@ bool StreamProcessorManager::syncStartAll() {
                     xmit_prebuffer_frames, max_packet_size_frames, tmp);
         xmit_prebuffer_frames = tmp;
     }
+    m_xmit_prebuffer_frames = xmit_prebuffer_frames;
 
     // check if this can even work.
     // the worst case point where we can receive a period is at 1 period + sync delay
@@ -749,6 +1028,7 @@ bool StreamProcessorManager::syncStartAll() {
           ++it ) {
         // set the number of prebuffer frames
         (*it)->setExtraBufferFrames(xmit_prebuffer_frames);
+        (*it)->resetMeasuredLatency();
 
         // set the TSP of the first sample in the buffer
         (*it)->setBufferHeadTimestamp(time_of_first_sample);
@@ -773,6 +1053,7 @@ bool StreamProcessorManager::syncStartAll() {
           ++it ) {
         // set the number of extra buffer frames
         (*it)->setExtraBufferFrames(sync_delay_frames);
+        (*it)->resetMeasuredLatency();
     }
 
     // switch syncsource to running state
@@ -878,6 +1159,10 @@ bool StreamProcessorManager::syncStartAll() {
         return false;
     }
 
+    m_last_start_usecs = Util::SystemTimeSource::getCurrentTime() - time_of_start;
+    debugOutput( DEBUG_LEVEL_NORMAL, "Streams started in %" PRId64 " usecs (waited %u periods for sync)\n",
+                 m_last_start_usecs, nb_sync_periods);
+
     debugOutput( DEBUG_LEVEL_VERBOSE, " StreamProcessor streams running...\n");
     return true;
 }
@@ -889,6 +1174,7 @@ StreamProcessorManager::alignReceivedStreams()
     unsigned int nb_sync_runs;
     unsigned int nb_rcv_sp = m_ReceiveProcessors.size();
     int64_t diff_between_streams[nb_rcv_sp];
+    double diff_squared_sum[nb_rcv_sp];
     int64_t diff;
 
     unsigned int i;
@@ -899,14 +1185,26 @@ StreamProcessorManager::alignReceivedStreams()
     config.getValueForSetting("streaming.spm.align_tries", cnt);
     config.getValueForSetting("streaming.spm.align_average_time_msec", align_average_time_msec);
 
+    int offset_tolerance_ticks = STREAMPROCESSORMANAGER_FAST_START_OFFSET_TOLERANCE_TICKS;
+    int settle_periods = STREAMPROCESSORMANAGER_FAST_START_SETTLE_PERIODS;
+    config.getValueForSetting("streaming.spm.fast_start_offset_tolerance_ticks", offset_tolerance_ticks);
+    config.getValueForSetting("streaming.spm.fast_start_settle_periods", settle_periods);
+    if(settle_periods < 1) settle_periods = 1;
+
+    // in fast start mode this is only the upper bound, the averaging stops
+    // as soon as the offsets have settled
     unsigned int periods_per_align_try = (align_average_time_msec * getNominalRate());
     periods_per_align_try /= 1000;
     periods_per_align_try /= getPeriodSize();
+    if(periods_per_align_try == 0) periods_per_align_try = 1;
     debugOutput( DEBUG_LEVEL_VERBOSE, " averaging over %u periods...\n", periods_per_align_try);
 
+    unsigned int nb_align_periods = 0;
+    unsigned int nb_averaged;
     bool aligned = false;
     while (!aligned && cnt--) {
         nb_sync_runs = periods_per_align_try;
+        nb_averaged = 0;
         while(nb_sync_runs) {
             debugOutput( DEBUG_LEVEL_VERY_VERBOSE, " check (%d)...\n", nb_sync_runs);
             if(!waitForPeriod()) {
@@ -927,14 +1225,31 @@ StreamProcessorManager::alignReceivedStreams()
                 diff = diffTicks(m_SyncSource->getTimeAtPeriod(), s->getTimeAtPeriod());
                 debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "  offset between SyncSP %p and SP %p is %" PRId64 " ticks...\n", 
                     m_SyncSource, s, diff);
-                if ( nb_sync_runs == periods_per_align_try ) {
+                if ( nb_averaged == 0 ) {
                     diff_between_streams[i] = diff;
+                    diff_squared_sum[i] = (double)diff * (double)diff;
                 } else {
                     diff_between_streams[i] += diff;
+                    diff_squared_sum[i] += (double)diff * (double)diff;
                 }
             }
-
+            nb_averaged++;
+            nb_align_periods++;
             nb_sync_runs--;
+
+            // stop averaging when the variance of all offsets is small enough
+            if(m_fast_start && nb_averaged >= (unsigned int)settle_periods) {
+                bool settled = true;
+                for ( i = 0; i < nb_rcv_sp; i++) {
+                    double mean = (double)diff_between_streams[i] / nb_averaged;
+                    double variance = diff_squared_sum[i] / nb_averaged - mean * mean;
+                    settled &= (variance <= (double)offset_tolerance_ticks * offset_tolerance_ticks);
+                }
+                if(settled) {
+                    debugOutput( DEBUG_LEVEL_VERY_VERBOSE, " offsets settled after %u periods\n", nb_averaged);
+                    break;
+                }
+            }
         }
         // calculate the average offsets
         debugOutput( DEBUG_LEVEL_VERBOSE, " Average offsets:\n");
@@ -945,7 +1260,7 @@ StreamProcessorManager::alignReceivedStreams()
         for ( i = 0; i < nb_rcv_sp; i++) {
             StreamProcessor *s = m_ReceiveProcessors.at(i);
 
-            diff_between_streams[i] /= periods_per_align_try;
+            diff_between_streams[i] /= nb_averaged;
             diff_between_streams_frames[i] = (int)roundf(diff_between_streams[i] / s->getTicksPerFrame());
             debugOutput( DEBUG_LEVEL_VERBOSE, "   avg offset between SyncSP %p and SP %p is %" PRId64 " ticks, %d frames...\n", 
                 m_SyncSource, s, diff_between_streams[i], diff_between_streams_frames[i]);
@@ -994,11 +1309,49 @@ StreamProcessorManager::alignReceivedStreams()
         debugError("Align failed\n");
         return false;
     }
+    debugOutput( DEBUG_LEVEL_VERBOSE, " streams aligned after %u periods\n", nb_align_periods);
     return true;
 }
 
+/**
+ * @brief Check whether the DLL's of the receive SP's have settled
+ *
+ * Used by the fast start mode. The DLL's have settled when the last DLL
+ * error of all receive SP's is within the tolerance, and the sync source
+ * rate didn't change more than the given amount since the previous call.
+ *
+ * @param prev_tpf the sync source rate at the previous call, is updated
+ * @param max_dll_error the DLL error tolerance, in ticks
+ * @param max_rate_change_ppm the rate change tolerance, in ppm
+ * @return true if the DLL's have settled
+ */
+bool
+StreamProcessorManager::dllsSettled(float &prev_tpf, float max_dll_error, float max_rate_change_ppm)
+{
+    bool settled = true;
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it ) {
+        float err = (*it)->getDllError();
+        debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "  SP %p DLL error: %f ticks\n", *it, err);
+        settled &= (fabsf(err) <= max_dll_error);
+    }
+
+    float tpf = m_SyncSource->getTicksPerFrame();
+    if (tpf <= 0.0 || prev_tpf <= 0.0) {
+        settled = false;
+    } else {
+        float change_ppm = fabsf(tpf - prev_tpf) / prev_tpf * 1e6;
+        debugOutput( DEBUG_LEVEL_VERY_VERBOSE, "  sync source rate change: %f ppm\n", change_ppm);
+        settled &= (change_ppm <= max_rate_change_ppm);
+    }
+    prev_tpf = tpf;
+    return settled;
+}
+
 bool StreamProcessorManager::start() {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Starting Processors...\n");
+    m_client_faults.reset();
 
     // start all SP's synchonized
     bool start_result = false;
@@ -1036,6 +1389,13 @@ bool StreamProcessorManager::start() {
 bool StreamProcessorManager::stop() {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Stopping...\n");
 
+    // a pending period size change is dropped, the scratch buffers
+    // prepared for it are released by the next prepare or by the SP
+    {
+        Util::MutexLockHelper lock(*m_PeriodChangeLock);
+        m_pending_period = 0;
+    }
+
     debugOutput( DEBUG_LEVEL_VERBOSE, " scheduling stop for all SP's...\n");
     // switch SP's over to the dry-running state
     for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
@@ -1145,9 +1505,37 @@ bool StreamProcessorManager::stop() {
         return false;
     }
     debugOutput( DEBUG_LEVEL_VERBOSE, " Stopped...\n");
+    saveCaptures();
     return true;
 }
 
+/**
+ * @brief Save the packet captures of the receive SP's, if any
+ *
+ * The captures are written to STREAMPROCESSORMANAGER_CAPTURE_FILE_PREFIX-<n>.isocap
+ * with n the index of the receive SP.
+ */
+void StreamProcessorManager::saveCaptures() {
+    int idx = 0;
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it, ++idx ) {
+        IsoStreamCapture *capture = (*it)->getPacketCapture();
+        if (capture == NULL || capture->getNbPackets() == 0) continue;
+
+        char filename[256];
+        snprintf(filename, sizeof(filename), "%s-%d.isocap",
+                 STREAMPROCESSORMANAGER_CAPTURE_FILE_PREFIX, idx);
+        if (capture->save(filename)) {
+            debugOutput(DEBUG_LEVEL_NORMAL, "Saved %u packets of SP %p to %s (%u not recorded)\n",
+                        capture->getNbPackets(), *it, filename, capture->getNbOverflows());
+        } else {
+            debugWarning("Could not save packet capture of SP %p\n", *it);
+        }
+        capture->clear();
+    }
+}
+
 /**
  * Called upon Xrun events. This brings all StreamProcessors back
  * into their starting state, and then carries on streaming. This should
@@ -1161,6 +1549,14 @@ bool StreamProcessorManager::handleXrun() {
 
     dumpInfo();
 
+    if (m_fast_xrun_resync) {
+        if (resyncStreams()) {
+            debugOutput( DEBUG_LEVEL_VERBOSE, "Xrun handled by resyncing the streams...\n");
+            return true;
+        }
+        debugOutput( DEBUG_LEVEL_VERBOSE, "Could not resync, doing a full restart...\n");
+    }
+
     /*
      * Reset means:
      * 1) Disabling the SP's, so that they don't process any packets
@@ -1203,6 +1599,157 @@ bool StreamProcessorManager::handleXrun() {
     return true;
 }
 
+/**
+ * @brief Re-align the buffers of running streams after an xrun
+ *
+ * When the client was late, the SP's keep running (see
+ * StreamProcessor::skipLateFrames()). Their DLL's are still locked, only
+ * the buffer contents no longer match the period boundaries. This
+ * brings them back in line without stopping the streams:
+ *  - the periods that piled up in the receive buffers are dropped
+ *  - the periods that the client didn't provide are replaced by silence
+ *    in the transmit buffers, keeping their timestamps continuous
+ *
+ * Must be called from the client thread (i.e. the thread that reads the
+ * receive and writes the transmit buffers).
+ *
+ * @return true if successful, false if the streams need a full restart
+ */
+bool StreamProcessorManager::resyncStreams() {
+    if(m_SyncSource == NULL) return false;
+    // the transmit timestamps are derived from the receive side
+    if(m_SyncSource->getType() != StreamProcessor::ePT_Receive) return false;
+
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it ) {
+        if(!(*it)->isRunning() || (*it)->inError() || (*it)->xrunOccurred()) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, " RECV SP %p not running anymore\n", *it);
+            return false;
+        }
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it ) {
+        if(!(*it)->isRunning() || (*it)->inError()) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, " XMIT SP %p not running anymore\n", *it);
+            return false;
+        }
+    }
+
+    // drop the periods that the client didn't pick up. all receive SP's
+    // drop the same amount such that they stay aligned.
+    unsigned int excess = getResyncExcessFrames(m_SyncSource->getBufferFill(), m_period);
+    if (excess) {
+        for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+              it != m_ReceiveProcessors.end();
+              ++it ) {
+            if((*it)->getBufferFill() < (int)excess) {
+                debugOutput(DEBUG_LEVEL_VERBOSE, " RECV SP %p has only %d frames\n",
+                            *it, (*it)->getBufferFill());
+                return false;
+            }
+        }
+        for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+              it != m_ReceiveProcessors.end();
+              ++it ) {
+            if(!(*it)->dropFrames(excess, m_time_of_transfer)) {
+                debugWarning("could not dropFrames(%u) from stream processor (%p)\n",
+                             excess, *it);
+                return false;
+            }
+        }
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, " dropped %u receive frames\n", excess);
+
+    // the time of the transfer that will follow
+    uint64_t time_of_transfer = m_SyncSource->getTimeAtPeriod();
+    float rate = m_SyncSource->getTicksPerFrame();
+    int64_t period_ticks = (int64_t)(((float)m_period) * rate);
+
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it ) {
+        // the next transfer() puts its period at one ringbuffer after the
+        // time of transfer (see transfer()). the buffer tail should be
+        // one period before that.
+        unsigned int one_ringbuffer_in_frames = m_nb_buffers * m_period + (*it)->getExtraBufferFrames();
+        int64_t tail_delay_ticks = (int64_t)(((float)(one_ringbuffer_in_frames - m_period)) * rate);
+        uint64_t expected_tail = addTicks(time_of_transfer, tail_delay_ticks);
+
+        ffado_timestamp_t ts_tail;
+        signed int fc;
+        (*it)->getBufferTailTimestamp(&ts_tail, &fc);
+        int64_t gap_ticks = diffTicks(expected_tail, (uint64_t)ts_tail);
+        int64_t missing = getResyncMissingPeriods(gap_ticks, period_ticks);
+        debugOutput(DEBUG_LEVEL_VERBOSE, " XMIT SP %p misses %" PRId64 " periods (fc=%d)\n",
+                    *it, missing, fc);
+        if (missing < 0) {
+            // the client wrote more than expected, can't take it back
+            return false;
+        }
+        if (missing && !(*it)->canClientTransferFrames(missing * m_period)) {
+            return false;
+        }
+        // the late frames will be skipped by the SP, but they keep the
+        // buffer timestamps continuous
+        uint64_t ts = (uint64_t)ts_tail;
+        for (int64_t i = 0; i < missing; i++) {
+            ts = addTicks(ts, period_ticks);
+            if(!(*it)->putSilenceFrames(m_period, ts)) {
+                debugWarning("could not putSilenceFrames(%u,%" PRIu64 ") to stream processor (%p)\n",
+                             m_period, ts, *it);
+                return false;
+            }
+        }
+    }
+
+    // the xruns have been dealt with
+    for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+          it != m_ReceiveProcessors.end();
+          ++it ) {
+        (*it)->clearXrun();
+    }
+    for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+          it != m_TransmitProcessors.end();
+          ++it ) {
+        (*it)->clearXrun();
+    }
+    return true;
+}
+
+/**
+ * @brief The number of receive frames to drop when resyncing
+ *
+ * Whole periods are dropped, such that one period is left for the next
+ * transfer.
+ *
+ * @param fill the number of frames in the sync source buffer
+ * @param period the period size
+ * @return the number of frames to drop
+ */
+unsigned int StreamProcessorManager::getResyncExcessFrames(int fill, unsigned int period) {
+    if (fill <= (int)period) {
+        return 0;
+    }
+    return ((fill - period) / period) * period;
+}
+
+/**
+ * @brief The number of periods missing from a transmit buffer when resyncing
+ *
+ * @param gap_ticks the time between the buffer tail and where it should be
+ * @param period_ticks the duration of a period
+ * @return the number of periods to fill up, rounded to the nearest one.
+ *         negative when the buffer holds more than expected.
+ */
+int64_t StreamProcessorManager::getResyncMissingPeriods(int64_t gap_ticks, int64_t period_ticks) {
+    if (gap_ticks < 0) {
+        return -((-gap_ticks + period_ticks / 2) / period_ticks);
+    }
+    return (gap_ticks + period_ticks / 2) / period_ticks;
+}
+
 /**
  * @brief Waits until the next period of samples is ready
  *
@@ -1220,6 +1767,12 @@ bool StreamProcessorManager::waitForPeriod() {
     // grab the wait lock
     // this ensures that bus reset handling doesn't interfere
     Util::MutexLockHelper lock(*m_WaitLock);
+
+    // the previous period has been transferred, so this is where the
+    // period size can change
+    if (m_pending_period) {
+        applyPeriodSizeChange();
+    }
     debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
                         "waiting for period (%d frames in buffer)...\n",
                         m_SyncSource->getBufferFill());
@@ -1426,20 +1979,158 @@ bool StreamProcessorManager::waitForPeriod() {
         }
     }
     #endif
-    m_nbperiods++;
 
     // this is to notify the client of the delay that we introduced by waiting
     pred_system_time_at_xfer = m_SyncSource->getParent().get1394Service().getSystemTimeForCycleTimerTicks(m_time_of_transfer);
 
     m_delayed_usecs = Util::SystemTimeSource::getCurrentTime() - pred_system_time_at_xfer;
+    // the reference for the latency measurement
+    m_time_of_wakeup = m_SyncSource->getParent().get1394Service().getCycleTimerTicks();
     debugOutputExtreme(DEBUG_LEVEL_VERBOSE,
                         "delayed for %d usecs...\n",
                         m_delayed_usecs);
 
+    // the report includes the delay of this wake-up
+    if(xrun_occurred) {
+        reportXrun();
+    }
+    m_nbperiods++;
+    m_client_faults.sample();
+
     // now we can signal the client that we are (should be) ready
     return !xrun_occurred;
 }
 
+/**
+ * @brief Find the stream that flagged an xrun first
+ *
+ * Updates the culprit, cause and cycle of the report if one of the
+ * streams flagged its xrun before the current culprit did.
+ */
+void StreamProcessorManager::findXrunCulprit(StreamProcessorVector &sps,
+                                             struct sXrunReport &r) {
+    for ( StreamProcessorVectorIterator it = sps.begin();
+          it != sps.end();
+          ++it ) {
+        StreamProcessor *sp = *it;
+        if (!sp->xrunOccurred()) continue;
+        uint32_t cycle;
+        enum StreamProcessor::eXrunCause cause = sp->getXrunCause(cycle);
+        if (cause == StreamProcessor::eXC_None) continue;
+        bool first;
+        if (r.culprit == NULL) {
+            first = true;
+        } else if (r.cycle == 0xFFFFFFFF) {
+            // bus resets and dead handlers take precedence
+            first = false;
+        } else if (cycle == 0xFFFFFFFF) {
+            first = true;
+        } else {
+            first = diffCycles(cycle, r.cycle) < 0;
+        }
+        if (first) {
+            r.culprit = sp;
+            r.cause = cause;
+            r.cycle = cycle;
+        }
+    }
+}
+
+/**
+ * @brief Determine the root cause of an xrun and report it
+ *
+ * The stream that flagged an xrun on the iso side first is the culprit.
+ * If none did, a receive stream that doesn't have its period yet points
+ * at the device, a transmit stream whose buffer wasn't emptied points at
+ * the iso side.
+ *
+ * @note called from waitForPeriod() with the wait lock held
+ */
+void StreamProcessorManager::reportXrun() {
+    struct sXrunReport r;
+    memset(&r, 0, sizeof(r));
+    r.count = ++m_xruns;
+    r.period = m_nbperiods;
+    r.phase = eXP_None;
+    r.culprit = NULL;
+    r.cause = StreamProcessor::eXC_None;
+    r.cycle = 0xFFFFFFFF;
+    r.delayed_usecs = m_delayed_usecs;
+
+    findXrunCulprit(m_ReceiveProcessors, r);
+    findXrunCulprit(m_TransmitProcessors, r);
+
+    if (r.culprit) {
+        switch (r.cause) {
+            case StreamProcessor::eXC_DroppedCycles:
+            case StreamProcessor::eXC_HandlerDied:
+                r.phase = eXP_KernelLate;
+                break;
+            case StreamProcessor::eXC_BusReset:
+                r.phase = eXP_DeviceLate;
+                break;
+            case StreamProcessor::eXC_BufferFull:
+            case StreamProcessor::eXC_BufferEmpty:
+            case StreamProcessor::eXC_FramesLate:
+                r.phase = eXP_ClientLate;
+                break;
+            default:
+                break;
+        }
+    } else {
+        for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
+              it != m_ReceiveProcessors.end() && r.culprit == NULL;
+              ++it ) {
+            if (!(*it)->canConsumePeriod()) {
+                r.culprit = *it;
+                r.phase = eXP_DeviceLate;
+            }
+        }
+        for ( StreamProcessorVectorIterator it = m_TransmitProcessors.begin();
+              it != m_TransmitProcessors.end() && r.culprit == NULL;
+              ++it ) {
+            if (!(*it)->canProducePeriod()) {
+                r.culprit = *it;
+                r.phase = eXP_KernelLate;
+            }
+        }
+    }
+
+    if (r.culprit) {
+        IsoHandlerManager &ihm = r.culprit->getParent().get1394Service().getIsoHandlerManager();
+        if (!ihm.getIsoStatsForStream(r.culprit, r.max_lateness_usecs,
+                                      r.max_iterate_nsecs, r.dropped_cycles)) {
+            r.dropped_cycles = r.culprit->getDroppedCycles();
+        }
+        StreamStatistics &packet_data = r.culprit->getPacketDataStatistics();
+        r.max_packet_data_nsecs = (packet_data.m_count ? (int)packet_data.m_max : 0);
+    }
+    m_last_xrun_report = r;
+
+    debugOutput(DEBUG_LEVEL_NORMAL,
+                "Xrun %u at period %u: %s (%s SP %p, %s at cycle %d)\n",
+                r.count, r.period, eXPToString(r.phase),
+                (r.culprit ? r.culprit->getTypeString() : "no"), r.culprit,
+                (r.culprit ? r.culprit->eXCToString(r.cause) : "unknown cause"),
+                (r.cycle == 0xFFFFFFFF ? -1 : (int)r.cycle));
+    debugOutput(DEBUG_LEVEL_NORMAL,
+                " dropped cycles: %u, max lateness: %d us, max iterate: %d ns, "
+                "max packet data: %d ns, client delay: %d us\n",
+                r.dropped_cycles, r.max_lateness_usecs, r.max_iterate_nsecs,
+                r.max_packet_data_nsecs, r.delayed_usecs);
+}
+
+const char *
+StreamProcessorManager::eXPToString(enum eXrunPhase p) {
+    switch (p) {
+        case eXP_None: return "unknown";
+        case eXP_KernelLate: return "kernel late";
+        case eXP_ClientLate: return "client late";
+        case eXP_DeviceLate: return "device late";
+        default: return "error: unknown phase";
+    }
+}
+
 /**
  * @brief Transfer one period of frames for both receive and transmit StreamProcessors
  *
@@ -1479,6 +2170,7 @@ bool StreamProcessorManager::transfer(enum StreamProcessor::eProcessorType t) {
         for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
                 it != m_ReceiveProcessors.end();
                 ++it ) {
+            (*it)->updateMeasuredLatency(m_time_of_wakeup);
             if(!(*it)->getFrames(m_period, m_time_of_transfer)) {
                     debugWarning("could not getFrames(%u, %11" PRIu64 ") from stream processor (%p)\n",
                             m_period, m_time_of_transfer,*it);
@@ -1506,6 +2198,8 @@ bool StreamProcessorManager::transfer(enum StreamProcessor::eProcessorType t) {
                 debugWarning("could not putFrames(%u,%" PRIu64 ") to stream processor (%p)\n",
                         m_period, transmit_timestamp, *it);
                 retval &= false; // buffer underrun
+            } else {
+                (*it)->updateMeasuredLatency(m_time_of_wakeup);
             }
         }
     }
@@ -1590,11 +2284,201 @@ bool StreamProcessorManager::transferSilence(enum StreamProcessor::eProcessorTyp
     return retval;
 }
 
+static const char *
+audioDataTypeToString(enum StreamProcessorManager::eADT_AudioDataType t)
+{
+    switch(t) {
+        case StreamProcessorManager::eADT_Int24: return "int24";
+        case StreamProcessorManager::eADT_Float: return "float";
+        case StreamProcessorManager::eADT_Int32: return "int32";
+        case StreamProcessorManager::eADT_Int16: return "int16";
+        case StreamProcessorManager::eADT_Float64: return "float64";
+        default: return "invalid";
+    }
+}
+
+/**
+ * @brief Measure the round trip latency using a loopback connection
+ *
+ * Sends impulses on the playback port and detects them on the capture
+ * port. The two have to be connected by a (physical) loopback cable.
+ * The difference between the measured round trip latency and the
+ * nominal latencies of the two port groups is the latency of the device
+ * itself (converters, internal routing). It is split evenly over both
+ * port groups, see StreamProcessor::setLatencyCorrection().
+ *
+ * This runs the client side of the streaming loop for a while, so it
+ * has to be called from the client thread after the streams are
+ * started, and not concurrently with waitForPeriod()/transfer(). All
+ * other ports are disabled meanwhile, the buffers and the enable state
+ * of the ports are restored afterwards.
+ *
+ * @param capture the capture port
+ * @param playback the playback port
+ * @param nb_impulses the number of impulses to measure
+ * @return true if successful
+ */
+bool
+StreamProcessorManager::calibrateLatency(Port *capture, Port *playback, unsigned int nb_impulses)
+{
+    if(m_SyncSource == NULL || !m_SyncSource->isRunning()) {
+        debugError("Streams have to be running for latency calibration\n");
+        return false;
+    }
+    if(capture->getPortType() != Port::E_Audio || capture->getDirection() != Port::E_Capture
+       || playback->getPortType() != Port::E_Audio || playback->getDirection() != Port::E_Playback) {
+        debugError("Need an audio capture and an audio playback port\n");
+        return false;
+    }
+    StreamProcessor *capture_sp = dynamic_cast<StreamProcessor *>(&capture->getManager());
+    StreamProcessor *playback_sp = dynamic_cast<StreamProcessor *>(&playback->getManager());
+    if(capture_sp == NULL || playback_sp == NULL) {
+        debugError("Ports don't belong to a stream processor\n");
+        return false;
+    }
+
+    // the impulse should be back after the nominal round trip plus the
+    // device latency, allow for 100ms of the latter.
+    unsigned int max_roundtrip = capture_sp->getNominalLatency()
+                                 + playback_sp->getNominalLatency()
+                                 + m_nominal_framerate / 10;
+    unsigned int max_wait_periods = max_roundtrip / m_period + 2;
+    unsigned int max_periods = nb_impulses * (max_wait_periods + 2) * 2;
+
+    // save the port setup and disable all other ports
+    std::vector<bool> enabled;
+    PortVectorIterator it;
+    for (it = m_CapturePorts_shadow.begin(); it != m_CapturePorts_shadow.end(); ++it) {
+        enabled.push_back(!(*it)->isDisabled());
+        if (*it != capture) (*it)->disable();
+    }
+    for (it = m_PlaybackPorts_shadow.begin(); it != m_PlaybackPorts_shadow.end(); ++it) {
+        enabled.push_back(!(*it)->isDisabled());
+        if (*it != playback) (*it)->disable();
+    }
+    void *capture_buffer = capture->getBufferAddress();
+    unsigned int capture_stride = capture->getBufferStride();
+    void *playback_buffer = playback->getBufferAddress();
+    unsigned int playback_stride = playback->getBufferStride();
+
+    // buffers in the client sample format (8 bytes is the largest sample)
+    char *cbuf = new char[m_period * 8];
+    char *pbuf = new char[m_period * 8];
+    int32_t *samples = new int32_t[m_period];
+    capture->setBufferAddress(cbuf);
+    capture->setBufferStride(1);
+    capture->enable();
+    playback->setBufferAddress(pbuf);
+    playback->setBufferStride(1);
+    playback->enable();
+
+    std::vector<unsigned int> results;
+    unsigned int period_nb;
+    int sent = -1; // the period in which the impulse was sent
+    unsigned int quiet = 2; // periods to wait before sending
+    bool ok = true;
+
+    for (period_nb = 0; period_nb < max_periods && results.size() < nb_impulses; period_nb++) {
+        if(!waitForPeriod()) {
+            if(m_shutdown_needed || !handleXrun()) {
+                debugError("Streaming failed during latency calibration\n");
+                ok = false;
+                break;
+            }
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Xrun during latency calibration\n");
+            sent = -1;
+            quiet = 2;
+            continue;
+        }
+        transfer(StreamProcessor::ePT_Receive);
+
+        // look for the impulse
+        if(sent >= 0) {
+            convertClientToInt24(m_audio_datatype, cbuf, 0, 1, samples, m_period, false);
+            unsigned int j;
+            for(j = 0; j < m_period; j++) {
+                int32_t v = samples[j];
+                if(v < 0) v = -v;
+                if(v > STREAMPROCESSORMANAGER_CALIBRATION_THRESHOLD) break;
+            }
+            if(j < m_period) {
+                unsigned int roundtrip = (period_nb - sent) * m_period + j;
+                debugOutput(DEBUG_LEVEL_VERBOSE, "Impulse %u: round trip %u frames\n",
+                            (unsigned int)results.size(), roundtrip);
+                results.push_back(roundtrip);
+                sent = -1;
+                quiet = 2; // let the loopback settle
+            } else if(period_nb - sent > max_wait_periods) {
+                debugWarning("Impulse not detected on the capture port, is there a loopback connection?\n");
+                sent = -1;
+                quiet = 2;
+            }
+        }
+
+        // send the next impulse at the start of the period
+        memset(samples, 0, m_period * sizeof(int32_t));
+        if(sent < 0) {
+            if(quiet) {
+                quiet--;
+            } else {
+                samples[0] = STREAMPROCESSORMANAGER_CALIBRATION_IMPULSE_LEVEL;
+                sent = period_nb;
+            }
+        }
+        convertInt24ToClient(m_audio_datatype, samples, pbuf, 0, 1, m_period);
+        transfer(StreamProcessor::ePT_Transmit);
+    }
+
+    // restore the port setup
+    unsigned int idx = 0;
+    for (it = m_CapturePorts_shadow.begin(); it != m_CapturePorts_shadow.end(); ++it) {
+        if (enabled.at(idx++)) (*it)->enable(); else (*it)->disable();
+    }
+    for (it = m_PlaybackPorts_shadow.begin(); it != m_PlaybackPorts_shadow.end(); ++it) {
+        if (enabled.at(idx++)) (*it)->enable(); else (*it)->disable();
+    }
+    capture->setBufferAddress(capture_buffer);
+    capture->setBufferStride(capture_stride);
+    playback->setBufferAddress(playback_buffer);
+    playback->setBufferStride(playback_stride);
+    delete[] cbuf;
+    delete[] pbuf;
+    delete[] samples;
+
+    if(!ok) return false;
+    if(results.size() < nb_impulses) {
+        debugError("Only %u of %u impulses detected\n",
+                   (unsigned int)results.size(), nb_impulses);
+        return false;
+    }
+
+    std::sort(results.begin(), results.end());
+    int roundtrip = results.at(results.size() / 2);
+    int extra = roundtrip - (int)capture_sp->getNominalLatency()
+                          - (int)playback_sp->getNominalLatency();
+    debugOutput(DEBUG_LEVEL_NORMAL,
+                "Round trip latency: %d frames (min %u, max %u), device latency %d frames\n",
+                roundtrip, results.front(), results.back(), extra);
+
+    capture_sp->setLatencyCorrection(extra / 2);
+    playback_sp->setLatencyCorrection(extra - extra / 2);
+    return true;
+}
+
 void StreamProcessorManager::dumpInfo() {
     debugOutputShort( DEBUG_LEVEL_NORMAL, "----------------------------------------------------\n");
     debugOutputShort( DEBUG_LEVEL_NORMAL, "Dumping StreamProcessorManager information...\n");
     debugOutputShort( DEBUG_LEVEL_NORMAL, "Period count: %6d\n", m_nbperiods);
-    debugOutputShort( DEBUG_LEVEL_NORMAL, "Data type: %s\n", (m_audio_datatype==eADT_Float?"float":"int24"));
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "Data type: %s\n", audioDataTypeToString(m_audio_datatype));
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "Last start: %" PRId64 " usecs (fast start %s)\n",
+                      m_last_start_usecs, (m_fast_start ? "on" : "off"));
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "Xruns: %u", m_xruns);
+    if (m_last_xrun_report.count) {
+        debugOutputShort( DEBUG_LEVEL_NORMAL, ", last at period %u: %s (SP %p)",
+                          m_last_xrun_report.period, eXPToString(m_last_xrun_report.phase),
+                          m_last_xrun_report.culprit);
+    }
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "\n");
 
     debugOutputShort( DEBUG_LEVEL_NORMAL, " Receive processors...\n");
     for ( StreamProcessorVectorIterator it = m_ReceiveProcessors.begin();
@@ -1610,6 +2494,9 @@ void StreamProcessorManager::dumpInfo() {
         (*it)->dumpInfo();
     }
 
+    m_client_faults.show();
+    Util::RtMemory::show();
+
     debugOutputShort( DEBUG_LEVEL_NORMAL, "----------------------------------------------------\n");
 
     // list port info in verbose mode
@@ -32,6 +32,7 @@
 #include "libutil/Thread.h"
 #include "libutil/Mutex.h"
 #include "libutil/OptionContainer.h"
+#include "libutil/RtMemory.h"
 
 #include <vector>
 #include <semaphore.h>
@@ -56,6 +57,9 @@ public:
     enum eADT_AudioDataType {
         eADT_Int24,
         eADT_Float,
+        eADT_Int32,
+        eADT_Int16,
+        eADT_Float64,
     };
 
     StreamProcessorManager(DeviceManager &parent);
@@ -85,9 +89,14 @@ public:
     bool unregisterProcessor(StreamProcessor *processor); ///< stop managing a streamprocessor
 
     bool streamingParamsOk(signed int period, signed int rate, signed int n_buffers);
-    void setPeriodSize(unsigned int period);
+    bool setPeriodSize(unsigned int period);
     unsigned int getPeriodSize()
             {return m_period;};
+    /// the largest period size that can be set while streaming
+    unsigned int getMaxLivePeriodSize()
+            {return m_max_live_period_size;};
+    /// the smallest period size that can be set while streaming
+    unsigned int getMinLivePeriodSize();
 
     bool setAudioDataType(enum eADT_AudioDataType t)
         {m_audio_datatype = t; return true;};
@@ -126,7 +135,15 @@ private:
     bool transferSilence(enum StreamProcessor::eProcessorType);
 
     bool alignReceivedStreams();
+    bool dllsSettled(float &prev_tpf, float max_dll_error, float max_rate_change_ppm);
+    bool resyncStreams();
+    bool requestPeriodSizeChange(unsigned int period);
+    void applyPeriodSizeChange();
+    void saveCaptures();
 public:
+    static unsigned int getResyncExcessFrames(int fill, unsigned int period);
+    static int64_t getResyncMissingPeriods(int64_t gap_ticks, int64_t period_ticks);
+
     int getDelayedUsecs() {return m_delayed_usecs;};
     bool xrunOccurred();
     bool shutdownNeeded() {return m_shutdown_needed;};
@@ -135,8 +152,50 @@ public:
     void setNominalRate(unsigned int r) {m_nominal_framerate = r;};
     unsigned int getNominalRate() {return m_nominal_framerate;};
     uint64_t getTimeOfLastTransfer() { return m_time_of_transfer;};
+    /// the delay between the end of a period and the client wakeup, in ticks
+    unsigned int getSyncDelay() {return m_sync_delay;};
+    /// the time the last (re)start of the streams took, in usecs
+    int64_t getLastStartUsecs() {return m_last_start_usecs;};
+
+    bool calibrateLatency(Port *capture, Port *playback, unsigned int nb_impulses);
+
+    /// where in the chain an xrun originated
+    enum eXrunPhase {
+        eXP_None,
+        eXP_KernelLate, ///< the iso side didn't keep up
+        eXP_ClientLate, ///< the client didn't transfer its period in time
+        eXP_DeviceLate, ///< the device didn't deliver in time, or a bus reset
+    };
+    /// the root cause analysis of an xrun
+    struct sXrunReport {
+        unsigned int count;             ///< the number of the xrun, 0 if none yet
+        unsigned int period;            ///< the period at which it was detected
+        enum eXrunPhase phase;
+        StreamProcessor *culprit;       ///< NULL if unknown
+        enum StreamProcessor::eXrunCause cause;
+        uint32_t cycle;                 ///< the cycle the culprit flagged it at
+        // the following are totals and maxima since the culprit's iso
+        // handler, or the culprit itself, was started
+        unsigned int dropped_cycles;    ///< by the culprit's iso handler
+        int max_lateness_usecs;         ///< of the culprit's iso handler
+        int max_iterate_nsecs;          ///< of the culprit's iso handler
+        int max_packet_data_nsecs;      ///< encoding/decoding by the culprit
+        int delayed_usecs;              ///< delay of the wake-up that saw the xrun
+    };
+    /**
+     * @brief the report of the last xrun
+     *
+     * The report is written by waitForPeriod(), so this may only be
+     * called from the client thread.
+     */
+    const struct sXrunReport &getLastXrunReport() {return m_last_xrun_report;};
+    const char *eXPToString(enum eXrunPhase);
 
 private:
+    void reportXrun();
+    void findXrunCulprit(StreamProcessorVector &sps, struct sXrunReport &r);
+    struct sXrunReport m_last_xrun_report;
+
     int m_delayed_usecs;
     // this stores the time at which the next transfer should occur
     // usually this is in the past, but it is needed as a timestamp
@@ -149,6 +208,9 @@ private:
 public:
     bool handleXrun(); ///< reset the streams & buffers after xrun
 
+    /// true if the SP's should try to keep running when the client is late
+    bool getFastXrunResync() {return m_fast_xrun_resync;};
+
     bool setThreadParameters(bool rt, int priority);
 
     virtual void setVerboseLevel(int l);
@@ -176,6 +238,8 @@ protected: // FIXME: private?
     int64_t m_activity_wait_timeout_nsec;
     bool m_thread_realtime;
     int m_thread_priority;
+    // page faults in the client thread
+    Util::RtMemory::FaultMonitor m_client_faults;
 
     // activity signaling
     sem_t m_activity_semaphore;
@@ -203,6 +267,23 @@ protected: // FIXME: private?
 
     signed int m_max_diff_ticks;
 
+    bool m_fast_xrun_resync;
+    unsigned int m_max_live_period_size;
+    unsigned int m_xmit_prebuffer_frames;
+    // the time the client was woken up for the current period, in ticks
+    uint64_t m_time_of_wakeup;
+
+    bool m_fast_start;
+    int64_t m_last_start_usecs;
+
+    // a period size change requested while streaming. it is applied by
+    // the client thread at the start of the next waitForPeriod().
+    Util::Mutex *m_PeriodChangeLock;
+    volatile unsigned int m_pending_period;
+    std::vector<int> m_pending_silence_periods;
+    std::vector<unsigned int> m_pending_xmit_extra_frames;
+    std::vector<unsigned int> m_pending_xmit_skip_frames;
+
     DECLARE_DEBUG_MODULE;
 
 };
@@ -27,6 +27,7 @@
 #include "devicemanager.h"
 
 #include "libieee1394/cycletimer.h"
+#include "libutil/RtMemory.h"
 
 #define DLL_PI        (3.141592653589793238)
 #define DLL_SQRT2     (1.414213562373095049)
@@ -89,8 +90,9 @@ AmdtpOxfordReceiveStreamProcessor::prepareChild()
     // adi@2011-1-14: Holger Dehnhardt says that using 4*4*2 instead of 4*4
     // makes his Mackie Onyx work
     FFADO_ASSERT( m_temp_buffer == NULL );
-    if( !(m_temp_buffer = ffado_ringbuffer_create(
-            packet_payload_size_events * 4 * 4 * 2))) {
+    if( !(m_temp_buffer = ffado_ringbuffer_create_with(
+            packet_payload_size_events * 4 * 4 * 2,
+            Util::RtMemory::allocate, Util::RtMemory::release))) {
         debugFatal("Could not allocate memory event ringbuffer\n");
         return false;
     }
@@ -24,6 +24,7 @@
 
 #include "AmdtpReceiveStreamProcessor.h"
 #include "AmdtpPort.h"
+#include "../generic/SampleConversion.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -46,9 +47,8 @@ AmdtpReceiveStreamProcessor::AmdtpReceiveStreamProcessor(FFADODevice &parent, in
     : StreamProcessor(parent, ePT_Receive)
     , m_dimension( dimension )
     , m_nb_audio_ports( 0 )
+    , m_audio_ports_native( true )
     , m_nb_midi_ports( 0 )
-    , mb_head( 0 )
-    , mb_tail( 0 )
 {}
 
 unsigned int
@@ -253,13 +253,18 @@ bool AmdtpReceiveStreamProcessor::processReadBlock(char *data,
     updatePortCache();
 
     // decode audio data
-    switch(m_StreamProcessorManager.getAudioDataType()) {
+    if (!m_audio_ports_native) {
+        decodeAudioPortsGeneric((quadlet_t *)data, offset, nevents);
+    } else switch(m_StreamProcessorManager.getAudioDataType()) {
         case StreamProcessorManager::eADT_Int24:
             decodeAudioPortsInt24((quadlet_t *)data, offset, nevents);
             break;
         case StreamProcessorManager::eADT_Float:
             decodeAudioPortsFloat((quadlet_t *)data, offset, nevents);
             break;
+        default:
+            decodeAudioPortsGeneric((quadlet_t *)data, offset, nevents);
+            break;
     }
 
     // do midi ports
@@ -423,6 +428,43 @@ AmdtpReceiveStreamProcessor::decodeAudioPortsFloat(quadlet_t *data,
 
 #endif
 
+/**
+ * @brief demux events to all audio ports (any sample format, interleaved buffers)
+ * @param data 
+ * @param offset 
+ * @param nevents 
+ */
+void
+AmdtpReceiveStreamProcessor::decodeAudioPortsGeneric(quadlet_t *data,
+                                                      unsigned int offset,
+                                                      unsigned int nevents)
+{
+    unsigned int i, j, k;
+    quadlet_t *target_event;
+    int32_t tmp[SAMPLE_CONVERSION_BLOCK_SIZE];
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+
+    for (i = 0; i < m_nb_audio_ports; i++) {
+        struct _MBLA_port_cache &p = m_audio_ports.at(i);
+        target_event = (quadlet_t *)(data + i);
+#ifdef DEBUG
+        assert(nevents + offset <= p.buffer_size );
+#endif
+
+        if(p.buffer && p.enabled) {
+            for(j = 0; j < nevents; j += k) {
+                unsigned int n = nevents - j;
+                if (n > SAMPLE_CONVERSION_BLOCK_SIZE) n = SAMPLE_CONVERSION_BLOCK_SIZE;
+                for(k = 0; k < n; k += 1) {
+                    tmp[k] = CondSwapFromBus32(*target_event) & 0x00FFFFFF;
+                    target_event+=m_dimension;
+                }
+                convertInt24ToClient(type, tmp, p.buffer, offset + j, p.stride, n);
+            }
+        }
+    }
+}
+
 /**
  * @brief decode all midi ports in the cache from events
  * @param data 
@@ -444,6 +486,8 @@ AmdtpReceiveStreamProcessor::decodeMidiPorts(quadlet_t *data,
             uint32_t *buffer = (quadlet_t *)(p.buffer);
             buffer += offset;
 
+            MidiScheduler &sched = p.port->getScheduler();
+
             /* clear output (to jackd) buffer for MIDI data */
             memset (buffer, 0, nevents*sizeof(*buffer));
 
@@ -452,21 +496,15 @@ AmdtpReceiveStreamProcessor::decodeMidiPorts(quadlet_t *data,
                 sample_int = CondSwapFromBus32(*target_event);
 
                 // FIXME: this assumes that 2X and 3X speed isn't used,
-                // because only the 1X slot is put into the ringbuffer
+                // because only the 1X slot is put into the scheduler
                 if(unlikely(IEC61883_AM824_HAS_LABEL(sample_int, IEC61883_AM824_LABEL_MIDI_1X))) {
                     sample_int=(sample_int >> 16) & 0x000000FF;
-                    sample_int |= 0x01000000; // flag that there is a midi event present
-                    midibuffer[mb_head++] = sample_int;
-                    mb_head &= RX_MIDIBUFFER_SIZE-1;
-                    if (unlikely(mb_head == mb_tail)) {
-                        debugWarning("AMDTP rx MIDI buffer overflow\n");
-                        /* Dump oldest byte.  This overflow can only happen if the
-                         * rate coming in from the hardware MIDI port grossly
-                         * exceeds the official MIDI baud rate of 31250 bps, so it
-                         * should never occur in practice.
-                         */
-                        mb_tail = (mb_tail + 1) & (RX_MIDIBUFFER_SIZE-1);
-                    }
+                    /* This overflow can only happen if the rate coming in
+                     * from the hardware MIDI port grossly exceeds the
+                     * official MIDI baud rate of 31250 bps, so it should
+                     * never occur in practice.
+                     */
+                    sched.put(sample_int, j);
 
                     debugOutputExtreme(DEBUG_LEVEL_VERBOSE, "(%p) MIDI [%d]: %08X\n", this,
                             i, sample_int);
@@ -475,15 +513,17 @@ AmdtpReceiveStreamProcessor::decodeMidiPorts(quadlet_t *data,
                     debugOutput(DEBUG_LEVEL_VERBOSE, "Midi mode %X not supported.\n",
                             IEC61883_AM824_GET_LABEL(sample_int));
                 }
-                /* Write to the buffer if we're at an 8-sample boundary */
-                if (unlikely(0 == j % 8)) {
-                    if (mb_head != mb_tail) {
-                        *buffer = midibuffer[mb_tail++];
-                        mb_tail &= RX_MIDIBUFFER_SIZE-1;
-                    }
-                    buffer += 8;
+                /* Write the byte at the frame it arrived in, or at the next
+                 * free frame if the previous one is still queued */
+                if (unlikely(sched.get(j, sample_int))) {
+                    buffer[j] = sample_int;
                 }
             }
+            sched.advance(nevents);
+            if (unlikely(sched.isNewOverflow())) {
+                debugWarning("MIDI port %s: rx buffer overflow, dropping messages\n",
+                             p.port->getName().c_str());
+            }
         }
     }
 }
@@ -542,6 +582,7 @@ AmdtpReceiveStreamProcessor::initPortCache() {
                     return false;
                 }
                 p.buffer = NULL; // to be filled by updatePortCache
+                p.stride = 1;
                 #ifdef DEBUG
                 p.buffer_size = (*it)->getBufferSize();
                 #endif
@@ -581,6 +622,10 @@ next_index:
             p.buffer_size = (*it)->getBufferSize();
             #endif
 
+            // one byte per frame, the rate is limited by the device
+            p.port->getScheduler().reset();
+            p.port->getScheduler().setSpacing(1);
+
             m_midi_ports.push_back(p);
             debugOutput(DEBUG_LEVEL_VERBOSE,
                         "Cached port %s at position %u, location %u\n",
@@ -595,11 +640,17 @@ next_index:
 void
 AmdtpReceiveStreamProcessor::updatePortCache() {
     unsigned int idx;
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+    m_audio_ports_native = true;
     for (idx = 0; idx < m_nb_audio_ports; idx++) {
         struct _MBLA_port_cache& p = m_audio_ports.at(idx);
         AmdtpAudioPort *port = p.port;
         p.buffer = port->getBufferAddress();
+        p.stride = port->getBufferStride();
         p.enabled = !port->isDisabled();
+        if (p.enabled && !isNativeAudioSampleLayout(type, p.stride)) {
+            m_audio_ports_native = false;
+        }
 #ifdef DEBUG
 	p.buffer_size = port->getBufferSize();
 #endif
@@ -72,6 +72,8 @@ public:
                     { return m_dimension; };
     virtual unsigned int getNominalFramesPerPacket() 
                     {return getSytInterval();};
+    virtual unsigned int getReceiveTransferDelay()
+                    {return AMDTP_RECEIVE_TRANSFER_DELAY;};
 
 
 protected:
@@ -81,6 +83,7 @@ protected:
     void decodeAudioPortsFloat(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void decodeAudioPortsInt24(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void decodeMidiPorts(quadlet_t *data, unsigned int offset, unsigned int nevents);
+    void decodeAudioPortsGeneric(quadlet_t *data, unsigned int offset, unsigned int nevents);
 
     unsigned int getSytInterval();
 
@@ -91,6 +94,7 @@ private: // local port caching for performance
     struct _MBLA_port_cache {
         AmdtpAudioPort*     port;
         void*               buffer;
+        unsigned int        stride;
         bool                enabled;
 #ifdef DEBUG
         unsigned int        buffer_size;
@@ -98,6 +102,8 @@ private: // local port caching for performance
     };
     std::vector<struct _MBLA_port_cache> m_audio_ports;
     unsigned int m_nb_audio_ports;
+    // true if the int24/float specific decoders can be used
+    bool m_audio_ports_native;
 
     struct _MIDI_port_cache {
         AmdtpMidiPort*      port;
@@ -112,23 +118,6 @@ private: // local port caching for performance
     std::vector<struct _MIDI_port_cache> m_midi_ports;
     unsigned int m_nb_midi_ports;
 
-    /* A small MIDI buffer to cover for the case where we need to span a
-     * period - that is, if more than one MIDI byte is sent per packet. 
-     * Since the long-term average data rate must be close to the MIDI spec
-     * (as it's coming from a physical MIDI port_ this buffer doesn't have
-     * to be particularly large.  The size is a power of 2 for optimisation
-     * reasons.
-     *
-     * FIXME: it is yet to be determined whether this is required for RME
-     * devices.
-     *
-     * FIXME: copied from RmeReceiveStreamProcessor.h. Needs refactoring
-     */
-#define RX_MIDIBUFFER_SIZE_EXP 6
-#define RX_MIDIBUFFER_SIZE     (1<<RX_MIDIBUFFER_SIZE_EXP)
-
-    unsigned int midibuffer[RX_MIDIBUFFER_SIZE];
-    unsigned mb_head, mb_tail;
 
     bool initPortCache();
     void updatePortCache();
@@ -25,6 +25,7 @@
 
 #include "AmdtpTransmitStreamProcessor.h"
 #include "AmdtpPort.h"
+#include "../generic/SampleConversion.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -58,6 +59,7 @@ AmdtpTransmitStreamProcessor::AmdtpTransmitStreamProcessor(FFADODevice &parent,
         , m_transmit_transfer_delay ( AMDTP_TRANSMIT_TRANSFER_DELAY )
         , m_min_cycles_before_presentation ( AMDTP_MIN_CYCLES_BEFORE_PRESENTATION )
         , m_nb_audio_ports( 0 )
+        , m_audio_ports_native( true )
         , m_nb_midi_ports( 0 )
 {}
 
@@ -486,13 +488,18 @@ bool AmdtpTransmitStreamProcessor::processWriteBlock ( char *data,
     updatePortCache();
 
     // encode audio data
-    switch(m_StreamProcessorManager.getAudioDataType()) {
+    if (!m_audio_ports_native) {
+        encodeAudioPortsGeneric((quadlet_t *)data, offset, nevents);
+    } else switch(m_StreamProcessorManager.getAudioDataType()) {
         case StreamProcessorManager::eADT_Int24:
             encodeAudioPortsInt24((quadlet_t *)data, offset, nevents);
             break;
         case StreamProcessorManager::eADT_Float:
             encodeAudioPortsFloat((quadlet_t *)data, offset, nevents);
             break;
+        default:
+            encodeAudioPortsGeneric((quadlet_t *)data, offset, nevents);
+            break;
     }
 
     // do midi ports
@@ -1008,8 +1015,57 @@ AmdtpTransmitStreamProcessor::encodeAudioPortsFloat(quadlet_t *data,
 }
 #endif
 
+/**
+ * @brief mux all audio ports to events (any sample format, interleaved buffers)
+ * @param data 
+ * @param offset 
+ * @param nevents 
+ */
+void
+AmdtpTransmitStreamProcessor::encodeAudioPortsGeneric(quadlet_t *data,
+                                                      unsigned int offset,
+                                                      unsigned int nevents)
+{
+    unsigned int j, k;
+    quadlet_t *target_event;
+    int i;
+    int32_t tmp[SAMPLE_CONVERSION_BLOCK_SIZE];
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+
+    for (i = 0; i < m_nb_audio_ports; i++) {
+        struct _MBLA_port_cache &p = m_audio_ports.at(i);
+        target_event = (quadlet_t *)(data + i);
+#ifdef DEBUG
+        assert(nevents + offset <= p.buffer_size );
+#endif
+
+        if(likely(p.buffer && p.enabled)) {
+            for (j = 0; j < nevents; j += k) {
+                unsigned int n = nevents - j;
+                if (n > SAMPLE_CONVERSION_BLOCK_SIZE) n = SAMPLE_CONVERSION_BLOCK_SIZE;
+                convertClientToInt24(type, p.buffer, offset + j, p.stride, tmp, n, AMDTP_CLIP_FLOATS);
+                for (k = 0; k < n; k += 1) {
+                    quadlet_t v = ((quadlet_t)tmp[k] & 0x00FFFFFF) | 0x40000000;
+                    *target_event = CondSwapToBus32(v);
+                    target_event += m_dimension;
+                }
+            }
+        } else {
+            for (j = 0;j < nevents; j += 1)
+            {
+                *target_event = CONDSWAPTOBUS32_CONST(0x40000000);
+                target_event += m_dimension;
+            }
+        }
+    }
+}
+
 /**
  * @brief encodes all midi ports in the cache to events (silence)
+ *
+ * The queued bytes stay in the port schedulers, but their time moves on
+ * such that they are sent as soon as real data is transmitted again.
+ *
  * @param data 
  * @param offset 
  * @param nevents 
@@ -1030,11 +1086,19 @@ AmdtpTransmitStreamProcessor::encodeMidiPortsSilence(quadlet_t *data,
             target_event = (quadlet_t *) (data + ((j * m_dimension) + p.position));
             *target_event = CondSwapToBus32(IEC61883_AM824_SET_LABEL(0, IEC61883_AM824_LABEL_MIDI_NO_DATA));
         }
+        if (p.port) {
+            p.port->getScheduler().advance(nevents);
+        }
     }
 }
 
 /**
  * @brief encodes all midi ports in the cache to events
+ *
+ * The bytes can be at any frame of the port buffer. They are queued in
+ * the port's scheduler, and sent in the first MIDI slot of the port that
+ * is at or after the frame they are at, at most at the MIDI baud rate.
+ *
  * @param data 
  * @param offset 
  * @param nevents 
@@ -1053,14 +1117,22 @@ AmdtpTransmitStreamProcessor::encodeMidiPorts(quadlet_t *data,
         if (p.buffer && p.enabled) {
             uint32_t *buffer = (quadlet_t *)(p.buffer);
             buffer += offset;
+            MidiScheduler &sched = p.port->getScheduler();
+
+            for (j = 0; j < nevents; j++) {
+                if (unlikely(buffer[j] & 0xFF000000)) {
+                    sched.put(buffer[j], j);
+                }
+            }
 
             for (j = p.location;j < nevents; j += 8) {
                 target_event = (quadlet_t *) (data + ((j * m_dimension) + p.position));
+                quadlet_t byte;
 
-                if ( *buffer & 0xFF000000 )   // we can send a byte
+                if (unlikely(sched.get(j, byte)))   // we can send a byte
                 {
                     quadlet_t tmpval;
-                    tmpval = ((*buffer)<<16) & 0x00FF0000;
+                    tmpval = (byte<<16) & 0x00FF0000;
                     tmpval = IEC61883_AM824_SET_LABEL(tmpval, IEC61883_AM824_LABEL_MIDI_1X);
                     *target_event = CondSwapToBus32(tmpval);
 
@@ -1069,12 +1141,15 @@ AmdtpTransmitStreamProcessor::encodeMidiPorts(quadlet_t *data,
                     debugOutputExtreme( DEBUG_LEVEL_VERBOSE, "base=%p, target=%p, value=%08X\n",
                                data, target_event, tmpval );
                 } else {
-                    // can't send a byte, either because there is no byte,
+                    // can't send a byte, either because there is no byte due,
                     // or because this would exceed the maximum rate
-                    // FIXME: this can be ifdef optimized since it's a constant
                     *target_event = CondSwapToBus32(IEC61883_AM824_SET_LABEL(0, IEC61883_AM824_LABEL_MIDI_NO_DATA));
                 }
-                buffer+=8;
+            }
+            sched.advance(nevents);
+            if (unlikely(sched.isNewOverflow())) {
+                debugWarning("MIDI port %s: tx buffer overflow, dropping messages\n",
+                             p.port->getName().c_str());
             }
         } else {
             for (j = p.location;j < nevents; j += 8) {
@@ -1140,6 +1215,7 @@ AmdtpTransmitStreamProcessor::initPortCache() {
                     return false;
                 }
                 p.buffer = NULL; // to be filled by updatePortCache
+                p.stride = 1;
                 #ifdef DEBUG
                 p.buffer_size = (*it)->getBufferSize();
                 #endif
@@ -1179,6 +1255,10 @@ next_index:
             p.buffer_size = (*it)->getBufferSize();
             #endif
 
+            // the devices pass the bytes on to a physical MIDI port
+            p.port->getScheduler().reset();
+            p.port->getScheduler().setRateLimit(m_StreamProcessorManager.getNominalRate());
+
             m_midi_ports.push_back(p);
             debugOutput(DEBUG_LEVEL_VERBOSE,
                         "Cached port %s at position %u, location %u\n",
@@ -1193,11 +1273,17 @@ next_index:
 void
 AmdtpTransmitStreamProcessor::updatePortCache() {
     int idx;
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+    m_audio_ports_native = true;
     for (idx = 0; idx < m_nb_audio_ports; idx++) {
         struct _MBLA_port_cache& p = m_audio_ports.at(idx);
         AmdtpAudioPort *port = p.port;
         p.buffer = port->getBufferAddress();
+        p.stride = port->getBufferStride();
         p.enabled = !port->isDisabled();
+        if (p.enabled && !isNativeAudioSampleLayout(type, p.stride)) {
+            m_audio_ports_native = false;
+        }
 #ifdef DEBUG
 	p.buffer_size = port->getBufferSize();
 #endif
@@ -115,6 +115,7 @@ private:
     void encodeAudioPortsSilence(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeAudioPortsFloat(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeAudioPortsInt24(quadlet_t *data, unsigned int offset, unsigned int nevents);
+    void encodeAudioPortsGeneric(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeMidiPortsSilence(quadlet_t *data, unsigned int offset, unsigned int nevents);
     void encodeMidiPorts(quadlet_t *data, unsigned int offset, unsigned int nevents);
 
@@ -139,6 +140,7 @@ private: // local port caching for performance
     struct _MBLA_port_cache {
         AmdtpAudioPort*     port;
         void*               buffer;
+        unsigned int        stride;
         bool                enabled;
 #ifdef DEBUG
         unsigned int        buffer_size;
@@ -146,6 +148,8 @@ private: // local port caching for performance
     };
     std::vector<struct _MBLA_port_cache> m_audio_ports;
     int m_nb_audio_ports;
+    // true if the int24/float specific encoders can be used
+    bool m_audio_ports_native;
 
     struct _MIDI_port_cache {
         AmdtpMidiPort*      port;
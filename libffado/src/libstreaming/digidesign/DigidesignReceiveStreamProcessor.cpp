@@ -27,6 +27,7 @@
 
 #include "DigidesignReceiveStreamProcessor.h"
 #include "DigidesignPort.h"
+#include "../generic/SampleConversion.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -265,7 +266,28 @@ signed int DigidesignReceiveStreamProcessor::decodeDigidesignEventsToPort(Digide
     unsigned char *src_data;
     src_data = (unsigned char *)data + p->getPosition();
 
-    switch(m_StreamProcessorManager.getAudioDataType()) {
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+    unsigned int stride = p->getBufferStride();
+    if (!isNativeAudioSampleLayout(type, stride)) {
+        // other sample formats and interleaved client buffers
+        int32_t tmp[SAMPLE_CONVERSION_BLOCK_SIZE];
+        unsigned int k;
+
+        assert(nevents + offset <= p->getBufferSize());
+
+        for(j = 0; j < nevents; j += k) {
+            unsigned int n = nevents - j;
+            if (n > SAMPLE_CONVERSION_BLOCK_SIZE) n = SAMPLE_CONVERSION_BLOCK_SIZE;
+            for(k = 0; k < n; k += 1) {
+                tmp[k] = (*src_data<<16)+(*(src_data+1)<<8)+*(src_data+2);
+                src_data += m_event_size;
+            }
+            convertInt24ToClient(type, tmp, p->getBufferAddress(), offset + j, stride, n);
+        }
+        return 0;
+    }
+
+    switch(type) {
         case StreamProcessorManager::eADT_Float:
             {
                 const float multiplier = 1.0f / (float)(0x7FFFFF);
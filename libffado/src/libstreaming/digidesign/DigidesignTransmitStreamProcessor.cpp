@@ -28,6 +28,7 @@
 
 #include "DigidesignTransmitStreamProcessor.h"
 #include "DigidesignPort.h"
+#include "../generic/SampleConversion.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -647,7 +648,30 @@ int DigidesignTransmitStreamProcessor::encodePortToDigidesignEvents(DigidesignAu
     unsigned char *target;
     target = (unsigned char *)data + p->getPosition();
 
-    switch(m_StreamProcessorManager.getAudioDataType()) {
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+    unsigned int stride = p->getBufferStride();
+    if (!isNativeAudioSampleLayout(type, stride)) {
+        // other sample formats and interleaved client buffers
+        int32_t tmp[SAMPLE_CONVERSION_BLOCK_SIZE];
+        unsigned int k;
+
+        assert(nevents + offset <= p->getBufferSize());
+
+        for(j = 0; j < nevents; j += k) {
+            unsigned int n = nevents - j;
+            if (n > SAMPLE_CONVERSION_BLOCK_SIZE) n = SAMPLE_CONVERSION_BLOCK_SIZE;
+            convertClientToInt24(type, p->getBufferAddress(), offset + j, stride, tmp, n, DIGIDESIGN_CLIP_FLOATS);
+            for(k = 0; k < n; k += 1) {
+                *target = (tmp[k] >> 16) & 0xff;
+                *(target+1) = (tmp[k] >> 8) & 0xff;
+                *(target+2) = tmp[k] & 0xff;
+                target+=m_event_size;
+            }
+        }
+        return 0;
+    }
+
+    switch(type) {
         default:
         case StreamProcessorManager::eADT_Int24:
             {
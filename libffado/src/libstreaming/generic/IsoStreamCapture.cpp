@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "IsoStreamCapture.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// packet records are padded to a multiple of 4 bytes
+#define ISOSTREAMCAPTURE_RECORD_SIZE(len) \
+    (sizeof(IsoStreamCapture::PacketHeader) + (((len) + 3) & ~3))
+
+namespace Streaming {
+
+IMPL_DEBUG_MODULE( IsoStreamCapture, IsoStreamCapture, DEBUG_LEVEL_NORMAL );
+
+IsoStreamCapture::IsoStreamCapture()
+    : m_buffer( NULL )
+    , m_size( 0 )
+    , m_fill( 0 )
+    , m_nb_packets( 0 )
+    , m_nb_overflows( 0 )
+    , m_nominal_rate( 0 )
+{
+}
+
+IsoStreamCapture::~IsoStreamCapture()
+{
+    free(m_buffer);
+}
+
+bool
+IsoStreamCapture::reserve(size_t size)
+{
+    unsigned char *b = (unsigned char *)realloc(m_buffer, size);
+    if (b == NULL && size) {
+        debugError("Could not allocate %zd bytes for packet capture\n", size);
+        return false;
+    }
+    m_buffer = b;
+    m_size = size;
+    if (m_fill > m_size) {
+        clear();
+    }
+    return true;
+}
+
+bool
+IsoStreamCapture::allocate(unsigned int max_packets, unsigned int max_packet_size)
+{
+    size_t size = (size_t)max_packets * ISOSTREAMCAPTURE_RECORD_SIZE(max_packet_size);
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Allocating room for %u packets of max %u bytes (%zd bytes)\n",
+                max_packets, max_packet_size, size);
+    if (!reserve(size)) {
+        return false;
+    }
+    // touch the buffer such that recording doesn't page fault
+    memset(m_buffer, 0, m_size);
+    clear();
+    return true;
+}
+
+void
+IsoStreamCapture::clear()
+{
+    m_fill = 0;
+    m_nb_packets = 0;
+    m_nb_overflows = 0;
+}
+
+bool
+IsoStreamCapture::record(unsigned char *data, unsigned int length,
+                         unsigned char channel, unsigned char tag, unsigned char sy,
+                         uint32_t pkt_ctr, unsigned int dropped)
+{
+    size_t record_size = ISOSTREAMCAPTURE_RECORD_SIZE(length);
+    if (m_fill + record_size > m_size) {
+        m_nb_overflows++;
+        return false;
+    }
+    PacketHeader *h = (PacketHeader *)(m_buffer + m_fill);
+    h->length = length;
+    h->pkt_ctr = pkt_ctr;
+    h->dropped = dropped;
+    h->channel = channel;
+    h->tag = tag;
+    h->sy = sy;
+    h->reserved = 0;
+    memcpy(getPacketData(h), data, length);
+
+    m_fill += record_size;
+    m_nb_packets++;
+    return true;
+}
+
+IsoStreamCapture::PacketHeader *
+IsoStreamCapture::nextPacket(size_t &pos)
+{
+    if (pos + sizeof(PacketHeader) > m_fill) {
+        return NULL;
+    }
+    PacketHeader *h = (PacketHeader *)(m_buffer + pos);
+    pos += ISOSTREAMCAPTURE_RECORD_SIZE(h->length);
+    if (pos > m_fill) {
+        debugError("Truncated packet record\n");
+        return NULL;
+    }
+    return h;
+}
+
+bool
+IsoStreamCapture::save(std::string filename)
+{
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (f == NULL) {
+        debugError("Could not open %s for writing\n", filename.c_str());
+        return false;
+    }
+
+    FileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    strncpy(hdr.magic, ISOSTREAMCAPTURE_MAGIC, sizeof(hdr.magic));
+    hdr.version = ISOSTREAMCAPTURE_VERSION;
+    hdr.nominal_rate = m_nominal_rate;
+    hdr.nb_packets = m_nb_packets;
+
+    bool result = true;
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        result = false;
+    }
+    if (result && m_fill && fwrite(m_buffer, m_fill, 1, f) != 1) {
+        result = false;
+    }
+    if (fclose(f) != 0) {
+        result = false;
+    }
+    if (!result) {
+        debugError("Could not write capture to %s\n", filename.c_str());
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Saved %u packets to %s\n",
+                m_nb_packets, filename.c_str());
+    return true;
+}
+
+bool
+IsoStreamCapture::load(std::string filename)
+{
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (f == NULL) {
+        debugError("Could not open %s for reading\n", filename.c_str());
+        return false;
+    }
+
+    FileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+        || strncmp(hdr.magic, ISOSTREAMCAPTURE_MAGIC, sizeof(hdr.magic)) != 0) {
+        debugError("%s is not a packet capture file\n", filename.c_str());
+        fclose(f);
+        return false;
+    }
+    if (hdr.version != ISOSTREAMCAPTURE_VERSION) {
+        debugError("Unsupported capture file version %u\n", hdr.version);
+        fclose(f);
+        return false;
+    }
+
+    // the packet records span the remainder of the file
+    long start = ftell(f);
+    fseek(f, 0, SEEK_END);
+    long end = ftell(f);
+    fseek(f, start, SEEK_SET);
+
+    size_t size = (end > start ? end - start : 0);
+    if (!reserve(size)) {
+        fclose(f);
+        return false;
+    }
+    clear();
+    if (size && fread(m_buffer, size, 1, f) != 1) {
+        debugError("Could not read packets from %s\n", filename.c_str());
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+
+    m_fill = size;
+    m_nominal_rate = hdr.nominal_rate;
+
+    // validate the records
+    size_t pos = 0;
+    while (nextPacket(pos)) {
+        m_nb_packets++;
+    }
+    if (m_nb_packets != hdr.nb_packets) {
+        debugWarning("File header announces %u packets, found %u\n",
+                     hdr.nb_packets, m_nb_packets);
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Loaded %u packets from %s\n",
+                m_nb_packets, filename.c_str());
+    return true;
+}
+
+void
+IsoStreamCapture::show()
+{
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "  Packet capture:\n");
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "   Packets    : %u\n", m_nb_packets);
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "   Overflows  : %u\n", m_nb_overflows);
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "   Fill       : %zd / %zd bytes\n", m_fill, m_size);
+}
+
+} // end of namespace Streaming
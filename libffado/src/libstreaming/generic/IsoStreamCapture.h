@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_ISOSTREAMCAPTURE__
+#define __FFADO_ISOSTREAMCAPTURE__
+
+#include "debugmodule/debugmodule.h"
+
+#include <string>
+#include <stdint.h>
+
+namespace Streaming {
+
+/*!
+\brief Recording of the packets received by a StreamProcessor
+
+ The packets are recorded, together with the metadata the IsoHandler
+ passes to StreamProcessor::putPacket(), into a buffer that is allocated
+ up front. This makes it possible to record from within the iso receive
+ thread. A recording can be saved to file and loaded again later, such
+ that the packets can be fed through a receive StreamProcessor offline
+ (see tests/test-streamreplay.cpp).
+
+ File layout (host byte order):
+   FileHeader
+   nb_packets times: PacketHeader + packet data padded to 4 bytes
+*/
+class IsoStreamCapture
+{
+public:
+    #define ISOSTREAMCAPTURE_MAGIC    "FFADO isocap"
+    #define ISOSTREAMCAPTURE_VERSION  1
+
+    struct FileHeader {
+        char     magic[16];
+        uint32_t version;
+        uint32_t nominal_rate;  ///< nominal sample rate of the stream
+        uint32_t nb_packets;
+        uint32_t reserved;
+    };
+
+    struct PacketHeader {
+        uint32_t length;        ///< length of the packet data in bytes
+        uint32_t pkt_ctr;       ///< cycle timer value for the receive cycle
+        uint32_t dropped;       ///< nb of dropped cycles before this packet
+        uint8_t  channel;
+        uint8_t  tag;
+        uint8_t  sy;
+        uint8_t  reserved;
+    };
+
+    IsoStreamCapture();
+    virtual ~IsoStreamCapture();
+
+    /**
+     * @brief allocate the recording buffer
+     * @param max_packets number of packets that can be recorded
+     * @param max_packet_size largest packet size to expect, in bytes
+     * @return true if successful
+     */
+    bool allocate(unsigned int max_packets, unsigned int max_packet_size);
+    /// forget about all recorded packets
+    void clear();
+
+    /**
+     * @brief record one packet. RT safe, never allocates.
+     * @return false if the packet did not fit into the buffer anymore
+     */
+    bool record(unsigned char *data, unsigned int length,
+                unsigned char channel, unsigned char tag, unsigned char sy,
+                uint32_t pkt_ctr, unsigned int dropped);
+
+    bool save(std::string filename);
+    bool load(std::string filename);
+
+    /**
+     * @brief iterate over the recorded packets
+     * @param pos iterator position, set to 0 to get the first packet
+     * @return the packet header, or NULL if there are no packets left
+     */
+    PacketHeader *nextPacket(size_t &pos);
+    static unsigned char *getPacketData(PacketHeader *h)
+        {return (unsigned char *)(h + 1);};
+
+    unsigned int getNbPackets() {return m_nb_packets;};
+    unsigned int getNbOverflows() {return m_nb_overflows;};
+    unsigned int getNominalRate() {return m_nominal_rate;};
+    void setNominalRate(unsigned int r) {m_nominal_rate = r;};
+
+    void show();
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+
+private:
+    bool reserve(size_t size);
+
+    unsigned char * m_buffer;
+    size_t          m_size;
+    size_t          m_fill;
+    unsigned int    m_nb_packets;
+    unsigned int    m_nb_overflows;
+    unsigned int    m_nominal_rate;
+
+    DECLARE_DEBUG_MODULE;
+};
+
+} // end of namespace Streaming
+
+#endif /* __FFADO_ISOSTREAMCAPTURE__ */
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_MIDISCHEDULER__
+#define __FFADO_MIDISCHEDULER__
+
+/*
+ * Frame accurate placement of MIDI bytes.
+ *
+ * A MIDI port buffer holds one quadlet per frame. A byte is present at a
+ * frame when one of the 8 MSB's of that quadlet is set, the byte itself is
+ * in the 8 LSB's. The frame a byte is at is the time it belongs to.
+ *
+ * The devices can't carry a byte at every frame: AMDTP has one MIDI slot
+ * per port every 8 frames, and the physical MIDI ports can't go faster
+ * than 31250 baud. The scheduler queues the bytes together with their
+ * frame, and hands them out again at the first frame that can carry them
+ * and is not earlier than the frame they belong to, at most one byte per
+ * 'spacing' frames. This keeps the MIDI timing to within one slot instead
+ * of moving all bytes to the first free slots of a period.
+ *
+ * The stream processors use one scheduler per port, and process a port
+ * buffer in blocks (usually a packet):
+ *   - put() every byte of the block, with its frame in the block
+ *   - get() the byte for every frame of the block that can carry one
+ *   - advance() to the next block
+ *
+ * When the queue is full, whole messages are dropped: the part of the
+ * message that is still queued is removed, and its remaining bytes are
+ * refused up to the next status byte. A message is a status byte and the
+ * data bytes that follow it (including the ones sent with running status),
+ * real-time bytes are messages of their own. If the start of the message
+ * was already handed out only the rest can be dropped, which receivers
+ * treat as an incomplete message.
+ */
+
+#include <stdint.h>
+
+namespace Streaming {
+
+// the number of bytes a scheduler can queue. should be a power of two.
+#define MIDI_SCHEDULER_SIZE_EXP     10
+#define MIDI_SCHEDULER_SIZE         (1<<MIDI_SCHEDULER_SIZE_EXP)
+
+// the rate of a physical MIDI port, in bytes per second
+// (31250 baud, 10 bits per byte)
+#define MIDI_BYTES_PER_SECOND       3125
+
+class MidiScheduler {
+
+public:
+    MidiScheduler()
+        : m_spacing( 1 )
+    {
+        reset();
+    };
+
+    /**
+     * @brief empty the queue and restart the frame count
+     */
+    void reset()
+    {
+        m_head = 0;
+        m_tail = 0;
+        m_now = 0;
+        m_next = 0;
+        m_overflows = 0;
+        m_overflow_reported = false;
+        m_msg_start = 0;
+        m_msg_queued = false;
+        m_discarding = false;
+    };
+
+    /**
+     * @brief sets the minimum distance between two bytes handed out
+     * @param frames the distance, in frames
+     */
+    void setSpacing(unsigned int frames)
+        {m_spacing = (frames ? frames : 1);};
+    unsigned int getSpacing() {return m_spacing;};
+
+    /**
+     * @brief sets the spacing such that the MIDI baud rate isn't exceeded
+     * @param rate the sample rate
+     */
+    void setRateLimit(unsigned int rate)
+        {setSpacing((rate + MIDI_BYTES_PER_SECOND - 1) / MIDI_BYTES_PER_SECOND);};
+
+    /**
+     * @brief queue a byte
+     *
+     * When the queue is full the message the byte belongs to is dropped.
+     *
+     * @param data the port buffer quadlet, only the 8 LSB's are used
+     * @param frame the frame the byte belongs to, relative to the current block
+     * @return false if the byte was dropped
+     */
+    bool put(uint32_t data, unsigned int frame)
+    {
+        uint32_t byte = data & 0xFF;
+        if (byte >= 0xF8) {
+            // real-time bytes can be anywhere, even within other messages
+            if (!queue(byte, frame)) {
+                m_overflows++;
+                return false;
+            }
+            return true;
+        }
+        if ((byte & 0x80) && byte != 0xF7) {
+            // a status byte starts a new message (0xF7 ends a sysex one)
+            m_discarding = false;
+            m_msg_start = m_head;
+            m_msg_queued = true;
+        } else if (m_discarding) {
+            m_overflows++;
+            return false;
+        }
+        if (!queue(byte, frame)) {
+            m_overflows++;
+            if (m_msg_queued) {
+                m_overflows += (m_head - m_msg_start) & (MIDI_SCHEDULER_SIZE - 1);
+                m_head = m_msg_start;
+                m_msg_queued = false;
+            }
+            m_discarding = true;
+            return false;
+        }
+        return true;
+    };
+
+    /**
+     * @brief get the byte to send at a frame, if there is one
+     *
+     * @param frame the frame, relative to the current block. has to be
+     *              increasing within a block.
+     * @param data the byte, with the 'MIDI byte present' flag set
+     * @return true if a byte is due at this frame
+     */
+    bool get(unsigned int frame, uint32_t &data)
+    {
+        if (m_head == m_tail) return false;
+        uint32_t now = m_now + frame;
+        struct event &e = m_events[m_tail];
+        // wrap-around safe versions of e.frame > now and m_next > now
+        if ((int32_t)(e.frame - now) > 0) return false;
+        if ((int32_t)(m_next - now) > 0) return false;
+        data = 0x01000000 | e.data;
+        if (m_tail == m_msg_start) {
+            // the current message can't be dropped as a whole anymore
+            m_msg_queued = false;
+        }
+        m_tail = (m_tail + 1) & (MIDI_SCHEDULER_SIZE - 1);
+        m_next = now + m_spacing;
+        return true;
+    };
+
+    /**
+     * @brief move on to the next block
+     * @param nframes the number of frames in the current block
+     */
+    void advance(unsigned int nframes)
+        {m_now += nframes;};
+
+    /**
+     * @brief the number of queued bytes
+     */
+    unsigned int getFill()
+        {return (m_head - m_tail) & (MIDI_SCHEDULER_SIZE - 1);};
+
+    /**
+     * @brief the number of bytes dropped because the queue was full
+     */
+    unsigned int getOverflowCount() {return m_overflows;};
+
+    /**
+     * @brief true the first time bytes were dropped since reset()
+     *
+     * Lets the stream processors warn once instead of for every byte.
+     */
+    bool isNewOverflow()
+    {
+        if (m_overflows == 0 || m_overflow_reported) return false;
+        m_overflow_reported = true;
+        return true;
+    };
+
+private:
+    bool queue(uint32_t byte, unsigned int frame)
+    {
+        unsigned int next = (m_head + 1) & (MIDI_SCHEDULER_SIZE - 1);
+        if (next == m_tail) return false;
+        struct event &e = m_events[m_head];
+        e.data = byte;
+        e.frame = m_now + frame;
+        m_head = next;
+        return true;
+    };
+
+    struct event {
+        uint32_t frame;
+        uint32_t data;
+    };
+    struct event m_events[MIDI_SCHEDULER_SIZE];
+    unsigned int m_head;
+    unsigned int m_tail;
+
+    // the frame count at the start of the current block
+    uint32_t m_now;
+    // the first frame at which a byte can be handed out again
+    uint32_t m_next;
+    unsigned int m_spacing;
+    unsigned int m_overflows;
+    bool m_overflow_reported;
+
+    // where the last message that is still (partially) queued starts
+    unsigned int m_msg_start;
+    bool m_msg_queued;
+    // the queue overflowed, drop bytes up to the next message
+    bool m_discarding;
+};
+
+}
+
+#endif /* __FFADO_MIDISCHEDULER__ */
@@ -39,6 +39,7 @@ Port::Port(PortManager& m, std::string name,
     , m_PortType( porttype )
     , m_Direction( direction )
     , m_buffer( NULL )
+    , m_buffer_stride( 1 )
     , m_manager( m )
     , m_State( E_Created )
 {
@@ -90,10 +91,8 @@ bool Port::setName(std::string name) {
 
 bool Port::setBufferSize(unsigned int newsize) {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Setting buffersize to %d for port %s\n",newsize,m_Name.c_str());
-    if (m_State != E_Created && m_disabled == false) {
-        debugFatal("Port (%s) not in E_Created/disabled state: %d\n",m_Name.c_str(),m_State);
-        return false;
-    }
+    // the buffer itself is provided by the client, hence the size
+    // can change at any time (e.g. on a period size change)
     m_buffersize=newsize;
     return true;
 }
@@ -160,11 +159,17 @@ void Port::show() {
     debugOutput(DEBUG_LEVEL_VERBOSE,"Enabled?      : %d\n", m_disabled==false);
     debugOutput(DEBUG_LEVEL_VERBOSE,"State?        : %d\n", m_State);
     debugOutput(DEBUG_LEVEL_VERBOSE,"Buffer Size   : %d\n", m_buffersize);
+    debugOutput(DEBUG_LEVEL_VERBOSE,"Buffer Stride : %d\n", m_buffer_stride);
     debugOutput(DEBUG_LEVEL_VERBOSE,"Event Size    : %d\n", getEventSize());
     debugOutput(DEBUG_LEVEL_VERBOSE,"Port Type     : %d\n", m_PortType);
     debugOutput(DEBUG_LEVEL_VERBOSE,"Direction     : %d\n", m_Direction);
 }
 
+void MidiPort::show() {
+    Port::show();
+    debugOutput(DEBUG_LEVEL_VERBOSE,"Dropped bytes : %u\n", m_scheduler.getOverflowCount());
+}
+
 void Port::setVerboseLevel(int l) {
     setDebugLevel(l);
 }
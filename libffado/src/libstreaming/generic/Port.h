@@ -25,6 +25,7 @@
 #define __FFADO_PORT__
 
 #include "libutil/ringbuffer.h"
+#include "MidiScheduler.h"
 
 #include "debugmodule/debugmodule.h"
 
@@ -124,13 +125,25 @@ public:
      * be large enough
      * if there is an internal buffer, it will be resized
      *
-     * \note use before calling init()
+     * \note can be changed while streaming, the client has to
+     *       provide a large enough buffer before the next transfer
      */
     virtual bool setBufferSize(unsigned int);
 
     void setBufferAddress(void *buff);
     void *getBufferAddress();
 
+    /**
+     * \brief sets the distance between two samples in the port buffer
+     *
+     * counted in samples. 1 for a non-interleaved buffer, the number
+     * of channels for a port that is a channel of an interleaved buffer.
+     *
+     * \note can be changed anytime, together with the buffer address
+     */
+    void setBufferStride(unsigned int stride) {m_buffer_stride = stride;};
+    unsigned int getBufferStride() {return m_buffer_stride;};
+
     PortManager& getManager() { return m_manager; };
 
     virtual void setVerboseLevel(int l);
@@ -146,6 +159,7 @@ protected:
     enum E_Direction m_Direction;
 
     void *m_buffer;
+    unsigned int m_buffer_stride;
 
     PortManager& m_manager;
 
@@ -182,6 +196,8 @@ public:
 /*!
 \brief The Base Class for a Midi Port
 
+ A midi port has a scheduler that the stream processor uses to place the
+ bytes at the frames they belong to, see MidiScheduler.h.
 
 */
 class MidiPort : public Port {
@@ -192,6 +208,13 @@ public:
       : Port(m, name, E_Midi, direction)
     {};
     virtual ~MidiPort() {};
+
+    virtual void show();
+
+    MidiScheduler& getScheduler() {return m_scheduler;};
+
+protected:
+    MidiScheduler m_scheduler;
 };
 
 /*!
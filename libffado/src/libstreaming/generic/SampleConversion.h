@@ -0,0 +1,604 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_SAMPLECONVERSION__
+#define __FFADO_SAMPLECONVERSION__
+
+/*
+ * Conversion between the 24 bit samples carried by all supported devices
+ * and the sample formats a client can ask for.
+ *
+ * The stream processors have dedicated (de)muxing code for the int24 and
+ * float formats with non-interleaved port buffers. For the other formats,
+ * and for port buffers that are part of an interleaved client buffer, they
+ * extract a block of 24 bit samples from the events into a small temporary
+ * array and convert that block to/from the port buffer with the functions
+ * below. This way the conversion is still done in the same pass as the
+ * (de)muxing.
+ *
+ * Blocks that are contiguous in the port buffer are converted with SSE2 or
+ * NEON (aarch64 only, since 32 bit ARM lacks rounding conversions and
+ * double vectors) when the build enables it. The scalar functions are the
+ * reference and handle the remaining samples and the interleaved buffers.
+ */
+
+#include "libstreaming/StreamProcessorManager.h"
+#include "libutil/float_cast.h"
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace Streaming {
+
+// the number of samples converted at once by the generic (de)muxing code
+#define SAMPLE_CONVERSION_BLOCK_SIZE        64
+
+/**
+ * @brief the size of one sample of the given type
+ * @param t the audio data type
+ * @return the size in bytes
+ */
+static inline unsigned int
+getAudioSampleSize(enum StreamProcessorManager::eADT_AudioDataType t)
+{
+    switch(t) {
+        case StreamProcessorManager::eADT_Int16:
+            return 2;
+        case StreamProcessorManager::eADT_Float64:
+            return 8;
+        default:
+            return 4;
+    }
+}
+
+/**
+ * @brief true if the stream processors have dedicated code for the type
+ *
+ * @param t the audio data type
+ * @param stride the stride of the port buffer
+ * @return true if the int24/float specific code can be used
+ */
+static inline bool
+isNativeAudioSampleLayout(enum StreamProcessorManager::eADT_AudioDataType t,
+                          unsigned int stride)
+{
+    return stride == 1 && (t == StreamProcessorManager::eADT_Int24
+                           || t == StreamProcessorManager::eADT_Float);
+}
+
+/**
+ * @brief convert 24 bit samples to the client sample format, scalar version
+ *
+ * @param t the client sample format
+ * @param src nevents samples, only the 24 LSB's are used
+ * @param buffer the port buffer
+ * @param offset the position in the port buffer to start at, in frames
+ * @param stride the distance between two samples in the port buffer, in samples
+ * @param nevents the number of samples
+ */
+static inline void
+convertInt24ToClientScalar(enum StreamProcessorManager::eADT_AudioDataType t,
+                           const int32_t *src, void *buffer,
+                           unsigned int offset, unsigned int stride,
+                           unsigned int nevents)
+{
+    unsigned int j;
+    switch(t) {
+        case StreamProcessorManager::eADT_Int24:
+            {
+                int32_t *dst = (int32_t *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    // sign-extend highest bit of 24-bit int
+                    *dst = (int32_t)((uint32_t)src[j] << 8) >> 8;
+                    dst += stride;
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            {
+                int32_t *dst = (int32_t *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    *dst = (int32_t)((uint32_t)src[j] << 8);
+                    dst += stride;
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            {
+                int16_t *dst = (int16_t *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    *dst = (int16_t)((int32_t)((uint32_t)src[j] << 8) >> 16);
+                    dst += stride;
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float:
+            {
+                const float multiplier = 1.0f / (float)(0x7FFFFF);
+                float *dst = (float *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    *dst = ((int32_t)((uint32_t)src[j] << 8) >> 8) * multiplier;
+                    dst += stride;
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            {
+                const double multiplier = 1.0 / (double)(0x7FFFFF);
+                double *dst = (double *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    *dst = ((int32_t)((uint32_t)src[j] << 8) >> 8) * multiplier;
+                    dst += stride;
+                }
+            }
+            break;
+    }
+}
+
+/**
+ * @brief convert samples in the client sample format to 24 bit samples, scalar version
+ *
+ * @param t the client sample format
+ * @param buffer the port buffer
+ * @param offset the position in the port buffer to start at, in frames
+ * @param stride the distance between two samples in the port buffer, in samples
+ * @param dst nevents samples, the result is in the 24 LSB's (sign-extended)
+ * @param nevents the number of samples
+ * @param clip clip float samples to [-1.0..1.0]
+ */
+static inline void
+convertClientToInt24Scalar(enum StreamProcessorManager::eADT_AudioDataType t,
+                           const void *buffer, unsigned int offset, unsigned int stride,
+                           int32_t *dst, unsigned int nevents, bool clip)
+{
+    unsigned int j;
+    switch(t) {
+        case StreamProcessorManager::eADT_Int24:
+            {
+                const int32_t *src = (const int32_t *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    dst[j] = (int32_t)((uint32_t)*src << 8) >> 8;
+                    src += stride;
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            {
+                const int32_t *src = (const int32_t *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    dst[j] = *src >> 8;
+                    src += stride;
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            {
+                const int16_t *src = (const int16_t *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    dst[j] = (int32_t)*src << 8;
+                    src += stride;
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float:
+            {
+                const float multiplier = (float)(0x7FFFFF);
+                const float *src = (const float *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    float in = *src;
+                    if (clip) {
+                        if (in > 1.0f) in = 1.0f;
+                        if (in < -1.0f) in = -1.0f;
+                    }
+                    dst[j] = lrintf(in * multiplier);
+                    src += stride;
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            {
+                const double multiplier = (double)(0x7FFFFF);
+                const double *src = (const double *)buffer + offset * stride;
+                for(j = 0; j < nevents; j++) {
+                    double in = *src;
+                    if (clip) {
+                        if (in > 1.0) in = 1.0;
+                        if (in < -1.0) in = -1.0;
+                    }
+                    dst[j] = lrint(in * multiplier);
+                    src += stride;
+                }
+            }
+            break;
+    }
+}
+
+/*
+ * The vector kernels convert the samples of a contiguous port buffer
+ * (stride 1) as long as there are enough of them to fill the vectors,
+ * and return how many they converted. They give the same results as the
+ * scalar versions (for floats in the default rounding mode).
+ */
+#if defined(__SSE2__)
+
+static inline unsigned int
+convertInt24ToClientVector(enum StreamProcessorManager::eADT_AudioDataType t,
+                           const int32_t *src, void *buffer,
+                           unsigned int offset, unsigned int nevents)
+{
+    unsigned int j = 0;
+    switch(t) {
+        case StreamProcessorManager::eADT_Int24:
+            {
+                int32_t *dst = (int32_t *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(src + j));
+                    v = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+                    _mm_storeu_si128((__m128i *)(dst + j), v);
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            {
+                int32_t *dst = (int32_t *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(src + j));
+                    _mm_storeu_si128((__m128i *)(dst + j), _mm_slli_epi32(v, 8));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            {
+                int16_t *dst = (int16_t *)buffer + offset;
+                for(; j + 8 <= nevents; j += 8) {
+                    __m128i v1 = _mm_loadu_si128((const __m128i *)(src + j));
+                    __m128i v2 = _mm_loadu_si128((const __m128i *)(src + j + 4));
+                    // the 16 MSB's of the 24 bit samples, these don't saturate
+                    v1 = _mm_srai_epi32(_mm_slli_epi32(v1, 8), 16);
+                    v2 = _mm_srai_epi32(_mm_slli_epi32(v2, 8), 16);
+                    _mm_storeu_si128((__m128i *)(dst + j), _mm_packs_epi32(v1, v2));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float:
+            {
+                const __m128 multiplier = _mm_set1_ps(1.0f / (float)(0x7FFFFF));
+                float *dst = (float *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(src + j));
+                    v = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+                    _mm_storeu_ps(dst + j, _mm_mul_ps(_mm_cvtepi32_ps(v), multiplier));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            {
+                const __m128d multiplier = _mm_set1_pd(1.0 / (double)(0x7FFFFF));
+                double *dst = (double *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(src + j));
+                    v = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+                    __m128d lo = _mm_cvtepi32_pd(v);
+                    __m128d hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+                    _mm_storeu_pd(dst + j, _mm_mul_pd(lo, multiplier));
+                    _mm_storeu_pd(dst + j + 2, _mm_mul_pd(hi, multiplier));
+                }
+            }
+            break;
+    }
+    return j;
+}
+
+static inline unsigned int
+convertClientToInt24Vector(enum StreamProcessorManager::eADT_AudioDataType t,
+                           const void *buffer, unsigned int offset,
+                           int32_t *dst, unsigned int nevents, bool clip)
+{
+    unsigned int j = 0;
+    switch(t) {
+        case StreamProcessorManager::eADT_Int24:
+            {
+                const int32_t *src = (const int32_t *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(src + j));
+                    v = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+                    _mm_storeu_si128((__m128i *)(dst + j), v);
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            {
+                const int32_t *src = (const int32_t *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(src + j));
+                    _mm_storeu_si128((__m128i *)(dst + j), _mm_srai_epi32(v, 8));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            {
+                const __m128i zero = _mm_setzero_si128();
+                const int16_t *src = (const int16_t *)buffer + offset;
+                for(; j + 8 <= nevents; j += 8) {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(src + j));
+                    // put the samples in the upper halves and sign-extend them
+                    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 8);
+                    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 8);
+                    _mm_storeu_si128((__m128i *)(dst + j), lo);
+                    _mm_storeu_si128((__m128i *)(dst + j + 4), hi);
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float:
+            {
+                const __m128 multiplier = _mm_set1_ps((float)(0x7FFFFF));
+                const __m128 v_max = _mm_set1_ps(1.0f);
+                const __m128 v_min = _mm_set1_ps(-1.0f);
+                const float *src = (const float *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    __m128 in = _mm_loadu_ps(src + j);
+                    if (clip) {
+                        in = _mm_max_ps(_mm_min_ps(in, v_max), v_min);
+                    }
+                    _mm_storeu_si128((__m128i *)(dst + j),
+                                     _mm_cvtps_epi32(_mm_mul_ps(in, multiplier)));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            {
+                const __m128d multiplier = _mm_set1_pd((double)(0x7FFFFF));
+                const __m128d v_max = _mm_set1_pd(1.0);
+                const __m128d v_min = _mm_set1_pd(-1.0);
+                const double *src = (const double *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    __m128d in1 = _mm_loadu_pd(src + j);
+                    __m128d in2 = _mm_loadu_pd(src + j + 2);
+                    if (clip) {
+                        in1 = _mm_max_pd(_mm_min_pd(in1, v_max), v_min);
+                        in2 = _mm_max_pd(_mm_min_pd(in2, v_max), v_min);
+                    }
+                    // each conversion fills the lower half
+                    __m128i lo = _mm_cvtpd_epi32(_mm_mul_pd(in1, multiplier));
+                    __m128i hi = _mm_cvtpd_epi32(_mm_mul_pd(in2, multiplier));
+                    _mm_storeu_si128((__m128i *)(dst + j), _mm_unpacklo_epi64(lo, hi));
+                }
+            }
+            break;
+    }
+    return j;
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+static inline unsigned int
+convertInt24ToClientVector(enum StreamProcessorManager::eADT_AudioDataType t,
+                           const int32_t *src, void *buffer,
+                           unsigned int offset, unsigned int nevents)
+{
+    unsigned int j = 0;
+    switch(t) {
+        case StreamProcessorManager::eADT_Int24:
+            {
+                int32_t *dst = (int32_t *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    int32x4_t v = vld1q_s32(src + j);
+                    vst1q_s32(dst + j, vshrq_n_s32(vshlq_n_s32(v, 8), 8));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            {
+                int32_t *dst = (int32_t *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    int32x4_t v = vld1q_s32(src + j);
+                    vst1q_s32(dst + j, vshlq_n_s32(v, 8));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            {
+                int16_t *dst = (int16_t *)buffer + offset;
+                for(; j + 8 <= nevents; j += 8) {
+                    int32x4_t v1 = vshlq_n_s32(vld1q_s32(src + j), 8);
+                    int32x4_t v2 = vshlq_n_s32(vld1q_s32(src + j + 4), 8);
+                    vst1q_s16(dst + j, vcombine_s16(vshrn_n_s32(v1, 16), vshrn_n_s32(v2, 16)));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float:
+            {
+                const float32x4_t multiplier = vdupq_n_f32(1.0f / (float)(0x7FFFFF));
+                float *dst = (float *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    int32x4_t v = vld1q_s32(src + j);
+                    v = vshrq_n_s32(vshlq_n_s32(v, 8), 8);
+                    vst1q_f32(dst + j, vmulq_f32(vcvtq_f32_s32(v), multiplier));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            {
+                const float64x2_t multiplier = vdupq_n_f64(1.0 / (double)(0x7FFFFF));
+                double *dst = (double *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    int32x4_t v = vld1q_s32(src + j);
+                    v = vshrq_n_s32(vshlq_n_s32(v, 8), 8);
+                    float64x2_t lo = vcvtq_f64_s64(vmovl_s32(vget_low_s32(v)));
+                    float64x2_t hi = vcvtq_f64_s64(vmovl_high_s32(v));
+                    vst1q_f64(dst + j, vmulq_f64(lo, multiplier));
+                    vst1q_f64(dst + j + 2, vmulq_f64(hi, multiplier));
+                }
+            }
+            break;
+    }
+    return j;
+}
+
+static inline unsigned int
+convertClientToInt24Vector(enum StreamProcessorManager::eADT_AudioDataType t,
+                           const void *buffer, unsigned int offset,
+                           int32_t *dst, unsigned int nevents, bool clip)
+{
+    unsigned int j = 0;
+    switch(t) {
+        case StreamProcessorManager::eADT_Int24:
+            {
+                const int32_t *src = (const int32_t *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    int32x4_t v = vld1q_s32(src + j);
+                    vst1q_s32(dst + j, vshrq_n_s32(vshlq_n_s32(v, 8), 8));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int32:
+            {
+                const int32_t *src = (const int32_t *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    vst1q_s32(dst + j, vshrq_n_s32(vld1q_s32(src + j), 8));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Int16:
+            {
+                const int16_t *src = (const int16_t *)buffer + offset;
+                for(; j + 8 <= nevents; j += 8) {
+                    int16x8_t v = vld1q_s16(src + j);
+                    vst1q_s32(dst + j, vshlq_n_s32(vmovl_s16(vget_low_s16(v)), 8));
+                    vst1q_s32(dst + j + 4, vshlq_n_s32(vmovl_high_s16(v), 8));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float:
+            {
+                const float32x4_t multiplier = vdupq_n_f32((float)(0x7FFFFF));
+                const float32x4_t v_max = vdupq_n_f32(1.0f);
+                const float32x4_t v_min = vdupq_n_f32(-1.0f);
+                const float *src = (const float *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    float32x4_t in = vld1q_f32(src + j);
+                    if (clip) {
+                        in = vmaxq_f32(vminq_f32(in, v_max), v_min);
+                    }
+                    // round to nearest, like lrintf()
+                    vst1q_s32(dst + j, vcvtnq_s32_f32(vmulq_f32(in, multiplier)));
+                }
+            }
+            break;
+        case StreamProcessorManager::eADT_Float64:
+            {
+                const float64x2_t multiplier = vdupq_n_f64((double)(0x7FFFFF));
+                const float64x2_t v_max = vdupq_n_f64(1.0);
+                const float64x2_t v_min = vdupq_n_f64(-1.0);
+                const double *src = (const double *)buffer + offset;
+                for(; j + 4 <= nevents; j += 4) {
+                    float64x2_t in1 = vld1q_f64(src + j);
+                    float64x2_t in2 = vld1q_f64(src + j + 2);
+                    if (clip) {
+                        in1 = vmaxq_f64(vminq_f64(in1, v_max), v_min);
+                        in2 = vmaxq_f64(vminq_f64(in2, v_max), v_min);
+                    }
+                    int64x2_t lo = vcvtnq_s64_f64(vmulq_f64(in1, multiplier));
+                    int64x2_t hi = vcvtnq_s64_f64(vmulq_f64(in2, multiplier));
+                    vst1q_s32(dst + j, vcombine_s32(vmovn_s64(lo), vmovn_s64(hi)));
+                }
+            }
+            break;
+    }
+    return j;
+}
+
+#else
+
+static inline unsigned int
+convertInt24ToClientVector(enum StreamProcessorManager::eADT_AudioDataType t,
+                           const int32_t *src, void *buffer,
+                           unsigned int offset, unsigned int nevents)
+{
+    return 0;
+}
+
+static inline unsigned int
+convertClientToInt24Vector(enum StreamProcessorManager::eADT_AudioDataType t,
+                           const void *buffer, unsigned int offset,
+                           int32_t *dst, unsigned int nevents, bool clip)
+{
+    return 0;
+}
+
+#endif
+
+/**
+ * @brief convert 24 bit samples to the client sample format
+ *
+ * @param t the client sample format
+ * @param src nevents samples, only the 24 LSB's are used
+ * @param buffer the port buffer
+ * @param offset the position in the port buffer to start at, in frames
+ * @param stride the distance between two samples in the port buffer, in samples
+ * @param nevents the number of samples
+ */
+static inline void
+convertInt24ToClient(enum StreamProcessorManager::eADT_AudioDataType t,
+                     const int32_t *src, void *buffer,
+                     unsigned int offset, unsigned int stride,
+                     unsigned int nevents)
+{
+    unsigned int done = 0;
+    if (stride == 1) {
+        done = convertInt24ToClientVector(t, src, buffer, offset, nevents);
+    }
+    convertInt24ToClientScalar(t, src + done, buffer, offset + done, stride, nevents - done);
+}
+
+/**
+ * @brief convert samples in the client sample format to 24 bit samples
+ *
+ * @param t the client sample format
+ * @param buffer the port buffer
+ * @param offset the position in the port buffer to start at, in frames
+ * @param stride the distance between two samples in the port buffer, in samples
+ * @param dst nevents samples, the result is in the 24 LSB's (sign-extended)
+ * @param nevents the number of samples
+ * @param clip clip float samples to [-1.0..1.0]
+ */
+static inline void
+convertClientToInt24(enum StreamProcessorManager::eADT_AudioDataType t,
+                     const void *buffer, unsigned int offset, unsigned int stride,
+                     int32_t *dst, unsigned int nevents, bool clip)
+{
+    unsigned int done = 0;
+    if (stride == 1) {
+        done = convertClientToInt24Vector(t, buffer, offset, dst, nevents, clip);
+    }
+    convertClientToInt24Scalar(t, buffer, offset + done, stride, dst + done, nevents - done, clip);
+}
+
+}
+
+#endif /* __FFADO_SAMPLECONVERSION__ */
@@ -22,6 +22,8 @@
  */
 
 #include "StreamProcessor.h"
+#include "IsoStreamCapture.h"
+#include "SampleConversion.h"
 #include "../StreamProcessorManager.h"
 
 #include "devicemanager.h"
@@ -33,9 +35,11 @@
 #include "libutil/Time.h"
 
 #include "libutil/Atomic.h"
+#include "libutil/RtMemory.h"
 
 #include <assert.h>
 #include <math.h>
+#include <cstring>
 
 #define SIGNAL_ACTIVITY_SPM { \
     m_StreamProcessorManager.signalActivity(); \
@@ -66,21 +70,38 @@ StreamProcessor::StreamProcessor(FFADODevice &parent, enum eProcessorType type)
     , m_IsoHandlerManager( parent.get1394Service().getIsoHandlerManager() ) // local cache
     , m_StreamProcessorManager( m_Parent.getDeviceManager().getStreamProcessorManager() ) // local cache
     , m_local_node_id ( 0 ) // local cache
+    , m_packet_capture( NULL )
     , m_channel( -1 )
     , m_last_timestamp( 0 )
     , m_last_timestamp2( 0 )
     , m_correct_last_timestamp( false )
     , m_scratch_buffer( NULL )
     , m_scratch_buffer_size_bytes( 0 )
+    , m_next_scratch_buffer( NULL )
+    , m_next_scratch_buffer_size_bytes( 0 )
     , m_ticks_per_frame( 0 )
     , m_dll_bandwidth_hz ( STREAMPROCESSOR_DLL_BW_HZ )
+    , m_dll_adaptive ( STREAMPROCESSOR_DLL_ADAPTIVE )
     , m_extra_buffer_frames( 0 )
     , m_max_fs_diff_norm ( 0.01 )
     , m_max_diff_ticks ( 50 )
     , m_in_xrun( false )
+    , m_measured_latency( 0 )
+    , m_max_measured_latency( 0 )
+    , m_latency_correction( 0 )
+    , m_latency_calibrated( false )
+    , m_xrun_info( 0 )
+    , m_dropped_cycles( 0 )
 {
     // create the timestamped buffer and register ourselves as its client
     m_data_buffer = new Util::TimestampedBuffer(this);
+
+    m_transfer_stats.setName("transfer time");
+    m_transfer_stats.setUnit("ns");
+    m_buffer_fill_stats.setName("buffer fill");
+    m_buffer_fill_stats.setUnit("frames");
+    m_packet_data_stats.setName(m_processor_type == ePT_Receive ? "decode time" : "encode time");
+    m_packet_data_stats.setUnit("ns");
 }
 
 StreamProcessor::~StreamProcessor() {
@@ -90,7 +111,9 @@ StreamProcessor::~StreamProcessor() {
     }
 
     if (m_data_buffer) delete m_data_buffer;
-    if (m_scratch_buffer) delete[] m_scratch_buffer;
+    if (m_scratch_buffer) Util::RtMemory::release(m_scratch_buffer);
+    if (m_next_scratch_buffer) Util::RtMemory::release(m_next_scratch_buffer);
+    if (m_packet_capture) delete m_packet_capture;
 }
 
 bool
@@ -109,8 +132,8 @@ StreamProcessor::periodSizeChanged(unsigned int new_periodsize) {
     // make the scratch buffer one period of frames long
     m_scratch_buffer_size_bytes = new_periodsize * getEventsPerFrame() * getEventSize();
     debugOutput( DEBUG_LEVEL_VERBOSE, " Allocate scratch buffer of %zd quadlets\n", m_scratch_buffer_size_bytes);
-    if(m_scratch_buffer) delete[] m_scratch_buffer;
-    m_scratch_buffer = new byte_t[m_scratch_buffer_size_bytes];
+    if(m_scratch_buffer) Util::RtMemory::release(m_scratch_buffer);
+    m_scratch_buffer = (byte_t *)Util::RtMemory::allocate(m_scratch_buffer_size_bytes);
     if(m_scratch_buffer == NULL) {
         debugFatal("Could not allocate scratch buffer\n");
         return false;
@@ -138,13 +161,100 @@ StreamProcessor::periodSizeChanged(unsigned int new_periodsize) {
     return updateState();
 }
 
+/**
+ * @brief Prepare a period size change while streaming
+ *
+ * Allocates everything that is needed for the new period size, such
+ * that commitPeriodSizeChange() doesn't have to. Doesn't change anything
+ * that is in use by the stream.
+ *
+ * @param new_periodsize the new period size
+ * @param new_extra_frames the extra buffer frames to use with the new period size
+ * @return true if the change is possible
+ */
+bool
+StreamProcessor::preparePeriodSizeChange(unsigned int new_periodsize, unsigned int new_extra_frames)
+{
+    // the data buffer is not resized while streaming, it has been
+    // sized for the largest period size when the stream was started
+    unsigned int needed = m_StreamProcessorManager.getNbBuffers() * new_periodsize
+                          + new_extra_frames + 1;
+    if (needed > m_data_buffer->getBufferSize()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) data buffer too small for period %u (%u < %u)\n",
+                    this, new_periodsize, m_data_buffer->getBufferSize(), needed);
+        return false;
+    }
+    // the period must span enough interrupts of the running ISO handler
+    if (!m_IsoHandlerManager.canServePeriodForStream(this, getNominalPacketsNeeded(new_periodsize))) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) ISO handler interrupts too seldom for period %u\n",
+                    this, new_periodsize);
+        return false;
+    }
+
+    if (m_next_scratch_buffer) Util::RtMemory::release(m_next_scratch_buffer);
+    m_next_scratch_buffer_size_bytes = new_periodsize * getEventsPerFrame() * getEventSize();
+    m_next_scratch_buffer = (byte_t *)Util::RtMemory::allocate(m_next_scratch_buffer_size_bytes);
+    if(m_next_scratch_buffer == NULL) {
+        debugError("Could not allocate scratch buffer\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Switch to a new period size while streaming
+ *
+ * Must be called at a period boundary, i.e. from the client thread in between
+ * two transfers, and only after a successful preparePeriodSizeChange().
+ * The ISO side of the stream is not affected.
+ *
+ * @param new_periodsize the new period size
+ * @param new_extra_frames the extra buffer frames to use with the new period size
+ */
+void
+StreamProcessor::commitPeriodSizeChange(unsigned int new_periodsize, unsigned int new_extra_frames)
+{
+    assert(m_next_scratch_buffer);
+    byte_t *old_scratch_buffer = m_scratch_buffer;
+    m_scratch_buffer = m_next_scratch_buffer;
+    m_scratch_buffer_size_bytes = m_next_scratch_buffer_size_bytes;
+    m_next_scratch_buffer = NULL;
+    m_next_scratch_buffer_size_bytes = 0;
+    Util::RtMemory::release(old_scratch_buffer);
+
+    m_extra_buffer_frames = new_extra_frames;
+
+    // the port buffers are provided by the client
+    for ( PortVectorIterator it = m_Ports.begin();
+        it != m_Ports.end();
+        ++it )
+    {
+        (*it)->setBufferSize(new_periodsize);
+    }
+
+    // the transmit buffer is written one period at a time
+    if (getType() == ePT_Transmit) {
+        m_data_buffer->setUpdatePeriod(new_periodsize);
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) period size now %u, %u extra frames\n",
+                this, new_periodsize, new_extra_frames);
+}
+
 bool
 StreamProcessor::handleBusResetDo()
 {
     debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) handling busreset\n", this);
+    if (m_Parent.streamsSurvivedBusReset()) {
+        // the iso channel has been restored, the stream keeps running.
+        // the local node id can have changed, it is the SID of our packets.
+        m_local_node_id = m_1394service.getLocalNodeId() & 0x3f;
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) stream survived busreset, local node %u\n",
+                    this, m_local_node_id);
+        return true;
+    }
     m_state = ePS_Error;
     // this will result in the SPM dying
-    m_in_xrun = true;
+    flagXrun(eXC_BusReset, 0xFFFFFFFF);
     SIGNAL_ACTIVITY_ALL;
     return true;
 }
@@ -172,14 +282,102 @@ void StreamProcessor::handlerDied()
 {
     debugWarning("Handler died for %p\n", this);
     m_state = ePS_Stopped;
-    m_in_xrun = true;
+    flagXrun(eXC_HandlerDied, 0xFFFFFFFF);
     SIGNAL_ACTIVITY_ALL;
 }
 
+/**
+ * @brief flag an xrun and remember its cause
+ *
+ * Only the first cause is kept until the xrun is cleared, since that
+ * is the one that started it.
+ *
+ * @param cause the reason for the xrun
+ * @param pkt_ctr the CTR of the packet that triggered it, 0xFFFFFFFF if none
+ */
+void
+StreamProcessor::flagXrun(enum eXrunCause cause, uint32_t pkt_ctr)
+{
+    uint32_t cycle = (pkt_ctr == 0xFFFFFFFF ? 0xFFFF : CYCLE_TIMER_GET_CYCLES(pkt_ctr));
+    // fails if a cause is set already
+    __sync_bool_compare_and_swap(&m_xrun_info, 0, ((uint32_t)cause << 16) | cycle);
+    m_in_xrun = true;
+}
+
+enum StreamProcessor::eXrunCause
+StreamProcessor::getXrunCause(uint32_t &cycle)
+{
+    uint32_t info = m_xrun_info;
+    cycle = info & 0xFFFF;
+    if (cycle == 0xFFFF) {
+        cycle = 0xFFFFFFFF;
+    }
+    return (enum eXrunCause)(info >> 16);
+}
+
 int StreamProcessor::getMaxFrameLatency() {
     return (int)(m_IsoHandlerManager.getPacketLatencyForStream( this ) * TICKS_PER_CYCLE);
 }
 
+unsigned int
+StreamProcessor::getNominalLatency()
+{
+    unsigned int period = m_StreamProcessorManager.getPeriodSize();
+    float tpf = (float)TICKS_PER_SECOND / (float)m_StreamProcessorManager.getNominalRate();
+    int sync_delay_frames = (int)((float)m_StreamProcessorManager.getSyncDelay() / tpf);
+    int latency;
+
+    if (getType() == ePT_Receive) {
+        // the client is woken up sync_delay after the end of the period
+        latency = period + sync_delay_frames;
+        latency += (int)((float)getReceiveTransferDelay() / tpf);
+    } else {
+        // the frames written are presented one ringbuffer after the
+        // period was received (see StreamProcessorManager::transfer)
+        latency = (m_StreamProcessorManager.getNbBuffers() - 1) * period;
+        latency += m_extra_buffer_frames;
+        latency -= sync_delay_frames;
+    }
+    return (latency > 0 ? latency : 0);
+}
+
+void
+StreamProcessor::updateMeasuredLatency(uint64_t time_of_wakeup)
+{
+    ffado_timestamp_t ts;
+    signed int fc;
+    float tpf = getTicksPerFrame();
+    int64_t latency_ticks;
+
+    if (tpf <= 0.0) return;
+
+    if (getType() == ePT_Receive) {
+        // the head is the first frame of the period to be read
+        m_data_buffer->getBufferHeadTimestamp(&ts, &fc);
+        latency_ticks = diffTicks(time_of_wakeup, (int64_t)ts);
+        latency_ticks += getReceiveTransferDelay();
+    } else {
+        // the tail is the last frame of the period just written
+        m_data_buffer->getBufferTailTimestamp(&ts, &fc);
+        int64_t first = (int64_t)ts;
+        first = substractTicks(first, (uint64_t)(tpf * (m_StreamProcessorManager.getPeriodSize() - 1)));
+        latency_ticks = diffTicks(first, time_of_wakeup);
+    }
+    if (latency_ticks < 0) latency_ticks = 0;
+
+    m_measured_latency = (unsigned int)((float)latency_ticks / tpf + 0.5);
+    if (m_measured_latency > m_max_measured_latency) {
+        m_max_measured_latency = m_measured_latency;
+    }
+}
+
+void
+StreamProcessor::resetMeasuredLatency()
+{
+    m_measured_latency = 0;
+    m_max_measured_latency = 0;
+}
+
 unsigned int
 StreamProcessor::getNominalPacketsNeeded(unsigned int nframes)
 {
@@ -192,10 +390,20 @@ StreamProcessor::getNominalPacketsNeeded(unsigned int nframes)
     return nominal_packets;
 }
 
+/**
+ * @brief the number of packets in a period
+ *
+ * The ISO handler sets its interrupt interval up for this, and that can't
+ * be changed while it runs. Hence this is the number of packets in the
+ * smallest period size that can be used while streaming (see
+ * StreamProcessorManager::getMinLivePeriodSize()).
+ *
+ * @return number of packets
+ */
 unsigned int
 StreamProcessor::getPacketsPerPeriod()
 {
-    return getNominalPacketsNeeded(m_StreamProcessorManager.getPeriodSize());
+    return getNominalPacketsNeeded(m_StreamProcessorManager.getMinLivePeriodSize());
 }
 
 unsigned int
@@ -254,6 +462,31 @@ StreamProcessor::setupDataBuffer() {
     return result;
 }
 
+/**
+ * @brief the size of the data buffer when starting to stream
+ *
+ * When the period size can be changed while streaming, the buffer is made
+ * large enough for the largest period size that is allowed. Since the sum
+ * of the period buffers and the extra frames is kept constant across such
+ * a change (see StreamProcessorManager::setPeriodSize()) an additional
+ * period is enough margin.
+ */
+unsigned int
+StreamProcessor::getRingBufferSizeFrames()
+{
+    unsigned int nb_buffers = m_StreamProcessorManager.getNbBuffers();
+    unsigned int period = m_StreamProcessorManager.getPeriodSize();
+    unsigned int max_period = m_StreamProcessorManager.getMaxLivePeriodSize();
+
+    unsigned int ringbuffer_size_frames = nb_buffers * period;
+    if (max_period > period) {
+        ringbuffer_size_frames = (nb_buffers + 1) * max_period;
+    }
+    ringbuffer_size_frames += m_extra_buffer_frames;
+    ringbuffer_size_frames += 1; // to ensure that we can fit it all in there
+    return ringbuffer_size_frames;
+}
+
 void
 StreamProcessor::getBufferHeadTimestamp(ffado_timestamp_t *ts, signed int *fc)
 {
@@ -331,6 +564,13 @@ StreamProcessor::getTicksPerFrame()
     return m_data_buffer->getRate();
 }
 
+float
+StreamProcessor::getDllError()
+{
+    assert(m_data_buffer != NULL);
+    return m_data_buffer->getDllError();
+}
+
 void
 StreamProcessor::setTicksPerFrame(float tpf)
 {
@@ -396,6 +636,11 @@ StreamProcessor::putPacket(unsigned char *data, unsigned int length,
         return RAW1394_ISO_OK;
     }
 
+    if (m_packet_capture) {
+        m_packet_capture->record(data, length, channel, tag, sy,
+                                 pkt_ctr, dropped_cycles);
+    }
+
     // store the previous timestamp
     m_last_timestamp2 = m_last_timestamp;
 
@@ -444,11 +689,12 @@ StreamProcessor::putPacket(unsigned char *data, unsigned int length,
 
     // handle dropped cycles
     if(dropped_cycles) {
+        m_dropped_cycles += dropped_cycles;
         // make sure the last_timestamp is corrected
         m_correct_last_timestamp = true;
         if (m_state == ePS_Running) {
             // this is an xrun situation
-            m_in_xrun = true;
+            flagXrun(eXC_DroppedCycles, pkt_ctr);
             debugOutput(DEBUG_LEVEL_NORMAL, "Should update state to WaitingForStreamDisable due to dropped packet xrun\n");
             m_cycle_to_switch_state = CYCLE_TIMER_GET_CYCLES(pkt_ctr) + 1; // switch in the next cycle
             m_next_state = ePS_WaitingForStreamDisable;
@@ -579,13 +825,15 @@ StreamProcessor::putPacket(unsigned char *data, unsigned int length,
 
         // for all states that reach this we are allowed to
         // do protocol specific data reception
+        uint64_t start = Util::SystemTimeSource::getCurrentTimeAsNsecs();
         enum eChildReturnValue result2 = processPacketData(data, length);
+        m_packet_data_stats.mark((int)(Util::SystemTimeSource::getCurrentTimeAsNsecs() - start));
 
         // if an xrun occured, switch to the dryRunning state and
         // allow for the xrun to be picked up
         if (result2 == eCRV_XRun) {
             debugOutput(DEBUG_LEVEL_NORMAL, "processPacketData xrun\n");
-            m_in_xrun = true;
+            flagXrun(eXC_BufferFull, pkt_ctr);
             debugOutput(DEBUG_LEVEL_VERBOSE, "Should update state to WaitingForStreamDisable due to data xrun\n");
             m_cycle_to_switch_state = CYCLE_TIMER_GET_CYCLES(pkt_ctr)+1; // switch in the next cycle
             m_next_state = ePS_WaitingForStreamDisable;
@@ -633,9 +881,10 @@ StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
     // note that we can ignore skipped cycles since
     // the protocol will take care of that
     if (dropped_cycles > 0) {
+        m_dropped_cycles += dropped_cycles;
         // HACK: this should not be necessary, since the header generation functions should trigger the xrun.
         //       but apparently there are some issues with the 1394 stack
-        m_in_xrun = true;
+        flagXrun(eXC_DroppedCycles, pkt_ctr);
         if(m_state == ePS_Running) {
             debugShowBackLogLines(200);
             debugOutput(DEBUG_LEVEL_NORMAL, "dropped packets xrun (%u)\n", dropped_cycles);
@@ -762,12 +1011,14 @@ StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
                 }
             }
 
+            uint64_t start = Util::SystemTimeSource::getCurrentTimeAsNsecs();
             enum eChildReturnValue result2 = generatePacketData(data, length);
+            m_packet_data_stats.mark((int)(Util::SystemTimeSource::getCurrentTimeAsNsecs() - start));
             // if an xrun occured, switch to the dryRunning state and
             // allow for the xrun to be picked up
             if (result2 == eCRV_XRun) {
                 debugOutput(DEBUG_LEVEL_NORMAL, "generatePacketData xrun\n");
-                m_in_xrun = true;
+                flagXrun(eXC_BufferEmpty, pkt_ctr);
                 debugOutput(DEBUG_LEVEL_VERBOSE, "Should update state to WaitingForStreamDisable due to data xrun\n");
                 m_cycle_to_switch_state = CYCLE_TIMER_GET_CYCLES(pkt_ctr) + 1; // switch in the next cycle
                 m_next_state = ePS_WaitingForStreamDisable;
@@ -824,7 +1075,11 @@ StreamProcessor::getPacket(unsigned char *data, unsigned int *length,
             }
         } else if (result == eCRV_XRun) { // pick up the possible xruns
             debugOutput(DEBUG_LEVEL_NORMAL, "generatePacketHeader xrun\n");
-            m_in_xrun = true;
+            flagXrun(eXC_FramesLate, pkt_ctr);
+            if (skipLateFrames(pkt_ctr)) {
+                // keep running, the SPM will resync the buffers
+                goto send_empty_packet;
+            }
             debugOutput(DEBUG_LEVEL_VERBOSE, "Should update state to WaitingForStreamDisable due to header xrun\n");
             m_cycle_to_switch_state = CYCLE_TIMER_GET_CYCLES(pkt_ctr) + 1; // switch in the next cycle
             m_next_state = ePS_WaitingForStreamDisable;
@@ -905,8 +1160,11 @@ bool StreamProcessor::getFrames(unsigned int nbframes, int64_t ts) {
                         "(%p, %s) getFrames(%d, %11" PRIu64 ")\n",
                         this, getTypeString(), nbframes, ts);
     assert( getType() == ePT_Receive );
+    uint64_t start = Util::SystemTimeSource::getCurrentTimeAsNsecs();
+    m_buffer_fill_stats.mark(m_data_buffer->getBufferFill());
     if(isDryRunning()) result = getFramesDry(nbframes, ts);
     else result = getFramesWet(nbframes, ts);
+    m_transfer_stats.mark((int)(Util::SystemTimeSource::getCurrentTimeAsNsecs() - start));
     SIGNAL_ACTIVITY_ISO_RECV;
     return result;
 }
@@ -962,6 +1220,32 @@ bool StreamProcessor::getFramesDry(unsigned int nbframes, int64_t ts)
     return provideSilenceBlock(nbframes, 0);
 }
 
+bool
+StreamProcessor::enablePacketCapture(unsigned int max_packets)
+{
+    if (m_state != ePS_Stopped && m_state != ePS_Created) {
+        debugError("Packet capture can't be changed while streaming\n");
+        return false;
+    }
+    if (m_packet_capture) {
+        delete m_packet_capture;
+        m_packet_capture = NULL;
+    }
+    if (max_packets == 0) {
+        return true;
+    }
+    IsoStreamCapture *capture = new IsoStreamCapture();
+    capture->setVerboseLevel(getDebugLevel());
+    capture->setNominalRate(m_StreamProcessorManager.getNominalRate());
+    if (!capture->allocate(max_packets, getMaxPacketSize())) {
+        debugError("Could not allocate packet capture\n");
+        delete capture;
+        return false;
+    }
+    m_packet_capture = capture;
+    return true;
+}
+
 bool
 StreamProcessor::dropFrames(unsigned int nbframes, int64_t ts)
 {
@@ -972,6 +1256,16 @@ StreamProcessor::dropFrames(unsigned int nbframes, int64_t ts)
     return result;
 }
 
+bool
+StreamProcessor::skipFrames(unsigned int nbframes)
+{
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) skipping %u frames\n", this, nbframes);
+    assert( getType() == ePT_Transmit );
+    // drop whole packets, such that the MIDI positions stay consistent
+    assert( nbframes % getNominalFramesPerPacket() == 0 );
+    return m_data_buffer->skipHeadFrames(nbframes);
+}
+
 bool StreamProcessor::putFrames(unsigned int nbframes, int64_t ts)
 {
     bool result;
@@ -979,8 +1273,11 @@ bool StreamProcessor::putFrames(unsigned int nbframes, int64_t ts)
                         "(%p, %s) putFrames(%d, %11" PRIu64 ")\n",
                         this, getTypeString(), nbframes, ts);
     assert( getType() == ePT_Transmit );
+    uint64_t start = Util::SystemTimeSource::getCurrentTimeAsNsecs();
+    m_buffer_fill_stats.mark(m_data_buffer->getBufferFill());
     if(isDryRunning()) result = putFramesDry(nbframes, ts);
     else result = putFramesWet(nbframes, ts);
+    m_transfer_stats.mark((int)(Util::SystemTimeSource::getCurrentTimeAsNsecs() - start));
     SIGNAL_ACTIVITY_ISO_XMIT;
     return result;
 }
@@ -1104,31 +1401,22 @@ StreamProcessor::provideSilenceToPort(Port *p, unsigned int offset, unsigned int
             }
             break;
         case Port::E_Audio:
-            switch(m_StreamProcessorManager.getAudioDataType()) {
-            case StreamProcessorManager::eADT_Int24:
-                {
-                    quadlet_t *buffer=(quadlet_t *)(p->getBufferAddress());
-                    assert(nevents + offset <= p->getBufferSize());
-                    buffer+=offset;
-    
-                    for(j = 0; j < nevents; j += 1) {
-                        *(buffer)=0;
-                        buffer++;
-                    }
-                }
-                break;
-            case StreamProcessorManager::eADT_Float:
-                {
-                    float *buffer=(float *)(p->getBufferAddress());
-                    assert(nevents + offset <= p->getBufferSize());
-                    buffer+=offset;
-    
+            {
+                // all sample formats use all-zero bits for silence
+                unsigned int sample_size = getAudioSampleSize(m_StreamProcessorManager.getAudioDataType());
+                unsigned int stride = p->getBufferStride();
+                char *buffer=(char *)(p->getBufferAddress());
+                assert(nevents + offset <= p->getBufferSize());
+                buffer += offset * stride * sample_size;
+
+                if (stride == 1) {
+                    memset(buffer, 0, nevents * sample_size);
+                } else {
                     for(j = 0; j < nevents; j += 1) {
-                        *buffer = 0.0;
-                        buffer++;
+                        memset(buffer, 0, sample_size);
+                        buffer += stride * sample_size;
                     }
                 }
-                break;
             }
             break;
     }
@@ -1177,6 +1465,8 @@ bool StreamProcessor::prepare()
         return false;
     }
 
+    publishStatistics();
+
     debugOutput( DEBUG_LEVEL_VERBOSE, "Prepared for:\n");
     debugOutput( DEBUG_LEVEL_VERBOSE, " Samplerate: %d  [DLL Bandwidth: %f Hz]\n",
              m_StreamProcessorManager.getNominalRate(), m_dll_bandwidth_hz);
@@ -1268,6 +1558,19 @@ bool StreamProcessor::scheduleStartDryRunning(int64_t t) {
     }
 }
 
+bool StreamProcessor::scheduleStartOffline(int64_t t) {
+    debugOutput(DEBUG_LEVEL_VERBOSE,"for %s SP (%p) at %011" PRId64 "\n", ePTToString(getType()), this, t);
+    if (getType() != ePT_Receive) {
+        debugError("Only receive SP's can be fed offline\n");
+        return false;
+    }
+    if (m_state != ePS_Stopped) {
+        debugError("Cannot start offline from %s\n", ePSToString(m_state));
+        return false;
+    }
+    return scheduleStateTransition(ePS_WaitingForStream, t);
+}
+
 bool StreamProcessor::scheduleStartRunning(int64_t t) {
     uint64_t tx;
     if (t < 0) {
@@ -1542,6 +1845,11 @@ StreamProcessor::doDryRunning()
         case ePS_WaitingForStreamDisable:
             result &= m_data_buffer->clearBuffer();
             m_data_buffer->setTransparent(true);
+            if (m_data_buffer->isBandwidthAdaptive()) {
+                // lock fast again when restarting
+                result &= m_data_buffer->setAdaptiveBandwidth(0.0, 0.0);
+                result &= m_data_buffer->setBandwidth(STREAMPROCESSOR_DLL_FAST_BW_HZ / (double)TICKS_PER_SECOND);
+            }
             // If the stream has been running, clear the previous timestamps
             // as they won't be relevant after a restart
             m_last_timestamp = m_last_timestamp2 = 0;
@@ -1575,9 +1883,7 @@ StreamProcessor::doWaitForStreamEnable()
 {
     debugOutput(DEBUG_LEVEL_VERBOSE, "Enter from state: %s\n", ePSToString(m_state));
 
-    unsigned int ringbuffer_size_frames = m_StreamProcessorManager.getNbBuffers() * m_StreamProcessorManager.getPeriodSize();
-    ringbuffer_size_frames += m_extra_buffer_frames;
-    ringbuffer_size_frames += 1; // to ensure that we can fit it all in there
+    unsigned int ringbuffer_size_frames = getRingBufferSizeFrames();
 
     switch(m_state) {
         case ePS_DryRunning:
@@ -1639,10 +1945,16 @@ StreamProcessor::doRunning()
             // a running stream has been detected
             debugOutput(DEBUG_LEVEL_VERBOSE, "StreamProcessor %p started running\n", 
                                              this);
-            m_in_xrun = false;
+            clearXrun();
             m_local_node_id = m_1394service.getLocalNodeId() & 0x3f;
-            // reduce the DLL bandwidth to what we require
-            result &= m_data_buffer->setBandwidth(m_dll_bandwidth_hz / (double)TICKS_PER_SECOND);
+            if (m_dll_adaptive && m_dll_bandwidth_hz < STREAMPROCESSOR_DLL_FAST_BW_HZ) {
+                // narrow down to the required DLL bandwidth gradually
+                result &= m_data_buffer->setAdaptiveBandwidth(m_dll_bandwidth_hz / (double)TICKS_PER_SECOND,
+                                                              STREAMPROCESSOR_DLL_FAST_BW_HZ / (double)TICKS_PER_SECOND);
+            } else {
+                // reduce the DLL bandwidth to what we require
+                result &= m_data_buffer->setBandwidth(m_dll_bandwidth_hz / (double)TICKS_PER_SECOND);
+            }
             // enable the data buffer
             m_data_buffer->setTransparent(false);
             m_last_timestamp2 = 0; // NOTE: no use in checking if we just started running
@@ -1875,6 +2187,74 @@ bool StreamProcessor::canConsume(unsigned int nframes)
 /***********************************************
  * Helper routines                             *
  ***********************************************/
+/**
+ * @brief Skip the frames that can't be transmitted in time anymore
+ *
+ * Called on a transmit xrun. When fast xrun resyncing is enabled and the
+ * stream is running, the frames at the head of the buffer that should be
+ * presented before the packet for pkt_ctr can reach the device are
+ * dropped, and the stream keeps running. The buffer timestamps stay
+ * valid, hence there is no need to restart the stream.
+ *
+ * @note runs in the ISO thread, the only reader of the transmit buffer
+ *
+ * @param pkt_ctr the cycle timer value for the packet to be sent
+ * @return true if the stream can keep running, false if it needs a restart
+ */
+bool
+StreamProcessor::skipLateFrames(uint32_t pkt_ctr)
+{
+    if (getType() != ePT_Transmit || m_state != ePS_Running
+        || !m_StreamProcessorManager.getFastXrunResync()) {
+        return false;
+    }
+
+    uint64_t deadline = addTicks(CYCLE_TIMER_TO_TICKS(pkt_ctr),
+                                 STREAMPROCESSOR_FAST_RESYNC_MARGIN_CYCLES * TICKS_PER_CYCLE);
+    ffado_timestamp_t ts_head;
+    signed int fc;
+    m_data_buffer->getBufferHeadTimestamp(&ts_head, &fc);
+    int64_t late_ticks = diffTicks(deadline, (uint64_t)ts_head);
+    if (late_ticks <= 0) {
+        // not late, just not enough frames. the client will catch up.
+        return true;
+    }
+
+    unsigned int nb_late = getNbLateFrames(late_ticks, getTicksPerFrame(),
+                                           getNominalFramesPerPacket(), fc);
+    if (nb_late) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) skipping %u late frames (%" PRId64 " ticks late)\n",
+                    this, nb_late, late_ticks);
+        m_data_buffer->dropFrames(nb_late);
+    }
+    return true;
+}
+
+/**
+ * @brief The number of frames to skip for frames that are late
+ *
+ * Whole packets are skipped, such that the MIDI positions stay consistent.
+ * Never skips more (whole packets of) frames than there are in the buffer.
+ *
+ * @param late_ticks how late the frame at the buffer head is, must be > 0
+ * @param ticks_per_frame the current rate
+ * @param frames_per_packet the number of frames per packet
+ * @param nb_frames the number of frames in the buffer
+ * @return the number of frames to skip
+ */
+unsigned int
+StreamProcessor::getNbLateFrames(int64_t late_ticks, float ticks_per_frame,
+                                 unsigned int frames_per_packet, unsigned int nb_frames)
+{
+    unsigned int nb_late = (unsigned int)(late_ticks / ticks_per_frame) + 1;
+    nb_late = ((nb_late + frames_per_packet - 1) / frames_per_packet) * frames_per_packet;
+    unsigned int available = nb_frames - (nb_frames % frames_per_packet);
+    if (nb_late > available) {
+        nb_late = available;
+    }
+    return nb_late;
+}
+
 // FIXME: I think this can be removed and replaced by putSilenceFrames
 bool
 StreamProcessor::transferSilence(unsigned int nframes)
@@ -1941,6 +2321,25 @@ StreamProcessor::ePTToString(enum eProcessorType t) {
     }
 }
 
+/**
+ * @brief convert a eXrunCause to a string
+ * @param c the cause
+ * @return a char * describing the cause
+ */
+const char *
+StreamProcessor::eXCToString(enum eXrunCause c) {
+    switch (c) {
+        case eXC_None: return "none";
+        case eXC_DroppedCycles: return "dropped cycles";
+        case eXC_HandlerDied: return "handler died";
+        case eXC_BusReset: return "bus reset";
+        case eXC_BufferFull: return "buffer full";
+        case eXC_BufferEmpty: return "buffer empty";
+        case eXC_FramesLate: return "frames late";
+        default: return "error: unknown cause";
+    }
+}
+
 /***********************************************
  * Debug                                       *
  ***********************************************/
@@ -1958,6 +2357,13 @@ StreamProcessor::dumpInfo()
                         (unsigned int)TICKS_TO_CYCLES(now),
                         (unsigned int)TICKS_TO_OFFSET(now));
     debugOutputShort( DEBUG_LEVEL_NORMAL, "  Xrun?                 : %s\n", (m_in_xrun ? "True":"False"));
+    if (m_in_xrun) {
+        uint32_t cycle;
+        enum eXrunCause cause = getXrunCause(cycle);
+        debugOutputShort( DEBUG_LEVEL_NORMAL, "  Xrun cause            : %s (cycle %u)\n",
+                                              eXCToString(cause), cycle);
+    }
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "  Dropped cycles        : %u\n", m_dropped_cycles);
     if (m_state == m_next_state) {
         debugOutputShort( DEBUG_LEVEL_NORMAL, "  State                 : %s\n", 
                                             ePSToString(m_state));
@@ -1971,8 +2377,37 @@ StreamProcessor::dumpInfo()
                                           m_StreamProcessorManager.getNominalRate(),
                                           24576000.0/m_StreamProcessorManager.getSyncSource().m_data_buffer->getRate(),
                                           24576000.0/m_data_buffer->getRate());
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "  Latency               : Nominal: %u, Measured: %u (max %u)",
+                                          getNominalLatency(), m_measured_latency, m_max_measured_latency);
+    if (m_latency_calibrated) {
+        debugOutputShort( DEBUG_LEVEL_NORMAL, ", Correction: %d\n", m_latency_correction);
+    } else {
+        debugOutputShort( DEBUG_LEVEL_NORMAL, "\n");
+    }
     #endif
     m_data_buffer->dumpInfo();
+    m_transfer_stats.dumpInfo();
+    m_buffer_fill_stats.dumpInfo();
+    m_packet_data_stats.dumpInfo();
+    if (m_packet_capture) m_packet_capture->show();
+}
+
+/**
+ * @brief publish the histograms of this stream in the shared statistics segment
+ */
+void
+StreamProcessor::publishStatistics()
+{
+    char owner[40];
+    snprintf(owner, sizeof(owner), "%s SP %p", getTypeString(), this);
+    m_transfer_stats.reset();
+    m_buffer_fill_stats.reset();
+    m_packet_data_stats.reset();
+    m_dropped_cycles = 0;
+    m_transfer_stats.publish(owner);
+    m_buffer_fill_stats.publish(owner);
+    m_packet_data_stats.publish(owner);
+    m_data_buffer->getDllErrorStatistics().publish(owner);
 }
 
 void
@@ -1988,6 +2423,7 @@ StreamProcessor::setVerboseLevel(int l) {
     setDebugLevel(l);
     PortManager::setVerboseLevel(l);
     m_data_buffer->setVerboseLevel(l);
+    if (m_packet_capture) m_packet_capture->setVerboseLevel(l);
     debugOutput( DEBUG_LEVEL_VERBOSE, "Setting verbose level to %d...\n", l );
 }
 
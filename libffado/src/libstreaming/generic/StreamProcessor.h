@@ -42,6 +42,7 @@ class IsoHandlerManager;
 namespace Streaming {
 
     class StreamProcessorManager;
+    class IsoStreamCapture;
 /*!
 \brief Class providing a generic interface for Stream Processors
 
@@ -65,6 +66,9 @@ public:
 
     ///> notification of a buffer size change
     virtual bool periodSizeChanged(unsigned int new_periodsize);
+    ///> period size change while streaming, see StreamProcessorManager::setPeriodSize()
+    bool preparePeriodSizeChange(unsigned int new_periodsize, unsigned int new_extra_frames);
+    void commitPeriodSizeChange(unsigned int new_periodsize, unsigned int new_extra_frames);
 private:
     // this can only be set by the constructor
     enum eProcessorType m_processor_type;
@@ -131,6 +135,18 @@ public: //--- state stuff
     bool scheduleStopDryRunning(int64_t time_to_stop_at);
     bool scheduleStopRunning(int64_t time_to_stop_at);
 
+    /**
+     * @brief start a receive SP that is fed with packets by hand
+     *
+     * Same as scheduleStartDryRunning(), but without starting an iso
+     * handler. The packets are expected to be passed to putPacket()
+     * directly, e.g. from a packet capture.
+     *
+     * @param time_to_start_at time at which the stream should start
+     * @return true if successful
+     */
+    bool scheduleStartOffline(int64_t time_to_start_at);
+
     // the main difference between init and prepare is that when prepare is called,
     // the SP is registered to a manager (FIXME: can't it be called by the manager?)
     bool init();
@@ -196,6 +212,32 @@ public:
      */
     bool dropFrames(unsigned int nframes, int64_t ts);
 
+    /**
+     * @brief skip frames at the head of the transmit buffer
+     *
+     * Removes the nframes oldest frames from the buffer and presents the
+     * remaining ones nframes earlier, i.e. lowers the transmit latency by
+     * nframes. Unlike dropFrames(), this is done from the client side of
+     * a transmit buffer.
+     *
+     * @param nframes number of frames, a multiple of the frames per packet
+     * @return true if the operation was successful
+     */
+    bool skipFrames(unsigned int nframes);
+
+    /**
+     * @brief record the received packets
+     *
+     * Allocates a capture buffer that can hold max_packets packets and
+     * records all packets passed to putPacket() into it. Should be called
+     * while the SP is not running. Pass 0 to stop recording.
+     *
+     * @param max_packets maximum number of packets to record
+     * @return true if successful
+     */
+    bool enablePacketCapture(unsigned int max_packets);
+    IsoStreamCapture *getPacketCapture() {return m_packet_capture;};
+
     /**
      * @brief put silence frames into the internal buffer
      *
@@ -219,6 +261,9 @@ public:
      */
     bool shiftStream(int nframes);
 
+private:
+    IsoStreamCapture *m_packet_capture;
+
 protected: // the helper receive/transmit functions
     enum eChildReturnValue {
         eCRV_OK,
@@ -275,12 +320,49 @@ private:
     bool putFramesWet(unsigned int nbframes, int64_t ts);
 
     bool transferSilence(unsigned int size);
+    bool skipLateFrames(uint32_t pkt_ctr);
+public:
+    static unsigned int getNbLateFrames(int64_t late_ticks, float ticks_per_frame,
+                                        unsigned int frames_per_packet, unsigned int nb_frames);
 
 public:
+    ///> what made the stream flag an xrun
+    enum eXrunCause {
+        eXC_None,
+        eXC_DroppedCycles,  ///< the iso side missed packets
+        eXC_HandlerDied,    ///< the iso handler stopped
+        eXC_BusReset,       ///< the stream didn't survive a bus reset
+        eXC_BufferFull,     ///< no room for the received frames
+        eXC_BufferEmpty,    ///< no frames to send
+        eXC_FramesLate,     ///< the frames to send came too late
+    };
+
     // move to private?
     bool xrunOccurred() { return m_in_xrun; };
+    void clearXrun() { m_in_xrun = false; m_xrun_info = 0; };
     void handlerDied();
 
+    /**
+     * @brief the first cause of the current xrun
+     *
+     * Can be called from any thread, the cause and the cycle are
+     * consistent with each other.
+     *
+     * @param cycle set to the iso cycle at which the xrun was flagged,
+     *        0xFFFFFFFF if unknown
+     * @return eXC_None if no xrun was flagged since the last clearXrun()
+     */
+    enum eXrunCause getXrunCause(uint32_t &cycle);
+    ///> the number of cycles dropped since the stream was prepared
+    unsigned int getDroppedCycles() {return m_dropped_cycles;};
+    ///> the time spent encoding/decoding the packet data
+    Streaming::StreamStatistics &getPacketDataStatistics()
+        {return m_packet_data_stats;};
+    const char *eXCToString(enum eXrunCause);
+
+private:
+    void flagXrun(enum eXrunCause cause, uint32_t pkt_ctr);
+
 // the ISO interface (can we get rid of this?)
 public:
     int getChannel() {return m_channel;};
@@ -317,6 +399,10 @@ protected:
     // an RT context
     byte_t*         m_scratch_buffer;
     size_t          m_scratch_buffer_size_bytes;
+    // the scratch buffer for a pending period size change
+    byte_t*         m_next_scratch_buffer;
+    size_t          m_next_scratch_buffer_size_bytes;
+    unsigned int getRingBufferSizeFrames();
 
 protected:
     // frame counter & sync stuff
@@ -378,10 +464,89 @@ protected:
          */
         int getMaxFrameLatency();
 
+        /**
+         * @brief get the nominal latency of the ports of this SP
+         *
+         * For receive SP's this is the age of the first frame of a period
+         * when the period is handed to the client, i.e. the time between
+         * the frame being captured by the device and the client waking up.
+         *
+         * For transmit SP's this is the time between the client waking up
+         * and the first frame of the period it writes being presented by
+         * the device.
+         *
+         * The value follows from the streaming parameters (period, number
+         * of buffers, sync delay, transmit prebuffer and the transfer
+         * delay of the device), and is only valid once the streams are
+         * started. It doesn't include the converter latency of the device.
+         *
+         * @return the latency in frames
+         */
+        unsigned int getNominalLatency();
+
+        /**
+         * @brief get the latency measured from the buffer timestamps
+         *
+         * Same as getNominalLatency(), but determined at every transfer
+         * from the timestamp of the frames transferred and the actual
+         * time at which the client was woken up.
+         *
+         * @return the latency of the last transfer in frames
+         */
+        unsigned int getMeasuredLatency() {return m_measured_latency;};
+        /// the largest latency measured since the streams were started
+        unsigned int getMaxMeasuredLatency() {return m_max_measured_latency;};
+        /**
+         * @brief update the measured latency
+         *
+         * Called by the StreamProcessorManager when transferring a period,
+         * before the frames are read for receive SP's and after the frames
+         * are written for transmit SP's.
+         *
+         * @param time_of_wakeup the time the client was woken up, in ticks
+         */
+        void updateMeasuredLatency(uint64_t time_of_wakeup);
+        void resetMeasuredLatency();
+
+        /**
+         * @brief set the latency found by loopback calibration
+         *
+         * @param frames the latency on top of the nominal latency
+         */
+        void setLatencyCorrection(int frames)
+            {m_latency_correction = frames; m_latency_calibrated = true;};
+        int getLatencyCorrection() {return m_latency_correction;};
+        bool isLatencyCalibrated() {return m_latency_calibrated;};
+
+        /**
+         * @brief get the delay between capture and timestamp of received frames
+         *
+         * The timestamp of a received frame is the time it was captured
+         * by the device, plus this delay.
+         *
+         * @return the delay in ticks
+         */
+        virtual unsigned int getReceiveTransferDelay() {return 0;};
+
         float getTicksPerFrame();
         void setTicksPerFrame(float tpf);
+        /// the error of the last timestamp DLL update, in ticks
+        float getDllError();
 
         bool setDllBandwidth(float bw);
+        /**
+         * @brief let the DLL bandwidth adapt while running
+         *
+         * The DLL then starts at the fast (locking) bandwidth and narrows
+         * down to the DLL bandwidth as long as that reduces the timestamp
+         * jitter. It widens again on disturbances.
+         */
+        void setDllAdaptive(bool enable) {m_dll_adaptive = enable;};
+        bool getDllAdaptive() {return m_dll_adaptive;};
+        Streaming::StreamStatistics &getDllErrorStatistics()
+            {return m_data_buffer->getDllErrorStatistics();};
+        Streaming::StreamStatistics &getDllBandwidthStatistics()
+            {return m_data_buffer->getDllBandwidthStatistics();};
 
         int getBufferFill();
 
@@ -430,11 +595,28 @@ protected:
     protected:
         float m_ticks_per_frame;
         float m_dll_bandwidth_hz;
+        bool m_dll_adaptive;
         unsigned int m_extra_buffer_frames;
         float m_max_fs_diff_norm;
         signed int m_max_diff_ticks;
     private:
         bool m_in_xrun;
+        unsigned int m_measured_latency;
+        unsigned int m_max_measured_latency;
+        int m_latency_correction;
+        bool m_latency_calibrated;
+
+        // the cause in the upper 16 bits, the cycle in the lower ones.
+        // one word such that the iso thread can set it atomically.
+        volatile uint32_t m_xrun_info;
+        unsigned int m_dropped_cycles;
+
+        // histograms of the client side transfers
+        Streaming::StreamStatistics m_transfer_stats;
+        Streaming::StreamStatistics m_buffer_fill_stats;
+        // and of the encoding/decoding on the iso side
+        Streaming::StreamStatistics m_packet_data_stats;
+        void publishStatistics();
 
 public:
     // debug stuff
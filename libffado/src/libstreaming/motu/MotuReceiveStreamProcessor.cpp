@@ -27,6 +27,7 @@
 
 #include "MotuReceiveStreamProcessor.h"
 #include "MotuPort.h"
+#include "../generic/SampleConversion.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -84,8 +85,6 @@ uint32_t ts_sec = CYCLE_TIMER_GET_SECS(ct_now);
 MotuReceiveStreamProcessor::MotuReceiveStreamProcessor(FFADODevice &parent, unsigned int event_size)
     : StreamProcessor(parent, ePT_Receive)
     , m_event_size( event_size )
-    , mb_head ( 0 )
-    , mb_tail ( 0 )
 {
     // The model needs to be easily visible since the interpretation of the
     // receive stream is dependent on the model in a slight but important
@@ -93,6 +92,19 @@ MotuReceiveStreamProcessor::MotuReceiveStreamProcessor(FFADODevice &parent, unsi
     Motu::MotuDevice *dev = static_cast<Motu::MotuDevice *>(&parent);
     m_motu_model = dev->m_motu_model;
     memset(&m_devctrls, 0, sizeof(m_devctrls));
+    memset(&m_devctrls_published, 0, sizeof(m_devctrls_published));
+    m_devctrls_seqnum = 0;
+}
+
+MotuReceiveStreamProcessor::MotuReceiveStreamProcessor(FFADODevice &parent, unsigned int event_size,
+                                                       signed int motu_model)
+    : StreamProcessor(parent, ePT_Receive)
+    , m_event_size( event_size )
+    , m_motu_model( motu_model )
+{
+    memset(&m_devctrls, 0, sizeof(m_devctrls));
+    memset(&m_devctrls_published, 0, sizeof(m_devctrls_published));
+    m_devctrls_seqnum = 0;
 }
 
 unsigned int
@@ -117,6 +129,16 @@ MotuReceiveStreamProcessor::getNominalFramesPerPacket() {
 bool
 MotuReceiveStreamProcessor::prepareChild() {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Preparing (%p)...\n", this);
+
+    for ( PortVectorIterator it = m_Ports.begin();
+      it != m_Ports.end();
+      ++it ) {
+        if ((*it)->getPortType() == Port::E_Midi) {
+            MidiScheduler &sched = static_cast<MotuMidiPort *>(*it)->getScheduler();
+            sched.reset();
+            sched.setSpacing(1);
+        }
+    }
     return true;
 }
 
@@ -172,7 +194,11 @@ static int pktcx = 0;
         // received.  Since every frame from the MOTU has its own timestamp
         // we can just pick it straight from the packet.
         uint32_t last_sph = CondSwapFromBus32(*(quadlet_t *)(data+8+(n_events-1)*m_event_size));
-        m_last_timestamp = sphRecvToFullTicks(last_sph, m_Parent.get1394Service().getCycleTimer());
+        // The seconds field is reconstructed relative to the cycle the
+        // packet was received in rather than the current cycle timer.
+        // This is closer to the SPH than "now" and keeps the result
+        // independent of when the packet is processed.
+        m_last_timestamp = sphRecvToFullTicks(last_sph, pkt_ctr);
 
         // To assist in debugging the packet format from new devices, periodically
         // dump a packet when debug is active.  Originally written to debug the
@@ -263,8 +289,11 @@ bool MotuReceiveStreamProcessor::processReadBlock(char *data,
      * be present on the 828Mk1 (or at the very least are in a different
      * location).
      */
-    if (m_motu_model != Motu::MOTU_MODEL_828MkI)
+    if (m_motu_model != Motu::MOTU_MODEL_828MkI) {
         decodeMotuCtrlEvents(data, nevents);
+        if (m_devctrls.status == MOTU_DEVCTRL_VALID)
+            publishDevControls();
+    }
 
     for ( PortVectorIterator it = m_Ports.begin();
           it != m_Ports.end();
@@ -309,7 +338,28 @@ signed int MotuReceiveStreamProcessor::decodeMotuEventsToPort(MotuAudioPort *p,
     unsigned char *src_data;
     src_data = (unsigned char *)data + p->getPosition();
 
-    switch(m_StreamProcessorManager.getAudioDataType()) {
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+    unsigned int stride = p->getBufferStride();
+    if (!isNativeAudioSampleLayout(type, stride)) {
+        // other sample formats and interleaved client buffers
+        int32_t tmp[SAMPLE_CONVERSION_BLOCK_SIZE];
+        unsigned int k;
+
+        assert(nevents + offset <= p->getBufferSize());
+
+        for(j = 0; j < nevents; j += k) {
+            unsigned int n = nevents - j;
+            if (n > SAMPLE_CONVERSION_BLOCK_SIZE) n = SAMPLE_CONVERSION_BLOCK_SIZE;
+            for(k = 0; k < n; k += 1) {
+                tmp[k] = (*src_data<<16)+(*(src_data+1)<<8)+*(src_data+2);
+                src_data+=m_event_size;
+            }
+            convertInt24ToClient(type, tmp, p->getBufferAddress(), offset + j, stride, n);
+        }
+        return 0;
+    }
+
+    switch(type) {
         default:
         case StreamProcessorManager::eADT_Int24:
             {
@@ -381,46 +431,35 @@ MotuReceiveStreamProcessor::decodeMotuMidiEventsToPort(
     // Get MIDI bytes if present in any frames within the packet.  MOTU MIDI
     // data is sent as part of a 3-byte sequence starting at the port's
     // position.  Some MOTUs (eg: the 828MkII) send more than one MIDI byte
-    // in some packets.  Since the FFADO MIDI layer requires a MIDI byte in
-    // only every 8th buffer position we allow for this by buffering the
-    // incoming data.  The buffer is small since it only has to cover for
-    // short-term excursions in the data rate.  Since the MIDI data
-    // originates on a physical MIDI bus the overall data rate is limited by
-    // the baud rate of that bus (31250), which is no more than one byte in
-    // 8 even for 1x sample rates.
+    // in some packets.  Each byte is written at the frame it arrived in,
+    // and the port's scheduler moves it to the next free frame if that one
+    // is taken.  Since the MIDI data originates on a physical MIDI bus the
+    // overall data rate is limited by the baud rate of that bus (31250), so
+    // only short-term excursions in the data rate have to be covered.
+    MidiScheduler &sched = p->getScheduler();
+    quadlet_t byte;
     src = (unsigned char *)data + p->getPosition();
-    // We assume that the buffer has been set up in such a way that the first
-    // element is correctly aligned for FFADOs MIDI layer.  The requirement
-    // is that actual MIDI bytes must be aligned to multiples of 8 samples.  
 
     while (j < nevents) {
         /* Most events don't have MIDI data bytes */
         if (unlikely((*src & MOTU_KEY_MASK_MIDI) == MOTU_KEY_MASK_MIDI)) {
-            // A MIDI byte is in *(src+2).  Bit 24 is used to flag MIDI data
-            // as present once the data makes it to the output buffer.
-            midibuffer[mb_head++] = 0x01000000 | *(src+2);
-            mb_head &= RX_MIDIBUFFER_SIZE-1;
-            if (unlikely(mb_head == mb_tail)) {
-                debugWarning("MOTU rx MIDI buffer overflow\n");
-                /* Dump oldest byte.  This overflow can only happen if the
-                 * rate coming in from the hardware MIDI port grossly
-                 * exceeds the official MIDI baud rate of 31250 bps, so it
-                 * should never occur in practice.
-                 */
-                mb_tail = (mb_tail + 1) & (RX_MIDIBUFFER_SIZE-1);
-            }
+            // A MIDI byte is in *(src+2).  The scheduler can only
+            // overflow if the rate coming in from the hardware MIDI port
+            // grossly exceeds the official MIDI baud rate of 31250 bps, so
+            // it should never occur in practice.
+            sched.put(*(src+2), j);
         }
-        /* Write to the buffer if we're at an 8-sample boundary */
-        if (unlikely(!(j & 0x07))) {
-            if (mb_head != mb_tail) {
-                *buffer = midibuffer[mb_tail++];
-                mb_tail &= RX_MIDIBUFFER_SIZE-1;
-            }
-            buffer += 8;
+        // Bit 24 is used to flag MIDI data as present in the output buffer.
+        if (unlikely(sched.get(j, byte))) {
+            buffer[j] = byte;
         }
         j++;
         src += m_event_size;
     }
+    sched.advance(nevents);
+    if (unlikely(sched.isNewOverflow())) {
+        debugWarning("MOTU rx MIDI buffer overflow, dropping messages\n");
+    }
 
     return 0;    
 }
@@ -572,4 +611,40 @@ MotuReceiveStreamProcessor::decodeMotuCtrlEvents(
     return 0;    
 }
 
+void
+MotuReceiveStreamProcessor::publishDevControls()
+{
+    // There is only one writer (the packet processing), so a sequence
+    // lock suffices.  The readers retry when the sequence number changed
+    // while they were copying.
+    m_devctrls_seqnum++;
+    __sync_synchronize();
+    memcpy(&m_devctrls_published, &m_devctrls, sizeof(m_devctrls_published));
+    __sync_synchronize();
+    m_devctrls_seqnum++;
+}
+
+bool
+MotuReceiveStreamProcessor::getDevControls(struct MotuDevControls &ctrls)
+{
+    if (!isRunning()) {
+        return false;
+    }
+    for (unsigned int tries = 0; tries < 4; tries++) {
+        uint32_t seqnum = m_devctrls_seqnum;
+        if (seqnum & 1) {
+            // being updated
+            continue;
+        }
+        __sync_synchronize();
+        memcpy(&ctrls, (const void *)&m_devctrls_published, sizeof(ctrls));
+        __sync_synchronize();
+        if (seqnum == m_devctrls_seqnum) {
+            return ctrls.status == MOTU_DEVCTRL_VALID;
+        }
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "could not get a consistent device control status\n");
+    return false;
+}
+
 } // end of namespace Streaming
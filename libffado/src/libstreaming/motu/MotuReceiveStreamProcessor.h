@@ -138,6 +138,13 @@ public:
      *                  (midi-muxed is only one stream)
      */
     MotuReceiveStreamProcessor(FFADODevice &parent, unsigned int event_size);
+    /**
+     * Create a MOTU receive StreamProcessor for a given model, for
+     * use with a parent that isn't a Motu::MotuDevice (e.g. when
+     * replaying a packet capture)
+     */
+    MotuReceiveStreamProcessor(FFADODevice &parent, unsigned int event_size,
+                               signed int motu_model);
     virtual ~MotuReceiveStreamProcessor() {};
 
     enum eChildReturnValue processPacketHeader(unsigned char *data, unsigned int length,
@@ -155,6 +162,17 @@ public:
                     { return 1; };
     virtual unsigned int getNominalFramesPerPacket();
 
+    /**
+     * @brief get the device control status decoded from the stream
+     *
+     * Can be called from any thread while the stream is running, the
+     * copy is consistent without locking the packet processing.
+     *
+     * @param ctrls receives the copy
+     * @return true if a valid and consistent copy was made
+     */
+    bool getDevControls(struct MotuDevControls &ctrls);
+
 protected:
     bool processReadBlock(char *data, unsigned int nevents, unsigned int offset);
 
@@ -164,6 +182,7 @@ private:
     int decodeMotuEventsToPort(MotuAudioPort *, quadlet_t *data, unsigned int offset, unsigned int nevents);
     int decodeMotuMidiEventsToPort(MotuMidiPort *, quadlet_t *data, unsigned int offset, unsigned int nevents);
     int decodeMotuCtrlEvents(char *data, unsigned int nevents);
+    void publishDevControls();
 
     /*
      * An iso packet mostly consists of multiple events.  m_event_size
@@ -174,18 +193,10 @@ private:
     signed int m_motu_model;
     struct MotuDevControls m_devctrls;
 
-    /* A small MIDI buffer to cover for the case where we need to span a
-     * period.  This can only occur if more than one MIDI byte is sent per
-     * packet, but this has been observed with some MOTUs (eg: 828MkII). 
-     * Since the long-term average data rate must be close to the MIDI spec
-     * since it's coming from a physical MIDI port this buffer doesn't have
-     * to be particularly large.  The size is a power of 2 for optimisation
-     * reasons.
-     */
-    #define RX_MIDIBUFFER_SIZE_EXP 6
-    #define RX_MIDIBUFFER_SIZE     (1<<RX_MIDIBUFFER_SIZE_EXP)
-    unsigned int midibuffer[RX_MIDIBUFFER_SIZE];
-    unsigned mb_head, mb_tail;
+    // The copy of m_devctrls that is read by the control elements.  The
+    // sequence number is odd while the copy is being updated.
+    struct MotuDevControls m_devctrls_published;
+    volatile uint32_t m_devctrls_seqnum;
 };
 
 
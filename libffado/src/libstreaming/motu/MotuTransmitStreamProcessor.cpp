@@ -28,6 +28,7 @@
 
 #include "MotuTransmitStreamProcessor.h"
 #include "MotuPort.h"
+#include "../generic/SampleConversion.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -72,9 +73,6 @@ MotuTransmitStreamProcessor::MotuTransmitStreamProcessor(FFADODevice &parent, un
         , m_event_size( event_size )
         , m_motu_model( 0 )
         , m_tx_dbc( 0 )
-        , mb_head( 0 )
-        , mb_tail( 0 )
-        , midi_lock( 0 )
 {
   int srate = m_Parent.getDeviceManager().getStreamProcessorManager().getNominalRate();
   /* Work out how many audio samples should be left between MIDI data bytes in order
@@ -564,6 +562,16 @@ unsigned int MotuTransmitStreamProcessor::fillNoDataPacketHeader (
 bool MotuTransmitStreamProcessor::prepareChild()
 {
     debugOutput ( DEBUG_LEVEL_VERBOSE, "Preparing (%p)...\n", this );
+
+    for ( PortVectorIterator it = m_Ports.begin();
+      it != m_Ports.end();
+      ++it ) {
+        if ((*it)->getPortType() == Port::E_Midi) {
+            MidiScheduler &sched = static_cast<MotuMidiPort *>(*it)->getScheduler();
+            sched.reset();
+            sched.setSpacing(midi_tx_period);
+        }
+    }
     return true;
 }
 
@@ -680,7 +688,30 @@ int MotuTransmitStreamProcessor::encodePortToMotuEvents(MotuAudioPort *p, quadle
     unsigned char *target;
     target = (unsigned char *)data + p->getPosition();
 
-    switch(m_StreamProcessorManager.getAudioDataType()) {
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+    unsigned int stride = p->getBufferStride();
+    if (!isNativeAudioSampleLayout(type, stride)) {
+        // other sample formats and interleaved client buffers
+        int32_t tmp[SAMPLE_CONVERSION_BLOCK_SIZE];
+        unsigned int k;
+
+        assert(nevents + offset <= p->getBufferSize());
+
+        for(j = 0; j < nevents; j += k) {
+            unsigned int n = nevents - j;
+            if (n > SAMPLE_CONVERSION_BLOCK_SIZE) n = SAMPLE_CONVERSION_BLOCK_SIZE;
+            convertClientToInt24(type, p->getBufferAddress(), offset + j, stride, tmp, n, MOTU_CLIP_FLOATS);
+            for(k = 0; k < n; k += 1) {
+                *target = (tmp[k] >> 16) & 0xff;
+                *(target+1) = (tmp[k] >> 8) & 0xff;
+                *(target+2) = tmp[k] & 0xff;
+                target+=m_event_size;
+            }
+        }
+        return 0;
+    }
+
+    switch(type) {
         default:
         case StreamProcessorManager::eADT_Int24:
             {
@@ -762,45 +793,35 @@ int MotuTransmitStreamProcessor::encodePortToMotuMidiEvents(
     src += offset;
     unsigned char *target = (unsigned char *)data + p->getPosition();
 
-    // Send a MIDI byte if there is one to send.  MOTU MIDI data is sent using
-    // a 3-byte sequence within a frame starting at the port's position.
-    // A non-zero MSB indicates there is MIDI data to send.
-
-    for (j=0; j<nevents; j++, src++, target+=m_event_size) {
-        if (midi_lock)
-            midi_lock--;
+    MidiScheduler &sched = p->getScheduler();
+    quadlet_t byte;
 
-        /* FFADO's MIDI subsystem dictates that at the most there will be one
-         * MIDI byte every 8th's sample, making a MIDI byte "unlikely".
-         */
-        if (unlikely(*src & 0xff000000)) { 
-            /* A MIDI byte is ready to send - buffer it */
-            midibuffer[mb_head++] = *src;
-            mb_head &= MIDIBUFFER_SIZE-1;
-            if (unlikely(mb_head == mb_tail)) {
-            /* Buffer overflow - dump oldest byte. */
-            /* Ideally this would dump an entire MIDI message, but this is only
-             * feasible if it's possible to determine the message size easily.
-             */
-                mb_tail = (mb_tail+1) & (MIDIBUFFER_SIZE-1);
-                debugWarning("MOTU MIDI buffer overflow\n");
-            }
+    // Queue the MIDI bytes with the frame they are at.  A non-zero MSB
+    // indicates there is MIDI data to send.
+    for (j=0; j<nevents; j++, src++) {
+        if (unlikely(*src & 0xff000000)) {
+            sched.put(*src, j);
             debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"Buffered MIDI byte %d\n", *src & 0xff);
         }
+    }
 
-        /* Send the MIDI byte at the tail of the buffer if enough time has elapsed
-         * since the last MIDI byte was sent.  For most iterations through the loop
-         * this condition will be false.
-         */
-        if (unlikely(mb_head!=mb_tail && !midi_lock)) {
+    // Send a MIDI byte in the first frame at or after the frame it was at,
+    // provided enough time has elapsed since the last MIDI byte was sent.
+    // MOTU MIDI data is sent using a 3-byte sequence within a frame
+    // starting at the port's position.  For most frames there is nothing
+    // to send.
+    for (j=0; j<nevents; j++, target+=m_event_size) {
+        if (unlikely(sched.get(j, byte))) {
             *(target) = 0x01;
             *(target+1) = 0x00;
-            *(target+2) = midibuffer[mb_tail] & 0xff;
-            debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"Sent MIDI byte %d (j=%d)\n", midibuffer[mb_tail], j);
-            mb_tail = (mb_tail+1) & (MIDIBUFFER_SIZE-1);
-            midi_lock = midi_tx_period;
+            *(target+2) = byte & 0xff;
+            debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"Sent MIDI byte %d (j=%d)\n", byte & 0xff, j);
         }
     }
+    sched.advance(nevents);
+    if (unlikely(sched.isNewOverflow())) {
+        debugWarning("MOTU MIDI buffer overflow, dropping messages\n");
+    }
 
     return 0;
 }
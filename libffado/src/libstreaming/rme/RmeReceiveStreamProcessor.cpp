@@ -32,6 +32,7 @@
 
 #include "RmeReceiveStreamProcessor.h"
 #include "RmePort.h"
+#include "../generic/SampleConversion.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -65,8 +66,6 @@ RmeReceiveStreamProcessor::RmeReceiveStreamProcessor(FFADODevice &parent,
     , n_hw_tx_buffer_samples ( -1 )
     , m_rme_model( model )
     , m_event_size( event_size )
-    , mb_head ( 0 )
-    , mb_tail ( 0 )
 {
 }
 
@@ -123,6 +122,16 @@ RmeReceiveStreamProcessor::prepareChild() {
     m_data_buffer->setMaxAbsDiff(10000);
     m_Parent.getDeviceManager().getStreamProcessorManager().setMaxDiffTicks(30720);
 
+    for ( PortVectorIterator it = m_Ports.begin();
+      it != m_Ports.end();
+      ++it ) {
+        if ((*it)->getPortType() == Port::E_Midi) {
+            MidiScheduler &sched = static_cast<RmeMidiPort *>(*it)->getScheduler();
+            sched.reset();
+            sched.setSpacing(1);
+        }
+    }
+
     return true;
 }
 
@@ -301,7 +310,28 @@ signed int RmeReceiveStreamProcessor::decodeRmeEventsToPort(RmeAudioPort *p,
     quadlet_t *src_data;
     src_data = data + p->getPosition()/4;
 
-    switch(m_StreamProcessorManager.getAudioDataType()) {
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+    unsigned int stride = p->getBufferStride();
+    if (!isNativeAudioSampleLayout(type, stride)) {
+        // other sample formats and interleaved client buffers
+        int32_t tmp[SAMPLE_CONVERSION_BLOCK_SIZE];
+        unsigned int k;
+
+        assert(nevents + offset <= p->getBufferSize());
+
+        for(j = 0; j < nevents; j += k) {
+            unsigned int n = nevents - j;
+            if (n > SAMPLE_CONVERSION_BLOCK_SIZE) n = SAMPLE_CONVERSION_BLOCK_SIZE;
+            for(k = 0; k < n; k += 1) {
+                tmp[k] = Rme::ByteSwapFromDevice32(*src_data) >> 8;
+                src_data+=m_event_size/4;
+            }
+            convertInt24ToClient(type, tmp, p->getBufferAddress(), offset + j, stride, n);
+        }
+        return 0;
+    }
+
+    switch(type) {
         default:
         case StreamProcessorManager::eADT_Int24:
             {
@@ -376,48 +406,36 @@ RmeReceiveStreamProcessor::decodeRmeMidiEventsToPort(
     //
     // Get MIDI bytes if present in any frames within the packet.  RME MIDI
     // data is sent as part of a 3-byte sequence starting at the port's
-    // position.  Some RMEs (eg: the 828MkII) send more than one MIDI byte
-    // in some packets.  Since the FFADO MIDI layer requires a MIDI byte in
-    // only every 8th buffer position we allow for this by buffering the
-    // incoming data.  The buffer is small since it only has to cover for
-    // short-term excursions in the data rate.  Since the MIDI data
-    // originates on a physical MIDI bus the overall data rate is limited by
-    // the baud rate of that bus (31250), which is no more than one byte in
-    // 8 even for 1x sample rates.
+    // position.  Each byte is written at the frame it arrived in, and the
+    // port's scheduler moves it to the next free frame if that one is
+    // taken.  Since the MIDI data originates on a physical MIDI bus the
+    // overall data rate is limited by the baud rate of that bus (31250), so
+    // only short-term excursions in the data rate have to be covered.
+    MidiScheduler &sched = p->getScheduler();
+    quadlet_t byte;
     src = (unsigned char *)data + p->getPosition();
-    // We assume that the buffer has been set up in such a way that the first
-    // element is correctly aligned for FFADOs MIDI layer.  The requirement
-    // is that actual MIDI bytes must be aligned to multiples of 8 samples.  
 
     while (j < nevents) {
         /* Most events don't have MIDI data bytes */
         // if (unlikely((*src & RME_KEY_MASK_MIDI) == RME_KEY_MASK_MIDI)) {
         if (0) {
-            // A MIDI byte is in *(src+2).  Bit 24 is used to flag MIDI data
-            // as present once the data makes it to the output buffer.
-            midibuffer[mb_head++] = 0x01000000 | *(src+2);
-            mb_head &= RX_MIDIBUFFER_SIZE-1;
-            if (unlikely(mb_head == mb_tail)) {
-                debugWarning("RME rx MIDI buffer overflow\n");
-                /* Dump oldest byte.  This overflow can only happen if the
-                 * rate coming in from the hardware MIDI port grossly
-                 * exceeds the official MIDI baud rate of 31250 bps, so it
-                 * should never occur in practice.
-                 */
-                mb_tail = (mb_tail + 1) & (RX_MIDIBUFFER_SIZE-1);
-            }
+            // A MIDI byte is in *(src+2).  The scheduler can only
+            // overflow if the rate coming in from the hardware MIDI port
+            // grossly exceeds the official MIDI baud rate of 31250 bps, so
+            // it should never occur in practice.
+            sched.put(*(src+2), j);
         }
-        /* Write to the buffer if we're at an 8-sample boundary */
-        if (unlikely(!(j & 0x07))) {
-            if (mb_head != mb_tail) {
-                *buffer = midibuffer[mb_tail++];
-                mb_tail &= RX_MIDIBUFFER_SIZE-1;
-            }
-            buffer += 8;
+        // Bit 24 is used to flag MIDI data as present in the output buffer.
+        if (unlikely(sched.get(j, byte))) {
+            buffer[j] = byte;
         }
         j++;
         src += m_event_size;
     }
+    sched.advance(nevents);
+    if (unlikely(sched.isNewOverflow())) {
+        debugWarning("RME rx MIDI buffer overflow, dropping messages\n");
+    }
 
     return 0;    
 }
@@ -34,6 +34,7 @@
 
 #include "RmeTransmitStreamProcessor.h"
 #include "RmePort.h"
+#include "../generic/SampleConversion.h"
 #include "../StreamProcessorManager.h"
 #include "devicemanager.h"
 
@@ -74,9 +75,6 @@ RmeTransmitStreamProcessor::RmeTransmitStreamProcessor(FFADODevice &parent,
         , m_rme_model( model)
         , m_event_size( event_size )
         , m_tx_dbc( 0 )
-        , mb_head( 0 )
-        , mb_tail( 0 )
-        , midi_lock( 0 )
         , streaming_has_run ( 0 )
         , streaming_has_dryrun ( 0 )
         , streaming_start_count ( 0 )
@@ -549,6 +547,16 @@ bool RmeTransmitStreamProcessor::prepareChild()
 
 // Unsure whether this helps yet.  Testing continues.
 m_dll_bandwidth_hz = 1.0; // 0.1;
+
+    for ( PortVectorIterator it = m_Ports.begin();
+      it != m_Ports.end();
+      ++it ) {
+        if ((*it)->getPortType() == Port::E_Midi) {
+            MidiScheduler &sched = static_cast<RmeMidiPort *>(*it)->getScheduler();
+            sched.reset();
+            sched.setSpacing(midi_tx_period);
+        }
+    }
     return true;
 }
 
@@ -647,7 +655,28 @@ int RmeTransmitStreamProcessor::encodePortToRmeEvents(RmeAudioPort *p, quadlet_t
     quadlet_t *target;
     target = data + p->getPosition()/4;
 
-    switch(m_StreamProcessorManager.getAudioDataType()) {
+    enum StreamProcessorManager::eADT_AudioDataType type = m_StreamProcessorManager.getAudioDataType();
+    unsigned int stride = p->getBufferStride();
+    if (!isNativeAudioSampleLayout(type, stride)) {
+        // other sample formats and interleaved client buffers
+        int32_t tmp[SAMPLE_CONVERSION_BLOCK_SIZE];
+        unsigned int k;
+
+        assert(nevents + offset <= p->getBufferSize());
+
+        for(j = 0; j < nevents; j += k) {
+            unsigned int n = nevents - j;
+            if (n > SAMPLE_CONVERSION_BLOCK_SIZE) n = SAMPLE_CONVERSION_BLOCK_SIZE;
+            convertClientToInt24(type, p->getBufferAddress(), offset + j, stride, tmp, n, RME_CLIP_FLOATS);
+            for(k = 0; k < n; k += 1) {
+                *target = Rme::ByteSwapToDevice32(((quadlet_t)tmp[k] & 0x00ffffff) << 8);
+                target+=m_event_size/4;
+            }
+        }
+        return 0;
+    }
+
+    switch(type) {
         default:
         case StreamProcessorManager::eADT_Int24:
             {
@@ -723,45 +752,34 @@ int RmeTransmitStreamProcessor::encodePortToRmeMidiEvents(
     src += offset;
     unsigned char *target = (unsigned char *)data + p->getPosition();
 
-    // Send a MIDI byte if there is one to send.  RME MIDI data is sent using
-    // a 3-byte sequence within a frame starting at the port's position.
-    // A non-zero MSB indicates there is MIDI data to send.
-
-    for (j=0; j<nevents; j++, src++, target+=m_event_size) {
-        if (midi_lock)
-            midi_lock--;
-
-        /* FFADO's MIDI subsystem dictates that at the most there will be one
-         * MIDI byte every 8th's sample, making a MIDI byte "unlikely".
-         */
-        if (unlikely(*src & 0xff000000)) { 
-            /* A MIDI byte is ready to send - buffer it */
-            midibuffer[mb_head++] = *src;
-            mb_head &= MIDIBUFFER_SIZE-1;
-            if (unlikely(mb_head == mb_tail)) {
-            /* Buffer overflow - dump oldest byte. */
-            /* Ideally this would dump an entire MIDI message, but this is only
-             * feasible if it's possible to determine the message size easily.
-             */
-                mb_tail = (mb_tail+1) & (MIDIBUFFER_SIZE-1);
-                debugWarning("RME MIDI buffer overflow\n");
-            }
+    MidiScheduler &sched = p->getScheduler();
+    quadlet_t byte;
+
+    // Queue the MIDI bytes with the frame they are at.  A non-zero MSB
+    // indicates there is MIDI data to send.
+    for (j=0; j<nevents; j++, src++) {
+        if (unlikely(*src & 0xff000000)) {
+            sched.put(*src, j);
             debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"Buffered MIDI byte %d\n", *src & 0xff);
         }
+    }
 
-        /* Send the MIDI byte at the tail of the buffer if enough time has elapsed
-         * since the last MIDI byte was sent.  For most iterations through the loop
-         * this condition will be false.
-         */
-        if (unlikely(mb_head!=mb_tail && !midi_lock)) {
+    // Send a MIDI byte in the first frame at or after the frame it was at,
+    // provided enough time has elapsed since the last MIDI byte was sent.
+    // RME MIDI data is sent using a 3-byte sequence within a frame starting
+    // at the port's position.
+    for (j=0; j<nevents; j++, target+=m_event_size) {
+        if (unlikely(sched.get(j, byte))) {
             *(target) = 0x01;
             *(target+1) = 0x00;
-            *(target+2) = midibuffer[mb_tail] & 0xff;
-            debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"Sent MIDI byte %d (j=%d)\n", midibuffer[mb_tail], j);
-            mb_tail = (mb_tail+1) & (MIDIBUFFER_SIZE-1);
-            midi_lock = midi_tx_period;
+            *(target+2) = byte & 0xff;
+            debugOutput(DEBUG_LEVEL_VERY_VERBOSE,"Sent MIDI byte %d (j=%d)\n", byte & 0xff, j);
         }
     }
+    sched.advance(nevents);
+    if (unlikely(sched.isNewOverflow())) {
+        debugWarning("RME MIDI buffer overflow, dropping messages\n");
+    }
 
     return 0;
 }
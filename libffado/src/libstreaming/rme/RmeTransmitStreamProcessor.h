@@ -119,19 +119,12 @@ private:
     // Keep track of transmission data block count
     unsigned int m_tx_dbc;
 
-    // A simple circular buffer for outgoing MIDI data to allow
-    // a rate control to be implemented on the data to suit the RME
-    // devices.  Note that this buffer's size is forced to be a power
-    // of 2 to allow for buffer manipulation optimisations.
-    // FIXME: it is yet to be determined whether this is necessary for
-    // the RME device.
-    #define MIDIBUFFER_SIZE_EXP 10
-    #define MIDIBUFFER_SIZE     (1<<MIDIBUFFER_SIZE_EXP)
-    unsigned int midibuffer[MIDIBUFFER_SIZE];
-    unsigned int mb_head, mb_tail;
-    unsigned int midi_lock;
     signed int streaming_has_run, streaming_has_dryrun;
     signed int streaming_start_count;
+    // The outgoing MIDI data is rate controlled by the scheduler of the
+    // MIDI port.
+    // FIXME: it is yet to be determined whether this is necessary for
+    // the RME device.
     unsigned int midi_tx_period; /* Measured in audio clock periods */
 };
 
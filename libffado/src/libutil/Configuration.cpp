@@ -77,6 +77,7 @@ Configuration::openFile(std::string filename, enum eFileMode mode)
             break;
     }
     m_ConfigFiles.push_back(c);
+    rebuildDeviceIndex();
     return true;
 }
 
@@ -89,6 +90,7 @@ Configuration::closeFile(std::string filename)
         ConfigFile *c = m_ConfigFiles.at(idx);
         m_ConfigFiles.erase(m_ConfigFiles.begin()+idx);
         delete c;
+        rebuildDeviceIndex();
         return true;
     } else {
         debugError("file not open\n");
@@ -313,16 +315,17 @@ Configuration::getSetting( std::string path )
 bool
 Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_id, std::string setting, int32_t &ref)
 {
-    libconfig::Setting *s = getDeviceSetting( vendor_id, model_id );
+    libconfig::Setting *s = getDeviceSetting( vendor_id, model_id, setting );
     if(s) {
         try {
-            return s->lookupValue(setting, ref);
+            int32_t value = *s;
+            ref = value;
+            return true;
         } catch (...) {
-            debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s not found\n", setting.c_str());
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s has wrong type\n", setting.c_str());
             return false;
         }
     } else {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "device %X/%X not found\n", vendor_id, model_id);
         return false;
     }
 }
@@ -330,17 +333,17 @@ Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_i
 bool
 Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_id, std::string setting, int64_t &ref)
 {
-    libconfig::Setting *s = getDeviceSetting( vendor_id, model_id );
+    libconfig::Setting *s = getDeviceSetting( vendor_id, model_id, setting );
     if(s) {
         try {
-            long long int refverylong = ref;
-            return s->lookupValue(setting, refverylong);
+            long long int value = *s;
+            ref = value;
+            return true;
         } catch (...) {
-            debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s not found\n", setting.c_str());
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s has wrong type\n", setting.c_str());
             return false;
         }
     } else {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "device %X/%X not found\n", vendor_id, model_id);
         return false;
     }
 }
@@ -348,94 +351,139 @@ Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_i
 bool
 Configuration::getValueForDeviceSetting(unsigned int vendor_id, unsigned model_id, std::string setting, float &ref)
 {
-    libconfig::Setting *s = getDeviceSetting( vendor_id, model_id );
+    libconfig::Setting *s = getDeviceSetting( vendor_id, model_id, setting );
     if(s) {
         try {
-            return s->lookupValue(setting, ref);
+            float value = *s;
+            ref = value;
+            return true;
         } catch (...) {
-            debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s not found\n", setting.c_str());
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s has wrong type\n", setting.c_str());
             return false;
         }
     } else {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "device %X/%X not found\n", vendor_id, model_id);
         return false;
     }
 }
 
 libconfig::Setting *
-Configuration::getDeviceSetting( unsigned int vendor_id, unsigned model_id )
+Configuration::getDeviceSetting( unsigned int vendor_id, unsigned model_id, std::string setting )
+{
+    struct DeviceIndexEntry *e = findDeviceIndexEntry(vendor_id, model_id);
+    if (e == NULL) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "device %X/%X not found\n", vendor_id, model_id);
+        return NULL;
+    }
+    std::map<std::string, libconfig::Setting *>::iterator it = e->members.find(setting);
+    if (it == e->members.end()) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "Setting %s not found\n", setting.c_str());
+        return NULL;
+    }
+    return it->second;
+}
+
+struct Configuration::DeviceIndexEntry *
+Configuration::findDeviceIndexEntry( unsigned int vendor_id, unsigned model_id )
 {
+    uint64_t key = ((uint64_t)vendor_id << 32) | model_id;
+    DeviceIndexIterator it = m_DeviceIndex.find(key);
+    if (it == m_DeviceIndex.end()) {
+        return NULL;
+    }
+    return &it->second;
+}
+
+void
+Configuration::rebuildDeviceIndex()
+{
+    m_DeviceIndex.clear();
+
+    // the files are in order of priority, and within a file the first
+    // definition of a device is the one that counts
     for ( std::vector<ConfigFile *>::iterator it = m_ConfigFiles.begin();
       it != m_ConfigFiles.end();
       ++it )
     {
         ConfigFile *c = *it;
+        Setting *plist;
         try {
-            Setting &list = c->lookup("device_definitions");
-            unsigned int children = list.getLength();
-            for(unsigned int i = 0; i < children; i++) {
-                Setting &s = list[i];
-                try {
-                    Setting &vendorid = s["vendorid"];
-                    Setting &modelid = s["modelid"];
-                    uint32_t vid = vendorid;
-                    uint32_t mid = modelid;
-                    if (vendor_id == vid && model_id == mid) {
-                        debugOutput(DEBUG_LEVEL_VERBOSE,
-                                    "  device VME for %X:%x found in %s\n",
-                                    vendor_id, model_id, c->getName().c_str());
-                        c->showSetting(s);
-                        return &s;
-                    }
-                } catch (...) {
-                    debugWarning("Bogus format\n");
-                }
-            }
+            plist = &c->lookup("device_definitions");
         } catch (...) {
             debugOutput(DEBUG_LEVEL_VERBOSE, "  %s has no device definitions\n", c->getName().c_str());
+            continue;
+        }
+        Setting &list = *plist;
+        unsigned int children = list.getLength();
+        for(unsigned int i = 0; i < children; i++) {
+            Setting &s = list[i];
+            uint32_t vid, mid;
+            try {
+                Setting &vendorid = s["vendorid"];
+                Setting &modelid = s["modelid"];
+                vid = vendorid;
+                mid = modelid;
+            } catch (...) {
+                debugWarning("Bogus format\n");
+                continue;
+            }
+            uint64_t key = ((uint64_t)vid << 32) | mid;
+            if (m_DeviceIndex.find(key) != m_DeviceIndex.end()) {
+                continue;
+            }
+
+            struct DeviceIndexEntry &e = m_DeviceIndex[key];
+            e.file = c;
+            e.setting = &s;
+            if (!parseDeviceVME(s, e.vme)) {
+                debugWarning("Bogus format\n");
+            }
+            for (int j = 0; j < s.getLength(); j++) {
+                Setting &m = s[j];
+                if (m.getName()) {
+                    e.members[m.getName()] = &m;
+                }
+            }
         }
     }
-    return NULL;
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Indexed %zd device definitions\n", m_DeviceIndex.size());
 }
 
-
+bool
+Configuration::parseDeviceVME( libconfig::Setting &s, VendorModelEntry &vme )
+{
+    try {
+        Setting &vendorid = s["vendorid"];
+        Setting &modelid = s["modelid"];
+        vme.vendor_id = vendorid;
+        vme.model_id = modelid;
+
+        const char *tmp = s["vendorname"];
+        vme.vendor_name = tmp;
+        tmp = s["modelname"];
+        vme.model_name = tmp;
+
+        if (!s.lookupValue("driver", vme.driver))
+        {
+            std::string driver = s["driver"];
+            vme.driver = convertDriver(driver);
+        }
+    } catch (...) {
+        // leave an invalid entry
+        vme = VendorModelEntry();
+        return false;
+    }
+    return true;
+}
 
 Configuration::VendorModelEntry
 Configuration::findDeviceVME( unsigned int vendor_id, unsigned model_id )
 {
-
-    // FIXME: clean this pointer/reference mess please
-    Setting *ps = getDeviceSetting(vendor_id, model_id);
-
-    if(ps) {
-        Setting &s = *ps;
-        try {
-            Setting &vendorid = s["vendorid"];
-            Setting &modelid = s["modelid"];
-            uint32_t vid = vendorid;
-            uint32_t mid = modelid;
-            if (vendor_id == vid && model_id == mid) {
-                struct VendorModelEntry vme;
-                vme.vendor_id = vendorid;
-                vme.model_id = modelid;
-
-                const char *tmp = s["vendorname"];
-                vme.vendor_name = tmp;
-                tmp = s["modelname"];
-                vme.model_name = tmp;
-
-                if (!s.lookupValue("driver", vme.driver))
-                {
-                    std::string driver = s["driver"];
-                    vme.driver = convertDriver(driver);
-                }
-                return vme;
-            } else {
-                debugError("BUG: vendor/model found but not found?\n");
-            }
-        } catch (...) {
-            debugWarning("Bogus format\n");
-        }
+    struct DeviceIndexEntry *e = findDeviceIndexEntry(vendor_id, model_id);
+    if (e) {
+        debugOutput(DEBUG_LEVEL_VERBOSE,
+                    "  device VME for %X:%x found in %s\n",
+                    vendor_id, model_id, e->file->getName().c_str());
+        return e->vme;
     }
     struct VendorModelEntry invalid;
     return invalid;
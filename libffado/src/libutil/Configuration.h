@@ -28,6 +28,7 @@
 #include "libconfig.h++"
 
 #include <vector>
+#include <map>
 
 namespace Util {
 /**
@@ -155,7 +156,7 @@ public:
 
 private:
     libconfig::Setting *getSetting( std::string path );
-    libconfig::Setting *getDeviceSetting( unsigned int vendor_id, unsigned model_id );
+    libconfig::Setting *getDeviceSetting( unsigned int vendor_id, unsigned model_id, std::string setting );
 
     int findFileName(std::string s);
 
@@ -166,6 +167,25 @@ private:
     // provide priorities
     std::vector<ConfigFile *> m_ConfigFiles;
 
+    // index of the device definitions in all config files, such that
+    // probing and device setting lookups don't have to walk the
+    // libconfig lists. Rebuilt when a file is opened or closed.
+    struct DeviceIndexEntry {
+        ConfigFile          *file;
+        libconfig::Setting  *setting;
+        VendorModelEntry     vme;
+        // the members of the device definition, by name
+        std::map<std::string, libconfig::Setting *> members;
+    };
+    typedef std::map<uint64_t, struct DeviceIndexEntry> DeviceIndex;
+    typedef std::map<uint64_t, struct DeviceIndexEntry>::iterator DeviceIndexIterator;
+
+    void rebuildDeviceIndex();
+    struct DeviceIndexEntry *findDeviceIndexEntry( unsigned int vendor_id, unsigned model_id );
+    bool parseDeviceVME( libconfig::Setting &s, VendorModelEntry &vme );
+
+    DeviceIndex m_DeviceIndex;
+
     DECLARE_DEBUG_MODULE;
 };
 
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "FlashProgrammer.h"
+#include "SystemTimeSource.h"
+
+#include <inttypes.h>
+
+namespace Util {
+
+IMPL_DEBUG_MODULE( FlashProgrammer, FlashProgrammer, DEBUG_LEVEL_NORMAL );
+
+FlashProgrammer::FlashProgrammer(Target &target, unsigned int busy_timeout_msecs)
+    : m_target( target )
+    , m_busy_timeout_msecs( busy_timeout_msecs )
+    , m_nb_blocks_written( 0 )
+    , m_nb_blocks_read( 0 )
+    , m_nb_busy_waits( 0 )
+    , m_nb_busy_polls( 0 )
+    , m_busy_time_usecs( 0 )
+    , m_max_busy_time_usecs( 0 )
+{
+}
+
+bool
+FlashProgrammer::write(uint64_t address, unsigned int nb_quads, uint32_t *data)
+{
+    return transfer(address, nb_quads, data, true);
+}
+
+bool
+FlashProgrammer::read(uint64_t address, unsigned int nb_quads, uint32_t *data)
+{
+    return transfer(address, nb_quads, data, false);
+}
+
+bool
+FlashProgrammer::transfer(uint64_t address, unsigned int nb_quads, uint32_t *data, bool write)
+{
+    unsigned int block_size = m_target.getBlockSizeQuads();
+    unsigned int max_blocks = m_target.getMaxOutstandingBlocks();
+    if (block_size == 0) {
+        debugError("Bogus block size\n");
+        return false;
+    }
+    if (max_blocks == 0) {
+        max_blocks = 1;
+    }
+
+    BlockVector blocks;
+    while (nb_quads > 0) {
+        // hand as many blocks to the target as it can keep outstanding
+        blocks.clear();
+        while (nb_quads > 0 && blocks.size() < max_blocks) {
+            struct sBlock b;
+            b.address = address;
+            b.nb_quads = (nb_quads > block_size ? block_size : nb_quads);
+            b.data = data;
+            blocks.push_back(b);
+
+            address += b.nb_quads * 4;
+            data += b.nb_quads;
+            nb_quads -= b.nb_quads;
+        }
+
+        if (write) {
+            if (!m_target.startWrite(blocks)) {
+                debugError("Could not write %zd blocks at 0x%012" PRIX64 "\n",
+                           blocks.size(), blocks.at(0).address);
+                return false;
+            }
+            if (m_target.writeNeedsBusyWait()
+                && !waitWhileBusy(m_busy_timeout_msecs)) {
+                debugError("Flash busy after writing 0x%012" PRIX64 "\n",
+                           blocks.at(0).address);
+                return false;
+            }
+            if (!m_target.completeWrite(blocks)) {
+                debugError("Write failed for 0x%012" PRIX64 "\n", blocks.at(0).address);
+                return false;
+            }
+            m_nb_blocks_written += blocks.size();
+        } else {
+            if (!m_target.startRead(blocks)) {
+                debugError("Could not read %zd blocks at 0x%012" PRIX64 "\n",
+                           blocks.size(), blocks.at(0).address);
+                return false;
+            }
+            if (m_target.readNeedsBusyWait()
+                && !waitWhileBusy(m_busy_timeout_msecs)) {
+                debugError("Flash busy after reading 0x%012" PRIX64 "\n",
+                           blocks.at(0).address);
+                return false;
+            }
+            if (!m_target.completeRead(blocks)) {
+                debugError("Read failed for 0x%012" PRIX64 "\n", blocks.at(0).address);
+                return false;
+            }
+            m_nb_blocks_read += blocks.size();
+        }
+    }
+    return true;
+}
+
+bool
+FlashProgrammer::waitWhileBusy(unsigned int timeout_msecs,
+                               unsigned int min_interval_usecs,
+                               unsigned int max_interval_usecs)
+{
+    if (min_interval_usecs == 0) {
+        min_interval_usecs = FLASHPROGRAMMER_MIN_POLL_INTERVAL_USECS;
+    }
+    if (max_interval_usecs < min_interval_usecs) {
+        max_interval_usecs = FLASHPROGRAMMER_MAX_POLL_INTERVAL_USECS;
+        if (max_interval_usecs < min_interval_usecs) {
+            max_interval_usecs = min_interval_usecs;
+        }
+    }
+
+    ffado_microsecs_t start = SystemTimeSource::getCurrentTimeAsUsecs();
+    ffado_microsecs_t deadline = start + (ffado_microsecs_t)timeout_msecs * 1000ULL;
+    unsigned int interval = min_interval_usecs;
+
+    m_nb_busy_waits++;
+
+    unsigned int settle = m_target.getSettleUsecs();
+    if (settle) {
+        SystemTimeSource::SleepUsecRelative(settle);
+    }
+
+    while (true) {
+        bool busy = true;
+        m_nb_busy_polls++;
+        if (!m_target.isBusy(busy)) {
+            debugError("Could not read the flash status\n");
+            return false;
+        }
+        ffado_microsecs_t now = SystemTimeSource::getCurrentTimeAsUsecs();
+        if (!busy) {
+            ffado_microsecs_t busy_time = now - start;
+            m_busy_time_usecs += busy_time;
+            if (busy_time > m_max_busy_time_usecs) {
+                m_max_busy_time_usecs = busy_time;
+            }
+            return true;
+        }
+        if (now >= deadline) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Flash still busy after %u ms\n", timeout_msecs);
+            return false;
+        }
+        // don't sleep past the deadline
+        ffado_microsecs_t sleep_time = interval;
+        if (now + sleep_time > deadline) {
+            sleep_time = deadline - now;
+        }
+        SystemTimeSource::SleepUsecRelative(sleep_time);
+
+        interval *= 2;
+        if (interval > max_interval_usecs) {
+            interval = max_interval_usecs;
+        }
+    }
+}
+
+void
+FlashProgrammer::show()
+{
+    debugOutput(DEBUG_LEVEL_NORMAL, "FlashProgrammer\n");
+    debugOutput(DEBUG_LEVEL_NORMAL, " Blocks written    : %u\n", m_nb_blocks_written);
+    debugOutput(DEBUG_LEVEL_NORMAL, " Blocks read       : %u\n", m_nb_blocks_read);
+    debugOutput(DEBUG_LEVEL_NORMAL, " Busy waits        : %u (%u polls)\n",
+                m_nb_busy_waits, m_nb_busy_polls);
+    debugOutput(DEBUG_LEVEL_NORMAL, " Busy time         : %" PRIu64 " us (max %" PRIu64 " us)\n",
+                m_busy_time_usecs, m_max_busy_time_usecs);
+}
+
+} // end of namespace Util
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_FLASHPROGRAMMER__
+#define __FFADO_FLASHPROGRAMMER__
+
+#include "debugmodule/debugmodule.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace Util {
+
+/**
+ * @brief Common engine to read and program device flash memory
+ *
+ * The device specific part is implemented by a FlashProgrammer::Target.
+ * The engine splits the transfers into blocks, hands as many blocks to
+ * the target at once as it can keep outstanding, and polls the busy
+ * status of the device with an exponentially growing interval instead
+ * of sleeping for a fixed (worst case) time.
+ */
+class FlashProgrammer
+{
+public:
+    struct sBlock {
+        uint64_t        address;
+        unsigned int    nb_quads;
+        uint32_t       *data;
+    };
+    typedef std::vector<struct sBlock> BlockVector;
+    typedef std::vector<struct sBlock>::iterator BlockVectorIterator;
+
+    class Target
+    {
+    public:
+        virtual ~Target() {};
+
+        /**
+         * @brief read the busy status of the flash
+         * @param busy set to true when the device is busy
+         * @return false if the status could not be read
+         */
+        virtual bool isBusy(bool &busy) = 0;
+        /**
+         * @brief the time the device needs before its busy status
+         *        is meaningful after a command was issued
+         */
+        virtual unsigned int getSettleUsecs() {return 0;};
+
+        /// the maximum size of one block transfer
+        virtual unsigned int getBlockSizeQuads() = 0;
+        /// the number of blocks that can be handed to the device at once
+        virtual unsigned int getMaxOutstandingBlocks() {return 1;};
+
+        /**
+         * @brief start writing a number of blocks
+         *
+         * When writeNeedsBusyWait() is true, the engine waits until the
+         * flash is no longer busy, and then calls completeWrite().
+         */
+        virtual bool startWrite(BlockVector &) {return false;};
+        virtual bool writeNeedsBusyWait() {return true;};
+        virtual bool completeWrite(BlockVector &) {return true;};
+
+        /**
+         * @brief start reading a number of blocks
+         *
+         * Same sequence as for writing, completeRead() should fill the
+         * data buffers of the blocks if startRead() didn't do so.
+         */
+        virtual bool startRead(BlockVector &) {return false;};
+        virtual bool readNeedsBusyWait() {return false;};
+        virtual bool completeRead(BlockVector &) {return true;};
+    };
+
+    /**
+     * @param target the device specific part
+     * @param busy_timeout_msecs the time a block write or read is allowed
+     *        to take before it is considered to be failed
+     */
+    FlashProgrammer(Target &target, unsigned int busy_timeout_msecs);
+    virtual ~FlashProgrammer() {};
+
+    bool write(uint64_t address, unsigned int nb_quads, uint32_t *data);
+    bool read(uint64_t address, unsigned int nb_quads, uint32_t *data);
+
+    /**
+     * @brief wait until the device is no longer busy
+     *
+     * The status is polled at an interval that starts at the minimum
+     * interval and doubles after each poll up to the maximum interval.
+     *
+     * @param timeout_msecs the maximum time to wait
+     * @param min_interval_usecs the first poll interval, 0 for the default
+     * @param max_interval_usecs the largest poll interval, 0 for the default
+     * @return true if the device is ready, false on timeout or error
+     */
+    bool waitWhileBusy(unsigned int timeout_msecs,
+                       unsigned int min_interval_usecs = 0,
+                       unsigned int max_interval_usecs = 0);
+
+    void setVerboseLevel(int l) {setDebugLevel(l);};
+    void show();
+
+private:
+    bool transfer(uint64_t address, unsigned int nb_quads, uint32_t *data, bool write);
+
+    Target         &m_target;
+    unsigned int    m_busy_timeout_msecs;
+
+    // statistics
+    unsigned int    m_nb_blocks_written;
+    unsigned int    m_nb_blocks_read;
+    unsigned int    m_nb_busy_waits;
+    unsigned int    m_nb_busy_polls;
+    uint64_t        m_busy_time_usecs;
+    uint64_t        m_max_busy_time_usecs;
+
+    DECLARE_DEBUG_MODULE;
+};
+
+} // end of namespace Util
+
+#endif /* __FFADO_FLASHPROGRAMMER__ */
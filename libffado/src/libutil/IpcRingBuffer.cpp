@@ -22,16 +22,16 @@
  */
 
 #include "IpcRingBuffer.h"
-#include "PosixMessageQueue.h"
 #include "PosixSharedMemory.h"
-#include "Mutex.h"
-#include "PosixMutex.h"
-#include "Functors.h"
 
 #include <cstring>
+#include <climits>
+#include <cerrno>
 
-// FIXME: if we restrict the nb_blocks to a power of two, the overflows
-//        can be implemented using masks
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 namespace Util {
 
@@ -49,40 +49,32 @@ IpcRingBuffer::IpcRingBuffer(std::string name,
 , m_direction( dir )
 , m_blocking( blocking )
 , m_initialized( false )
-, m_next_block( 1 )
-, m_last_block_ack( 0 )
-, m_idx( 1 )
-, m_last_idx_ack( 0 )
-, m_ping_queue( *(new PosixMessageQueue(name+":ping")) )
-, m_pong_queue( *(new PosixMessageQueue(name+":pong")) )
-, m_memblock( *(new PosixSharedMemory(name+":mem", blocks*block_size)) )
-, m_access_lock( *(new PosixMutex()) )
-, m_notify_functor( *(new MemberFunctor0< IpcRingBuffer*, void (IpcRingBuffer::*)() >
-                     ( this, &IpcRingBuffer::notificationHandler, false )) )
-, m_block_requested_for_read( *(new PosixMutex()) )
-, m_block_requested_for_write( *(new PosixMutex()) )
+, m_memblock( *(new PosixSharedMemory(name+":mem",
+                                      sizeof(struct ControlBlock) + blocks*block_size)) )
+, m_control( NULL )
+, m_data( NULL )
+, m_requested_idx( 0 )
+, m_block_requested_for_read( false )
+, m_block_requested_for_write( false )
+, m_poll_fd( -1 )
+, m_notify_fd( -1 )
 {
-    m_ping_queue.setVerboseLevel(getDebugLevel());
-    m_pong_queue.setVerboseLevel(getDebugLevel());
     m_memblock.setVerboseLevel(getDebugLevel());
-    m_access_lock.setVerboseLevel(getDebugLevel());
-    sem_init(&m_activity, 0, 0);
 }
 
 IpcRingBuffer::~IpcRingBuffer()
 {
-    // make sure everyone is done with this
-    // should not be necessary AFAIK
-    m_access_lock.Lock();
+    if(m_poll_fd >= 0) {
+        if(m_initialized) {
+            __sync_fetch_and_and(&m_control->poller, ~(int32_t)getPollRole());
+        }
+        close(m_poll_fd);
+    }
+    if(m_notify_fd >= 0) {
+        close(m_notify_fd);
+    }
     m_initialized=false;
     delete &m_memblock;
-    delete &m_ping_queue;
-    delete &m_pong_queue;
-    m_access_lock.Unlock();
-
-    delete &m_access_lock;
-    delete &m_notify_functor;
-    sem_destroy(&m_activity);
 }
 
 bool
@@ -97,301 +89,221 @@ IpcRingBuffer::init()
     debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) init %s\n", this, m_name.c_str());
     debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) direction %d, %d blocks of %d bytes\n",
                                      this, m_direction, m_blocks, m_blocksize);
+    // both sides update an index in the control block, hence
+    // both map the segment read-write
     switch(m_type) {
         case eBT_Master:
-            // a master creates and owns all of the shared memory structures
-            // for outward connections we write the data, else we read
+            // a master creates and owns the shared memory segment
             if(!m_memblock.Create( PosixSharedMemory::eD_ReadWrite ))
             {
                 debugError("(%p, %s) Could not create memblock\n",
                            this, m_name.c_str());
                 return false;
             }
-
-            m_memblock.LockInMemory(true);
-            // for outward connections we do the pinging, else
-            // we do the pong-ing. note that for writing, we open read-write
-            // in order to be able to dequeue when the queue is full
-            if(!m_ping_queue.Create( (m_direction == eD_Outward ?
-                                       PosixMessageQueue::eD_ReadWrite :
-                                       PosixMessageQueue::eD_ReadOnly),
-                                     (m_blocking==eB_Blocking ?
-                                       PosixMessageQueue::eB_Blocking :
-                                       PosixMessageQueue::eB_NonBlocking)
-                                   ))
-            {
-                debugError("(%p, %s) Could not create ping queue\n",
-                           this, m_name.c_str());
-                return false;
-            }
-            if(!m_pong_queue.Create( (m_direction == eD_Outward ?
-                                       PosixMessageQueue::eD_ReadOnly :
-                                       PosixMessageQueue::eD_ReadWrite),
-                                     (m_blocking==eB_Blocking ?
-                                       PosixMessageQueue::eB_Blocking :
-                                       PosixMessageQueue::eB_NonBlocking)
-                                   ))
-            {
-                debugError("(%p, %s) Could not create pong queue\n",
-                           this, m_name.c_str());
-                return false;
-            }
             break;
         case eBT_Slave:
-            // a slave only opens the shared memory structures
-            // for outward connections we write the data, else we read
-            if(!m_memblock.Open( (m_direction == eD_Outward
-                                    ? PosixSharedMemory::eD_ReadWrite
-                                    : PosixSharedMemory::eD_ReadOnly) ))
+            // a slave only opens the shared memory segment
+            if(!m_memblock.Open( PosixSharedMemory::eD_ReadWrite ))
             {
                 debugError("(%p, %s) Could not open memblock\n",
                            this, m_name.c_str());
                 return false;
             }
-            m_memblock.LockInMemory(true);
-            // for outward connections we do the pinging, else
-            // we do the pong-ing. note that for writing, we open read-write
-            // in order to be able to dequeue when the queue is full
-            if(!m_ping_queue.Open( (m_direction == eD_Outward ?
-                                      PosixMessageQueue::eD_ReadWrite :
-                                      PosixMessageQueue::eD_ReadOnly),
-                                   (m_blocking==eB_Blocking ?
-                                      PosixMessageQueue::eB_Blocking :
-                                      PosixMessageQueue::eB_NonBlocking)
-                                 ))
-            {
-                debugError("(%p, %s) Could not open ping queue\n",
-                           this, m_name.c_str());
-                return false;
-            }
-            if(!m_pong_queue.Open( (m_direction == eD_Outward ?
-                                      PosixMessageQueue::eD_ReadOnly :
-                                      PosixMessageQueue::eD_ReadWrite),
-                                   (m_blocking==eB_Blocking ?
-                                      PosixMessageQueue::eB_Blocking :
-                                      PosixMessageQueue::eB_NonBlocking)
-                                 ))
-            {
-                debugError("(%p, %s) Could not open pong queue\n",
-                           this, m_name.c_str());
-                return false;
-            }
             break;
     }
+    m_memblock.LockInMemory(true);
 
-    // if we are on the sending end of the buffer, we need a notifier
-    // on the pong queue
-    // the receiving end is driven by the messages in the ping queue
-    if(m_direction == eD_Outward) {
-        if(!m_pong_queue.setNotificationHandler(&m_notify_functor)) {
-            debugError("Could not set Notification Handler\n");
+    m_control = (struct ControlBlock *)m_memblock.requestBlock(0, sizeof(struct ControlBlock));
+    m_data = (char *)m_memblock.requestBlock(sizeof(struct ControlBlock), m_blocks*m_blocksize);
+    if(m_control == NULL || m_data == NULL) {
+        debugError("(%p, %s) Could not map the memblock\n",
+                   this, m_name.c_str());
+        return false;
+    }
+
+    if(m_type == eBT_Master) {
+        memset(m_control, 0, sizeof(struct ControlBlock));
+        m_control->version = FFADO_IPC_RINGBUFFER_VERSION;
+        m_control->blocks = m_blocks;
+        m_control->blocksize = m_blocksize;
+        // the magic marks the control block as valid
+        __sync_synchronize();
+        m_control->magic = FFADO_IPC_RINGBUFFER_MAGIC;
+    } else {
+        if(m_control->magic != FFADO_IPC_RINGBUFFER_MAGIC) {
+            debugError("(%p, %s) Invalid magic\n",
+                       this, m_name.c_str());
+            return false;
+        }
+        if(m_control->version != FFADO_IPC_RINGBUFFER_VERSION) {
+            debugError("(%p, %s) Version mismatch (have %u, expected %u)\n",
+                       this, m_name.c_str(), m_control->version,
+                       FFADO_IPC_RINGBUFFER_VERSION);
             return false;
         }
-        // enable the handler
-        if(!m_pong_queue.enableNotification()) {
-            debugError("Could not enable notification\n");
+        if(m_control->blocks != m_blocks || m_control->blocksize != m_blocksize) {
+            debugError("(%p, %s) Layout mismatch (have %u blocks of %u bytes, expected %u of %u)\n",
+                       this, m_name.c_str(), m_control->blocks, m_control->blocksize,
+                       m_blocks, m_blocksize);
+            return false;
         }
-        // now clear the queue to eliminate messages that might be there
-        // from earlier runs
-        m_pong_queue.Clear();
-    } else {
-        // if we are on the receiving end, clear any waiting messages in the ping
-        // queue
-        m_ping_queue.Clear();
     }
-    
+
     m_initialized = true;
     return true;
 }
 
-void
-IpcRingBuffer::notificationHandler()
+bool
+IpcRingBuffer::reset()
 {
-    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) IpcRingBuffer %s\n", this, m_name.c_str());
-    // prevent multiple access
-    MutexLockHelper lock(m_access_lock);
-
-    // The first thing we do is re-enable the handler
-    // it is not going to be called since there are messages in the queue
-    // first enabling the handler, then reading all received messages will
-    // ensure that we either read or get notified of any message that arrives
-    // while this handler is running
-    if(!m_pong_queue.enableNotification()) {
-        debugError("Could not re-enable notification\n");
-    }
-
-    // no need for a lock protecting the pong queue as long as we are the only ones reading it
-    // while we have messages to read, read them
-    while(m_pong_queue.canReceive()) {
-        // message placeholder
-        IpcMessage m_ack = IpcMessage(); // FIXME: stack allocation not strictly RT safe
-        // read ping message (blocks)
-        enum PosixMessageQueue::eResult msg_res;
-        msg_res = m_pong_queue.Receive(m_ack);
-        switch(msg_res) {
-            case PosixMessageQueue::eR_OK:
+    if(!m_initialized) {
+        debugError("(%p, %s) Not initialized\n",
+                   this, m_name.c_str());
+        return false;
+    }
+    if(m_direction != eD_Outward) {
+        debugError("(%p, %s) Only the writer can reset the buffer\n",
+                   this, m_name.c_str());
+        return false;
+    }
+    if(m_block_requested_for_write) {
+        debugError("(%p, %s) Cannot reset while a block is requested for write\n",
+                   this, m_name.c_str());
+        return false;
+    }
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) reset %s\n", this, m_name.c_str());
+
+    // mark everything as read. if the reader is still there and
+    // releases a block in the mean time, we simply leave it as is
+    int32_t read_idx = m_control->read_idx;
+    __sync_bool_compare_and_swap(&m_control->read_idx, read_idx, m_control->write_idx);
+    return true;
+}
+
+/**
+ * Sleeps until *idx changes from seen, or until the timeout expires.
+ *
+ * The waiter first announces itself through the waiters counter and
+ * then re-checks the index. Since the other side first updates the
+ * index and then checks the counter, either we see the new index, or
+ * the other side sees us waiting and wakes us.
+ */
+enum IpcRingBuffer::eResult
+IpcRingBuffer::waitForIndexChange(volatile int32_t *idx,
+                                  volatile int32_t *waiters,
+                                  int32_t seen)
+{
+    struct timespec timeout;
+    timeout.tv_sec = FFADO_IPC_RINGBUFFER_TIMEOUT_SEC;
+    timeout.tv_nsec = FFADO_IPC_RINGBUFFER_TIMEOUT_NSEC;
+
+    int retval = 0;
+    __sync_fetch_and_add(waiters, 1);
+    if(*idx == seen) {
+        retval = syscall(SYS_futex, (int *)idx, FUTEX_WAIT, seen, &timeout, NULL, 0);
+    }
+    __sync_fetch_and_sub(waiters, 1);
+
+    if(retval < 0) {
+        switch(errno) {
+            case EAGAIN: // the index changed before we were asleep
+            case EINTR:
                 break;
-            default: // we were just notified, anything except OK is an error
-                debugError("Could not read from ping queue\n");
+            case ETIMEDOUT:
+                debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) Timeout\n", this, m_name.c_str());
+                return eR_Timeout;
+            default:
+                debugError("(%p, %s) Could not wait: %s\n",
+                           this, m_name.c_str(), strerror(errno));
+                return eR_Error;
         }
-    
-        IpcMessage::eMessageType type = m_ack.getType();
-        if(type == IpcMessage::eMT_DataAck) {
-            // get a view on the data
-            struct DataWrittenMessage* data = reinterpret_cast<struct DataWrittenMessage*>(m_ack.getDataPtr());
-    
-            debugOutput(DEBUG_LEVEL_VERBOSE, "Received ack idx %d at id %d\n", data->idx, data->id);
-    
-            // check counters
-            unsigned int expected_block_ack = m_last_block_ack+1;
-            if(expected_block_ack == m_blocks) expected_block_ack = 0;
-            if(data->id != expected_block_ack) {
-                debugWarning("unexpected block id: %d (expected %d)\n", data->id, expected_block_ack);
-            }
+    }
+    return eR_OK;
+}
 
-            unsigned int expected_block_idx = m_last_idx_ack+1; //will auto-overflow
-            if(data->idx != expected_block_idx) {
-                debugWarning("unexpected block idx: %d (expected %d)\n", data->idx, expected_block_idx);
-            }
-    
-            // prepare the next expected values
-            // this is the only value used (and written in case of error) in the other thread
-            m_last_block_ack = data->id;
-            // this is not used
-            m_last_idx_ack = data->idx;
-            // signal activity
-            if(m_blocking == eB_Blocking) {
-                sem_post(&m_activity);
-            }
-        } else {
-            debugError("Invalid message received (type %d)\n", type);
+void
+IpcRingBuffer::wakeWaiters(volatile int32_t *idx, volatile int32_t *waiters)
+{
+    // only do the system call if someone is sleeping
+    if(*waiters) {
+        if(syscall(SYS_futex, (int *)idx, FUTEX_WAKE, INT_MAX, NULL, NULL, 0) < 0) {
+            debugError("(%p, %s) Could not wake: %s\n",
+                       this, m_name.c_str(), strerror(errno));
         }
     }
 }
 
+char *
+IpcRingBuffer::getBlockAddress(int32_t idx)
+{
+    return m_data + ((uint32_t)idx % m_blocks) * m_blocksize;
+}
+
 unsigned int
 IpcRingBuffer::getBufferFill()
 {
-    // the next pointer is last_written+1
-    // so the bufferfill = last_written - last_ack
-    //                   = last_written+1 - last_ack - 1
-    // last_ack is always <= last_written. if not,
-    // last_written has wrapped
-    // => wrap if: last_written < last_ack
-    //          or last_written+1 < last_ack+1
-    //          or m_next_block < last_ack+1
-    // unwrap if this happens
-    int bufferfill = m_next_block - m_last_block_ack - 1;
-    if(m_next_block <= m_last_block_ack) {
-        bufferfill += m_blocks;
-    }
-    assert(bufferfill>=0);
-    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) fill: %d\n", this, m_name.c_str(), bufferfill);
-    return (unsigned int)bufferfill;
+    // the indices wrap, their difference doesn't
+    unsigned int bufferfill = (uint32_t)m_control->write_idx - (uint32_t)m_control->read_idx;
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) fill: %u\n", this, m_name.c_str(), bufferfill);
+    return bufferfill;
 }
 
-
 enum IpcRingBuffer::eResult
 IpcRingBuffer::requestBlockForWrite(void **block)
 {
-    if(!m_block_requested_for_write.TryLock()) {
+    if(!m_initialized || m_direction != eD_Outward) {
+        debugError("Cannot write to this buffer\n");
+        return eR_Error;
+    }
+    if(m_block_requested_for_write) {
         debugError("Already a block requested for write\n");
         return eR_Error;
     }
 
-    // check if we can write a message
-    // we can send when: 
-    //  - we are not overwriting
-    //    AND -    we are in blocking mode and 
-    //        - OR (we are in non-blocking mode and there is space)
-
-    if(m_blocking == eB_Blocking) {
-        if(getBufferFill() >= m_blocks) {
-            debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) full\n", this, m_name.c_str());
-            // make it wait
-            sem_wait(&m_activity);
+    // the write index is only changed by us
+    int32_t write_idx = m_control->write_idx;
+    while(true) {
+        int32_t read_idx = m_control->read_idx;
+        if((uint32_t)write_idx - (uint32_t)read_idx < m_blocks) {
+            break;
         }
-    } else {
-        // there are no free data blocks, or there is no message space
-        if(getBufferFill() >= m_blocks || !m_ping_queue.canSend()) {
-            debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) full\n", this, m_name.c_str());
-            m_block_requested_for_write.Unlock();
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) full\n", this, m_name.c_str());
+        if(m_blocking == eB_NonBlocking) {
             return eR_Again;
         }
-    }
-
-    // check for overflow
-    if(m_next_block == m_last_block_ack) {
-        debugWarning("Overwriting not yet read block %u\n", m_next_block);
-        // we have to increment the block_read pointer
-        // in order to keep consistency
-        m_last_block_ack++;
-        if(m_last_block_ack == m_blocks) {
-            m_last_block_ack = 0;
+        enum eResult res = waitForIndexChange(&m_control->read_idx,
+                                              &m_control->writers_waiting,
+                                              read_idx);
+        if(res != eR_OK) {
+            return res;
         }
     }
 
-    int offset = m_next_block * m_blocksize;
-    *block = m_memblock.requestBlock(offset, m_blocksize);
-    if(*block) {
-        // keep the lock, to be released by releaseBlockForWrite
-        return eR_OK;
-    } else {
-        m_block_requested_for_write.Unlock();
-        return eR_Error;
-    }
+    m_requested_idx = write_idx;
+    *block = getBlockAddress(write_idx);
+    m_block_requested_for_write = true;
+    return eR_OK;
 }
 
 enum IpcRingBuffer::eResult
 IpcRingBuffer::releaseBlockForWrite()
 {
-    if(!m_block_requested_for_write.isLocked()) {
+    if(!m_block_requested_for_write) {
         debugError("No block requested for write\n");
         return eR_Error;
     }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Releasing block idx %d\n", m_requested_idx);
+
+    // this is a full barrier, so the block contents are visible
+    // before the new index is
+    __sync_fetch_and_add(&m_control->write_idx, 1);
+    wakeWaiters(&m_control->write_idx, &m_control->readers_waiting);
+    if(m_control->poller & eP_Reader) {
+        notifyPoller();
+    }
 
-    IpcMessage &m = m_LastDataMessageSent;
-
-    // prepare ping message
-    m.setType(IpcMessage::eMT_DataWritten);
-    m.setDataSize(sizeof(struct DataWrittenMessage));
-
-    // get a view on the data
-    struct DataWrittenMessage* data = reinterpret_cast<struct DataWrittenMessage*>(m.getDataPtr());
-    // set the data contents
-    data->id = m_next_block;
-    data->idx = m_idx;
-
-    debugOutput(DEBUG_LEVEL_VERBOSE, "Releasing block idx %d at id %d\n", data->idx, data->id);
-
-    // send ping message
-    enum PosixMessageQueue::eResult msg_res;
-    msg_res = m_ping_queue.Send(m);
-    switch(msg_res) {
-        case PosixMessageQueue::eR_OK:
-            break;
-        case PosixMessageQueue::eR_Again:
-            // this is a bug since we checked whether it was empty or not
-            debugError("Bad response value\n");
-            m_block_requested_for_write.Unlock();
-            return eR_Error; 
-        case PosixMessageQueue::eR_Timeout:
-            debugOutput(DEBUG_LEVEL_VERBOSE, "Timeout\n");
-            m_block_requested_for_write.Unlock();
-            return eR_Timeout; // blocking and no space on time
-        default:
-            debugError("Could not send to ping queue\n");
-            m_block_requested_for_write.Unlock();
-            return eR_Error;
-    }
-
-    // increment and wrap
-    m_next_block++;
-    if(m_next_block == m_blocks) {
-        m_next_block = 0;
-    }
-    m_idx++;
-    m_block_requested_for_write.Unlock();
+    m_block_requested_for_write = false;
     return eR_OK;
 }
 
@@ -421,117 +333,81 @@ enum IpcRingBuffer::eResult
 IpcRingBuffer::waitForWrite()
 {
     debugOutput(DEBUG_LEVEL_VERBOSE, "(%p,  %s) IpcRingBuffer\n", this, m_name.c_str());
-    while(getBufferFill() >= m_blocks-1) {
+    while(true) {
+        int32_t read_idx = m_control->read_idx;
+        if((uint32_t)m_control->write_idx - (uint32_t)read_idx < m_blocks) {
+            return eR_OK;
+        }
         debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) full\n", this, m_name.c_str());
-        // wait
-        sem_wait(&m_activity);
+        enum eResult res = waitForIndexChange(&m_control->read_idx,
+                                              &m_control->writers_waiting,
+                                              read_idx);
+        if(res != eR_OK) {
+            return res;
+        }
     }
-    return eR_OK;
 }
 
 enum IpcRingBuffer::eResult
 IpcRingBuffer::requestBlockForRead(void **block)
 {
-    if(!m_block_requested_for_read.TryLock()) {
+    if(!m_initialized || m_direction != eD_Inward) {
+        debugError("Cannot read from this buffer\n");
+        return eR_Error;
+    }
+    if(m_block_requested_for_read) {
         debugError("Already a block requested for read\n");
         return eR_Error;
     }
-    // message placeholder
-    IpcMessage &m = m_LastDataMessageReceived;
 
-    // read ping message (blocks)
-    enum PosixMessageQueue::eResult msg_res;
-    msg_res = m_ping_queue.Receive(m);
-    switch(msg_res) {
-        case PosixMessageQueue::eR_OK:
+    int32_t read_idx;
+    while(true) {
+        int32_t write_idx = m_control->write_idx;
+        read_idx = m_control->read_idx;
+        if(write_idx != read_idx) {
             break;
-        case PosixMessageQueue::eR_Again:
-            m_block_requested_for_read.Unlock();
-            return eR_Again; // non-blocking and no message
-        case PosixMessageQueue::eR_Timeout:
-            debugOutput(DEBUG_LEVEL_VERBOSE, "Timeout\n");
-            m_block_requested_for_read.Unlock();
-            return eR_Timeout; // blocking and no message on time
-        default:
-            debugError("Could not read from ping queue\n");
-            m_block_requested_for_read.Unlock();
-            return eR_Error;
-    }
-
-    IpcMessage::eMessageType type = m.getType();
-    if(type == IpcMessage::eMT_DataWritten) {
-        // get a view on the data
-        struct DataWrittenMessage* data = reinterpret_cast<struct DataWrittenMessage*>(m.getDataPtr());
-        debugOutput(DEBUG_LEVEL_VERBOSE, "Requested block idx %d at id %d\n", data->idx, data->id);
-
-        // check counters
-        if(data->id != m_next_block) {
-            debugWarning("unexpected block id: %d (expected %d)\n", data->id, m_next_block);
         }
-        if(data->idx != m_idx) {
-            debugWarning("unexpected block idx: %d (expected %d)\n", data->idx, m_idx);
+        if(m_blocking == eB_NonBlocking) {
+            return eR_Again; // non-blocking and no data
         }
-
-        int offset = data->id * m_blocksize;
-        *block = m_memblock.requestBlock(offset, m_blocksize);
-        if(*block) {
-            // keep the mutex locked, we expect the thread that grabbed the block to also return it
-            return eR_OK;
-        } else {
-            m_block_requested_for_read.Unlock();
-            return eR_Error;
+        enum eResult res = waitForIndexChange(&m_control->write_idx,
+                                              &m_control->readers_waiting,
+                                              write_idx);
+        if(res != eR_OK) {
+            return res;
         }
-    } else {
-        debugError("Invalid message received (type %d)\n", type);
-        m_block_requested_for_read.Unlock();
-        return eR_Error;
     }
+    // don't read the block contents before the index
+    __sync_synchronize();
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Requested block idx %d\n", read_idx);
+    m_requested_idx = read_idx;
+    *block = getBlockAddress(read_idx);
+    m_block_requested_for_read = true;
+    return eR_OK;
 }
 
 enum IpcRingBuffer::eResult
 IpcRingBuffer::releaseBlockForRead()
 {
-    if(!m_block_requested_for_read.isLocked()) {
+    if(!m_block_requested_for_read) {
         debugError("No block requested for read\n");
         return eR_Error;
     }
+    debugOutput(DEBUG_LEVEL_VERBOSE, "Releasing block idx %d\n", m_requested_idx);
 
-    IpcMessage &m = m_LastDataMessageReceived;
-
-    // get a view on the data
-    struct DataWrittenMessage* data = reinterpret_cast<struct DataWrittenMessage*>(m.getDataPtr());
-    debugOutput(DEBUG_LEVEL_VERBOSE, "Releasing block idx %d at id %d\n", data->idx, data->id);
+    // if the writer has reset the buffer in the mean time, the
+    // block is already considered to be read.
+    if(!__sync_bool_compare_and_swap(&m_control->read_idx,
+                                     m_requested_idx, m_requested_idx + 1)) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) buffer was reset\n", this, m_name.c_str());
+    }
+    wakeWaiters(&m_control->read_idx, &m_control->writers_waiting);
+    if(m_control->poller & eP_Writer) {
+        notifyPoller();
+    }
 
-    // write a response to the pong queue
-    // reuse the message
-    m.setType(IpcMessage::eMT_DataAck);
-    enum PosixMessageQueue::eResult msg_res;
-    msg_res = m_pong_queue.Send(m);
-    switch(msg_res) {
-        case PosixMessageQueue::eR_OK:
-            break;
-        case PosixMessageQueue::eR_Again:
-            m_block_requested_for_read.Unlock(); // FIXME: this is not very correct
-            debugOutput(DEBUG_LEVEL_VERBOSE, "Again on ACK\n");
-            return eR_Again; // non-blocking and no message
-        case PosixMessageQueue::eR_Timeout:
-            m_block_requested_for_read.Unlock();
-            debugOutput(DEBUG_LEVEL_VERBOSE, "Timeout on ACK\n");
-            return eR_Timeout; // blocking and no message on time
-        default:
-            debugError("Could not write to pong queue\n");
-            m_block_requested_for_read.Unlock();
-            return eR_Error;
-    }
-
-    // prepare the next expected values
-    m_next_block = data->id + 1;
-    if(m_next_block == m_blocks) {
-        m_next_block = 0;
-    }
-    m_idx = data->idx + 1;
-
-    m_block_requested_for_read.Unlock();
+    m_block_requested_for_read = false;
     return eR_OK;
 }
 
@@ -560,61 +436,137 @@ IpcRingBuffer::Read(char *block)
 enum IpcRingBuffer::eResult
 IpcRingBuffer::waitForRead()
 {
-    while(getBufferFill() == 0) {
+    while(true) {
+        int32_t write_idx = m_control->write_idx;
+        if(write_idx != m_control->read_idx) {
+            return eR_OK;
+        }
         debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) empty\n", this, m_name.c_str());
-        // FIXME: this will work only when no non-data messages are sent
-        m_ping_queue.Wait();
+        enum eResult res = waitForIndexChange(&m_control->write_idx,
+                                              &m_control->readers_waiting,
+                                              write_idx);
+        if(res != eR_OK) {
+            return res;
+        }
     }
-    return eR_OK;
 }
 
-void
-IpcRingBuffer::show()
+/**
+ * The poll fd is a datagram socket in the abstract namespace, hence
+ * there is nothing to clean up when one of the sides goes away. The
+ * other side sends an empty datagram to it when it released a block,
+ * but only if someone registered as poller.
+ */
+// the role of this side when it polls
+enum IpcRingBuffer::ePoller
+IpcRingBuffer::getPollRole()
 {
-    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) IpcRingBuffer %s\n", this, m_name.c_str());
+    return (m_direction == eD_Outward ? eP_Writer : eP_Reader);
 }
 
 void
-IpcRingBuffer::setVerboseLevel(int i)
+IpcRingBuffer::getPollAddress(enum ePoller role, struct sockaddr_un &addr, socklen_t &len)
 {
-    setDebugLevel(i);
-    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) verbose: %d\n", this, m_name.c_str(), i);
-    m_ping_queue.setVerboseLevel(i);
-    m_pong_queue.setVerboseLevel(i);
-    m_memblock.setVerboseLevel(i);
-    m_access_lock.setVerboseLevel(i);
+    // both sides can poll, each on its own address
+    std::string name = "ffado-ipc:" + m_name + (role == eP_Writer ? ":writer" : ":reader");
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    // sun_path[0] = 0 selects the abstract namespace
+    size_t n = name.size();
+    if(n > sizeof(addr.sun_path) - 1) {
+        n = sizeof(addr.sun_path) - 1;
+    }
+    memcpy(addr.sun_path + 1, name.c_str(), n);
+    len = offsetof(struct sockaddr_un, sun_path) + 1 + n;
 }
 
-bool
-IpcRingBuffer::IpcMessage::serialize(char *buff)
+int
+IpcRingBuffer::getPollFd()
 {
-    memcpy(buff, &m_header, sizeof(m_header));
-    buff += sizeof(m_header);
-    memcpy(buff, m_data, m_data_len);
-    return true;
-}
-bool
-IpcRingBuffer::IpcMessage::deserialize(const char *buff, unsigned int length, unsigned prio)
-{
-    assert(length >= sizeof(m_header));
-    memcpy(&m_header, buff, sizeof(m_header));
+    if(!m_initialized) {
+        debugError("(%p, %s) Not initialized\n", this, m_name.c_str());
+        return -1;
+    }
+    if(m_poll_fd >= 0) {
+        return m_poll_fd;
+    }
 
-    if(m_header.magic != FFADO_IPC_RINGBUFFER_MAGIC) {
-        return false; // invalid magic
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0) {
+        debugError("(%p, %s) Could not create poll fd: %s\n",
+                   this, m_name.c_str(), strerror(errno));
+        return -1;
     }
-    if(m_header.version != FFADO_IPC_RINGBUFFER_VERSION) {
-        return false; // invalid version
+    struct sockaddr_un addr;
+    socklen_t len;
+    getPollAddress(getPollRole(), addr, len);
+    if(bind(fd, (struct sockaddr *)&addr, len) < 0) {
+        debugError("(%p, %s) Could not bind poll fd: %s\n",
+                   this, m_name.c_str(), strerror(errno));
+        close(fd);
+        return -1;
     }
+    m_poll_fd = fd;
+    __sync_fetch_and_or(&m_control->poller, (int32_t)getPollRole());
+    return m_poll_fd;
+}
 
-    m_data_len = length - sizeof(m_header);
-    buff += sizeof(m_header);
+void
+IpcRingBuffer::clearPollFd()
+{
+    if(m_poll_fd < 0) return;
+    char buf[16];
+    while(recv(m_poll_fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0) {};
+}
 
-    assert(m_data_len <= FFADO_IPC_MAX_MESSAGE_SIZE);
-    memcpy(m_data, buff, m_data_len);
+void
+IpcRingBuffer::pokePollFd()
+{
+    if(m_poll_fd < 0) return;
+    struct sockaddr_un addr;
+    socklen_t len;
+    getPollAddress(getPollRole(), addr, len);
+    // if there is no space for the datagram, the fd is readable anyway
+    sendto(m_poll_fd, "", 1, MSG_DONTWAIT, (struct sockaddr *)&addr, len);
+}
 
-    m_priority = prio;
-    return true;
+void
+IpcRingBuffer::notifyPoller()
+{
+    if(m_notify_fd < 0) {
+        m_notify_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(m_notify_fd < 0) {
+            debugError("(%p, %s) Could not create notify fd: %s\n",
+                       this, m_name.c_str(), strerror(errno));
+            return;
+        }
+    }
+    // the poller is the other side
+    struct sockaddr_un addr;
+    socklen_t len;
+    getPollAddress((getPollRole() == eP_Writer ? eP_Reader : eP_Writer), addr, len);
+    // errors are not fatal: the poller might be gone, or its
+    // socket is full, in which case it is readable anyway
+    sendto(m_notify_fd, "", 1, MSG_DONTWAIT, (struct sockaddr *)&addr, len);
+}
+
+void
+IpcRingBuffer::show()
+{
+    debugOutput(DEBUG_LEVEL_NORMAL, "(%p) IpcRingBuffer %s\n", this, m_name.c_str());
+    if(m_initialized) {
+        debugOutput(DEBUG_LEVEL_NORMAL, " write idx: %d, read idx: %d, fill: %u/%u\n",
+                    m_control->write_idx, m_control->read_idx,
+                    getBufferFill(), m_blocks);
+    }
 }
 
+void
+IpcRingBuffer::setVerboseLevel(int i)
+{
+    setDebugLevel(i);
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p, %s) verbose: %d\n", this, m_name.c_str(), i);
+    m_memblock.setVerboseLevel(i);
+}
 
 } // Util
@@ -27,97 +27,69 @@
 #include "debugmodule/debugmodule.h"
 #include <string>
 
-
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #define FFADO_IPC_RINGBUFFER_MAGIC   0x57439812
-#define FFADO_IPC_RINGBUFFER_VERSION 0
-
-#define FFADO_IPC_MAX_MESSAGE_SIZE 16
+#define FFADO_IPC_RINGBUFFER_VERSION 1
 
-#include "PosixMessageQueue.h"
+// the time a blocking operation waits for the other side
+#define FFADO_IPC_RINGBUFFER_TIMEOUT_SEC   10
+#define FFADO_IPC_RINGBUFFER_TIMEOUT_NSEC  0
 
-#include <semaphore.h>
+// the indices in the control block each get their own cache line
+#define FFADO_IPC_RINGBUFFER_CACHELINE_SIZE 64
 
 namespace Util {
 
 /**
  * @brief A Ringbuffer for IPC use.
+ *
+ * The ringbuffer lives in a shared memory segment. The segment starts
+ * with a control block that holds the write and read indices, followed
+ * by the data blocks. The writer only updates the write index, the
+ * reader only updates the read index, hence no locking is needed.
+ * A side that has to wait for the other side sleeps on the index it
+ * is waiting for using a futex. The other side only issues a wake-up
+ * call when someone is actually waiting, so in the normal flow no
+ * system calls are needed at all.
+ *
+ * One side can also ask for a file descriptor that can be used with
+ * poll(). It becomes readable when the other side released a block.
  */
 
-class PosixMessageQueue;
 class PosixSharedMemory;
-class Mutex;
-class Functor;
 
 class IpcRingBuffer
 {
-// the message types
 protected:
-    enum eMessagePriorities {
-        eMP_Realtime = 10,
-    };
-
-    // these are the views on the message contents
-    struct DataWrittenMessage {
-        unsigned int idx;
-        unsigned int id;
+    // the control block at the start of the shared memory segment
+    struct ControlBlock {
+        uint32_t            magic;
+        uint32_t            version;
+        uint32_t            blocks;
+        uint32_t            blocksize;
+        char                pad0[FFADO_IPC_RINGBUFFER_CACHELINE_SIZE - 4 * sizeof(uint32_t)];
+        // the number of blocks written (wraps)
+        volatile int32_t    write_idx;
+        // the number of readers sleeping on write_idx
+        volatile int32_t    readers_waiting;
+        char                pad1[FFADO_IPC_RINGBUFFER_CACHELINE_SIZE - 2 * sizeof(int32_t)];
+        // the number of blocks read and released (wraps)
+        volatile int32_t    read_idx;
+        // the number of writers sleeping on read_idx
+        volatile int32_t    writers_waiting;
+        char                pad2[FFADO_IPC_RINGBUFFER_CACHELINE_SIZE - 2 * sizeof(int32_t)];
+        // the sides that use a poll fd (ePoller bits)
+        volatile int32_t    poller;
+        char                pad3[FFADO_IPC_RINGBUFFER_CACHELINE_SIZE - sizeof(int32_t)];
     };
 
-    class IpcMessage : public PosixMessageQueue::Message
-    {
-    public:
-        enum eMessageType {
-            eMT_Unknown     = 0,
-            eMT_DataWritten = 1,
-            eMT_DataAck     = 2,
-        };
-
-        IpcMessage()
-        : Message()
-        , m_priority( 0 )
-        , m_data_len( 0 )
-        {
-            m_header.magic = FFADO_IPC_RINGBUFFER_MAGIC;
-            m_header.version = FFADO_IPC_RINGBUFFER_VERSION;
-            m_header.type = eMT_Unknown;
-        };
-
-        IpcMessage(enum eMessageType t)
-        : Message()
-        , m_priority( 0 )
-        , m_data_len( 0 )
-        {
-            m_header.magic = FFADO_IPC_RINGBUFFER_MAGIC;
-            m_header.version = FFADO_IPC_RINGBUFFER_VERSION;
-            m_header.type = t;
-        };
-
-        virtual ~IpcMessage() {};
-
-        virtual unsigned getPriority()
-            {return m_priority;};
-        virtual unsigned int getLength() 
-            {return sizeof(m_header)
-                    + sizeof(m_data);};
-
-        virtual bool serialize(char *buff);
-        virtual bool deserialize(const char *buff, unsigned int length, unsigned prio);
-
-        void setType(enum eMessageType t) {m_header.type=t;};
-        enum eMessageType getType() {return m_header.type;};
-        char *getDataPtr() {return m_data;};
-        void setDataSize(unsigned int i) 
-                { assert(i<FFADO_IPC_MAX_MESSAGE_SIZE);
-                  m_data_len = i; };
-    private:
-        unsigned            m_priority;
-        struct header {
-            unsigned int        magic;
-            unsigned int        version;
-            enum eMessageType   type;
-        } m_header;
-        unsigned int        m_data_len;
-        char                m_data[FFADO_IPC_MAX_MESSAGE_SIZE];
+    enum ePoller {
+        eP_None   = 0,
+        eP_Writer = 1,
+        eP_Reader = 2,
     };
 
 public:
@@ -153,6 +125,10 @@ public:
     ~IpcRingBuffer();
 
     bool init();
+    // drop all blocks that were not read yet.
+    // only makes sense for outward buffers,
+    // e.g. to re-attach to a reader that went away
+    bool reset();
 
     enum IpcRingBuffer::eResult Write(char *block);
     enum IpcRingBuffer::eResult Read(char *block);
@@ -173,12 +149,27 @@ public:
     enum IpcRingBuffer::eResult waitForRead();
     enum IpcRingBuffer::eResult waitForWrite();
 
+    // returns a file descriptor that becomes readable when the other
+    // side has released a block, i.e. when there is new data to read
+    // or new space to write. only one side can poll. returns -1 on error.
+    int getPollFd();
+    // consume the pending notifications on the poll fd
+    void clearPollFd();
+    // make the poll fd readable, e.g. when there is still work left
+    void pokePollFd();
+
     void show();
     void setVerboseLevel(int l);
-    // only makes sense for outward buffers
     unsigned int getBufferFill();
 private:
-    void notificationHandler();
+    enum IpcRingBuffer::eResult waitForIndexChange(volatile int32_t *idx,
+                                                   volatile int32_t *waiters,
+                                                   int32_t seen);
+    void wakeWaiters(volatile int32_t *idx, volatile int32_t *waiters);
+    char *getBlockAddress(int32_t idx);
+    void notifyPoller();
+    enum ePoller getPollRole();
+    void getPollAddress(enum ePoller role, struct sockaddr_un &addr, socklen_t &len);
 
 private:
     std::string         m_name;
@@ -188,22 +179,18 @@ private:
     enum eDirection     m_direction;
     enum eBlocking      m_blocking;
     bool                m_initialized;
-    unsigned int        m_next_block;
-    unsigned int        m_last_block_ack;
-    unsigned int        m_idx;
-    unsigned int        m_last_idx_ack;
-
-    PosixMessageQueue&  m_ping_queue;     // for notifications
-    PosixMessageQueue&  m_pong_queue;     // for responses
-    PosixSharedMemory&  m_memblock;       // the actual data carrier
-    Mutex&              m_access_lock;    // to make operations atomic
-    Functor&            m_notify_functor; // to receive async notifications
-    sem_t               m_activity;       // to signal that async activity occurred
-
-    IpcMessage          m_LastDataMessageReceived;
-    Mutex&              m_block_requested_for_read;
-    IpcMessage          m_LastDataMessageSent;
-    Mutex&              m_block_requested_for_write;
+
+    PosixSharedMemory&  m_memblock;       // the control block and the data
+    struct ControlBlock *m_control;
+    char *              m_data;
+
+    // the index of the block handed out by the last request
+    int32_t             m_requested_idx;
+    bool                m_block_requested_for_read;
+    bool                m_block_requested_for_write;
+
+    int                 m_poll_fd;        // our poll fd, if we poll
+    int                 m_notify_fd;      // to notify the other side's poll fd
 
 protected:
     DECLARE_DEBUG_MODULE;
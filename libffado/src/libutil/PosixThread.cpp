@@ -51,7 +51,49 @@
 #include <string.h> // for memset
 #include <errno.h>
 #include <assert.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
+
+// SCHED_DEADLINE is only reachable through sched_setattr(), for which the
+// C library doesn't necessarily have a wrapper or definitions
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+struct ffado_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t  sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+static int
+ffado_sched_setattr(pid_t tid, struct ffado_sched_attr *attr)
+{
+#ifdef SYS_sched_setattr
+    if (syscall(SYS_sched_setattr, tid, attr, 0) != 0) {
+        return errno;
+    }
+    return 0;
+#else
+    return ENOSYS;
+#endif
+}
+
+static uint64_t
+thread_cpu_time_nsecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
 namespace Util
 {
@@ -66,6 +108,8 @@ void* PosixThread::ThreadHandler(void* arg)
 
     obj->m_lock.Lock();
 
+    obj->fTid = syscall(SYS_gettid);
+
     // Signal that ThreadHandler has acquired its initial lock
     pthread_mutex_lock(&obj->handler_active_lock);
     obj->handler_active = 1;
@@ -94,7 +138,20 @@ void* PosixThread::ThreadHandler(void* arg)
     obj->m_lock.Unlock();
     while (obj->fRunning && res) {
         debugOutputExtreme( DEBUG_LEVEL_VERY_VERBOSE, "(%s) ThreadHandler: run %p\n", obj->m_id.c_str(), obj);
-        res = runnable->Execute();
+        if (obj->fDeadline) {
+            // account the CPU time of this iteration against the budget
+            uint64_t start = thread_cpu_time_nsecs();
+            res = runnable->Execute();
+            uint64_t used = thread_cpu_time_nsecs() - start;
+            if (used > obj->fComputation) {
+                obj->fOverruns++;
+            }
+            if (used > obj->fMaxComputation) {
+                obj->fMaxComputation = used;
+            }
+        } else {
+            res = runnable->Execute();
+        }
         pthread_testcancel();
     }
 
@@ -182,6 +239,11 @@ int PosixThread::Start()
         pthread_cond_wait(&handler_active_cond, &handler_active_lock);
     pthread_mutex_unlock(&handler_active_lock);
 
+    // the thread is created as SCHED_FIFO, which is what it keeps if
+    // SCHED_DEADLINE isn't possible
+    if (fRealTime && fPeriod) {
+        AcquireDeadline();
+    }
     return 0;
 }
 
@@ -227,6 +289,10 @@ int PosixThread::AcquireRealTime()
     if (!fThread)
         return -1;
 
+    if (fPeriod && AcquireDeadline() == 0) {
+        return 0;
+    }
+
     memset(&rtparam, 0, sizeof(rtparam));
     if(fPriority <= 0) {
         debugWarning("Clipping to minimum priority (%d -> 1)\n", fPriority);
@@ -271,9 +337,67 @@ int PosixThread::DropRealTime()
         debugError("Cannot switch to normal scheduling priority(%s)\n", strerror(res));
         return -1;
     }
+    fDeadline = false;
+    return 0;
+}
+
+int PosixThread::AcquireDeadline()
+{
+    struct ffado_sched_attr attr;
+    int res;
+    debugOutput( DEBUG_LEVEL_VERBOSE,
+                 "(%s, %p) Acquire deadline scheduling, runtime %" PRIu64 " ns, deadline %" PRIu64 " ns, period %" PRIu64 " ns\n",
+                 m_id.c_str(), this, fComputation, fConstraint, fPeriod);
+
+    if (!fTid)
+        return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = fComputation;
+    attr.sched_deadline = fConstraint;
+    attr.sched_period = fPeriod;
+
+    if ((res = ffado_sched_setattr(fTid, &attr)) != 0) {
+        // e.g. no CAP_SYS_NICE, not enough bandwidth left or an old kernel
+        debugWarning("(%s) Cannot use deadline scheduling (%d: %s), using FIFO/%d\n",
+                     m_id.c_str(), res, strerror(res), fPriority);
+        fDeadline = false;
+        return -1;
+    }
+    fDeadline = true;
     return 0;
 }
 
+void PosixThread::SetParams(uint64_t period, uint64_t computation, uint64_t constraint)
+{
+    if (constraint == 0 || constraint > period) {
+        constraint = period;
+    }
+    if (computation > constraint) {
+        computation = constraint;
+    }
+    debugOutput( DEBUG_LEVEL_VERBOSE, "(%s, %p) Deadline parameters: %" PRIu64 "/%" PRIu64 "/%" PRIu64 " ns\n",
+                 m_id.c_str(), this, computation, constraint, period);
+    fPeriod = period;
+    fComputation = computation;
+    fConstraint = constraint;
+    if (fPeriod == 0) {
+        fDeadline = false;
+    }
+}
+
+bool PosixThread::GetDeadlineStats(unsigned int &overruns, uint64_t &max_computation)
+{
+    if (!fDeadline) {
+        return false;
+    }
+    overruns = fOverruns;
+    max_computation = fMaxComputation;
+    return true;
+}
+
 pthread_t PosixThread::GetThreadID()
 {
     return fThread;
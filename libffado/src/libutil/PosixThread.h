@@ -53,6 +53,7 @@
 
 #include "Thread.h"
 #include <pthread.h>
+#include <sys/types.h>
 #include "PosixMutex.h"
 
 namespace Util
@@ -77,13 +78,27 @@ class PosixThread : public Thread
         pthread_cond_t handler_active_cond;
         int handler_active;
 
+        // kernel thread id, needed for sched_setattr()
+        pid_t fTid;
+        // SCHED_DEADLINE parameters in nsec, all 0 to use SCHED_FIFO
+        uint64_t fPeriod;
+        uint64_t fComputation;
+        uint64_t fConstraint;
+        bool fDeadline;
+        // the CPU time used by one Execute() call vs. fComputation
+        unsigned int fOverruns;
+        uint64_t fMaxComputation;
+
         static void* ThreadHandler(void* arg);
+        int AcquireDeadline();
         Util::Mutex &m_lock;
     public:
 
         PosixThread(RunnableInterface* runnable, bool real_time, int priority, int cancellation)
                 : Thread(runnable), fThread((pthread_t)NULL), fPriority(priority), fRealTime(real_time), fRunning(false), fCancellation(cancellation)
                 , handler_active(0)
+                , fTid(0), fPeriod(0), fComputation(0), fConstraint(0), fDeadline(false)
+                , fOverruns(0), fMaxComputation(0)
                 , m_lock(*(new Util::PosixMutex("THREAD")))
         { pthread_mutex_init(&handler_active_lock, NULL); 
           pthread_cond_init(&handler_active_cond, NULL);
@@ -91,6 +106,8 @@ class PosixThread : public Thread
         PosixThread(RunnableInterface* runnable)
                 : Thread(runnable), fThread((pthread_t)NULL), fPriority(0), fRealTime(false), fRunning(false), fCancellation(PTHREAD_CANCEL_DEFERRED)
                 , handler_active(0)
+                , fTid(0), fPeriod(0), fComputation(0), fConstraint(0), fDeadline(false)
+                , fOverruns(0), fMaxComputation(0)
                 , m_lock(*(new Util::PosixMutex("THREAD")))
         { pthread_mutex_init(&handler_active_lock, NULL); 
           pthread_cond_init(&handler_active_cond, NULL);
@@ -98,6 +115,8 @@ class PosixThread : public Thread
         PosixThread(RunnableInterface* runnable, int cancellation)
                 : Thread(runnable), fThread((pthread_t)NULL), fPriority(0), fRealTime(false), fRunning(false), fCancellation(cancellation)
                 , handler_active(0)
+                , fTid(0), fPeriod(0), fComputation(0), fConstraint(0), fDeadline(false)
+                , fOverruns(0), fMaxComputation(0)
                 , m_lock(*(new Util::PosixMutex("THREAD")))
         { pthread_mutex_init(&handler_active_lock, NULL); 
           pthread_cond_init(&handler_active_cond, NULL);
@@ -106,6 +125,8 @@ class PosixThread : public Thread
         PosixThread(RunnableInterface* runnable, std::string id, bool real_time, int priority, int cancellation)
                 : Thread(runnable, id), fThread((pthread_t)NULL), fPriority(priority), fRealTime(real_time), fRunning(false), fCancellation(cancellation)
                 , handler_active(0)
+                , fTid(0), fPeriod(0), fComputation(0), fConstraint(0), fDeadline(false)
+                , fOverruns(0), fMaxComputation(0)
                 , m_lock(*(new Util::PosixMutex(id)))
         { pthread_mutex_init(&handler_active_lock, NULL); 
           pthread_cond_init(&handler_active_cond, NULL);
@@ -113,6 +134,8 @@ class PosixThread : public Thread
         PosixThread(RunnableInterface* runnable, std::string id)
                 : Thread(runnable, id), fThread((pthread_t)NULL), fPriority(0), fRealTime(false), fRunning(false), fCancellation(PTHREAD_CANCEL_DEFERRED)
                 , handler_active(0)
+                , fTid(0), fPeriod(0), fComputation(0), fConstraint(0), fDeadline(false)
+                , fOverruns(0), fMaxComputation(0)
                 , m_lock(*(new Util::PosixMutex(id)))
         { pthread_mutex_init(&handler_active_lock, NULL); 
           pthread_cond_init(&handler_active_cond, NULL);
@@ -120,6 +143,8 @@ class PosixThread : public Thread
         PosixThread(RunnableInterface* runnable, std::string id, int cancellation)
                 : Thread(runnable, id), fThread((pthread_t)NULL), fPriority(0), fRealTime(false), fRunning(false), fCancellation(cancellation)
                 , handler_active(0)
+                , fTid(0), fPeriod(0), fComputation(0), fConstraint(0), fDeadline(false)
+                , fOverruns(0), fMaxComputation(0)
                 , m_lock(*(new Util::PosixMutex(id)))
         { pthread_mutex_init(&handler_active_lock, NULL); 
           pthread_cond_init(&handler_active_cond, NULL);
@@ -139,6 +164,14 @@ class PosixThread : public Thread
         virtual int AcquireRealTime(int priority);
         virtual int DropRealTime();
 
+        /**
+         * Set the SCHED_DEADLINE parameters (in nsec) that are used when the
+         * thread is real-time. The thread falls back to SCHED_FIFO if the
+         * kernel refuses them. Passing all 0 selects SCHED_FIFO.
+         */
+        virtual void SetParams(uint64_t period, uint64_t computation, uint64_t constraint);
+        virtual bool GetDeadlineStats(unsigned int &overruns, uint64_t &max_computation);
+
         pthread_t GetThreadID();
 
     protected:
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "RtMemory.h"
+
+#include <map>
+#include <cstring>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+namespace Util {
+
+IMPL_DEBUG_MODULE( RtMemory, RtMemory, DEBUG_LEVEL_NORMAL );
+
+// all allocations are aligned to a cache line
+#define RTMEMORY_ALIGNMENT 64
+
+// address -> size
+typedef std::map<char *, size_t> block_map_t;
+
+static block_map_t rtmem_free;
+static block_map_t rtmem_used;
+static pthread_mutex_t rtmem_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool rtmem_use_hugepages = RTMEMORY_USE_HUGEPAGES;
+static size_t rtmem_total = 0;
+static size_t rtmem_total_huge = 0;
+static size_t rtmem_total_unlocked = 0;
+
+// called with the lock held
+bool
+RtMemory::addChunk(size_t size)
+{
+    size_t page_size = getpagesize();
+    if (size < RTMEMORY_CHUNK_SIZE) {
+        size = RTMEMORY_CHUNK_SIZE;
+    }
+
+    void *p = MAP_FAILED;
+    bool huge = false;
+#ifdef MAP_HUGETLB
+    if (rtmem_use_hugepages) {
+        // assume 2MB huge pages, the most common size
+        size_t huge_size = (size + (2 << 20) - 1) & ~(size_t)((2 << 20) - 1);
+        p = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "No huge pages available (%s)\n", strerror(errno));
+        } else {
+            size = huge_size;
+            huge = true;
+        }
+    }
+#endif
+    if (p == MAP_FAILED) {
+        size = (size + page_size - 1) & ~(page_size - 1);
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            debugError("Could not map %zd bytes: %s\n", size, strerror(errno));
+            return false;
+        }
+    }
+
+    // lock it, which also faults in all pages. if that is not allowed,
+    // at least make sure the pages are present
+    if (mlock(p, size)) {
+        debugWarning("Could not lock %zd bytes of streaming memory: %s\n", size, strerror(errno));
+        rtmem_total_unlocked += size;
+    }
+    for (size_t i = 0; i < size; i += page_size) {
+        ((volatile char *)p)[i] = 0;
+    }
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "New chunk of %zd bytes at %p%s\n",
+                size, p, (huge ? " (huge pages)" : ""));
+    rtmem_free[(char *)p] = size;
+    rtmem_total += size;
+    if (huge) {
+        rtmem_total_huge += size;
+    }
+    return true;
+}
+
+void *
+RtMemory::allocate(size_t size)
+{
+    if (size == 0) {
+        size = 1;
+    }
+    size = (size + RTMEMORY_ALIGNMENT - 1) & ~(size_t)(RTMEMORY_ALIGNMENT - 1);
+
+    pthread_mutex_lock(&rtmem_lock);
+    block_map_t::iterator it;
+    for (int tries = 0; tries < 2; tries++) {
+        // first fit
+        for (it = rtmem_free.begin(); it != rtmem_free.end(); ++it) {
+            if (it->second >= size) break;
+        }
+        if (it != rtmem_free.end() || !addChunk(size)) break;
+    }
+    if (it == rtmem_free.end()) {
+        pthread_mutex_unlock(&rtmem_lock);
+        debugError("Could not allocate %zd bytes\n", size);
+        return NULL;
+    }
+
+    char *p = it->first;
+    size_t left = it->second - size;
+    rtmem_free.erase(it);
+    if (left) {
+        rtmem_free[p + size] = left;
+    }
+    rtmem_used[p] = size;
+    pthread_mutex_unlock(&rtmem_lock);
+
+    memset(p, 0, size);
+    return p;
+}
+
+void
+RtMemory::release(void *p)
+{
+    if (p == NULL) return;
+
+    pthread_mutex_lock(&rtmem_lock);
+    block_map_t::iterator it = rtmem_used.find((char *)p);
+    if (it == rtmem_used.end()) {
+        pthread_mutex_unlock(&rtmem_lock);
+        debugError("%p was not allocated here\n", p);
+        return;
+    }
+    char *start = it->first;
+    size_t size = it->second;
+    rtmem_used.erase(it);
+
+    // merge with the free neighbours
+    block_map_t::iterator next = rtmem_free.lower_bound(start);
+    if (next != rtmem_free.end() && start + size == next->first) {
+        size += next->second;
+        rtmem_free.erase(next++);
+    }
+    if (next != rtmem_free.begin()) {
+        block_map_t::iterator prev = next;
+        --prev;
+        if (prev->first + prev->second == start) {
+            start = prev->first;
+            size += prev->second;
+            rtmem_free.erase(prev);
+        }
+    }
+    rtmem_free[start] = size;
+    pthread_mutex_unlock(&rtmem_lock);
+}
+
+void
+RtMemory::setUseHugePages(bool use)
+{
+    pthread_mutex_lock(&rtmem_lock);
+    rtmem_use_hugepages = use;
+    pthread_mutex_unlock(&rtmem_lock);
+}
+
+void
+RtMemory::show()
+{
+    pthread_mutex_lock(&rtmem_lock);
+    size_t used = 0;
+    for (block_map_t::iterator it = rtmem_used.begin(); it != rtmem_used.end(); ++it) {
+        used += it->second;
+    }
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "Streaming memory: %zd of %zd bytes in use, %zd blocks\n",
+                     used, rtmem_total, rtmem_used.size());
+    debugOutputShort(DEBUG_LEVEL_NORMAL, " huge pages: %zd bytes, not locked: %zd bytes\n",
+                     rtmem_total_huge, rtmem_total_unlocked);
+    pthread_mutex_unlock(&rtmem_lock);
+}
+
+// --- page fault monitor --- //
+
+RtMemory::FaultMonitor::FaultMonitor(std::string name)
+    : m_name( name )
+    , m_valid( false )
+    , m_warned( false )
+    , m_last_minflt( 0 )
+    , m_last_majflt( 0 )
+    , m_nb_periods( 0 )
+    , m_nb_periods_with_faults( 0 )
+    , m_minflt( 0 )
+    , m_majflt( 0 )
+{
+}
+
+void
+RtMemory::FaultMonitor::sample()
+{
+#if RTMEMORY_MONITOR && defined(RUSAGE_THREAD)
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage)) {
+        return;
+    }
+    if (!m_valid) {
+        // the faults before the first period are not ours
+        m_last_minflt = usage.ru_minflt;
+        m_last_majflt = usage.ru_majflt;
+        m_valid = true;
+        return;
+    }
+    long minflt = usage.ru_minflt - m_last_minflt;
+    long majflt = usage.ru_majflt - m_last_majflt;
+    m_last_minflt = usage.ru_minflt;
+    m_last_majflt = usage.ru_majflt;
+    m_nb_periods++;
+    if (minflt == 0 && majflt == 0) {
+        return;
+    }
+    m_nb_periods_with_faults++;
+    m_minflt += minflt;
+    m_majflt += majflt;
+    if (!m_warned) {
+        m_warned = true;
+        debugWarning("%s: %ld minor and %ld major page faults in one period\n",
+                     m_name.c_str(), minflt, majflt);
+    }
+#endif
+}
+
+void
+RtMemory::FaultMonitor::show()
+{
+    debugOutputShort(DEBUG_LEVEL_NORMAL, "%s page faults: %" PRIu64 " minor, %" PRIu64 " major, in %" PRIu64 " of %" PRIu64 " periods\n",
+                     m_name.c_str(), m_minflt, m_majflt, m_nb_periods_with_faults, m_nb_periods);
+}
+
+} // end of namespace Util
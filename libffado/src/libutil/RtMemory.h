@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __FFADO_RTMEMORY__
+#define __FFADO_RTMEMORY__
+
+#include "debugmodule/debugmodule.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace Util {
+
+/**
+ * @brief Memory for buffers that are accessed from the streaming threads
+ *
+ * The memory is taken from chunks that are locked and prefaulted when
+ * they are obtained from the system, optionally backed by huge pages.
+ * Accessing it never causes a page fault. Allocating and releasing is
+ * not real-time safe, it should be done when preparing the streams.
+ * The chunks are kept for the lifetime of the process.
+ */
+class RtMemory
+{
+public:
+    /**
+     * @brief allocate zeroed memory
+     * @return the memory, NULL if it could not be allocated
+     */
+    static void *allocate(size_t size);
+    static void release(void *p);
+
+    static void setUseHugePages(bool use);
+    static void show();
+
+    /**
+     * @brief Counts the page faults of one thread
+     *
+     * sample() is called by the monitored thread once per period. The
+     * first period with page faults is reported with a warning.
+     */
+    class FaultMonitor
+    {
+    public:
+        FaultMonitor(std::string name);
+
+        /// restart the monitoring, e.g. when the thread changes
+        void reset() {m_valid = false;};
+        void sample();
+        void show();
+
+    private:
+        std::string     m_name;
+        bool            m_valid;
+        bool            m_warned;
+        long            m_last_minflt;
+        long            m_last_majflt;
+        uint64_t        m_nb_periods;
+        uint64_t        m_nb_periods_with_faults;
+        uint64_t        m_minflt;
+        uint64_t        m_majflt;
+    };
+
+private:
+    static bool addChunk(size_t size);
+
+    DECLARE_DEBUG_MODULE;
+};
+
+} // end of namespace Util
+
+#endif /* __FFADO_RTMEMORY__ */
@@ -21,29 +21,180 @@
  *
  */
 
+#include "config.h"
+
 #include "StreamStatistics.h"
+#include "PosixSharedMemory.h"
+
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/mman.h>
+
+#include <vector>
+#include <algorithm>
 
 namespace Streaming {
 IMPL_DEBUG_MODULE( StreamStatistics, StreamStatistics, DEBUG_LEVEL_VERBOSE );
 
+// the shared segment with the published histograms, one per process
+class StatsSegment {
+public:
+    StatsSegment() : m_shm( NULL ), m_header( NULL ) {};
+    ~StatsSegment() {delete m_shm;};
+
+    bool open();
+    struct sStatsHistogram *getSlot();
+
+    // the statistics that use a slot
+    std::vector<StreamStatistics *> m_published;
+
+private:
+    Util::PosixSharedMemory *m_shm;
+    struct sStatsSegmentHeader *m_header;
+};
+
+// created by the first createSegment(), removed by the last destroySegment()
+static StatsSegment *stats_segment = NULL;
+static unsigned int stats_segment_users = 0;
+static pthread_mutex_t stats_segment_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// called with the lock held
+bool
+StatsSegment::open()
+{
+    char name[32];
+    snprintf(name, sizeof(name), "ffado-stats-%d", (int)getpid());
+    unsigned int size = sizeof(struct sStatsSegmentHeader)
+                        + STREAMSTATISTICS_SHM_SLOTS * sizeof(struct sStatsHistogram);
+    m_shm = new Util::PosixSharedMemory(name, size);
+    if (!m_shm->Create(Util::PosixSharedMemory::eD_ReadWrite)) {
+        delete m_shm;
+        m_shm = NULL;
+        return false;
+    }
+    // the streaming threads write to it
+    m_shm->LockInMemory(true);
+
+    m_header = (struct sStatsSegmentHeader *)m_shm->requestBlock(0, size);
+    memset(m_header, 0, size);
+    m_header->version = STREAMSTATISTICS_SHM_VERSION;
+    m_header->nb_slots = STREAMSTATISTICS_SHM_SLOTS;
+    m_header->slot_size = sizeof(struct sStatsHistogram);
+    m_header->nb_buckets = STREAMSTATISTICS_NB_BUCKETS;
+    m_header->sub_bucket_bits = STREAMSTATISTICS_SUB_BUCKET_BITS;
+    m_header->pid = getpid();
+    // readers check the magic last
+    __sync_synchronize();
+    m_header->magic = STREAMSTATISTICS_SHM_MAGIC;
+    return true;
+}
+
+// called with the lock held
+struct sStatsHistogram *
+StatsSegment::getSlot()
+{
+    struct sStatsHistogram *slots = (struct sStatsHistogram *)(m_header + 1);
+    for (unsigned int i = 0; i < m_header->nb_slots; i++) {
+        if (!slots[i].in_use) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
 StreamStatistics::StreamStatistics()
     : m_name("")
+    , m_unit("")
     , m_count(0)
     , m_average(0.0)
     , m_min(0x7FFFFFFF)
     , m_max(0)
     , m_sum(0)
+    , m_hist( &m_local )
 {
+    memset(&m_local, 0, sizeof(m_local));
     reset();
 }
 
+StreamStatistics::~StreamStatistics()
+{
+    unpublish();
+}
+
+void StreamStatistics::setName(std::string n) {
+    m_name=n;
+    setSlotName();
+}
+
+void StreamStatistics::setUnit(std::string u) {
+    m_unit=u;
+    setSlotName();
+}
+
+void StreamStatistics::setSlotName() {
+    std::string name = m_name;
+    if (m_owner.size()) {
+        name = m_owner + ": " + m_name;
+    }
+    strncpy(m_hist->name, name.c_str(), sizeof(m_hist->name) - 1);
+    m_hist->name[sizeof(m_hist->name) - 1] = 0;
+    strncpy(m_hist->unit, m_unit.c_str(), sizeof(m_hist->unit) - 1);
+    m_hist->unit[sizeof(m_hist->unit) - 1] = 0;
+}
+
+unsigned int StreamStatistics::getBucketIndex(int64_t value) {
+    unsigned int offset = 0;
+    if (value < 0) {
+        value = -value;
+        offset = STREAMSTATISTICS_HALF_BUCKETS;
+    }
+    if (value > 0xFFFFFFFFLL) value = 0xFFFFFFFFLL;
+    uint32_t u = (uint32_t)value;
+    if (u < STREAMSTATISTICS_SUB_BUCKETS) {
+        return offset + u;
+    }
+    // the power of two determines the bucket group, the next bits the bucket
+    int msb = 31 - __builtin_clz(u);
+    int shift = msb - (STREAMSTATISTICS_SUB_BUCKET_BITS - 1);
+    return offset + STREAMSTATISTICS_SUB_BUCKETS
+           + (shift - 1) * (STREAMSTATISTICS_SUB_BUCKETS / 2)
+           + ((u >> shift) - STREAMSTATISTICS_SUB_BUCKETS / 2);
+}
+
+int64_t StreamStatistics::getBucketLowerBound(unsigned int index) {
+    int64_t sign = 1;
+    if (index >= STREAMSTATISTICS_HALF_BUCKETS) {
+        index -= STREAMSTATISTICS_HALF_BUCKETS;
+        sign = -1;
+    }
+    if (index < STREAMSTATISTICS_SUB_BUCKETS) {
+        return sign * index;
+    }
+    index -= STREAMSTATISTICS_SUB_BUCKETS;
+    int shift = index / (STREAMSTATISTICS_SUB_BUCKETS / 2) + 1;
+    int64_t top = index % (STREAMSTATISTICS_SUB_BUCKETS / 2) + STREAMSTATISTICS_SUB_BUCKETS / 2;
+    return sign * (top << shift);
+}
+
 void StreamStatistics::mark(int value) {
     if(value>m_max) m_max=value;
     if(value<m_min) m_min=value;
     m_count++;
     m_sum+=value;
     m_average=(1.0*m_sum)/(1.0*m_count);
+
+    struct sStatsHistogram *h = m_hist;
+    h->buckets[getBucketIndex(value)]++;
+    h->count = m_count;
+    h->sum = m_sum;
+    h->min = m_min;
+    h->max = m_max;
 }
 
 void StreamStatistics::signal(unsigned int val) {
@@ -52,10 +203,37 @@ void StreamStatistics::signal(unsigned int val) {
     }
 }
 
+int64_t StreamStatistics::getPercentile(float percentile) {
+    return getPercentile(*m_hist, percentile);
+}
+
+int64_t StreamStatistics::getPercentile(const struct sStatsHistogram &h, float percentile) {
+    if (h.count == 0) return 0;
+    int64_t target = (int64_t)(h.count * percentile / 100.0);
+    int64_t seen = 0;
+    // walk the values in ascending order: the negative half
+    // from its largest magnitude down, then the positive half
+    for (int i = STREAMSTATISTICS_NB_BUCKETS - 1; i >= STREAMSTATISTICS_HALF_BUCKETS; i--) {
+        seen += h.buckets[i];
+        if (seen > target) return getBucketLowerBound(i);
+    }
+    for (int i = 0; i < STREAMSTATISTICS_HALF_BUCKETS; i++) {
+        seen += h.buckets[i];
+        if (seen > target) return getBucketLowerBound(i);
+    }
+    return h.max;
+}
+
 void StreamStatistics::dumpInfo() {
     debugOutputShort( DEBUG_LEVEL_VERBOSE, 
                       "--- Stats for %s: min=%" PRId64 " avg=%f max=%" PRId64 " cnt=%" PRId64 " sum=%" PRId64 "\n",
                       m_name.c_str(), m_min, m_average, m_max, m_count, m_sum);
+    if (m_count) {
+        debugOutputShort( DEBUG_LEVEL_VERBOSE,
+                          "    p50=%" PRId64 " p99=%" PRId64 " p99.9=%" PRId64 " %s\n",
+                          getPercentile(50.0), getPercentile(99.0), getPercentile(99.9),
+                          m_unit.c_str());
+    }
     debugOutputShort( DEBUG_LEVEL_VERBOSE, "    Signal stats\n");
     for (unsigned int i=0;i <= MAX_SIGNAL_VALUE; i++) {
         debugOutputShort(DEBUG_LEVEL_VERBOSE, 
@@ -74,6 +252,116 @@ void StreamStatistics::reset() {
     for (unsigned int i=0;i <= MAX_SIGNAL_VALUE; i++) {
         m_signalled[i]=0;
     }
+
+    struct sStatsHistogram *h = m_hist;
+    h->count = 0;
+    h->sum = 0;
+    h->min = m_min;
+    h->max = m_max;
+    memset(h->buckets, 0, sizeof(h->buckets));
+}
+
+bool StreamStatistics::publish(std::string owner) {
+#if STREAMSTATISTICS_SHM
+    pthread_mutex_lock(&stats_segment_lock);
+    if (m_hist == &m_local) {
+        struct sStatsHistogram *slot = NULL;
+        if (stats_segment) {
+            slot = stats_segment->getSlot();
+        }
+        if (slot == NULL) {
+            pthread_mutex_unlock(&stats_segment_lock);
+            debugOutput(DEBUG_LEVEL_VERBOSE, "No shared slot for %s: %s\n",
+                        owner.c_str(), m_name.c_str());
+            return false;
+        }
+        memcpy(slot, &m_local, sizeof(m_local));
+        slot->in_use = 1;
+        m_hist = slot;
+        stats_segment->m_published.push_back(this);
+    }
+    m_owner = owner;
+    setSlotName();
+    pthread_mutex_unlock(&stats_segment_lock);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void StreamStatistics::unpublish() {
+    pthread_mutex_lock(&stats_segment_lock);
+    detach();
+    pthread_mutex_unlock(&stats_segment_lock);
+}
+
+void StreamStatistics::detach() {
+    if (m_hist != &m_local) {
+        memcpy(&m_local, m_hist, sizeof(m_local));
+        m_local.in_use = 0;
+        m_hist->in_use = 0;
+        m_hist = &m_local;
+        std::vector<StreamStatistics *> &published = stats_segment->m_published;
+        published.erase(std::remove(published.begin(), published.end(), this),
+                        published.end());
+    }
+    m_owner = "";
+    setSlotName();
+}
+
+// remove the segments of processes that ended without doing so
+void StreamStatistics::removeStaleSegments() {
+    DIR *dir = opendir("/dev/shm");
+    if (dir == NULL) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int pid;
+        if (sscanf(entry->d_name, "ffado-stats-%d", &pid) != 1) continue;
+        if (pid == (int)getpid()) continue;
+        if (kill(pid, 0) == 0 || errno != ESRCH) continue;
+        if (shm_unlink(entry->d_name) == 0) {
+            debugOutputShort(DEBUG_LEVEL_VERBOSE, "Removed stale statistics segment %s\n",
+                             entry->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+bool StreamStatistics::createSegment() {
+#if STREAMSTATISTICS_SHM
+    bool result;
+    pthread_mutex_lock(&stats_segment_lock);
+    if (stats_segment_users++ == 0) {
+        removeStaleSegments();
+        stats_segment = new StatsSegment();
+        if (!stats_segment->open()) {
+            debugWarning("Could not create the statistics segment\n");
+            delete stats_segment;
+            stats_segment = NULL;
+        }
+    }
+    result = (stats_segment != NULL);
+    pthread_mutex_unlock(&stats_segment_lock);
+    return result;
+#else
+    return false;
+#endif
+}
+
+void StreamStatistics::destroySegment() {
+#if STREAMSTATISTICS_SHM
+    pthread_mutex_lock(&stats_segment_lock);
+    if (stats_segment_users == 0) {
+        debugError("Statistics segment is not in use\n");
+    } else if (--stats_segment_users == 0 && stats_segment) {
+        while (!stats_segment->m_published.empty()) {
+            stats_segment->m_published.back()->detach();
+        }
+        delete stats_segment;
+        stats_segment = NULL;
+    }
+    pthread_mutex_unlock(&stats_segment_lock);
+#endif
 }
 
 }
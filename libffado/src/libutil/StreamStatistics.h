@@ -25,26 +25,120 @@
 #define FFADOSTREAMINGSTREAMSTATISTICS_H
 
 #include <string>
+#include <stdint.h>
 
 #include "debugmodule/debugmodule.h"
 
 #define MAX_SIGNAL_VALUE 7
+
+/*
+ * The histograms are log-linear (HDR style): values below
+ * STREAMSTATISTICS_SUB_BUCKETS have a bucket each, every following power
+ * of two is split into STREAMSTATISTICS_SUB_BUCKETS/2 buckets. This gives
+ * a relative resolution of about 6% over the whole 32 bit range.
+ *
+ * The first STREAMSTATISTICS_HALF_BUCKETS buckets count the values >= 0,
+ * the second half counts the negative values by their magnitude.
+ */
+#define STREAMSTATISTICS_SUB_BUCKET_BITS   5
+#define STREAMSTATISTICS_SUB_BUCKETS       (1 << STREAMSTATISTICS_SUB_BUCKET_BITS)
+#define STREAMSTATISTICS_HALF_BUCKETS      (STREAMSTATISTICS_SUB_BUCKETS \
+                                            + (32 - STREAMSTATISTICS_SUB_BUCKET_BITS) \
+                                              * (STREAMSTATISTICS_SUB_BUCKETS / 2))
+#define STREAMSTATISTICS_NB_BUCKETS        (2 * STREAMSTATISTICS_HALF_BUCKETS)
+
+/*
+ * Layout of the shared memory segment "/ffado-stats-<pid>" in which the
+ * published histograms live. A segment header is followed by nb_slots
+ * histograms of slot_size bytes. Slots with in_use == 0 are free.
+ *
+ * Each histogram has a single writer, the thread that owns the metric,
+ * which updates it without locking. Readers can copy it at any time, a
+ * copy might be inconsistent by the values that are recorded during the
+ * copy.
+ */
+#define STREAMSTATISTICS_SHM_MAGIC         0x46465354 // "FFST"
+#define STREAMSTATISTICS_SHM_VERSION       1
+
 namespace Streaming {
 
+struct sStatsSegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nb_slots;
+    uint32_t slot_size;
+    uint32_t nb_buckets;
+    uint32_t sub_bucket_bits;
+    int32_t  pid;
+    uint32_t reserved;
+};
+
+struct sStatsHistogram {
+    char     name[56];      // "<owner>: <metric>"
+    char     unit[8];
+    uint32_t in_use;
+    uint32_t reserved;
+    int64_t  count;
+    int64_t  sum;
+    int64_t  min;
+    int64_t  max;
+    uint32_t buckets[STREAMSTATISTICS_NB_BUCKETS];
+};
+
 class StreamStatistics {
 public:
     StreamStatistics();
 
-    ~StreamStatistics() {};
+    ~StreamStatistics();
 
-    void setName(std::string n) {m_name=n;};
+    void setName(std::string n);
+    void setUnit(std::string u);
 
     void mark(int value);
 
     void dumpInfo();
     void reset();
 
+    /**
+     * @brief make the histogram available in the shared memory segment
+     *
+     * Not real-time safe, call it when preparing.
+     * @param owner identifies the owner of the metric in the segment
+     * @return false if there is no segment or no free slot in it
+     */
+    bool publish(std::string owner);
+    void unpublish();
+
+    /**
+     * @brief get the lower bound of the bucket that contains the percentile
+     * @param percentile between 0.0 and 100.0
+     */
+    int64_t getPercentile(float percentile);
+    static int64_t getPercentile(const struct sStatsHistogram &h, float percentile);
+
+    /**
+     * @brief create the shared memory segment of this process
+     *
+     * The segment exists until every createSegment() is matched by a
+     * destroySegment(). Segments left behind by processes that no longer
+     * exist are removed.
+     * @return false if the segment could not be created
+     */
+    static bool createSegment();
+    /**
+     * @brief release the shared memory segment
+     *
+     * The histograms that are still published are moved out of the
+     * segment before it is removed. Their owners should not be
+     * recording at that time, i.e. the streams should be stopped.
+     */
+    static void destroySegment();
+
+    static unsigned int getBucketIndex(int64_t value);
+    static int64_t getBucketLowerBound(unsigned int index);
+
     std::string m_name;
+    std::string m_unit;
 
     int64_t m_count;
     float m_average;
@@ -60,6 +154,20 @@ public:
     unsigned int m_signalled[MAX_SIGNAL_VALUE+1];
 
 private:
+    // not copyable, m_hist can point to m_local
+    StreamStatistics(const StreamStatistics &);
+    StreamStatistics &operator=(const StreamStatistics &);
+
+    void setSlotName();
+    // the segment lock is held
+    void detach();
+    static void removeStaleSegments();
+
+    // the histogram, either m_local or a slot in the shared segment
+    struct sStatsHistogram *m_hist;
+    struct sStatsHistogram m_local;
+    std::string m_owner;
+
     DECLARE_DEBUG_MODULE;
 };
 
@@ -140,4 +140,12 @@ SystemTimeSource::getCurrentTimeAsUsecs()
     return (ffado_microsecs_t)(ts.tv_sec * 1000000LL + ts.tv_nsec / 1000LL);
 }
 
+uint64_t
+SystemTimeSource::getCurrentTimeAsNsecs()
+{
+    struct timespec ts;
+    clock_gettime(clock_id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 } // end of namespace Util
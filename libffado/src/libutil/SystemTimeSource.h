@@ -52,6 +52,7 @@ public:
 
     static ffado_microsecs_t getCurrentTime();
     static ffado_microsecs_t getCurrentTimeAsUsecs();
+    static uint64_t getCurrentTimeAsNsecs();
 
     static void SleepUsecRelative(ffado_microsecs_t usecs);
     static void SleepUsecAbsolute(ffado_microsecs_t wake_time);
@@ -115,6 +115,11 @@ class Thread
 
         virtual void SetParams(uint64_t period, uint64_t computation, uint64_t constraint) // Empty implementation, will only make sense on OSX...
         {}
+        /*! Deadline statistics, for threads that have a computation budget */
+        virtual bool GetDeadlineStats(unsigned int &overruns, uint64_t &max_computation)
+        {
+            return false;
+        }
 
         virtual pthread_t GetThreadID() = 0;
 
@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include "libutil/Atomic.h"
+#include "libutil/RtMemory.h"
 #include "libieee1394/cycletimer.h"
 
 #include "TimestampedBuffer.h"
@@ -43,6 +44,25 @@
 #define DLL_COEFF_B   (DLL_SQRT2 * DLL_OMEGA)
 #define DLL_COEFF_C   (DLL_OMEGA * DLL_OMEGA)
 
+// adaptive bandwidth
+// the error variance is measured over windows of this number of loop
+// time constants, but at least DLL_ADAPT_MIN_WINDOW updates
+#define DLL_ADAPT_WINDOW_CONSTANTS      4.0
+#define DLL_ADAPT_MIN_WINDOW            64
+// when the variance didn't increase over a window, the bandwidth is
+// narrowed by this factor
+#define DLL_ADAPT_NARROW_FACTOR         0.5
+// when it did increase by more than this factor, the last narrowing
+// step is undone
+#define DLL_ADAPT_VARIANCE_HYSTERESIS   1.25
+// an error is an outlier when it is larger than this amount of standard
+// deviations (and larger than 1/4 of the max abs diff). this number of
+// consecutive outliers is a disturbance.
+#define DLL_ADAPT_OUTLIER_SIGMA         8.0
+#define DLL_ADAPT_DISTURBANCE_COUNT     3
+// on a disturbance, the bandwidth is widened by this factor
+#define DLL_ADAPT_WIDEN_FACTOR          8.0
+
 #define FRAMES_PER_PROCESS_BLOCK 8
 /*
 #define ENTER_CRITICAL_SECTION { \
@@ -71,22 +91,29 @@ TimestampedBuffer::TimestampedBuffer(TimestampedBufferClient *c)
       m_bytes_per_frame(0), m_bytes_per_buffer(0),
       m_enabled( false ), m_transparent ( true ),
       m_wrap_at(0xFFFFFFFFFFFFFFFFLLU),
-      m_Client(c), m_framecounter(0),
+      m_Client(c), m_framecounter(0), m_skipped_frames(0),
       m_buffer_tail_timestamp(TIMESTAMP_MAX + 1.0),
       m_buffer_next_tail_timestamp(TIMESTAMP_MAX + 1.0),
       m_dll_e2(0.0), m_dll_b(DLL_COEFF_B), m_dll_c(DLL_COEFF_C),
-      m_nominal_rate(0.0), m_current_rate(0.0), m_update_period(0),
+      m_dll_adaptive(false), m_dll_min_bw(0.0), m_dll_max_bw(0.0),
+      m_dll_window_updates(0), m_dll_window_err2(0.0),
+      m_dll_err_variance(0.0), m_dll_outliers(0),
+      m_nominal_rate(0.0), m_current_rate(0.0), m_dll_error(0.0),
+      m_update_period(0),
       // half a cycle is what we consider 'normal'
       m_max_abs_diff(3072/2)
 {
     pthread_mutex_init(&m_framecounter_lock, NULL);
+    m_dll_error_stats.setName("DLL error");
+    m_dll_error_stats.setUnit("ticks");
+    m_dll_bandwidth_stats.setName("DLL bandwidth");
 }
 
 TimestampedBuffer::~TimestampedBuffer() {
     pthread_mutex_destroy(&m_framecounter_lock);
 
     if(m_event_buffer) ffado_ringbuffer_free(m_event_buffer);
-    if(m_process_buffer) free(m_process_buffer);
+    if(m_process_buffer) Util::RtMemory::release(m_process_buffer);
 }
 
 /**
@@ -108,12 +135,140 @@ bool TimestampedBuffer::setBandwidth(double bw) {
         return false;
     }
     ENTER_CRITICAL_SECTION;
+    setCoefficients(bw);
+    EXIT_CRITICAL_SECTION;
+    return true;
+}
+
+/**
+ * \brief Sets the DLL coefficients for a bandwidth
+ *
+ * @note the caller should hold the framecounter lock
+ *
+ * @param bw bandwidth in absolute frequency
+ */
+void TimestampedBuffer::setCoefficients(double bw) {
+    double bw_rel = bw * m_nominal_rate * (float)m_update_period;
     m_dll_b = bw_rel * (DLL_SQRT2 * DLL_2PI);
     m_dll_c = bw_rel * bw_rel * DLL_2PI * DLL_2PI;
+}
+
+/**
+ * \brief Let the DLL adapt its bandwidth
+ *
+ * Enables the adaptive bandwidth mode. The DLL continues at its current
+ * bandwidth, clipped to the given range. It narrows the bandwidth in steps
+ * as long as this doesn't increase the error variance, hence the jitter of
+ * the timestamps. It widens the bandwidth again when a disturbance is
+ * detected, such that the DLL can quickly re-lock.
+ *
+ * Set max_bw to 0 to disable the adaptive mode. The DLL then keeps its
+ * current bandwidth.
+ *
+ * @param min_bw the lowest bandwidth in absolute frequency
+ * @param max_bw the highest bandwidth in absolute frequency
+ * @return true if successful
+ */
+bool TimestampedBuffer::setAdaptiveBandwidth(double min_bw, double max_bw) {
+    if (max_bw <= 0.0) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, " adaptive bandwidth disabled\n");
+        m_dll_adaptive = false;
+        return true;
+    }
+    double tupdate = m_nominal_rate * (float)m_update_period;
+    if (min_bw <= 0.0 || min_bw > max_bw || max_bw * tupdate >= 0.5) {
+        debugError("Invalid adaptive bandwidth range: %e - %e\n", min_bw, max_bw);
+        return false;
+    }
+    debugOutput(DEBUG_LEVEL_VERBOSE, " adaptive bandwidth %e - %e\n", min_bw, max_bw);
+
+    double bw = getBandwidth();
+    if (bw < min_bw) bw = min_bw;
+    if (bw > max_bw) bw = max_bw;
+
+    ENTER_CRITICAL_SECTION;
+    m_dll_min_bw = min_bw;
+    m_dll_max_bw = max_bw;
+    m_dll_window_updates = 0;
+    m_dll_window_err2 = 0.0;
+    m_dll_err_variance = 0.0;
+    m_dll_outliers = 0;
+    setCoefficients(bw);
+    m_dll_adaptive = true;
     EXIT_CRITICAL_SECTION;
+
+    m_dll_bandwidth_stats.reset();
+    m_dll_bandwidth_stats.mark((int)(bw * TICKS_PER_SECOND * 1000.0));
     return true;
 }
 
+/**
+ * \brief Adapts the DLL bandwidth to the error
+ *
+ * Called on every DLL update when the adaptive mode is enabled.
+ *
+ * @note the caller should hold the framecounter lock
+ *
+ * @param err the error of this update
+ */
+void TimestampedBuffer::adaptBandwidth(double err) {
+    double err2 = err * err;
+    double bw = getBandwidth();
+    double new_bw = bw;
+    int event = -1;
+
+    // detect disturbances, only possible once the variance is known
+    if (m_dll_err_variance > 0.0
+        && err2 > DLL_ADAPT_OUTLIER_SIGMA * DLL_ADAPT_OUTLIER_SIGMA * m_dll_err_variance
+        && fabs(err) > m_max_abs_diff / 4) {
+        m_dll_outliers++;
+    } else {
+        m_dll_outliers = 0;
+    }
+
+    if (m_dll_outliers >= DLL_ADAPT_DISTURBANCE_COUNT) {
+        new_bw = bw * DLL_ADAPT_WIDEN_FACTOR;
+        event = eDAE_Disturbance;
+        // restart the variance measurement
+        m_dll_err_variance = 0.0;
+        m_dll_window_updates = 0;
+        m_dll_window_err2 = 0.0;
+        m_dll_outliers = 0;
+    } else {
+        m_dll_window_updates++;
+        m_dll_window_err2 += err2;
+
+        // the loop time constant, in updates
+        double tau = 1.0 / (DLL_2PI * bw * m_nominal_rate * (float)m_update_period);
+        unsigned int window = (unsigned int)(DLL_ADAPT_WINDOW_CONSTANTS * tau);
+        if (window < DLL_ADAPT_MIN_WINDOW) window = DLL_ADAPT_MIN_WINDOW;
+
+        if (m_dll_window_updates >= window) {
+            double variance = m_dll_window_err2 / m_dll_window_updates;
+            if (m_dll_err_variance == 0.0 || variance <= m_dll_err_variance) {
+                new_bw = bw * DLL_ADAPT_NARROW_FACTOR;
+                event = eDAE_Narrowed;
+            } else if (variance > m_dll_err_variance * DLL_ADAPT_VARIANCE_HYSTERESIS) {
+                new_bw = bw / DLL_ADAPT_NARROW_FACTOR;
+                event = eDAE_Widened;
+            }
+            m_dll_err_variance = variance;
+            m_dll_window_updates = 0;
+            m_dll_window_err2 = 0.0;
+        }
+    }
+
+    if (new_bw < m_dll_min_bw) new_bw = m_dll_min_bw;
+    if (new_bw > m_dll_max_bw) new_bw = m_dll_max_bw;
+    if (event >= 0) {
+        m_dll_bandwidth_stats.signal(event);
+        if (new_bw != bw) {
+            setCoefficients(new_bw);
+            m_dll_bandwidth_stats.mark((int)(new_bw * TICKS_PER_SECOND * 1000.0));
+        }
+    }
+}
+
 /**
  * \brief Returns the current bandwidth of the DLL
  *
@@ -151,12 +306,34 @@ bool TimestampedBuffer::setNominalRate(float r) {
  * Sets the nominal update period. This period is the number of frames
  * between two timestamp updates (hence buffer writes)
  *
+ * This can be changed while the buffer is in use. The DLL state is
+ * rescaled such that it keeps tracking at the same (absolute) bandwidth.
+ *
  * @param n period in frames
  * @return true if successful
  */
 bool TimestampedBuffer::setUpdatePeriod(unsigned int n) {
+    if (m_update_period == 0 || m_nominal_rate == 0.0 || n == m_update_period) {
+        m_update_period=n;
+        return true;
+    }
+
+    double bw = getBandwidth();
+    debugOutput(DEBUG_LEVEL_VERBOSE," update period %u => %u\n",
+                                    m_update_period, n);
+
+    ENTER_CRITICAL_SECTION;
+    // e2 is the predicted time between two updates
+    m_dll_e2 = m_dll_e2 * (double)n / (double)m_update_period;
+    m_buffer_next_tail_timestamp = (ffado_timestamp_t)((double)m_buffer_tail_timestamp + m_dll_e2);
+    if (m_buffer_next_tail_timestamp >= m_wrap_at) {
+        m_buffer_next_tail_timestamp -= m_wrap_at;
+    }
     m_update_period=n;
-    return true;
+    EXIT_CRITICAL_SECTION;
+
+    // the coefficients depend on the update period
+    return setBandwidth(bw);
 }
 
 /**
@@ -395,8 +572,8 @@ bool TimestampedBuffer::prepare() {
     m_cluster_size = m_events_per_frame * m_event_size;
     m_process_block_size = m_cluster_size * FRAMES_PER_PROCESS_BLOCK;
     if (m_process_buffer != NULL)
-        free(m_process_buffer);
-    if( !(m_process_buffer=(char *)calloc(m_process_block_size, 1))) {
+        Util::RtMemory::release(m_process_buffer);
+    if( !(m_process_buffer=(char *)Util::RtMemory::allocate(m_process_block_size))) {
             debugFatal("Could not allocate temporary cluster buffer\n");
         ffado_ringbuffer_free(m_event_buffer);
         return false;
@@ -404,6 +581,7 @@ bool TimestampedBuffer::prepare() {
 
     // init the DLL
     m_dll_e2 = m_nominal_rate * (float)m_update_period;
+    m_dll_error_stats.reset();
 
     // init the timestamps to a bogus value, as there is not
     // really something sane to say about them
@@ -429,8 +607,10 @@ TimestampedBuffer::resizeBuffer(unsigned int new_size)
         ffado_ringbuffer_free(m_event_buffer);
     }
     // allocate a new one
-    if( !(m_event_buffer = ffado_ringbuffer_create(
-            (m_events_per_frame * new_size) * m_event_size))) {
+    // from locked memory, the streaming threads access it
+    if( !(m_event_buffer = ffado_ringbuffer_create_with(
+            (m_events_per_frame * new_size) * m_event_size,
+            Util::RtMemory::allocate, Util::RtMemory::release))) {
         debugFatal("Could not allocate memory event ringbuffer\n");
 
         return false;
@@ -569,12 +749,72 @@ bool TimestampedBuffer::preloadFrames(unsigned int nframes, char *data, bool kee
  */
 bool
 TimestampedBuffer::dropFrames(unsigned int nframes) {
+    discardSkippedFrames();
     unsigned int read_size = nframes * m_event_size * m_events_per_frame;
     ffado_ringbuffer_read_advance(m_event_buffer, read_size);
     decrementFrameCounter(nframes);
     return true;
 }
 
+/**
+ * @brief Skip frames at the head of the buffer
+ *
+ * Removes \ref nframes of frames from the head of the buffer, and moves
+ * the timestamps of the remaining frames such that the buffer head
+ * timestamp stays the same. The buffer hence holds \ref nframes frames
+ * less worth of time afterwards.
+ *
+ * Unlike dropFrames(), this can be called by the writer. Only the reader
+ * can advance the ringbuffer, so the frames are accounted for here and
+ * removed from the ringbuffer by the next read.
+ *
+ * @param nframes number of frames to skip
+ * @return true if successful
+ */
+bool
+TimestampedBuffer::skipHeadFrames(unsigned int nframes) {
+    if (nframes == 0) return true;
+
+    ENTER_CRITICAL_SECTION;
+    if ((int)nframes > m_framecounter) {
+        EXIT_CRITICAL_SECTION;
+        debugError("(%p) can't skip %u frames, only %d in buffer\n",
+                   this, nframes, m_framecounter);
+        return false;
+    }
+    ffado_timestamp_t shift = (ffado_timestamp_t)((float)nframes * m_current_rate);
+
+    m_buffer_tail_timestamp -= shift;
+    if (m_buffer_tail_timestamp < 0) {
+        m_buffer_tail_timestamp += m_wrap_at;
+    }
+    m_buffer_next_tail_timestamp -= shift;
+    if (m_buffer_next_tail_timestamp < 0) {
+        m_buffer_next_tail_timestamp += m_wrap_at;
+    }
+    m_framecounter -= nframes;
+    __sync_fetch_and_add(&m_skipped_frames, nframes);
+    EXIT_CRITICAL_SECTION;
+
+    debugOutput(DEBUG_LEVEL_VERBOSE, "(%p) skipped %u frames, tail TS now " TIMESTAMP_FORMAT_SPEC "\n",
+                this, nframes, m_buffer_tail_timestamp);
+    return true;
+}
+
+/**
+ * @brief Remove the frames skipped by skipHeadFrames() from the ringbuffer
+ *
+ * Called by the reader before it reads from the ringbuffer. The frame
+ * counter has already been decremented by skipHeadFrames().
+ */
+void
+TimestampedBuffer::discardSkippedFrames() {
+    unsigned int nframes = m_skipped_frames;
+    if (nframes == 0) return;
+    ffado_ringbuffer_read_advance(m_event_buffer, nframes * m_event_size * m_events_per_frame);
+    __sync_fetch_and_sub(&m_skipped_frames, nframes);
+}
+
 /**
  * @brief Read frames from the buffer
  *
@@ -589,6 +829,7 @@ bool TimestampedBuffer::readFrames(unsigned int nframes, char *data) {
 
     unsigned int read_size=nframes*m_event_size*m_events_per_frame;
 
+    discardSkippedFrames();
     if (m_transparent) {
         return true; // FIXME: the data still doesn't make sense!
     } else {
@@ -739,6 +980,7 @@ bool TimestampedBuffer::blockProcessReadFrames(unsigned int nbframes) {
     // we received one period of frames on each connection
     // this is period_size*dimension of events
 
+    discardSkippedFrames();
     unsigned int events2read = nbframes * m_events_per_frame;
     unsigned int bytes2read = events2read * m_event_size;
     /* read events2read bytes from the ringbuffer
@@ -998,6 +1240,7 @@ ffado_timestamp_t TimestampedBuffer::getTimestampFromHead(int nframes)
 void TimestampedBuffer::resetFrameCounter() {
     ENTER_CRITICAL_SECTION;
     m_framecounter = 0;
+    m_skipped_frames = 0;
     EXIT_CRITICAL_SECTION;
 }
 
@@ -1085,6 +1328,11 @@ void TimestampedBuffer::incrementFrameCounter(unsigned int nbframes, ffado_times
     m_buffer_tail_timestamp = m_buffer_next_tail_timestamp;
     m_buffer_next_tail_timestamp = m_buffer_next_tail_timestamp + (ffado_timestamp_t)(m_dll_b * err + m_dll_e2);
     m_dll_e2 += m_dll_c*err;
+    m_dll_error = err;
+    m_dll_error_stats.mark((int)err);
+    if (m_dll_adaptive) {
+        adaptBandwidth(err);
+    }
 
     if (m_buffer_next_tail_timestamp >= m_wrap_at) {
         debugOutputExtreme(DEBUG_LEVEL_VERY_VERBOSE,
@@ -1151,7 +1399,17 @@ void TimestampedBuffer::dumpInfo() {
     debugOutputShort( DEBUG_LEVEL_NORMAL, "    Head - Tail         : " TIMESTAMP_FORMAT_SPEC " (%f frames)\n", diff, diff/m_dll_e2*m_update_period);
 #endif
     debugOutputShort( DEBUG_LEVEL_NORMAL, "   DLL Rate             : %f (%f)\n", m_dll_e2, m_dll_e2/m_update_period);
-    debugOutputShort( DEBUG_LEVEL_NORMAL, "   DLL Bandwidth        : %10e 1/ticks (%f Hz)\n", getBandwidth(), getBandwidth() * TICKS_PER_SECOND);
+    debugOutputShort( DEBUG_LEVEL_NORMAL, "   DLL Bandwidth        : %10e 1/ticks (%f Hz)%s\n", getBandwidth(), getBandwidth() * TICKS_PER_SECOND,
+                                          (m_dll_adaptive ? ", adaptive" : ""));
+    if (m_dll_adaptive) {
+        debugOutputShort( DEBUG_LEVEL_NORMAL, "   DLL Error variance   : %f (%u/%u/%u narrowed/widened/disturbed)\n",
+                                              m_dll_err_variance,
+                                              m_dll_bandwidth_stats.m_signalled[eDAE_Narrowed],
+                                              m_dll_bandwidth_stats.m_signalled[eDAE_Widened],
+                                              m_dll_bandwidth_stats.m_signalled[eDAE_Disturbance]);
+    }
+    m_dll_error_stats.dumpInfo();
+    m_dll_bandwidth_stats.dumpInfo();
 }
 
 } // end of namespace Util
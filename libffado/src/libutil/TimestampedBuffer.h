@@ -26,6 +26,7 @@
 
 #include "debugmodule/debugmodule.h"
 #include "libutil/ringbuffer.h"
+#include "libutil/StreamStatistics.h"
 #include <pthread.h>
 
 //typedef float ffado_timestamp_t;
@@ -96,6 +97,7 @@ class TimestampedBuffer
 
         bool writeDummyFrame();
         bool dropFrames ( unsigned int nbframes );
+        bool skipHeadFrames ( unsigned int nbframes );
 
         bool writeFrames ( unsigned int nbframes, char *data, ffado_timestamp_t ts );
         bool readFrames ( unsigned int nbframes, char *data );
@@ -142,14 +144,34 @@ class TimestampedBuffer
         // dll stuff
         bool setBandwidth(double bw);
         double getBandwidth();
+        bool setAdaptiveBandwidth(double min_bw, double max_bw);
+        bool isBandwidthAdaptive() {return m_dll_adaptive;};
         bool setNominalRate ( float r );
         float getNominalRate() {return m_nominal_rate;};
         float getRate();
         void setRate(float rate);
+        /// the error of the last DLL update, in timeunits
+        float getDllError() {return m_dll_error;};
 
         bool setUpdatePeriod ( unsigned int t );
         unsigned int getUpdatePeriod();
 
+        /**
+         * the events signalled to the DLL bandwidth statistics
+         */
+        enum eDllAdaptEvent {
+            eDAE_Narrowed = 0,
+            eDAE_Widened = 1,
+            eDAE_Disturbance = 2
+        };
+
+        /// the DLL error of every update, in timeunits
+        Streaming::StreamStatistics &getDllErrorStatistics()
+            {return m_dll_error_stats;};
+        /// the DLL bandwidth after every adaptation, in mHz
+        Streaming::StreamStatistics &getDllBandwidthStatistics()
+            {return m_dll_bandwidth_stats;};
+
         // misc stuff
         void dumpInfo();
         void setVerboseLevel ( int l ) {setDebugLevel ( l );};
@@ -160,6 +182,7 @@ class TimestampedBuffer
         void decrementFrameCounter(unsigned int nbframes);
         void incrementFrameCounter(unsigned int nbframes, ffado_timestamp_t new_timestamp);
         void resetFrameCounter();
+        void discardSkippedFrames();
 
     protected:
 
@@ -185,6 +208,9 @@ class TimestampedBuffer
     private:
         // the framecounter gives the number of frames in the buffer
         signed int m_framecounter;
+        // frames that have been skipped by skipHeadFrames(), but that
+        // are still to be removed from the ringbuffer by the reader
+        volatile unsigned int m_skipped_frames;
 
         // the buffer tail timestamp gives the timestamp of the last frame
         // that was put into the buffer
@@ -202,9 +228,25 @@ class TimestampedBuffer
         float m_dll_b;
         float m_dll_c;
 
+        // adaptive bandwidth
+        void adaptBandwidth(double err);
+        void setCoefficients(double bw);
+        bool m_dll_adaptive;
+        double m_dll_min_bw;
+        double m_dll_max_bw;
+        // the error variance is measured over windows of some loop
+        // time constants
+        unsigned int m_dll_window_updates;
+        double m_dll_window_err2;
+        double m_dll_err_variance;
+        unsigned int m_dll_outliers;
+        Streaming::StreamStatistics m_dll_error_stats;
+        Streaming::StreamStatistics m_dll_bandwidth_stats;
+
         float m_nominal_rate;
         float calculateRate();
         float m_current_rate;
+        float m_dll_error;
         unsigned int m_update_period;
 
         unsigned int m_max_abs_diff;
@@ -35,6 +35,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <poll.h>
+#include <inttypes.h>
 
 namespace Util {
 
@@ -126,6 +127,7 @@ Watchdog::WatchdogCheckTask::Execute()
         // set all watched threads to non-rt scheduling
         m_parent.rescheduleThreads();
     }
+    m_parent.checkDeadlines();
 
     #ifdef DEBUG
     uint64_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
@@ -367,6 +369,7 @@ Watchdog::unregisterThread(Thread *thread)
     {
         if(*it == thread) {
             m_Threads.erase(it);
+            m_OverrunCounts.erase(thread);
             return true;
         }
     }
@@ -386,4 +389,37 @@ void Watchdog::rescheduleThreads()
     }
 }
 
+/**
+ * Checks the threads that run with a computation budget (SCHED_DEADLINE)
+ * for iterations that used more CPU time than their budget. Threads that
+ * keep overrunning are moved back to SCHED_FIFO, since the kernel throttles
+ * them every time they overrun.
+ */
+void Watchdog::checkDeadlines()
+{
+    for ( ThreadVectorIterator it = m_Threads.begin();
+      it != m_Threads.end();
+      ++it )
+    {
+        unsigned int overruns;
+        uint64_t max_computation;
+        if (!(*it)->GetDeadlineStats(overruns, max_computation)) {
+            continue;
+        }
+        unsigned int new_overruns = overruns - m_OverrunCounts[*it];
+        m_OverrunCounts[*it] = overruns;
+        if (new_overruns == 0) {
+            continue;
+        }
+        debugWarning("(%p) thread %p overran its deadline budget %u times (max %" PRIu64 " ns)\n",
+                     this, *it, new_overruns, max_computation);
+        if (new_overruns > WATCHDOG_MAX_DEADLINE_OVERRUNS) {
+            debugWarning("(%p) switching thread %p to FIFO scheduling\n", this, *it);
+            (*it)->SetParams(0, 0, 0);
+            (*it)->AcquireRealTime();
+            m_OverrunCounts.erase(*it);
+        }
+    }
+}
+
 } // end of namespace Util
@@ -27,6 +27,8 @@
 #include "debugmodule/debugmodule.h"
 #include "libutil/Thread.h"
 
+#include <map>
+
 namespace Util {
 
 typedef std::vector<Thread *> ThreadVector;
@@ -107,9 +109,12 @@ protected:
     void setHartbeat() {m_hartbeat=true;};
 
     void rescheduleThreads();
+    void checkDeadlines();
 
 private:
     ThreadVector    m_Threads;
+    // the deadline overrun count of each thread at the previous check
+    std::map<Thread *, unsigned int> m_OverrunCounts;
     bool            m_hartbeat;
 
     unsigned int    m_check_interval;
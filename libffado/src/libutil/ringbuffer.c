@@ -63,11 +63,22 @@
 
 ffado_ringbuffer_t *
 ffado_ringbuffer_create (size_t sz)
+{
+  return ffado_ringbuffer_create_with (sz, malloc, free);
+}
+
+ffado_ringbuffer_t *
+ffado_ringbuffer_create_with (size_t sz,
+                              void *(*allocate)(size_t),
+                              void (*release)(void *))
 {
   int power_of_two;
   ffado_ringbuffer_t *rb;
 
   rb = malloc (sizeof (ffado_ringbuffer_t));
+  if (rb == NULL) {
+    return NULL;
+  }
 
   for (power_of_two = 1; 1 << power_of_two < sz; power_of_two++);
 
@@ -76,8 +87,13 @@ ffado_ringbuffer_create (size_t sz)
   rb->size_mask -= 1;
   rb->write_ptr = 0;
   rb->read_ptr = 0;
-  rb->buf = malloc (rb->size);
+  rb->buf = allocate (rb->size);
   rb->mlocked = 0;
+  rb->release = release;
+  if (rb->buf == NULL) {
+    free (rb);
+    return NULL;
+  }
 
   return rb;
 }
@@ -92,7 +108,7 @@ ffado_ringbuffer_free (ffado_ringbuffer_t * rb)
     munlock (rb->buf, rb->size);
   }
 #endif /* USE_MLOCK */
-  free (rb->buf);
+  rb->release (rb->buf);
 }
 
 /* Lock the data block of `rb' using the system call 'mlock'.  */
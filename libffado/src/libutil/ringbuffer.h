@@ -84,6 +84,7 @@ typedef struct
   size_t      size;
   size_t      size_mask;
   int          mlocked;
+  void       (*release)(void *);
 }
 ffado_ringbuffer_t ;
 
@@ -99,6 +100,21 @@ ffado_ringbuffer_t ;
  */
 ffado_ringbuffer_t *ffado_ringbuffer_create(size_t sz);
 
+/**
+ * Same as ffado_ringbuffer_create(), but with the data block obtained
+ * from the given allocator instead of malloc().
+ *
+ * @param sz the ringbuffer size in bytes.
+ * @param allocate returns a block of the requested size, or NULL
+ * @param release releases a block returned by allocate
+ *
+ * @return a pointer to a new ffado_ringbuffer_t, if successful; NULL
+ * otherwise.
+ */
+ffado_ringbuffer_t *ffado_ringbuffer_create_with(size_t sz,
+                                                 void *(*allocate)(size_t),
+                                                 void (*release)(void *));
+
 /**
  * Frees the ringbuffer data structure allocated by an earlier call to
  * ffado_ringbuffer_create().
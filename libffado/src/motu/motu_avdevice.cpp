@@ -43,6 +43,7 @@
 
 #include "libutil/Time.h"
 #include "libutil/Configuration.h"
+#include "libutil/PosixMutex.h"
 
 #include "libcontrol/BasicElements.h"
 
@@ -328,6 +329,7 @@ MotuDevice::MotuDevice( DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ))
     , m_transmitProcessor ( 0 )
     , m_MixerContainer ( NULL )
     , m_ControlContainer ( NULL )
+    , m_ctrl_write_lock ( new Util::PosixMutex("MOTUCTRL") )
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Created Motu::MotuDevice (NodeID %d)\n",
                  getConfigRom().getNodeId() );
@@ -347,6 +349,7 @@ MotuDevice::~MotuDevice()
     }
 
     destroyMixer();
+    delete m_ctrl_write_lock;
 }
 
 bool
@@ -1115,10 +1118,10 @@ MotuDevice::prepare() {
 
     // Assign iso channels if not already done
     if (m_iso_send_channel < 0)
-        m_iso_send_channel = get1394Service().allocateIsoChannelGeneric(m_tx_bandwidth);
+        m_iso_send_channel = get1394Service().allocateIsoChannelGeneric(m_tx_bandwidth, getNodeId());
 
     if (m_iso_recv_channel < 0)
-        m_iso_recv_channel = get1394Service().allocateIsoChannelGeneric(m_rx_bandwidth);
+        m_iso_recv_channel = get1394Service().allocateIsoChannelGeneric(m_rx_bandwidth, getNodeId());
 
     debugOutput(DEBUG_LEVEL_VERBOSE, "recv channel = %d, send channel = %d\n",
         m_iso_recv_channel, m_iso_send_channel);
@@ -2031,10 +2034,115 @@ signed int MotuDevice::WriteRegister(fb_nodeaddr_t reg, quadlet_t data) {
         debugError("Error doing motu write to register 0x%012" PRIx64 "\n",reg);
     }
 
+    /* Until the stream reflects the new value, ReadControlRegister() has
+     * to read it from the device.
+     */
+    if (isStreamControlRegister(reg)) {
+        Util::MutexLockHelper lock(*m_ctrl_write_lock);
+        m_ctrl_write_times[reg] = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+    }
+
     SleepRelativeUsec(100);
     return (err==0)?0:-1;
 }
 
+unsigned int MotuDevice::ReadControlRegister(fb_nodeaddr_t reg) {
+/*
+ * Reads a mixer control register.  While streaming, G2 devices send the
+ * state of the mixer in the iso stream, so the register doesn't need to
+ * be read from the device.
+ */
+#if MOTU_CTRL_READBACK_FROM_STREAM
+    unsigned int val;
+
+    if ((reg & MOTU_REG_BASE_ADDR) == 0)
+        reg |= MOTU_REG_BASE_ADDR;
+    if (getStreamControlRegister(reg, val)) {
+        debugOutput(DEBUG_LEVEL_VERY_VERBOSE, "register 0x%012" PRIx64 " = 0x%08x from stream\n", reg, val);
+        return val;
+    }
+#endif
+    return ReadRegister(reg);
+}
+
+bool MotuDevice::isStreamControlRegister(fb_nodeaddr_t reg) {
+/*
+ * Returns true if the value of the given register can be reconstructed
+ * from the device control status in the stream.  "reg" includes
+ * MOTU_REG_BASE_ADDR.
+ */
+    if (getDeviceGeneration() != MOTU_DEVICE_G2 || m_motu_model == MOTU_MODEL_828MkI)
+        return false;
+    if ((reg & MOTU_REG_BASE_ADDR) != MOTU_REG_BASE_ADDR)
+        return false;
+    reg &= ~MOTU_REG_BASE_ADDR;
+    if (reg & 0x03)
+        return false;
+    if (reg >= MOTU_REG_MIXBUS_CHANNEL0 &&
+        reg < MOTU_REG_MIXBUS_CHANNEL0 + 0x100*MOTUFW_MAX_MIXBUSES &&
+        (reg & 0xff) < 4*MOTUFW_MAX_MIXBUS_CHANNELS)
+        return true;
+    if (reg >= MOTU_REG_MIXBUS0 && reg < MOTU_REG_MIXBUS0 + 4*MOTUFW_MAX_MIXBUSES)
+        return true;
+    return reg==MOTU_REG_MAINOUT_VOL || reg==MOTU_REG_PHONES_VOL;
+}
+
+bool MotuDevice::getStreamControlRegister(fb_nodeaddr_t reg, unsigned int &val) {
+/*
+ * Reconstructs the value of a mixer register from the device control
+ * status in the stream.  Only the fields read by the mixer controls are
+ * filled in.  Returns false if this isn't possible: when not streaming,
+ * when the status isn't complete or when the register has been written
+ * recently.
+ */
+    struct Streaming::MotuDevControls ctrls;
+
+    if (m_receiveProcessor == NULL || !isStreamControlRegister(reg))
+        return false;
+
+    {
+        Util::MutexLockHelper lock(*m_ctrl_write_lock);
+        std::map<fb_nodeaddr_t, ffado_microsecs_t>::iterator it = m_ctrl_write_times.find(reg);
+        if (it != m_ctrl_write_times.end()) {
+            ffado_microsecs_t now = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+            if (now - it->second < MOTU_CTRL_READBACK_HOLDOFF_USECS)
+                return false;
+            m_ctrl_write_times.erase(it);
+        }
+    }
+
+    if (!m_receiveProcessor->getDevControls(ctrls))
+        return false;
+
+    reg &= ~MOTU_REG_BASE_ADDR;
+    if (reg >= MOTU_REG_MIXBUS_CHANNEL0) {
+        /* The channels are sent in the order of their registers */
+        unsigned int bus = (reg - MOTU_REG_MIXBUS_CHANNEL0) >> 8;
+        unsigned int ch = (reg & 0xff) >> 2;
+        if (bus >= ctrls.n_mixbuses || ch >= ctrls.n_channels)
+            return false;
+        val = ctrls.mixbus[bus].channel_gain[ch] |
+              (ctrls.mixbus[bus].channel_pan[ch] << 8);
+        if (ctrls.mixbus[bus].channel_control[ch] & MOTU_CHANNEL_MUTE)
+            val |= MOTU_CTRL_MASK_MUTE_VALUE;
+        if (ctrls.mixbus[bus].channel_control[ch] & MOTU_CHANNEL_SOLO)
+            val |= MOTU_CTRL_MASK_SOLO_VALUE;
+    } else
+    if (reg >= MOTU_REG_MIXBUS0) {
+        unsigned int bus = (reg - MOTU_REG_MIXBUS0) >> 2;
+        if (bus >= ctrls.n_mixbuses)
+            return false;
+        /* Destination in bits 8-11, mute in bit 12 */
+        val = ctrls.mixbus[bus].bus_gain | ((ctrls.mixbus[bus].bus_dest & 0x1f) << 8);
+    } else
+    if (reg == MOTU_REG_MAINOUT_VOL) {
+        val = ctrls.main_out_volume;
+    } else {
+        val = ctrls.phones_volume;
+    }
+    return true;
+}
+
 signed int
 MotuDevice::writeBlock(fb_nodeaddr_t reg, quadlet_t *data, signed int n_quads) {
 //
@@ -36,6 +36,11 @@
 #include "motu_controls.h"
 #include "motu_mark3_controls.h"
 
+#include "libutil/Mutex.h"
+#include "libutil/SystemTimeSource.h"
+
+#include <map>
+
 /* Bitmasks and values used when setting MOTU device registers.  Note that
  * the only "generation 1" device presently supported is the original 828.
  * "Generation 2" devices include the original Traveler, the 828Mk2, the
@@ -98,6 +103,15 @@
 #define MOTU_REG_INPUT_GAIN_PHINV1 0x0c74
 #define MOTU_REG_INPUT_GAIN_PHINV2 0x0c78
 
+/* G2 mixer registers.  The channel registers of mix bus n start at
+ * MOTU_REG_MIXBUS_CHANNEL0 + n*0x100, the mix bus registers are at
+ * MOTU_REG_MIXBUS0 + n*4.
+ */
+#define MOTU_REG_MAINOUT_VOL       0x0c0c
+#define MOTU_REG_PHONES_VOL        0x0c10
+#define MOTU_REG_MIXBUS0           0x0c20
+#define MOTU_REG_MIXBUS_CHANNEL0   0x4000
+
 /* Device register definitions for the earliest generation devices */
 #define MOTU_G1_REG_CONFIG         0x0b00
 #define MOTU_G1_REG_UNKNOWN_1      0x0b04  // Precise function unknown
@@ -460,9 +474,26 @@ public:
     signed int WriteRegister(fb_nodeaddr_t reg, quadlet_t data);
     signed int writeBlock(fb_nodeaddr_t reg, quadlet_t *data, signed int n_quads);
 
+    /**
+     * @brief read a mixer control register
+     *
+     * While streaming, the value is taken from the device control status
+     * received in the iso stream when possible. Otherwise the register
+     * is read from the device.
+     */
+    unsigned int ReadControlRegister(fb_nodeaddr_t reg);
+
 private:
+    bool isStreamControlRegister(fb_nodeaddr_t reg);
+    bool getStreamControlRegister(fb_nodeaddr_t reg, unsigned int &val);
+
     Control::Container *m_MixerContainer;
     Control::Container *m_ControlContainer;
+
+    // the time of the last write to the registers that are also
+    // received in the stream
+    Util::Mutex        *m_ctrl_write_lock;
+    std::map<fb_nodeaddr_t, ffado_microsecs_t> m_ctrl_write_times;
 };
 
 }
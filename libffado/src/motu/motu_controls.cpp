@@ -86,10 +86,9 @@ MotuBinarySwitch::setValue(int v)
       // Set the "write enable" bit for the value being set
       val |= m_setenable_mask;
     } else {
-      // It would be good to utilise the cached value from the receive
-      // processor (if running) later on.  For now we'll just fetch the
-      // current register value directly when needed.
-      val = m_parent.ReadRegister(m_register);
+      // Use the value from the receive processor when streaming, the
+      // current register value otherwise.
+      val = m_parent.ReadControlRegister(m_register);
       if (v==0)
         val &= ~m_value_mask;
       else
@@ -112,7 +111,7 @@ MotuBinarySwitch::getValue()
         return 0;
     }
 
-    val = m_parent.ReadRegister(m_register);
+    val = m_parent.ReadControlRegister(m_register);
     return (val & m_value_mask) != 0;
 }
 
@@ -160,7 +159,7 @@ ChannelFader::getValue()
         return 0;
     }
 
-    val = m_parent.ReadRegister(m_register);
+    val = m_parent.ReadControlRegister(m_register);
     return val & 0xff;
 }
 
@@ -208,7 +207,7 @@ ChannelPan::getValue()
         return 0;
     }
 
-    val = m_parent.ReadRegister(m_register);
+    val = m_parent.ReadControlRegister(m_register);
     return ((val >> 8) & 0xff) - 0x40;
 }
 
@@ -320,7 +319,7 @@ double ChannelFaderMatrixMixer::getValue(const int row, const int col)
         debugOutput(DEBUG_LEVEL_VERBOSE, "ignoring control marked as non-existent\n");
         return 0;
     }
-    val = m_parent.ReadRegister(reg) & 0xff;
+    val = m_parent.ReadControlRegister(reg) & 0xff;
 
     debugOutput(DEBUG_LEVEL_VERBOSE, "ChannelFader getValue for row %d col %d = %u\n",
       row, col, val);
@@ -373,7 +372,7 @@ double ChannelPanMatrixMixer::getValue(const int row, const int col)
         return 0;
     }
 
-    val = m_parent.ReadRegister(reg);
+    val = m_parent.ReadControlRegister(reg);
     val = ((val >> 8) & 0xff) - 0x40;
 
     debugOutput(DEBUG_LEVEL_VERBOSE, "ChannelPan getValue for row %d col %d = %u\n",
@@ -419,10 +418,9 @@ double ChannelBinSwMatrixMixer::setValue(const int row, const int col, const dou
       // Set the "write enable" bit for the value being set
       v |= m_setenable_mask;
     } else {
-      // It would be good to utilise the cached value from the receive
-      // processor (if running) later on.  For now we'll just fetch the
-      // current register value directly when needed.
-      v = m_parent.ReadRegister(reg);
+      // Use the value from the receive processor when streaming, the
+      // current register value otherwise.
+      v = m_parent.ReadControlRegister(reg);
       if (v==0)
         v &= ~m_value_mask;
       else
@@ -444,7 +442,7 @@ double ChannelBinSwMatrixMixer::getValue(const int row, const int col)
         return 0;
     }
 
-    val = m_parent.ReadRegister(reg);
+    val = m_parent.ReadControlRegister(reg);
     val = (val & m_value_mask) != 0;
 
     debugOutput(DEBUG_LEVEL_VERBOSE, "BinSw getValue for row %d col %d = %u\n",
@@ -497,7 +495,7 @@ MixFader::getValue()
         return 0;
     }
 
-    val = m_parent.ReadRegister(m_register);
+    val = m_parent.ReadControlRegister(m_register);
     return val & 0xff;
 }
 
@@ -526,7 +524,7 @@ MixMute::setValue(int v)
 
     // Need to read current destination so we can preserve that when setting
     // mute status (mute and destination are always set together).
-    dest = m_parent.ReadRegister(m_register) & 0x00000f00;
+    dest = m_parent.ReadControlRegister(m_register) & 0x00000f00;
     // Mute status is bit 12
     val = (v==0)?0:0x00001000;
     // Bit 25 indicates that mute and destination are being set.  Also
@@ -549,7 +547,7 @@ MixMute::getValue()
         return 0;
     }
 
-    val = m_parent.ReadRegister(m_register);
+    val = m_parent.ReadControlRegister(m_register);
     return (val & 0x00001000) != 0;
 }
 
@@ -576,7 +574,7 @@ MixDest::setValue(int v)
         return true;
     }
     // Need to get current mute status so we can preserve it
-    mute = m_parent.ReadRegister(m_register) & 0x00001000;
+    mute = m_parent.ReadControlRegister(m_register) & 0x00001000;
     val = v;
     /* Currently destination values between 0 and 0x0b are accepted. 
      * Ultimately this will be device (and device configuration) dependent.
@@ -605,7 +603,7 @@ MixDest::getValue()
         debugOutput(DEBUG_LEVEL_WARNING, "use of MOTU_CTRL_NONE in non-matrix control\n");
         return true;
     }
-    val = m_parent.ReadRegister(m_register);
+    val = m_parent.ReadControlRegister(m_register);
     return (val >> 8) & 0x0f;
 }
 
@@ -146,6 +146,11 @@
 
 #define RME_FF_FLASH_SECTOR_SIZE            256   // In bytes
 #define RME_FF_FLASH_SECTOR_SIZE_QUADS      (RME_FF_FLASH_SECTOR_SIZE/4)
+#define RME_FF400_FLASH_BUFFER_SIZE_QUADS   32
+/* Time a sector write/read may keep the flash busy, and the time after a
+ * command before the busy status can be trusted */
+#define RME_FF_FLASH_BUSY_TIMEOUT_MSECS     125
+#define RME_FF_FLASH_SETTLE_USECS           1000
 #define RME_FF_FLASH_0DB_VOL_VALUE          0x323
 
 /* Defines for components of the control registers */
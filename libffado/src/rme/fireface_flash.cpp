@@ -37,29 +37,11 @@ namespace Rme {
 signed int 
 Device::wait_while_busy(unsigned int init_delay_ms) 
 {
-    signed int i;
-    quadlet_t status;
-
-    // Wait for the device to become available for a new command.  A delay
-    // of init_delay_ms is executed prior to each test of the device status.
-    for (i=0; i<MAX_FLASH_BUSY_RETRIES; i++) {
-        usleep(init_delay_ms*1000);
-        if (m_rme_model == RME_MODEL_FIREFACE400) {
-            status = readRegister(RME_FF400_FLASH_STAT_REG);
-            if (status == 0)
-                break;
-        } else 
-        if (m_rme_model == RME_MODEL_FIREFACE800) {
-            status = readRegister(RME_FF_STATUS_REG1);
-            if (status & 0x40000000)
-                break;
-        } else {
-            debugOutput(DEBUG_LEVEL_ERROR, "unimplemented model %d\n", m_rme_model);
-            return -1;
-        }
-    }
-
-    if (i == MAX_FLASH_BUSY_RETRIES)
+    // Wait for the device to become available for a new command.  The
+    // status is polled at an increasing interval, for at most the time
+    // that MAX_FLASH_BUSY_RETRIES tests spaced init_delay_ms apart would
+    // take.
+    if (!m_flash.waitWhileBusy(init_delay_ms*MAX_FLASH_BUSY_RETRIES))
         return -1;
     return 0;
 }
@@ -90,41 +72,7 @@ Device::read_flash(fb_nodeaddr_t addr, quadlet_t *buf, unsigned int n_quads)
     // hold the result.  Return 0 on success, -1 on error.  The caller must ensure
     // that the flash source address makes sense for the device in use.
 
-    unsigned int xfer_size;
-    unsigned int err = 0;
-    quadlet_t block_desc[2];
-    quadlet_t ff400_addr = (addr & 0xffffffff);
-
-    if (m_rme_model == RME_MODEL_FIREFACE800) {
-        do {
-            xfer_size = (n_quads > RME_FF_FLASH_SECTOR_SIZE_QUADS)?RME_FF_FLASH_SECTOR_SIZE_QUADS:n_quads;
-            err |= readBlock(addr, buf, xfer_size);
-            n_quads -= xfer_size;
-            buf += xfer_size;
-            addr += xfer_size*sizeof(quadlet_t);
-        } while (n_quads>0 && !err);
-    } else {
-        // FF400 case follows
-        do {
-            xfer_size = (n_quads > 32)?32:n_quads;
-            block_desc[0] = ff400_addr;
-            block_desc[1] = xfer_size * sizeof(quadlet_t);
-            // Program the read address and size
-            err |= writeBlock(RME_FF400_FLASH_BLOCK_ADDR_REG, block_desc, 2);
-            // Execute the read and wait for its completion
-            err |= writeRegister(RME_FF400_FLASH_CMD_REG, RME_FF400_FLASH_CMD_READ);
-           if (!err)
-               wait_while_busy(2);
-            // Read from bounce buffer into final destination
-            err |= readBlock(RME_FF400_FLASH_READ_BUFFER, buf, xfer_size);
-
-            n_quads -= xfer_size;
-            ff400_addr += xfer_size*sizeof(quadlet_t);
-            buf += xfer_size;
-        } while (n_quads>0 && !err);
-    }
-
-    return err?-1:0;
+    return m_flash.read(addr, n_quads, buf)?0:-1;
 }
 
 signed int
@@ -187,50 +135,114 @@ Device::write_flash(fb_nodeaddr_t addr, quadlet_t *buf, unsigned int n_quads)
     // addr.  Return 0 on success, -1 on error.  The caller must ensure the
     // supplied address is appropriate for the device in use.
 
-    unsigned int xfer_size;
+    if (!m_flash.write(addr, n_quads, buf)) {
+        debugOutput(DEBUG_LEVEL_WARNING, "flash write failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+// The flash target.  The FF800 maps the flash into its address space, so
+// a sector is written or read directly.  The FF400 transfers the data
+// through a bounce buffer of RME_FF400_FLASH_BUFFER_SIZE_QUADS quadlets,
+// and needs a command to move it between the buffer and the flash.
+
+bool
+Device::FlashTarget::isBusy(bool &busy)
+{
+    quadlet_t status;
+    if (m_parent.m_rme_model == RME_MODEL_FIREFACE400) {
+        status = m_parent.readRegister(RME_FF400_FLASH_STAT_REG);
+        busy = (status != 0);
+    } else
+    if (m_parent.m_rme_model == RME_MODEL_FIREFACE800) {
+        status = m_parent.readRegister(RME_FF_STATUS_REG1);
+        busy = (status & 0x40000000) == 0;
+    } else {
+        debugOutput(DEBUG_LEVEL_ERROR, "unimplemented model %d\n", m_parent.m_rme_model);
+        return false;
+    }
+    return true;
+}
+
+unsigned int
+Device::FlashTarget::getSettleUsecs()
+{
+    return RME_FF_FLASH_SETTLE_USECS;
+}
+
+unsigned int
+Device::FlashTarget::getBlockSizeQuads()
+{
+    if (m_parent.m_rme_model == RME_MODEL_FIREFACE800)
+        return RME_FF_FLASH_SECTOR_SIZE_QUADS;
+    return RME_FF400_FLASH_BUFFER_SIZE_QUADS;
+}
+
+bool
+Device::FlashTarget::startWrite(Util::FlashProgrammer::BlockVector &blocks)
+{
+    // One block at a time: the flash has to finish a sector before it
+    // accepts the next one.
+    Util::FlashProgrammer::sBlock &b = blocks.at(0);
     unsigned int err = 0;
     quadlet_t block_desc[2];
-    quadlet_t ff400_addr = (addr & 0xffffffff);
 
-    if (m_rme_model == RME_MODEL_FIREFACE800) {
-        do {
-            xfer_size = (n_quads > RME_FF_FLASH_SECTOR_SIZE_QUADS)?RME_FF_FLASH_SECTOR_SIZE_QUADS:n_quads;
-            err |= writeBlock(addr, buf, xfer_size);
-            if (!err) {
-                err = wait_while_busy(5) != 0;
-                if (err)
-                    debugOutput(DEBUG_LEVEL_WARNING, "device still busy after flash write\n");
-            } else
-                debugOutput(DEBUG_LEVEL_WARNING, "flash writeBlock() failed\n");
-            n_quads -= xfer_size;
-            buf += xfer_size;
-            addr += xfer_size*sizeof(quadlet_t);
-        } while (n_quads>0 && !err);
-        return err?-1:0;
+    if (m_parent.m_rme_model == RME_MODEL_FIREFACE800) {
+        err |= m_parent.writeBlock(b.address, b.data, b.nb_quads);
+        return err==0;
     }
 
     // FF400 case follows
-    do {
-        xfer_size = (n_quads > 32)?32:n_quads;
-        // Send data to flash buffer
-        err |= writeBlock(RME_FF400_FLASH_WRITE_BUFFER, buf, xfer_size);
-        // Program the destination address and size
-        block_desc[0] = ff400_addr;
-        block_desc[1] = xfer_size * sizeof(quadlet_t);
-        err |= writeBlock(RME_FF400_FLASH_BLOCK_ADDR_REG, block_desc, 2);
-        // Execute the write and wait for its completion
-        err |= writeRegister(RME_FF400_FLASH_CMD_REG, RME_FF400_FLASH_CMD_WRITE);
-        if (!err)
-            wait_while_busy(2);
-
-        n_quads -= xfer_size;
-        ff400_addr += xfer_size*sizeof(quadlet_t);
-        buf += xfer_size;
-    } while (n_quads>0 && !err);
+    // Send data to flash buffer
+    err |= m_parent.writeBlock(RME_FF400_FLASH_WRITE_BUFFER, b.data, b.nb_quads);
+    // Program the destination address and size
+    block_desc[0] = (b.address & 0xffffffff);
+    block_desc[1] = b.nb_quads * sizeof(quadlet_t);
+    err |= m_parent.writeBlock(RME_FF400_FLASH_BLOCK_ADDR_REG, block_desc, 2);
+    // Execute the write, the engine waits for its completion
+    err |= m_parent.writeRegister(RME_FF400_FLASH_CMD_REG, RME_FF400_FLASH_CMD_WRITE);
+    return err==0;
+}
 
-    return err?-1:0;
+bool
+Device::FlashTarget::startRead(Util::FlashProgrammer::BlockVector &blocks)
+{
+    Util::FlashProgrammer::sBlock &b = blocks.at(0);
+    unsigned int err = 0;
+    quadlet_t block_desc[2];
+
+    if (m_parent.m_rme_model == RME_MODEL_FIREFACE800) {
+        err |= m_parent.readBlock(b.address, b.data, b.nb_quads);
+        return err==0;
+    }
+
+    // FF400 case follows
+    // Program the read address and size
+    block_desc[0] = (b.address & 0xffffffff);
+    block_desc[1] = b.nb_quads * sizeof(quadlet_t);
+    err |= m_parent.writeBlock(RME_FF400_FLASH_BLOCK_ADDR_REG, block_desc, 2);
+    // Execute the read, the engine waits for its completion
+    err |= m_parent.writeRegister(RME_FF400_FLASH_CMD_REG, RME_FF400_FLASH_CMD_READ);
+    return err==0;
 }
 
+bool
+Device::FlashTarget::readNeedsBusyWait()
+{
+    return m_parent.m_rme_model != RME_MODEL_FIREFACE800;
+}
+
+bool
+Device::FlashTarget::completeRead(Util::FlashProgrammer::BlockVector &blocks)
+{
+    if (m_parent.m_rme_model == RME_MODEL_FIREFACE800)
+        return true;
+
+    // Read from bounce buffer into final destination
+    Util::FlashProgrammer::sBlock &b = blocks.at(0);
+    return m_parent.readBlock(RME_FF400_FLASH_READ_BUFFER, b.data, b.nb_quads) == 0;
+}
 
 signed int 
 Device::read_device_flash_settings(FF_software_settings_t *dsettings) 
@@ -74,6 +74,8 @@ Device::Device( DeviceManager& d,
     , m_transmitProcessor( NULL )
     , m_MixerContainer( NULL )
     , m_ControlContainer( NULL )
+    , m_flash_target( *this )
+    , m_flash( m_flash_target, RME_FF_FLASH_BUSY_TIMEOUT_MSECS )
 {
     debugOutput( DEBUG_LEVEL_VERBOSE, "Created Rme::Device (NodeID %d)\n",
                  getConfigRom().getNodeId() );
@@ -733,6 +735,7 @@ Device::showDevice()
 
     debugOutput(DEBUG_LEVEL_VERBOSE,
         "%s %s at node %d\n", vme.vendor_name.c_str(), vme.model_name.c_str(), getNodeId());
+    m_flash.show();
 }
 
 bool
@@ -876,7 +879,7 @@ Device::prepare() {
     // handle the bus-level channel/bandwidth allocation so we must do that 
     // here.
     if (iso_tx_channel < 0) {
-        iso_tx_channel = get1394Service().allocateIsoChannelGeneric(bandwidth);
+        iso_tx_channel = get1394Service().allocateIsoChannelGeneric(bandwidth, getNodeId());
     }
     if (iso_tx_channel < 0) {
         debugFatal("Could not allocate iso tx channel\n");
@@ -903,7 +906,7 @@ Device::prepare() {
 
     /* We need to manage the FF400's iso rx channel */
     if (m_rme_model == RME_MODEL_FIREFACE400) {
-        iso_rx_channel = get1394Service().allocateIsoChannelGeneric(bandwidth);
+        iso_rx_channel = get1394Service().allocateIsoChannelGeneric(bandwidth, getNodeId());
     }
 
     // get the device specific and/or global SP configuration
@@ -31,6 +31,7 @@
 #include "libavc/avc_definitions.h"
 
 #include "libutil/Configuration.h"
+#include "libutil/FlashProgrammer.h"
 
 #include "fireface_def.h"
 #include "libstreaming/rme/RmeReceiveStreamProcessor.h"
@@ -276,6 +277,27 @@ private:
 
     Control::Container *m_MixerContainer;
     Control::Container *m_ControlContainer;
+
+    /* Model specific access to the flash for the flash programming engine */
+    class FlashTarget : public Util::FlashProgrammer::Target
+    {
+    public:
+        FlashTarget(Device &parent) : m_parent( parent ) {};
+        virtual ~FlashTarget() {};
+
+        virtual bool isBusy(bool &busy);
+        virtual unsigned int getSettleUsecs();
+        virtual unsigned int getBlockSizeQuads();
+
+        virtual bool startWrite(Util::FlashProgrammer::BlockVector &blocks);
+        virtual bool startRead(Util::FlashProgrammer::BlockVector &blocks);
+        virtual bool readNeedsBusyWait();
+        virtual bool completeRead(Util::FlashProgrammer::BlockVector &blocks);
+    private:
+        Device &m_parent;
+    };
+    FlashTarget m_flash_target;
+    Util::FlashProgrammer m_flash;
 };
 
 }
@@ -30,49 +30,78 @@ DECLARE_GLOBAL_DEBUG_MODULE;
 #include "libutil/SystemTimeSource.h"
 using namespace Util;
 
+#include <string>
+
 extern "C" {
 
 #include "version.h"
 
-#include <byteswap.h>
-#include <sys/shm.h>
 #include <sys/types.h>
-#include <sys/socket.h>
 
 #include <inttypes.h>
-
-#include <pthread.h>
+#include <strings.h>
 
 #include <alsa/asoundlib.h>
 #include <alsa/pcm_external.h>
 
-#define FFADO_PLUGIN_VERSION "0.0.2"
+#define FFADO_PLUGIN_VERSION "0.0.3"
 
-#define PRINT_FUNCTION_ENTRY (printMessage("entering %s\n",__FUNCTION__))
-// #define PRINT_FUNCTION_ENTRY
+// #define PRINT_FUNCTION_ENTRY (printMessage("entering %s\n",__FUNCTION__))
+#define PRINT_FUNCTION_ENTRY
+
+/*
+ * The plugin is a client of an IPC streaming server, e.g. ffado-streamd
+ * or ffado-test-streaming-ipc. One block of the IPC ring buffer is one
+ * period of non-interleaved samples.
+ *
+ * The plugin has no thread of its own. ALSA calls the transfer callback
+ * when the application commits (playback) or asks for (capture) frames,
+ * which copies them between the ALSA buffer and the ring buffer blocks.
+ * The hardware pointer is derived from the ring buffer fill, and the
+ * poll fd of the ring buffer wakes up the application when the server
+ * has consumed or produced a period.
+ *
+ * Example configuration for the "alsa" slot of ffado-streamd:
+ *
+ *   pcm.ffado {
+ *       type ffado
+ *       buffer "ffado-streamd:alsa"   # ":playback"/":capture" is appended
+ *       format float                  # s24 (default) or float
+ *       channels 2
+ *       period 512                    # must match the server
+ *       periods 3                     # must match the server
+ *       rate 48000
+ *   }
+ */
 
 typedef struct {
     snd_pcm_ioplug_t io;
+    // per instance, the transfer callback depends on the direction
+    snd_pcm_ioplug_callback_t callback;
 
-    int fd;
-    int activated;
+    snd_pcm_stream_t stream;
 
-    unsigned int hw_ptr;
-    unsigned int channels;
+    // the ring buffer block we are currently filling/emptying
+    char *block;
+    snd_pcm_uframes_t block_pos;
     snd_pcm_channel_area_t *areas;
 
-    snd_pcm_stream_t stream;
-
-    // thread for polling
-    pthread_t thread;
+    // the number of blocks we released, and the value at
+    // the last prepare. used to calculate the hardware pointer
+    unsigned int blocks_released;
+    unsigned int blocks_base;
 
     // IPC stuff
     Util::IpcRingBuffer* buffer;
 
     // options
     long int verbose;
+    long int channels;
     snd_pcm_uframes_t period;
     long int nb_buffers;
+    long int rate;
+    snd_pcm_format_t format;
+    std::string *buffer_name;
 
 } snd_pcm_ffado_t;
 
@@ -80,285 +109,139 @@ static int snd_pcm_ffado_hw_params(snd_pcm_ioplug_t *io, snd_pcm_hw_params_t *pa
     PRINT_FUNCTION_ENTRY;
     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
 
-    ffado->channels=0;
-    if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
-        // HACK
-        ffado->channels=2;
-    } else {
-        // HACK
-        ffado->channels=2;
+    if (io->period_size != ffado->period) {
+        debugError("Period size %lu does not match the server period (%lu)\n",
+                   (unsigned long)io->period_size, (unsigned long)ffado->period);
+        return -EINVAL;
     }
-
     return 0;
 }
 
-// static snd_pcm_sframes_t snd_pcm_ffado_write(snd_pcm_ioplug_t *io,
-//                    const snd_pcm_channel_area_t *areas,
-//                    snd_pcm_uframes_t offset,
-//                    snd_pcm_uframes_t size)
-// {
-//     PRINT_FUNCTION_ENTRY;
-//     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
-//     IpcRingBuffer::eResult res;
-//     unsigned int i;
-// 
-//     do {
-//         uint32_t *audiobuffers_raw;
-//         res = ffado->buffer->requestBlockForWrite((void**) &audiobuffers_raw); // pointer voodoo
-//         if(res == IpcRingBuffer::eR_OK) {
-//             memset(audiobuffers_raw, 0, ffado->channels * ffado->period * 4);
-//             for (i = 0; i < ffado->channels; i++) {
-//                 uint32_t *alsa_data_ptr = (uint32_t *)((char *)areas[i].addr + (areas[i].step * offset / 8));
-//                 uint32_t *ffado_data_ptr = audiobuffers_raw + i*ffado->period;
-//                 memcpy(ffado_data_ptr, alsa_data_ptr, ffado->period * 4);
-//             }
-//             // release the block
-//             res = ffado->buffer->releaseBlockForWrite();
-//             if(res != IpcRingBuffer::eR_OK) {
-//                 debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error committing memory block\n");
-//                 break;
-//             }
-//         } else if(res != IpcRingBuffer::eR_Again) {
-//             debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error getting memory block\n");
-//         }
-//     } while (res == IpcRingBuffer::eR_Again);
-// 
-//     ffado->hw_ptr += ffado->period;
-//     ffado->hw_ptr %= io->buffer_size;
-// 
-//     if(size != ffado->period) {
-//         debugWarning("size %d, period %d, offset %d\n", size, ffado->period, offset);
-//     } else {
-//         debugOutput(DEBUG_LEVEL_NORMAL, "size %d, period %d, offset %d\n", size, ffado->period, offset);
-//     }
-// 
-//     if(res == IpcRingBuffer::eR_OK) {
-//         return ffado->period;
-//     } else {
-//         debugOutput(DEBUG_LEVEL_NORMAL, "error happened\n");
-//         return -1;
-//     }
-// }
-// 
-// static snd_pcm_sframes_t snd_pcm_ffado_read(snd_pcm_ioplug_t *io,
-//                   const snd_pcm_channel_area_t *areas,
-//                   snd_pcm_uframes_t offset,
-//                   snd_pcm_uframes_t size)
-// {
-//     PRINT_FUNCTION_ENTRY;
-//     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
-//     IpcRingBuffer::eResult res;
-//     unsigned int i;
-// 
-//     do {
-//         uint32_t *audiobuffers_raw;
-//         res = ffado->buffer->requestBlockForRead((void**) &audiobuffers_raw); // pointer voodoo
-//         if(res == IpcRingBuffer::eR_OK) {
-//             for (i = 0; i < ffado->channels; i++) {
-//                 uint32_t *alsa_data_ptr = (uint32_t *)((char *)areas[i].addr + (areas[i].step * offset / 8));
-//                 uint32_t *ffado_data_ptr = audiobuffers_raw + i*ffado->period;
-//                 memcpy(alsa_data_ptr, ffado_data_ptr, ffado->period * 4);
-//             }
-//             // release the block
-//             res = ffado->buffer->releaseBlockForRead();
-//             if(res != IpcRingBuffer::eR_OK) {
-//                 debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error committing memory block\n");
-//                 break;
-//             }
-//         } else if(res != IpcRingBuffer::eR_Again) {
-//             debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error getting memory block\n");
-//         }
-//     } while (res == IpcRingBuffer::eR_Again);
-// 
-//     ffado->hw_ptr += ffado->period;
-//     ffado->hw_ptr %= io->buffer_size;
-// 
-//     if(res == IpcRingBuffer::eR_OK) {
-//         return ffado->period;
-//     } else {
-//         debugOutput(DEBUG_LEVEL_NORMAL, "error happened\n");
-//         return -1;
-//     }
-// }
-
-static int
-snd_pcm_ffado_pollfunction(snd_pcm_ffado_t *ffado)
+/**
+ * sets up ffado->areas to point to the channels in the current block
+ */
+static void
+snd_pcm_ffado_setup_block_areas(snd_pcm_ffado_t *ffado)
 {
+    unsigned int sample_bits = snd_pcm_format_physical_width(ffado->format);
+    for (int channel = 0; channel < ffado->channels; channel++) {
+        ffado->areas[channel].addr = ffado->block + channel * ffado->period * sample_bits / 8;
+        ffado->areas[channel].first = 0;
+        ffado->areas[channel].step = sample_bits;
+    }
+}
 
-//      PRINT_FUNCTION_ENTRY;
-    static char buf[1];
-    snd_pcm_ioplug_t *io = &ffado->io;
-    const snd_pcm_channel_area_t *areas;
-
-    assert(ffado);
-    assert(ffado->buffer);
+static snd_pcm_sframes_t snd_pcm_ffado_write(snd_pcm_ioplug_t *io,
+                   const snd_pcm_channel_area_t *areas,
+                   snd_pcm_uframes_t offset,
+                   snd_pcm_uframes_t size)
+{
+    snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
+    snd_pcm_uframes_t xfer = 0;
+
+    while (xfer < size) {
+        if (ffado->block == NULL) {
+            IpcRingBuffer::eResult res;
+            res = ffado->buffer->requestBlockForWrite((void**) &ffado->block); // pointer voodoo
+            if (res == IpcRingBuffer::eR_Again) {
+                // the server didn't consume enough yet
+                break;
+            } else if (res != IpcRingBuffer::eR_OK) {
+                debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error getting memory block\n");
+                ffado->block = NULL;
+                return -EIO;
+            }
+            ffado->block_pos = 0;
+            snd_pcm_ffado_setup_block_areas(ffado);
+        }
 
-    IpcRingBuffer::eResult res;
-    if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
-        debugOutput(DEBUG_LEVEL_VERBOSE, "PBK: wait\n");
-        res = ffado->buffer->waitForWrite();
-        debugOutput(DEBUG_LEVEL_VERBOSE, "PBK: done, fill: %d\n", ffado->buffer->getBufferFill());
-
-        if(res == IpcRingBuffer::eR_OK) {
-            do {
-                uint32_t *audiobuffers_raw;
-                res = ffado->buffer->requestBlockForWrite((void**) &audiobuffers_raw); // pointer voodoo
-                if(res == IpcRingBuffer::eR_OK) {
-                    // we have the memory block, do the actual transfer
-                    // silence the block
-                    memset(audiobuffers_raw, 0, ffado->channels * ffado->period * 4);
-                    if(io->state == SND_PCM_STATE_RUNNING) {
-                        // get the data address the data comes from
-                        areas = snd_pcm_ioplug_mmap_areas(io);
-
-                        // create the list of areas where the data goes to
-                        unsigned int channel = 0;
-                        for (channel = 0; channel < ffado->channels; channel++) {
-                            uint32_t *target = (audiobuffers_raw + channel*ffado->period);
-                            ffado->areas[channel].addr = target;
-                            ffado->areas[channel].first = 0;
-                            ffado->areas[channel].step = 4*8; // FIXME: hardcoded sample size
-                        }
-                        snd_pcm_uframes_t xfer = 0;
-                        while (xfer < ffado->period) {
-                            snd_pcm_uframes_t frames = ffado->period - xfer;
-                            snd_pcm_uframes_t offset = ffado->hw_ptr;
-                            snd_pcm_uframes_t cont = io->buffer_size - offset;
-
-                            if (cont < frames)
-                                frames = cont;
-
-                            for (channel = 0; channel < ffado->channels; channel++) {
-                                snd_pcm_area_copy(&ffado->areas[channel], xfer, &areas[channel], offset, frames, io->format);
-                            }
-
-                            ffado->hw_ptr += frames;
-                            ffado->hw_ptr %= io->buffer_size;
-                            xfer += frames;
-                        }
-                    }
-                    // release the block
-                    res = ffado->buffer->releaseBlockForWrite();
-                    if(res != IpcRingBuffer::eR_OK) {
-                        debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error committing memory block\n");
-                        break;
-                    }
-                } else if(res != IpcRingBuffer::eR_Again) {
-                    debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error getting memory block\n");
-                }
-                if (res == IpcRingBuffer::eR_Again) {
-                    debugWarning("Again\n");
-                }
-            } while (res == IpcRingBuffer::eR_Again);
-        } else {
-            debugError("Error while waiting\n");
+        snd_pcm_uframes_t frames = ffado->period - ffado->block_pos;
+        if (frames > size - xfer) {
+            frames = size - xfer;
         }
-    } else {
-        res = ffado->buffer->waitForRead();
-        if(res == IpcRingBuffer::eR_OK) {
-            do {
-                uint32_t *audiobuffers_raw;
-                res = ffado->buffer->requestBlockForRead((void**) &audiobuffers_raw); // pointer voodoo
-                if(res == IpcRingBuffer::eR_OK) {
-                    // we have the memory block, do the actual transfer
-                    if(io->state == SND_PCM_STATE_RUNNING) {
-                        // get the data address the data goes to
-                        areas = snd_pcm_ioplug_mmap_areas(io);
-
-                        // create the list of areas where the data comes from
-                        unsigned int channel = 0;
-                        for (channel = 0; channel < io->channels; channel++) {
-                            ffado->areas[channel].addr = audiobuffers_raw + channel*ffado->period;
-                            ffado->areas[channel].first = 0;
-                            ffado->areas[channel].step = 4*8; // FIXME: hardcoded sample size
-                        }
-                        snd_pcm_uframes_t xfer = 0;
-                        while (xfer < ffado->period) {
-                            snd_pcm_uframes_t frames = ffado->period - xfer;
-                            snd_pcm_uframes_t offset = ffado->hw_ptr;
-                            snd_pcm_uframes_t cont = io->buffer_size - offset;
-
-                            if (cont < frames)
-                                frames = cont;
-
-                            for (channel = 0; channel < io->channels; channel++) {
-                                snd_pcm_area_copy(&areas[channel], offset, &ffado->areas[channel], xfer, frames, io->format);
-                            }
-
-                            ffado->hw_ptr += frames;
-                            ffado->hw_ptr %= io->buffer_size;
-                            xfer += frames;
-                        }
-                    }
-                    // release the block
-                    res = ffado->buffer->releaseBlockForRead();
-                    if(res != IpcRingBuffer::eR_OK) {
-                        debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error committing memory block\n");
-                        break;
-                    }
-                } else if(res != IpcRingBuffer::eR_Again) {
-                    debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error getting memory block\n");
-                }
-            } while (res == IpcRingBuffer::eR_Again);
-        } else {
-            debugError("Error while waiting\n");
+        for (int channel = 0; channel < ffado->channels; channel++) {
+            snd_pcm_area_copy(&ffado->areas[channel], ffado->block_pos,
+                              &areas[channel], offset + xfer, frames, io->format);
+        }
+        ffado->block_pos += frames;
+        xfer += frames;
+
+        if (ffado->block_pos == ffado->period) {
+            ffado->block = NULL;
+            if (ffado->buffer->releaseBlockForWrite() != IpcRingBuffer::eR_OK) {
+                debugOutput(DEBUG_LEVEL_NORMAL, "PBK: error committing memory block\n");
+                return -EIO;
+            }
+            ffado->blocks_released++;
         }
     }
-
-    write(ffado->fd, buf, 1); /* for polling */
-
-    if(res == IpcRingBuffer::eR_OK) {
-        return 0;
-    } else {
-        debugOutput(DEBUG_LEVEL_NORMAL, "error happened\n");
-        return -1;
-    }
+    return xfer;
 }
 
-// static int
-// snd_pcm_ffado_pollfunction(snd_pcm_ffado_t *ffado)
-// {
-//     // wait for a period
-//     IpcRingBuffer::eResult res;
-//     if(ffado->stream == SND_PCM_STREAM_PLAYBACK) {
-//         res = ffado->buffer->waitForWrite();
-//     } else {
-//         res = ffado->buffer->waitForRead();
-//     }
-// 
-//     if(res == IpcRingBuffer::eR_OK) {
-//         char buf[1];
-//         write(ffado->fd, buf, 1); /* for polling */
-//         return 0;
-//     } else {
-//         return -1;
-//     }
-// }
-
-static void * ffado_workthread(void *arg)
+static snd_pcm_sframes_t snd_pcm_ffado_read(snd_pcm_ioplug_t *io,
+                  const snd_pcm_channel_area_t *areas,
+                  snd_pcm_uframes_t offset,
+                  snd_pcm_uframes_t size)
 {
-    PRINT_FUNCTION_ENTRY;
-    snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)arg;
-
-    int oldstate;
-
-    pthread_setcancelstate (PTHREAD_CANCEL_DEFERRED, &oldstate);
+    snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
+    snd_pcm_uframes_t xfer = 0;
+
+    while (xfer < size) {
+        if (ffado->block == NULL) {
+            IpcRingBuffer::eResult res;
+            res = ffado->buffer->requestBlockForRead((void**) &ffado->block); // pointer voodoo
+            if (res == IpcRingBuffer::eR_Again) {
+                // the server didn't produce enough yet
+                break;
+            } else if (res != IpcRingBuffer::eR_OK) {
+                debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error getting memory block\n");
+                ffado->block = NULL;
+                return -EIO;
+            }
+            ffado->block_pos = 0;
+            snd_pcm_ffado_setup_block_areas(ffado);
+        }
 
-    while (snd_pcm_ffado_pollfunction(ffado) == 0) {
-        pthread_testcancel();
+        snd_pcm_uframes_t frames = ffado->period - ffado->block_pos;
+        if (frames > size - xfer) {
+            frames = size - xfer;
+        }
+        for (int channel = 0; channel < ffado->channels; channel++) {
+            snd_pcm_area_copy(&areas[channel], offset + xfer,
+                              &ffado->areas[channel], ffado->block_pos, frames, io->format);
+        }
+        ffado->block_pos += frames;
+        xfer += frames;
+
+        if (ffado->block_pos == ffado->period) {
+            ffado->block = NULL;
+            if (ffado->buffer->releaseBlockForRead() != IpcRingBuffer::eR_OK) {
+                debugOutput(DEBUG_LEVEL_NORMAL, "CAP: error committing memory block\n");
+                return -EIO;
+            }
+            ffado->blocks_released++;
+        }
     }
-    return 0;
+    return xfer;
 }
 
 static int snd_pcm_ffado_poll_revents(snd_pcm_ioplug_t *io,
                      struct pollfd *pfds, unsigned int nfds,
                      unsigned short *revents)
 {
-    static char buf[1];
-    PRINT_FUNCTION_ENTRY;
+    snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
     assert(pfds && nfds == 1 && revents);
-    read(pfds[0].fd, buf, 1);
-    *revents = pfds[0].revents;
+
+    ffado->buffer->clearPollFd();
+
+    // only report the fd as ready if there is at least a period
+    // to transfer. the notifications can be stale.
+    unsigned int fill = ffado->buffer->getBufferFill();
+    if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
+        *revents = (fill < (unsigned int)ffado->nb_buffers ? POLLOUT : 0);
+    } else {
+        *revents = (fill > 0 ? POLLIN : 0);
+    }
     return 0;
 }
 
@@ -366,8 +249,9 @@ static void snd_pcm_ffado_free(snd_pcm_ffado_t *ffado)
 {
     PRINT_FUNCTION_ENTRY;
     if (ffado) {
-        if (ffado->fd >= 0) close(ffado->fd);
-        if (ffado->io.poll_fd >= 0) close(ffado->io.poll_fd);
+        // the poll fd is owned by the IPC buffer
+        delete ffado->buffer;
+        delete ffado->buffer_name;
         free(ffado->areas);
         free(ffado);
     }
@@ -378,61 +262,86 @@ static int snd_pcm_ffado_close(snd_pcm_ioplug_t *io)
     PRINT_FUNCTION_ENTRY;
     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
 
-    // cleanup the SHM structures here
-    delete ffado->buffer;
-    ffado->buffer = NULL;
-
     snd_pcm_ffado_free(ffado);
     return 0;
 }
 
 static snd_pcm_sframes_t snd_pcm_ffado_pointer(snd_pcm_ioplug_t *io)
 {
-    PRINT_FUNCTION_ENTRY;
     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
-    return ffado->hw_ptr;
+    unsigned int fill = ffado->buffer->getBufferFill();
+    unsigned int blocks;
+
+    if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
+        // the blocks the server has consumed
+        blocks = ffado->blocks_released - fill - ffado->blocks_base;
+    } else {
+        // the blocks the server has produced
+        blocks = ffado->blocks_released + fill - ffado->blocks_base;
+    }
+    return ((snd_pcm_uframes_t)blocks * ffado->period) % io->buffer_size;
+}
+
+/**
+ * drops the captured data that was not read yet
+ */
+static void snd_pcm_ffado_flush_capture(snd_pcm_ffado_t *ffado)
+{
+    void *block;
+    if (ffado->block) {
+        ffado->block = NULL;
+        ffado->buffer->releaseBlockForRead();
+        ffado->blocks_released++;
+    }
+    while (ffado->buffer->requestBlockForRead(&block) == IpcRingBuffer::eR_OK) {
+        ffado->buffer->releaseBlockForRead();
+        ffado->blocks_released++;
+    }
 }
 
 static int snd_pcm_ffado_start(snd_pcm_ioplug_t *io)
 {
-    int result = 0;
     snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
 
     PRINT_FUNCTION_ENTRY;
 
-    result = pthread_create (&ffado->thread, 0, ffado_workthread, ffado);
-    if(result) return result;
-
-    // FIXME: start the SHM stuff
+    if (ffado->stream == SND_PCM_STREAM_CAPTURE) {
+        // start capturing from now on
+        snd_pcm_ffado_flush_capture(ffado);
+        ffado->blocks_base = ffado->blocks_released;
+    }
     return 0;
 }
 
 static int snd_pcm_ffado_stop(snd_pcm_ioplug_t *io)
 {
-    snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
-
     PRINT_FUNCTION_ENTRY;
-
-    if(pthread_cancel(ffado->thread)) {
-        debugError("could not cancel thread!\n");
-    }
-
-    if(pthread_join(ffado->thread,NULL)) {
-        debugError("could not join thread!\n");
-    }
-
-    // FIXME: stop the SHM client
     return 0;
 } 
 
 static int snd_pcm_ffado_prepare(snd_pcm_ioplug_t *io)
 {
     PRINT_FUNCTION_ENTRY;
+    snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)io->private_data;
+
+    if (ffado->stream == SND_PCM_STREAM_PLAYBACK) {
+        // complete a partially filled block with silence
+        if (ffado->block) {
+            snd_pcm_areas_silence(ffado->areas, ffado->block_pos, ffado->channels,
+                                  ffado->period - ffado->block_pos, ffado->format);
+            ffado->block = NULL;
+            ffado->buffer->releaseBlockForWrite();
+            ffado->blocks_released++;
+        }
+        // what is still in the buffer is played before the new data
+        ffado->blocks_base = ffado->blocks_released - ffado->buffer->getBufferFill();
+    } else {
+        snd_pcm_ffado_flush_capture(ffado);
+        ffado->blocks_base = ffado->blocks_released;
+    }
     return 0;
 }
 
-static snd_pcm_ioplug_callback_t ffado_pcm_callback;
-
 #define ARRAY_SIZE(ary)    (sizeof(ary)/sizeof(ary[0]))
 
 static int ffado_set_hw_constraint(snd_pcm_ffado_t *ffado)
@@ -440,16 +349,16 @@ static int ffado_set_hw_constraint(snd_pcm_ffado_t *ffado)
     PRINT_FUNCTION_ENTRY;
     unsigned int access_list[] = {
         SND_PCM_ACCESS_MMAP_NONINTERLEAVED,
-//         SND_PCM_ACCESS_RW_NONINTERLEAVED,
+        SND_PCM_ACCESS_RW_NONINTERLEAVED,
     };
 
     unsigned int rate_list[1];
-
-    unsigned int format = SND_PCM_FORMAT_S24;
+    unsigned int format = ffado->format;
+    unsigned int period_bytes = ffado->period * ffado->channels
+                                * snd_pcm_format_physical_width(ffado->format) / 8;
     int err;
 
-    // FIXME: make all of the parameters dynamic instead of static
-    rate_list[0] = 48000;
+    rate_list[0] = ffado->rate;
 
     // setup the plugin capabilities
     if ((err = snd_pcm_ioplug_set_param_list(&ffado->io, SND_PCM_IOPLUG_HW_ACCESS,
@@ -461,7 +370,7 @@ static int ffado_set_hw_constraint(snd_pcm_ffado_t *ffado)
         (err = snd_pcm_ioplug_set_param_minmax(&ffado->io, SND_PCM_IOPLUG_HW_CHANNELS,
                            ffado->channels, ffado->channels)) < 0 ||
         (err = snd_pcm_ioplug_set_param_minmax(&ffado->io, SND_PCM_IOPLUG_HW_PERIOD_BYTES,
-                           ffado->period, ffado->period)) < 0 ||
+                           period_bytes, period_bytes)) < 0 ||
         (err = snd_pcm_ioplug_set_param_minmax(&ffado->io, SND_PCM_IOPLUG_HW_PERIODS,
                            ffado->nb_buffers, ffado->nb_buffers)) < 0)
         return err;
@@ -470,52 +379,71 @@ static int ffado_set_hw_constraint(snd_pcm_ffado_t *ffado)
 }
 
 static int snd_pcm_ffado_open(snd_pcm_t **pcmp, const char *name,
-                 snd_pcm_stream_t stream, int mode)
+                 snd_pcm_stream_t stream, int mode,
+                 snd_pcm_ffado_t *ffado)
 {
-
     PRINT_FUNCTION_ENTRY;
-    snd_pcm_ffado_t *ffado;
     int err;
-    int fd[2];
 
     assert(pcmp);
 
-    ffado = (snd_pcm_ffado_t *)calloc(1, sizeof(*ffado));
-    if (!ffado)
-        return -ENOMEM;
-
     ffado->stream=stream;
 
-    // discover the devices to discover the capabilities
-    // get the SHM structure
+    setDebugLevel(ffado->verbose);
 
-    socketpair(AF_LOCAL, SOCK_STREAM, 0, fd);
+    ffado->areas = (snd_pcm_channel_area_t *)calloc(ffado->channels, sizeof(snd_pcm_channel_area_t));
+    if (!ffado->areas) {
+        snd_pcm_ffado_free(ffado);
+        return -ENOMEM;
+    }
 
-    ffado->fd = fd[0];
+    // attach to the IPC buffer of the server
+    unsigned int buffsize = ffado->channels * ffado->period
+                            * snd_pcm_format_physical_width(ffado->format) / 8;
+    ffado->buffer = new IpcRingBuffer(*ffado->buffer_name,
+                          IpcRingBuffer::eBT_Slave,
+                          (stream == SND_PCM_STREAM_PLAYBACK
+                             ? IpcRingBuffer::eD_Outward
+                             : IpcRingBuffer::eD_Inward),
+                          IpcRingBuffer::eB_NonBlocking,
+                          ffado->nb_buffers, buffsize);
+    ffado->buffer->setVerboseLevel(ffado->verbose);
+    if(!ffado->buffer->init()) {
+        debugError("Could not attach to IPC buffer %s\n", ffado->buffer_name->c_str());
+        snd_pcm_ffado_free(ffado);
+        return -ENODEV;
+    }
+
+    int poll_fd = ffado->buffer->getPollFd();
+    if (poll_fd < 0) {
+        snd_pcm_ffado_free(ffado);
+        return -EIO;
+    }
 
     // initialize callback struct
-    ffado_pcm_callback.close = snd_pcm_ffado_close;
-    ffado_pcm_callback.start = snd_pcm_ffado_start;
-    ffado_pcm_callback.stop = snd_pcm_ffado_stop;
-    ffado_pcm_callback.pointer = snd_pcm_ffado_pointer;
-    ffado_pcm_callback.hw_params = snd_pcm_ffado_hw_params;
-    ffado_pcm_callback.prepare = snd_pcm_ffado_prepare;
-    ffado_pcm_callback.poll_revents = snd_pcm_ffado_poll_revents;
-//     if (stream == SND_PCM_STREAM_PLAYBACK) {
-//         ffado_pcm_callback.transfer = snd_pcm_ffado_write;
-//     } else {
-//         ffado_pcm_callback.transfer = snd_pcm_ffado_read;
-//     }
+    ffado->callback.close = snd_pcm_ffado_close;
+    ffado->callback.start = snd_pcm_ffado_start;
+    ffado->callback.stop = snd_pcm_ffado_stop;
+    ffado->callback.pointer = snd_pcm_ffado_pointer;
+    ffado->callback.hw_params = snd_pcm_ffado_hw_params;
+    ffado->callback.prepare = snd_pcm_ffado_prepare;
+    ffado->callback.poll_revents = snd_pcm_ffado_poll_revents;
+    if (stream == SND_PCM_STREAM_PLAYBACK) {
+        ffado->callback.transfer = snd_pcm_ffado_write;
+    } else {
+        ffado->callback.transfer = snd_pcm_ffado_read;
+    }
 
     // prepare io struct
     ffado->io.version = SND_PCM_IOPLUG_VERSION;
     ffado->io.name = "FFADO PCM Plugin";
-    ffado->io.callback = &ffado_pcm_callback;
+    ffado->io.callback = &ffado->callback;
     ffado->io.private_data = ffado;
-//     ffado->io.mmap_rw = 0;
-    ffado->io.mmap_rw = 1;
-    ffado->io.poll_fd = fd[1];
-    ffado->io.poll_events = stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN;
+    // no buffer emulation, the transfer callback copies straight
+    // between the ALSA buffer and the IPC buffer
+    ffado->io.mmap_rw = 0;
+    ffado->io.poll_fd = poll_fd;
+    ffado->io.poll_events = POLLIN;
 
     err = snd_pcm_ioplug_create(&ffado->io, name, stream, mode);
     if (err < 0) {
@@ -530,59 +458,6 @@ static int snd_pcm_ffado_open(snd_pcm_t **pcmp, const char *name,
     }
 
     *pcmp = ffado->io.pcm;
-
-    // these are the params
-    ffado->channels = 2;
-    ffado->period = 1024;
-    ffado->verbose = 6;
-    ffado->nb_buffers = 5;
-
-    setDebugLevel(ffado->verbose);
-
-    ffado->areas = (snd_pcm_channel_area_t *)calloc(ffado->channels, sizeof(snd_pcm_channel_area_t));
-    if (!ffado->areas) {
-        snd_pcm_ffado_free(ffado);
-        return -ENOMEM;
-    }
-
-    // prepare the IPC buffer
-    unsigned int buffsize = ffado->channels * ffado->period * 4;
-    if(stream == SND_PCM_STREAM_PLAYBACK) {
-        ffado->buffer = new IpcRingBuffer("playbackbuffer",
-                              IpcRingBuffer::eBT_Slave,
-                              IpcRingBuffer::eD_Outward,
-                              IpcRingBuffer::eB_Blocking,
-                              ffado->nb_buffers, buffsize);
-        if(ffado->buffer == NULL) {
-            debugError("Could not create playbackbuffer\n");
-            return -1;
-        }
-        if(!ffado->buffer->init()) {
-            debugError("Could not init playbackbuffer\n");
-            delete ffado->buffer;
-            ffado->buffer = NULL;
-            return -1;
-        }
-        ffado->buffer->setVerboseLevel(ffado->verbose);
-    } else {
-        ffado->buffer = new IpcRingBuffer("capturebuffer",
-                              IpcRingBuffer::eBT_Slave,
-                              IpcRingBuffer::eD_Inward,
-                              IpcRingBuffer::eB_Blocking,
-                              ffado->nb_buffers, buffsize);
-        if(ffado->buffer == NULL) {
-            debugError("Could not create capturebuffer\n");
-            return -1;
-        }
-        if(!ffado->buffer->init()) {
-            debugError("Could not init capturebuffer\n");
-            delete ffado->buffer;
-            ffado->buffer = NULL;
-            return -1;
-        }
-        ffado->buffer->setVerboseLevel(ffado->verbose);
-    }
-
     return 0;
 }
 
@@ -592,8 +467,22 @@ SND_PCM_PLUGIN_DEFINE_FUNC(ffado)
         FFADO_PLUGIN_VERSION, __DATE__, __TIME__, PACKAGE_STRING);
 
     snd_config_iterator_t i, next;
+    const char *buffer_name = NULL;
+    const char *format = NULL;
+    long int period = 1024;
     int err;
 
+    snd_pcm_ffado_t *ffado = (snd_pcm_ffado_t *)calloc(1, sizeof(snd_pcm_ffado_t));
+    if (!ffado)
+        return -ENOMEM;
+
+    // these are the defaults, matching ffado-test-streaming-ipc
+    ffado->channels = 2;
+    ffado->verbose = 1;
+    ffado->nb_buffers = 5;
+    ffado->rate = 48000;
+    ffado->format = SND_PCM_FORMAT_S24;
+
     snd_config_for_each(i, next, conf) {
         snd_config_t *n = snd_config_iterator_entry(i);
         const char *id;
@@ -601,12 +490,58 @@ SND_PCM_PLUGIN_DEFINE_FUNC(ffado)
             continue;
         if (strcmp(id, "comment") == 0 || strcmp(id, "type") == 0)
             continue;
+        if (strcmp(id, "buffer") == 0) {
+            err = snd_config_get_string(n, &buffer_name);
+        } else if (strcmp(id, "format") == 0) {
+            err = snd_config_get_string(n, &format);
+        } else if (strcmp(id, "channels") == 0) {
+            err = snd_config_get_integer(n, &ffado->channels);
+        } else if (strcmp(id, "period") == 0) {
+            err = snd_config_get_integer(n, &period);
+        } else if (strcmp(id, "periods") == 0) {
+            err = snd_config_get_integer(n, &ffado->nb_buffers);
+        } else if (strcmp(id, "rate") == 0) {
+            err = snd_config_get_integer(n, &ffado->rate);
+        } else if (strcmp(id, "verbose") == 0) {
+            err = snd_config_get_integer(n, &ffado->verbose);
+        } else {
+            SNDERR("Unknown field %s", id);
+            free(ffado);
+            return -EINVAL;
+        }
+        if (err < 0) {
+            SNDERR("Invalid value for %s", id);
+            free(ffado);
+            return -EINVAL;
+        }
+    }
 
-        SNDERR("Unknown field %s", id);
+    if (format == NULL || strcasecmp(format, "s24") == 0) {
+        ffado->format = SND_PCM_FORMAT_S24;
+    } else if (strcasecmp(format, "float") == 0) {
+        ffado->format = SND_PCM_FORMAT_FLOAT;
+    } else {
+        SNDERR("Unsupported format %s (use s24 or float)", format);
+        free(ffado);
+        return -EINVAL;
+    }
+    if (ffado->channels <= 0 || period <= 0 || ffado->nb_buffers < 2) {
+        SNDERR("Invalid channels/period/periods");
+        free(ffado);
         return -EINVAL;
     }
+    ffado->period = period;
+
+    if (buffer_name) {
+        // e.g. "ffado-streamd:alsa" for the slot "alsa" of ffado-streamd
+        ffado->buffer_name = new std::string(buffer_name);
+        *ffado->buffer_name += (stream == SND_PCM_STREAM_PLAYBACK ? ":playback" : ":capture");
+    } else {
+        ffado->buffer_name = new std::string(stream == SND_PCM_STREAM_PLAYBACK
+                                             ? "playbackbuffer" : "capturebuffer");
+    }
 
-    err = snd_pcm_ffado_open(pcmp, name, stream, mode);
+    err = snd_pcm_ffado_open(pcmp, name, stream, mode, ffado);
 
     return err;
 
@@ -0,0 +1,674 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * ffado-streamd owns the streams of the FFADO devices and shares them
+ * between several client processes.
+ *
+ * Every client gets a slot, defined on the command line with
+ *   --client=name:capture_channels:playback_channels
+ * where the channel lists are comma separated lists of (ranges of)
+ * device audio channels, e.g. "rec:0-7,10:" or "jack:0-17:0-17".
+ *
+ * For each slot two IPC ring buffers are created:
+ *   ffado-streamd:<name>:capture   carries the capture channels to the client
+ *   ffado-streamd:<name>:playback  carries the playback channels from the client
+ * One block of these buffers is one period. It contains the channels in
+ * the order they were specified, each as 'period' float samples.
+ * The client attaches to them as the slave.
+ *
+ * The capture channels are copied to all clients that want them, the
+ * playback channels of all clients are mixed. A client that does not keep
+ * up with the capture data (or that is not running) is detached, i.e. its
+ * capture buffer is reset such that it can (re)attach at any time.
+ */
+
+#include "version.h"
+
+#include "libffado/ffado.h"
+
+#include "debugmodule/debugmodule.h"
+
+#include "libutil/IpcRingBuffer.h"
+
+#include <signal.h>
+#include <sched.h>
+
+#include <argp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+#include <string>
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+using namespace Util;
+
+#define STREAMD_RING_PREFIX     "ffado-streamd:"
+
+int run;
+
+static void sighandler (int sig)
+{
+    run = 0;
+}
+
+// global's
+const char *argp_program_version = PACKAGE_STRING;
+const char *argp_program_bug_address = PACKAGE_BUGREPORT;
+
+// Program documentation.
+static char doc[] = "ffado-streamd -- share the streams of FFADO devices between several processes\n\n"
+                    "The client slots are specified as name:capture_channels:playback_channels,\n"
+                    "e.g. --client=jack:0-17:0-17 --client=rec:0-7: --client=meter:0-17:\n"
+                    ;
+
+// A description of the arguments we accept.
+static char args_doc[] = "[DEVICE...]";
+
+struct arguments
+{
+    long int verbose;
+    long int period;
+    long int slave_mode;
+    long int snoop_mode;
+    long int nb_buffers;
+    long int sample_rate;
+    long int rtprio;
+    std::vector<std::string> *clients;
+    std::vector<char *> *devices;
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",  'v', "level",    0,  "Verbose level" },
+    {"rtprio",  'P', "prio",  0,  "Realtime priority (0 = no RT scheduling)" },
+    {"samplerate",  'r', "hz",  0,  "Sample rate" },
+    {"period",  'p', "frames",  0,  "Period (buffer) size" },
+    {"nb_buffers",  'n', "nb",  0,  "Nb buffers (periods), for the device and the client buffers" },
+    {"slave_mode",  's', "bool",  0,  "Run in slave mode" },
+    {"snoop_mode",  'S', "bool",  0,  "Run in snoop mode" },
+    {"client",  'c', "spec",  0,  "Add a client slot (name:capture_channels:playback_channels)" },
+    { 0 }
+};
+
+//-------------------------------------------------------------
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+
+    errno = 0;
+    switch (key) {
+    case 'v':
+        if (arg) {
+            arguments->verbose = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'verbose' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'P':
+        if (arg) {
+            arguments->rtprio = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'rtprio' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'p':
+        if (arg) {
+            arguments->period = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'period' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'n':
+        if (arg) {
+            arguments->nb_buffers = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'nb_buffers' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'r':
+        if (arg) {
+            arguments->sample_rate = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'samplerate' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 's':
+        if (arg) {
+            arguments->slave_mode = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'slave_mode' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'S':
+        if (arg) {
+            arguments->snoop_mode = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'snoop_mode' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'c':
+        if (arg) {
+            arguments->clients->push_back(arg);
+        }
+        break;
+    case ARGP_KEY_ARG:
+        arguments->devices->push_back(arg);
+        break;
+    case ARGP_KEY_END:
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+int set_realtime_priority(unsigned int prio)
+{
+    debugOutput(DEBUG_LEVEL_NORMAL, "Setting thread prio to %u\n", prio);
+    struct sched_param schp;
+    memset(&schp, 0, sizeof(schp));
+    schp.sched_priority = prio;
+
+    if (sched_setscheduler(0, (prio > 0 ? SCHED_FIFO : SCHED_OTHER), &schp) != 0) {
+        perror("sched_setscheduler");
+        return -1;
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------
+
+struct client {
+    std::string name;
+    // the device audio channels, in the order they appear in a block
+    std::vector<unsigned int> capture;
+    std::vector<unsigned int> playback;
+
+    IpcRingBuffer *capturebuffer;
+    IpcRingBuffer *playbackbuffer;
+
+    // the number of consecutive periods the client didn't make
+    // room in the capture buffer
+    unsigned int capture_stalled;
+    bool capture_attached;
+    bool playback_attached;
+};
+
+/**
+ * parses a channel list like "0-7,10" into chans
+ */
+static bool
+parse_channel_list(std::string list, unsigned int nb_channels,
+                   std::vector<unsigned int> &chans)
+{
+    const char *p = list.c_str();
+    while (*p) {
+        char *tail;
+        errno = 0;
+        unsigned long first = strtoul(p, &tail, 10);
+        if (errno || tail == p) {
+            return false;
+        }
+        unsigned long last = first;
+        p = tail;
+        if (*p == '-') {
+            p++;
+            last = strtoul(p, &tail, 10);
+            if (errno || tail == p || last < first) {
+                return false;
+            }
+            p = tail;
+        }
+        if (last >= nb_channels) {
+            debugError("Channel %lu does not exist (have %u)\n", last, nb_channels);
+            return false;
+        }
+        for (unsigned long ch = first; ch <= last; ch++) {
+            chans.push_back(ch);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * parses a client specification (name:capture_channels:playback_channels)
+ */
+static bool
+parse_client(std::string spec, unsigned int nb_in_channels,
+             unsigned int nb_out_channels, struct client &c)
+{
+    std::string::size_type sep1 = spec.find(':');
+    if (sep1 == std::string::npos) {
+        debugError("Invalid client specification '%s'\n", spec.c_str());
+        return false;
+    }
+    std::string::size_type sep2 = spec.find(':', sep1 + 1);
+    if (sep2 == std::string::npos) {
+        sep2 = spec.size();
+    }
+    c.name = spec.substr(0, sep1);
+    if (c.name.size() == 0 || c.name.find('/') != std::string::npos) {
+        debugError("Invalid client name '%s'\n", c.name.c_str());
+        return false;
+    }
+    if (!parse_channel_list(spec.substr(sep1 + 1, sep2 - sep1 - 1),
+                            nb_in_channels, c.capture)) {
+        debugError("Invalid capture channels for client '%s'\n", c.name.c_str());
+        return false;
+    }
+    if (sep2 < spec.size()
+        && !parse_channel_list(spec.substr(sep2 + 1),
+                               nb_out_channels, c.playback)) {
+        debugError("Invalid playback channels for client '%s'\n", c.name.c_str());
+        return false;
+    }
+    if (c.capture.size() == 0 && c.playback.size() == 0) {
+        debugError("Client '%s' has no channels\n", c.name.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool
+create_client_buffers(struct client &c, unsigned int nb_buffers,
+                      unsigned int period, int verbose)
+{
+    if (c.capture.size()) {
+        c.capturebuffer = new IpcRingBuffer(STREAMD_RING_PREFIX + c.name + ":capture",
+                                IpcRingBuffer::eBT_Master,
+                                IpcRingBuffer::eD_Outward,
+                                IpcRingBuffer::eB_NonBlocking,
+                                nb_buffers,
+                                period * c.capture.size() * sizeof(float));
+        c.capturebuffer->setVerboseLevel(verbose);
+        if (!c.capturebuffer->init()) {
+            debugError("Could not init capture buffer for client '%s'\n", c.name.c_str());
+            return false;
+        }
+    }
+    if (c.playback.size()) {
+        c.playbackbuffer = new IpcRingBuffer(STREAMD_RING_PREFIX + c.name + ":playback",
+                                IpcRingBuffer::eBT_Master,
+                                IpcRingBuffer::eD_Inward,
+                                IpcRingBuffer::eB_NonBlocking,
+                                nb_buffers,
+                                period * c.playback.size() * sizeof(float));
+        c.playbackbuffer->setVerboseLevel(verbose);
+        if (!c.playbackbuffer->init()) {
+            debugError("Could not init playback buffer for client '%s'\n", c.name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * copies the capture channels of one period to the capture buffer of a client
+ */
+static void
+distribute_capture(struct client &c, float **capture,
+                   unsigned int period, unsigned int nb_buffers)
+{
+    float *block;
+    enum IpcRingBuffer::eResult res;
+    res = c.capturebuffer->requestBlockForWrite((void**) &block);
+    if (res == IpcRingBuffer::eR_OK) {
+        for (unsigned int k = 0; k < c.capture.size(); k++) {
+            memcpy(block + k * period, capture[c.capture[k]], period * sizeof(float));
+        }
+        if (c.capturebuffer->releaseBlockForWrite() != IpcRingBuffer::eR_OK) {
+            debugWarning("Could not release capture block for client '%s'\n", c.name.c_str());
+        }
+        if (!c.capture_attached) {
+            debugOutput(DEBUG_LEVEL_NORMAL, "Client '%s' capture attached\n", c.name.c_str());
+            c.capture_attached = true;
+        }
+        c.capture_stalled = 0;
+    } else if (res == IpcRingBuffer::eR_Again) {
+        // the client didn't consume the data in time. if this persists
+        // for longer than the buffer can cover, the client is gone (or
+        // never was there). reset the buffer such that it can (re)attach.
+        if (++c.capture_stalled > nb_buffers) {
+            if (c.capture_attached) {
+                debugOutput(DEBUG_LEVEL_NORMAL, "Client '%s' capture detached\n", c.name.c_str());
+                c.capture_attached = false;
+            }
+            c.capturebuffer->reset();
+            c.capture_stalled = 0;
+        }
+    } else {
+        debugWarning("Could not get capture block for client '%s'\n", c.name.c_str());
+    }
+}
+
+/**
+ * adds the playback data of one period of a client to the playback channels
+ */
+static void
+mix_playback(struct client &c, float **playback, unsigned int period)
+{
+    float *block;
+    enum IpcRingBuffer::eResult res;
+    res = c.playbackbuffer->requestBlockForRead((void**) &block);
+    if (res == IpcRingBuffer::eR_OK) {
+        for (unsigned int k = 0; k < c.playback.size(); k++) {
+            float *src = block + k * period;
+            float *dst = playback[c.playback[k]];
+            for (unsigned int j = 0; j < period; j++) {
+                dst[j] += src[j];
+            }
+        }
+        if (c.playbackbuffer->releaseBlockForRead() != IpcRingBuffer::eR_OK) {
+            debugWarning("Could not release playback block for client '%s'\n", c.name.c_str());
+        }
+        if (!c.playback_attached) {
+            debugOutput(DEBUG_LEVEL_NORMAL, "Client '%s' playback attached\n", c.name.c_str());
+            c.playback_attached = true;
+        }
+    } else if (res == IpcRingBuffer::eR_Again) {
+        // no data from this client, it contributes silence
+        if (c.playback_attached) {
+            debugOutput(DEBUG_LEVEL_VERBOSE, "Client '%s' missed a playback period\n", c.name.c_str());
+        }
+    } else {
+        debugWarning("Could not get playback block for client '%s'\n", c.name.c_str());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct arguments arguments;
+    std::vector<std::string> client_specs;
+    std::vector<char *> device_specs;
+
+    // Default values.
+    arguments.verbose           = 3;
+    arguments.period            = 512;
+    arguments.slave_mode        = 0;
+    arguments.snoop_mode        = 0;
+    arguments.nb_buffers        = 3;
+    arguments.sample_rate       = 48000;
+    arguments.rtprio            = 0;
+    arguments.clients           = &client_specs;
+    arguments.devices           = &device_specs;
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        debugError("Could not parse command line\n" );
+        return -1;
+    }
+
+    setDebugLevel(arguments.verbose);
+
+    if (client_specs.size() == 0) {
+        debugError("No clients specified\n");
+        return -1;
+    }
+
+    run = 1;
+    signal (SIGINT, sighandler);
+    signal (SIGTERM, sighandler);
+    signal (SIGPIPE, SIG_IGN);
+
+    ffado_device_info_t device_info;
+    memset(&device_info, 0, sizeof(ffado_device_info_t));
+    if (device_specs.size()) {
+        device_info.nb_device_spec_strings = device_specs.size();
+        device_info.device_spec_strings = &device_specs[0];
+    }
+
+    ffado_options_t dev_options;
+    memset(&dev_options, 0, sizeof(ffado_options_t));
+
+    dev_options.sample_rate = arguments.sample_rate;
+    dev_options.period_size = arguments.period;
+    dev_options.nb_buffers = arguments.nb_buffers;
+    dev_options.realtime = (arguments.rtprio != 0);
+    dev_options.packetizer_priority = arguments.rtprio;
+    dev_options.verbose = arguments.verbose;
+    dev_options.slave_mode = arguments.slave_mode;
+    dev_options.snoop_mode = arguments.snoop_mode;
+
+    ffado_device_t *dev = ffado_streaming_init(device_info, dev_options);
+    if (!dev) {
+        debugError("Could not init Ffado Streaming layer\n");
+        return -1;
+    }
+    ffado_streaming_set_audio_datatype(dev, ffado_audio_datatype_float);
+
+    unsigned int period = arguments.period;
+    int i;
+
+    // the clients address the audio channels only
+    std::vector<int> capture_streams;
+    std::vector<int> playback_streams;
+    int nb_in_channels_all = ffado_streaming_get_nb_capture_streams(dev);
+    int nb_out_channels_all = ffado_streaming_get_nb_playback_streams(dev);
+    for (i = 0; i < nb_in_channels_all; i++) {
+        if (ffado_streaming_get_capture_stream_type(dev, i) == ffado_stream_type_audio) {
+            capture_streams.push_back(i);
+        }
+    }
+    for (i = 0; i < nb_out_channels_all; i++) {
+        if (ffado_streaming_get_playback_stream_type(dev, i) == ffado_stream_type_audio) {
+            playback_streams.push_back(i);
+        }
+    }
+    unsigned int nb_in_channels = capture_streams.size();
+    unsigned int nb_out_channels = playback_streams.size();
+
+    printMessage("Device channel count: %u capture, %u playback\n",
+                 nb_in_channels, nb_out_channels);
+
+    // set up the client slots
+    std::vector<struct client> clients(client_specs.size());
+    bool ok = true;
+    for (unsigned int c = 0; c < clients.size(); c++) {
+        clients[c].capturebuffer = NULL;
+        clients[c].playbackbuffer = NULL;
+        clients[c].capture_stalled = 0;
+        clients[c].capture_attached = false;
+        clients[c].playback_attached = false;
+        if (!parse_client(client_specs[c], nb_in_channels, nb_out_channels, clients[c])) {
+            ok = false;
+            break;
+        }
+        for (unsigned int d = 0; d < c; d++) {
+            if (clients[d].name == clients[c].name) {
+                debugError("Duplicate client name '%s'\n", clients[c].name.c_str());
+                ok = false;
+            }
+        }
+        if (!ok || !create_client_buffers(clients[c], arguments.nb_buffers,
+                                          period, arguments.verbose)) {
+            ok = false;
+            break;
+        }
+        printMessage(" client '%s': %u capture, %u playback channels\n",
+                     clients[c].name.c_str(),
+                     (unsigned int)clients[c].capture.size(),
+                     (unsigned int)clients[c].playback.size());
+    }
+
+    // the device side buffers, only the channels that
+    // are used by a client are enabled
+    float **capture = (float **)calloc(nb_in_channels + 1, sizeof(float *));
+    float **playback = (float **)calloc(nb_out_channels + 1, sizeof(float *));
+    std::vector<bool> capture_used(nb_in_channels, false);
+    std::vector<bool> playback_used(nb_out_channels, false);
+    float *nullbuffer = (float *)calloc(period, sizeof(float));
+
+    for (unsigned int c = 0; ok && c < clients.size(); c++) {
+        for (unsigned int k = 0; k < clients[c].capture.size(); k++) {
+            capture_used[clients[c].capture[k]] = true;
+        }
+        for (unsigned int k = 0; k < clients[c].playback.size(); k++) {
+            playback_used[clients[c].playback[k]] = true;
+        }
+    }
+    for (i = 0; i < nb_in_channels_all; i++) {
+        ffado_streaming_set_capture_stream_buffer(dev, i, (char *)nullbuffer);
+        ffado_streaming_capture_stream_onoff(dev, i, 0);
+    }
+    for (i = 0; i < nb_out_channels_all; i++) {
+        ffado_streaming_set_playback_stream_buffer(dev, i, (char *)nullbuffer);
+        ffado_streaming_playback_stream_onoff(dev, i, 0);
+    }
+    for (unsigned int ch = 0; ok && ch < nb_in_channels; ch++) {
+        if (capture_used[ch]) {
+            capture[ch] = (float *)calloc(period, sizeof(float));
+            ffado_streaming_set_capture_stream_buffer(dev, capture_streams[ch], (char *)capture[ch]);
+            ffado_streaming_capture_stream_onoff(dev, capture_streams[ch], 1);
+        }
+    }
+    for (unsigned int ch = 0; ok && ch < nb_out_channels; ch++) {
+        if (playback_used[ch]) {
+            playback[ch] = (float *)calloc(period, sizeof(float));
+            ffado_streaming_set_playback_stream_buffer(dev, playback_streams[ch], (char *)playback[ch]);
+            ffado_streaming_playback_stream_onoff(dev, playback_streams[ch], 1);
+        }
+    }
+
+    // give us RT prio
+    if (ok) {
+        set_realtime_priority(arguments.rtprio);
+    }
+
+    // start the streaming layer
+    if (ok && ffado_streaming_prepare(dev)) {
+        debugFatal("Could not prepare streaming system\n");
+        ok = false;
+    }
+    bool started = false;
+    if (ok) {
+        if (ffado_streaming_start(dev)) {
+            debugFatal("Could not start streaming system\n");
+            ok = false;
+        } else {
+            started = true;
+        }
+    }
+
+    if (ok) {
+        printMessage("Streaming server running\n");
+        printMessage("press ctrl-c to stop it & exit\n");
+    }
+
+    while (ok && run) {
+        ffado_wait_response response;
+        response = ffado_streaming_wait(dev);
+        if (response == ffado_wait_xrun) {
+            debugOutput(DEBUG_LEVEL_NORMAL, "Xrun\n");
+            ffado_streaming_reset(dev);
+            continue;
+        } else if (response == ffado_wait_shutdown) {
+            debugOutput(DEBUG_LEVEL_NORMAL, "Streaming shut down\n");
+            break;
+        } else if (response == ffado_wait_error) {
+            debugError("fatal xrun\n");
+            break;
+        }
+
+        // fan out the capture data
+        ffado_streaming_transfer_capture_buffers(dev);
+        for (unsigned int c = 0; c < clients.size(); c++) {
+            if (clients[c].capturebuffer) {
+                distribute_capture(clients[c], capture, period, arguments.nb_buffers);
+            }
+        }
+
+        // mix the playback data
+        for (unsigned int ch = 0; ch < nb_out_channels; ch++) {
+            if (playback[ch]) {
+                memset(playback[ch], 0, period * sizeof(float));
+            }
+        }
+        for (unsigned int c = 0; c < clients.size(); c++) {
+            if (clients[c].playbackbuffer) {
+                mix_playback(clients[c], playback, period);
+            }
+        }
+        ffado_streaming_transfer_playback_buffers(dev);
+    }
+
+    debugOutput(DEBUG_LEVEL_NORMAL, "Exiting streaming loop\n");
+
+    if (started) {
+        ffado_streaming_stop(dev);
+    }
+    ffado_streaming_finish(dev);
+
+    for (unsigned int c = 0; c < clients.size(); c++) {
+        delete clients[c].capturebuffer;
+        delete clients[c].playbackbuffer;
+    }
+    for (unsigned int ch = 0; ch < nb_in_channels; ch++) {
+        free(capture[ch]);
+    }
+    for (unsigned int ch = 0; ch < nb_out_channels; ch++) {
+        free(playback[ch]);
+    }
+    free(capture);
+    free(playback);
+    free(nullbuffer);
+
+    signal (SIGINT, SIG_DFL);
+    signal (SIGTERM, SIG_DFL);
+
+    printMessage("server stopped\n");
+    flushDebugOutput();
+    return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
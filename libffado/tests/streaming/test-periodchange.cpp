@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ * Test application for changing the period size while streaming.
+ *
+ * The client loop copies the capture buffers to the playback buffers,
+ * while a second thread keeps switching the period size between two
+ * values. The test fails if an xrun or an error occurs.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <pthread.h>
+
+#include "libffado/ffado.h"
+
+#include "debugmodule/debugmodule.h"
+
+#include <argp.h>
+
+int run;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+// Program documentation.
+static char doc[] = "FFADO -- a driver for Firewire Audio devices (period size change test application)\n\n"
+                    ;
+
+// A description of the arguments we accept.
+static char args_doc[] = "";
+
+struct arguments
+{
+    long int verbose;
+    long int period;
+    long int period2;
+    long int nb_buffers;
+    long int sample_rate;
+    long int interval;
+    long int count;
+    char* args[2];
+};
+
+// The options we understand.
+static struct argp_option options[] = {
+    {"verbose",  'v', "level",    0,  "Verbose level" },
+    {"samplerate",  'r', "hz",  0,  "Sample rate" },
+    {"period",  'p', "frames",  0,  "Period (buffer) size at start" },
+    {"period2",  'q', "frames",  0,  "Period size to switch to" },
+    {"nb_buffers",  'n', "nb",  0,  "Nb buffers (periods)" },
+    {"interval",  'i', "ms",  0,  "Time between two period size changes" },
+    {"count",  'c', "nb",  0,  "Number of period size changes" },
+    { 0 }
+};
+
+//-------------------------------------------------------------
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+    char* tail;
+    long int *value = NULL;
+
+    switch (key) {
+    case 'v': value = &arguments->verbose; break;
+    case 'r': value = &arguments->sample_rate; break;
+    case 'p': value = &arguments->period; break;
+    case 'q': value = &arguments->period2; break;
+    case 'n': value = &arguments->nb_buffers; break;
+    case 'i': value = &arguments->interval; break;
+    case 'c': value = &arguments->count; break;
+    case ARGP_KEY_ARG:
+        return 0;
+    case ARGP_KEY_END:
+        return 0;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    if (arg) {
+        errno = 0;
+        *value = strtol( arg, &tail, 0 );
+        if ( errno ) {
+            fprintf( stderr,  "Could not parse '%c' argument\n", key );
+            return ARGP_ERR_UNKNOWN;
+        }
+    }
+    return 0;
+}
+
+// Our argp parser.
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+static void sighandler (int sig)
+{
+    run = 0;
+}
+
+struct changer_info {
+    ffado_device_t *dev;
+    struct arguments *arguments;
+    int nb_changes;
+    int nb_failed;
+};
+
+// switches the period size from another thread than the client thread
+static void *changer_thread(void *arg)
+{
+    struct changer_info *info = (struct changer_info *)arg;
+    struct arguments *arguments = info->arguments;
+    long int period = arguments->period;
+
+    while (run && info->nb_changes < arguments->count) {
+        usleep(arguments->interval * 1000);
+        period = (period == arguments->period ? arguments->period2 : arguments->period);
+        debugOutput(DEBUG_LEVEL_NORMAL, "Changing period size to %ld\n", period);
+        if (ffado_streaming_set_period_size(info->dev, period)) {
+            debugError("Could not change the period size to %ld\n", period);
+            info->nb_failed++;
+        }
+        info->nb_changes++;
+    }
+    // let the client loop run for a bit with the last period size
+    usleep(arguments->interval * 1000);
+    run = 0;
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct arguments arguments;
+
+    // Default values.
+    arguments.verbose           = 4;
+    arguments.period            = 256;
+    arguments.period2           = 512;
+    arguments.nb_buffers        = 3;
+    arguments.sample_rate       = 48000;
+    arguments.interval          = 500;
+    arguments.count             = 20;
+
+    // Parse our arguments; every option seen by `parse_opt' will
+    // be reflected in `arguments'.
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        debugError("Could not parse command line\n" );
+        return -1;
+    }
+
+    setDebugLevel(arguments.verbose);
+
+    int nb_in_channels=0, nb_out_channels=0;
+    int min_ch_count=0;
+    int i=0;
+    int nb_periods=0;
+    int nb_xruns=0;
+    int in_error=0;
+    long int max_period = (arguments.period > arguments.period2 ? arguments.period : arguments.period2);
+
+    float **audiobuffers_in;
+    float **audiobuffers_out;
+
+    run=1;
+
+    signal (SIGINT, sighandler);
+    signal (SIGPIPE, sighandler);
+
+    ffado_device_info_t device_info;
+    memset(&device_info,0,sizeof(ffado_device_info_t));
+
+    ffado_options_t dev_options;
+    memset(&dev_options,0,sizeof(ffado_options_t));
+
+    dev_options.sample_rate = arguments.sample_rate;
+    dev_options.period_size = arguments.period;
+    dev_options.nb_buffers = arguments.nb_buffers;
+    dev_options.verbose = arguments.verbose;
+
+    ffado_device_t *dev=ffado_streaming_init(device_info, dev_options);
+    if (!dev) {
+        debugError("Could not init Ffado Streaming layer\n");
+        exit(-1);
+    }
+    ffado_streaming_set_audio_datatype(dev, ffado_audio_datatype_float);
+
+    nb_in_channels = ffado_streaming_get_nb_capture_streams(dev);
+    nb_out_channels = ffado_streaming_get_nb_playback_streams(dev);
+    min_ch_count = (nb_in_channels < nb_out_channels ? nb_in_channels : nb_out_channels);
+
+    // the buffers are sized for the largest period size, the library
+    // only touches the first period frames of them
+    audiobuffers_in = (float **)calloc(nb_in_channels, sizeof(float *));
+    for (i=0; i < nb_in_channels; i++) {
+        audiobuffers_in[i] = (float *)calloc(max_period+1, sizeof(float));
+        ffado_streaming_set_capture_stream_buffer(dev, i, (char *)(audiobuffers_in[i]));
+        ffado_streaming_capture_stream_onoff(dev, i, 1);
+    }
+    audiobuffers_out = (float **)calloc(nb_out_channels, sizeof(float *));
+    for (i=0; i < nb_out_channels; i++) {
+        audiobuffers_out[i] = (float *)calloc(max_period+1, sizeof(float));
+        ffado_streaming_set_playback_stream_buffer(dev, i, (char *)(audiobuffers_out[i]));
+        ffado_streaming_playback_stream_onoff(dev, i, 1);
+    }
+
+    if (ffado_streaming_prepare(dev)) {
+        debugFatal("Could not prepare streaming system\n");
+        ffado_streaming_finish(dev);
+        return -1;
+    }
+    if (ffado_streaming_start(dev)) {
+        debugFatal("Could not start streaming system\n");
+        ffado_streaming_finish(dev);
+        return -1;
+    }
+
+    struct changer_info info;
+    info.dev = dev;
+    info.arguments = &arguments;
+    info.nb_changes = 0;
+    info.nb_failed = 0;
+    pthread_t changer;
+    if (pthread_create(&changer, NULL, changer_thread, &info)) {
+        debugFatal("Could not start the period change thread\n");
+        ffado_streaming_stop(dev);
+        ffado_streaming_finish(dev);
+        return -1;
+    }
+
+    while(run) {
+        ffado_wait_response response;
+        response = ffado_streaming_wait(dev);
+        if (response == ffado_wait_xrun) {
+            debugOutput(DEBUG_LEVEL_NORMAL, "Xrun at period %d\n", nb_periods);
+            nb_xruns++;
+            ffado_streaming_reset(dev);
+            continue;
+        } else if (response == ffado_wait_error) {
+            debugError("fatal xrun\n");
+            in_error = 1;
+            run = 0;
+            break;
+        }
+        ffado_streaming_transfer_capture_buffers(dev);
+        for (i=0; i < min_ch_count; i++) {
+            if (ffado_streaming_get_capture_stream_type(dev,i) == ffado_stream_type_audio
+                && ffado_streaming_get_playback_stream_type(dev,i) == ffado_stream_type_audio) {
+                memcpy((char *)(audiobuffers_out[i]), (char *)(audiobuffers_in[i]), sizeof(float) * max_period);
+            }
+        }
+        ffado_streaming_transfer_playback_buffers(dev);
+        nb_periods++;
+    }
+
+    pthread_join(changer, NULL);
+    ffado_streaming_stop(dev);
+    ffado_streaming_finish(dev);
+
+    for (i=0;i<nb_in_channels;i++) {
+        free(audiobuffers_in[i]);
+    }
+    for (i=0;i<nb_out_channels;i++) {
+        free(audiobuffers_out[i]);
+    }
+    free(audiobuffers_in);
+    free(audiobuffers_out);
+
+    printf("%d periods, %d period size changes (%d failed), %d xruns\n",
+           nb_periods, info.nb_changes, info.nb_failed, nb_xruns);
+    if (in_error || nb_xruns || info.nb_failed) {
+        printf("FAILED\n");
+        return EXIT_FAILURE;
+    }
+    printf("OK\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Feeds the timestamp DLL of a TimestampedBuffer with synthetic
+ * timestamps and checks that the adaptive bandwidth mode narrows the
+ * bandwidth on a stable stream, widens it on a disturbance and narrows
+ * it again once the DLL has re-locked.
+ */
+
+#include "debugmodule/debugmodule.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#include "libutil/TimestampedBuffer.h"
+#include "libieee1394/cycletimer.h"
+
+#include <stdint.h>
+#include <math.h>
+
+using namespace Util;
+
+#define RATE                512.0   // ticks per frame, i.e. 48kHz
+#define FRAMES_PER_PACKET   8
+#define JITTER_TICKS        50      // uniform, peak
+#define STEP_TICKS          1000
+#define MIN_BW_HZ           0.1
+#define MAX_BW_HZ           5.0
+
+class DllTestClient
+    : public TimestampedBufferClient {
+public:
+    bool processReadBlock(char *data, unsigned int nevents, unsigned int offset) {return true;};
+    bool processWriteBlock(char *data, unsigned int nevents, unsigned int offset) {return true;};
+};
+
+// a deterministic noise source, such that every run sees the same jitter
+static uint32_t noise_state = 1;
+
+static int
+jitter() {
+    noise_state = noise_state * 1103515245 + 12345;
+    return (int)((noise_state >> 16) % (2 * JITTER_TICKS + 1)) - JITTER_TICKS;
+}
+
+// the timestamps of an ideal clock, plus jitter and an offset
+static uint64_t time_ideal = 0;
+static int64_t time_offset = 0;
+
+static void
+feed(TimestampedBuffer *t, unsigned int nb_packets) {
+    int frames[FRAMES_PER_PACKET];
+    for (unsigned int i = 0; i < nb_packets; i++) {
+        time_ideal = addTicks(time_ideal, (uint64_t)(RATE * FRAMES_PER_PACKET));
+        uint64_t ts = addTicks(time_ideal, time_offset + jitter());
+        t->writeFrames(FRAMES_PER_PACKET, (char *)frames, ts);
+        t->readFrames(FRAMES_PER_PACKET, (char *)frames);
+    }
+}
+
+static double
+bandwidthHz(TimestampedBuffer *t) {
+    return t->getBandwidth() * TICKS_PER_SECOND;
+}
+
+bool
+testAdaptiveBandwidth(TimestampedBuffer *t) {
+    bool all_ok = true;
+    double bw;
+
+    printMessage( "Checking the adaptive DLL bandwidth...\n");
+
+    t->setBufferTailTimestamp(0);
+    t->setBandwidth(MAX_BW_HZ / TICKS_PER_SECOND);
+    if (!t->setAdaptiveBandwidth(MIN_BW_HZ / TICKS_PER_SECOND, MAX_BW_HZ / TICKS_PER_SECOND)) {
+        printMessage( " could not enable the adaptive bandwidth\n");
+        return false;
+    }
+
+    // a stable stream: the bandwidth goes down to the minimum
+    feed(t, 100000);
+    bw = bandwidthHz(t);
+    if (bw > 2 * MIN_BW_HZ) {
+        printMessage( " bandwidth not narrowed: %f Hz\n", bw);
+        all_ok = false;
+    }
+    double narrow_bw = bw;
+
+    // a step in the timestamps: the bandwidth goes up at once
+    time_offset += STEP_TICKS;
+    feed(t, 10);
+    bw = bandwidthHz(t);
+    if (bw <= 4 * narrow_bw) {
+        printMessage( " bandwidth not widened on a disturbance: %f Hz\n", bw);
+        all_ok = false;
+    }
+
+    // the DLL re-locks and the bandwidth goes down again
+    feed(t, 200000);
+    bw = bandwidthHz(t);
+    if (bw > 2 * MIN_BW_HZ) {
+        printMessage( " bandwidth not narrowed again: %f Hz\n", bw);
+        all_ok = false;
+    }
+    if (fabs(t->getDllError()) > 4 * JITTER_TICKS) {
+        printMessage( " DLL not locked again: error %f ticks\n", t->getDllError());
+        all_ok = false;
+    }
+
+    // disabling keeps the current bandwidth
+    t->setAdaptiveBandwidth(0.0, 0.0);
+    if (t->isBandwidthAdaptive() || bandwidthHz(t) != bw) {
+        printMessage( " bad state after disabling\n");
+        all_ok = false;
+    }
+
+    return all_ok;
+}
+
+int
+main(int argc, char **argv) {
+    bool all_ok = true;
+
+    setDebugLevel(DEBUG_LEVEL_MESSAGE);
+
+    DllTestClient c;
+    TimestampedBuffer t(&c);
+    t.setBufferSize(1024);
+    t.setEventSize(sizeof(int));
+    t.setEventsPerFrame(1);
+    t.setUpdatePeriod(FRAMES_PER_PACKET);
+    t.setNominalRate(RATE);
+    t.setWrapValue(TICKS_PER_SECOND * 128LL);
+    t.prepare();
+    // a transparent buffer resets the DLL on every update
+    t.setTransparent(false);
+
+    all_ok &= testAdaptiveBandwidth(&t);
+
+    if (!all_ok) {
+        printMessage( "Test failed\n");
+        return -1;
+    }
+    printMessage( "All checks passed\n");
+    return 0;
+}
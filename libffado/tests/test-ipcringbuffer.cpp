@@ -24,13 +24,17 @@
 #include "debugmodule/debugmodule.h"
 
 #include "libutil/IpcRingBuffer.h"
+#include "libutil/PosixMessageQueue.h"
 #include "libutil/SystemTimeSource.h"
 
 #include <argp.h>
 #include <stdlib.h>
 #include <iostream>
+#include <cstring>
 #include <signal.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
 
 using namespace Util;
 
@@ -54,6 +58,8 @@ static char doc[] = "test-avccmd -- test program to test the ipc ringbuffer clas
 static char args_doc[] = "DIRECTION";
 static struct argp_option options[] = {
     {"verbose",  'v', "level",    0,  "Produce verbose output" },
+    {"benchmark",  'b', "blocks",    0,  "Measure the per-block latency (DIRECTION not needed)" },
+    {"poll",  'p', 0,    0,  "Test polling on both ends (DIRECTION not needed)" },
    { 0 }
 };
 
@@ -62,6 +68,8 @@ struct arguments
     arguments()
         : nargs ( 0 )
         , verbose( false )
+        , benchmark( 0 )
+        , poll( false )
         {
             args[0] = 0;
         }
@@ -69,6 +77,8 @@ struct arguments
     char* args[MAX_ARGS];
     int   nargs;
     long int verbose;
+    long int benchmark;
+    bool poll;
 } arguments;
 
 // Parse a single option.
@@ -91,6 +101,18 @@ parse_opt( int key, char* arg, struct argp_state* state )
             }
         }
         break;
+    case 'b':
+        if (arg) {
+            arguments->benchmark = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'benchmark' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'p':
+        arguments->poll = true;
+        break;
     case ARGP_KEY_ARG:
         if (state->arg_num >= MAX_ARGS) {
             // Too many arguments.
@@ -100,7 +122,7 @@ parse_opt( int key, char* arg, struct argp_state* state )
         arguments->nargs++;
         break;
     case ARGP_KEY_END:
-        if(arguments->nargs <= 0) {
+        if(arguments->nargs <= 0 && arguments->benchmark <= 0 && !arguments->poll) {
             printMessage("not enough arguments\n");
             return -1;
         }
@@ -113,6 +135,274 @@ parse_opt( int key, char* arg, struct argp_state* state )
 
 static struct argp argp = { options, parse_opt, args_doc, doc };
 
+////////////////////////////////////////////////
+// benchmark
+////////////////////////////////////////////////
+
+#define BENCH_BUFF_SIZE 4096
+#define BENCH_NB_BUFFERS 4
+// the time between two blocks, such that the reader is
+// asleep when the block arrives
+#define BENCH_INTERVAL_USECS 250
+
+static uint64_t
+getTimeNsecs()
+{
+    struct timespec ts;
+    SystemTimeSource::clockGettime(&ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct bench_stats {
+    bench_stats()
+        : count( 0 )
+        , sum( 0 )
+        , min( (uint64_t)-1 )
+        , max( 0 )
+        {};
+
+    void add(uint64_t t) {
+        count++;
+        sum += t;
+        if(t < min) min = t;
+        if(t > max) max = t;
+    };
+    void show(const char *name) {
+        if(count == 0) {
+            printMessage("%s: no blocks received\n", name);
+            return;
+        }
+        printMessage("%s: %u blocks, latency (nsec) avg: %llu, min: %llu, max: %llu\n",
+                     name, count, (unsigned long long)(sum / count),
+                     (unsigned long long)min, (unsigned long long)max);
+    };
+
+    unsigned int count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+};
+
+// a message like the ones the message queue based ringbuffer used
+// to signal one block
+class BenchMessage : public PosixMessageQueue::Message
+{
+public:
+    BenchMessage() : m_stamp( 0 ) {};
+    virtual ~BenchMessage() {};
+
+    virtual unsigned getPriority() {return 0;};
+    virtual unsigned int getLength() {return sizeof(m_stamp);};
+    virtual bool serialize(char *buff) {
+        memcpy(buff, &m_stamp, sizeof(m_stamp));
+        return true;
+    };
+    virtual bool deserialize(const char *buff, unsigned int length, unsigned prio) {
+        if(length != sizeof(m_stamp)) return false;
+        memcpy(&m_stamp, buff, sizeof(m_stamp));
+        return true;
+    };
+
+    uint64_t m_stamp;
+};
+
+// the child process writes timestamped blocks, the parent reads
+// them and measures the time it took for the block to arrive.
+static bool
+benchmarkRingBuffer(unsigned int nb_blocks)
+{
+    IpcRingBuffer* b = new IpcRingBuffer("testbench",
+                                         IpcRingBuffer::eBT_Master,
+                                         IpcRingBuffer::eD_Inward,
+                                         IpcRingBuffer::eB_Blocking,
+                                         BENCH_NB_BUFFERS, BENCH_BUFF_SIZE);
+    if(!b->init()) {
+        debugError("Could not init buffer\n");
+        delete b;
+        return false;
+    }
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        debugError("Could not fork\n");
+        delete b;
+        return false;
+    }
+    if(pid == 0) {
+        IpcRingBuffer* w = new IpcRingBuffer("testbench",
+                                             IpcRingBuffer::eBT_Slave,
+                                             IpcRingBuffer::eD_Outward,
+                                             IpcRingBuffer::eB_Blocking,
+                                             BENCH_NB_BUFFERS, BENCH_BUFF_SIZE);
+        if(!w->init()) {
+            _exit(-1);
+        }
+        for(unsigned int i = 0; i < nb_blocks; i++) {
+            void *block;
+            if(w->requestBlockForWrite(&block) != IpcRingBuffer::eR_OK) {
+                _exit(-1);
+            }
+            uint64_t stamp = getTimeNsecs();
+            memcpy(block, &stamp, sizeof(stamp));
+            w->releaseBlockForWrite();
+            usleep(BENCH_INTERVAL_USECS);
+        }
+        delete w;
+        _exit(0);
+    }
+
+    bench_stats stats;
+    for(unsigned int i = 0; i < nb_blocks && run; i++) {
+        void *block;
+        if(b->requestBlockForRead(&block) != IpcRingBuffer::eR_OK) {
+            debugError("Could not read block %u\n", i);
+            break;
+        }
+        uint64_t stamp;
+        memcpy(&stamp, block, sizeof(stamp));
+        stats.add(getTimeNsecs() - stamp);
+        b->releaseBlockForRead();
+    }
+    waitpid(pid, NULL, 0);
+    delete b;
+
+    stats.show("IpcRingBuffer ");
+    return stats.count == nb_blocks;
+}
+
+// the same, but signalling every block with a ping/pong message pair,
+// as the message queue based ringbuffer did
+static bool
+benchmarkMessageQueue(unsigned int nb_blocks)
+{
+    PosixMessageQueue ping("testbench:ping");
+    PosixMessageQueue pong("testbench:pong");
+    if(!ping.Create(PosixMessageQueue::eD_ReadOnly)
+       || !pong.Create(PosixMessageQueue::eD_WriteOnly)) {
+        debugError("Could not create message queues\n");
+        return false;
+    }
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        debugError("Could not fork\n");
+        return false;
+    }
+    if(pid == 0) {
+        PosixMessageQueue cping("testbench:ping");
+        PosixMessageQueue cpong("testbench:pong");
+        if(!cping.Open(PosixMessageQueue::eD_WriteOnly)
+           || !cpong.Open(PosixMessageQueue::eD_ReadOnly)) {
+            _exit(-1);
+        }
+        BenchMessage m;
+        for(unsigned int i = 0; i < nb_blocks; i++) {
+            m.m_stamp = getTimeNsecs();
+            if(cping.Send(m) != PosixMessageQueue::eR_OK
+               || cpong.Receive(m) != PosixMessageQueue::eR_OK) {
+                _exit(-1);
+            }
+            usleep(BENCH_INTERVAL_USECS);
+        }
+        _exit(0);
+    }
+
+    bench_stats stats;
+    BenchMessage m;
+    for(unsigned int i = 0; i < nb_blocks && run; i++) {
+        if(ping.Receive(m) != PosixMessageQueue::eR_OK) {
+            debugError("Could not receive message %u\n", i);
+            break;
+        }
+        stats.add(getTimeNsecs() - m.m_stamp);
+        if(pong.Send(m) != PosixMessageQueue::eR_OK) {
+            debugError("Could not send ack %u\n", i);
+            break;
+        }
+    }
+    waitpid(pid, NULL, 0);
+
+    stats.show("PosixMessageQueue");
+    return stats.count == nb_blocks;
+}
+
+// true if the fd becomes readable within the timeout
+static bool
+isReadable(int fd, int timeout_msecs)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, timeout_msecs) == 1 && (pfd.revents & POLLIN);
+}
+
+// both ends poll at the same time, each is woken by the other one
+static bool
+testPollFds()
+{
+    bool ok = false;
+    IpcRingBuffer* w = new IpcRingBuffer("testpoll",
+                                         IpcRingBuffer::eBT_Master,
+                                         IpcRingBuffer::eD_Outward,
+                                         IpcRingBuffer::eB_NonBlocking,
+                                         BENCH_NB_BUFFERS, BENCH_BUFF_SIZE);
+    IpcRingBuffer* r = new IpcRingBuffer("testpoll",
+                                         IpcRingBuffer::eBT_Slave,
+                                         IpcRingBuffer::eD_Inward,
+                                         IpcRingBuffer::eB_NonBlocking,
+                                         BENCH_NB_BUFFERS, BENCH_BUFF_SIZE);
+    void *block;
+    int wfd, rfd;
+    if(!w->init() || !r->init()) {
+        debugError("Could not init buffers\n");
+        goto out;
+    }
+    wfd = w->getPollFd();
+    rfd = r->getPollFd();
+    if(wfd < 0 || rfd < 0) {
+        debugError("Could not get the poll fds\n");
+        goto out;
+    }
+    w->clearPollFd();
+    r->clearPollFd();
+
+    if(w->requestBlockForWrite(&block) != IpcRingBuffer::eR_OK) {
+        debugError("Could not write\n");
+        goto out;
+    }
+    w->releaseBlockForWrite();
+    if(!isReadable(rfd, 1000)) {
+        debugError("Reader not woken by the writer\n");
+        goto out;
+    }
+    if(isReadable(wfd, 0)) {
+        debugError("Writer woken by itself\n");
+        goto out;
+    }
+    r->clearPollFd();
+
+    if(r->requestBlockForRead(&block) != IpcRingBuffer::eR_OK) {
+        debugError("Could not read\n");
+        goto out;
+    }
+    r->releaseBlockForRead();
+    if(!isReadable(wfd, 1000)) {
+        debugError("Writer not woken by the reader\n");
+        goto out;
+    }
+    if(isReadable(rfd, 0)) {
+        debugError("Reader woken by itself\n");
+        goto out;
+    }
+    ok = true;
+out:
+    delete r;
+    delete w;
+    printMessage("Poll test %s\n", (ok ? "passed" : "failed"));
+    return ok;
+}
+
 ///////////////////////////
 // main
 //////////////////////////
@@ -130,6 +420,17 @@ main(int argc, char **argv)
 
     setDebugLevel(arguments.verbose);
 
+    if(arguments.poll) {
+        return (testPollFds() ? 0 : -1);
+    }
+
+    if(arguments.benchmark > 0) {
+        printMessage("Benchmarking %ld blocks\n", arguments.benchmark);
+        bool ok = benchmarkRingBuffer(arguments.benchmark);
+        ok = benchmarkMessageQueue(arguments.benchmark) && ok;
+        return (ok ? 0 : -1);
+    }
+
     errno = 0;
     char* tail;
     long int direction = strtol( arguments.args[0], &tail, 0 );
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "debugmodule/debugmodule.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#include "libstreaming/generic/MidiScheduler.h"
+
+using namespace Streaming;
+
+static bool
+check(bool cond, const char *what) {
+    if (!cond) {
+        printMessage( " bad result: %s\n", what);
+    }
+    return cond;
+}
+
+static bool
+checkByte(MidiScheduler &s, unsigned int frame, uint32_t expected, const char *what) {
+    uint32_t data = 0;
+    if (!s.get(frame, data) || data != (0x01000000 | expected)) {
+        printMessage( " bad result: %s: %08X at frame %u, should be %08X\n",
+                      what, data, frame, 0x01000000 | expected);
+        return false;
+    }
+    return true;
+}
+
+// a byte comes out at the first frame that is at or after its own frame
+bool
+testPlacement() {
+    MidiScheduler s;
+    uint32_t data = 0;
+    bool all_ok = true;
+
+    printMessage( "Checking the placement...\n");
+    all_ok &= check(s.put(0x01000090, 3), "put");
+    all_ok &= check(s.getFill() == 1, "fill after put");
+    all_ok &= check(!s.get(0, data), "byte before its frame");
+    all_ok &= check(!s.get(2, data), "byte before its frame");
+    all_ok &= checkByte(s, 3, 0x90, "byte at its frame");
+    all_ok &= check(s.getFill() == 0, "fill after get");
+    all_ok &= check(!s.get(4, data), "empty queue");
+    return all_ok;
+}
+
+// bytes that aren't due in this block are carried over to the next one
+bool
+testBlocks() {
+    MidiScheduler s;
+    uint32_t data = 0;
+    bool all_ok = true;
+
+    printMessage( "Checking the carry-over between blocks...\n");
+    all_ok &= check(s.put(0x01000040, 7), "put");
+    all_ok &= check(!s.get(0, data), "byte before its frame");
+    s.advance(8);
+    // frame 7 of the previous block is frame -1 of this one
+    all_ok &= checkByte(s, 0, 0x40, "byte of the previous block");
+
+    // only AMDTP slot positions are asked for, the byte waits for the next
+    all_ok &= check(s.put(0x01000041, 1), "put");
+    all_ok &= check(!s.get(0, data), "byte before its frame");
+    all_ok &= checkByte(s, 8, 0x41, "byte at the next slot");
+    return all_ok;
+}
+
+// the spacing limits the rate, the order is kept
+bool
+testSpacing() {
+    MidiScheduler s;
+    uint32_t data = 0;
+    bool all_ok = true;
+
+    printMessage( "Checking the rate limit...\n");
+    s.setRateLimit(48000);
+    all_ok &= check(s.getSpacing() == 16, "spacing at 48kHz");
+
+    for (unsigned int i = 0; i < 3; i++) {
+        all_ok &= check(s.put(0x01000010 + i, 0), "put");
+    }
+    all_ok &= checkByte(s, 0, 0x10, "first byte");
+    all_ok &= check(!s.get(8, data), "byte within the spacing");
+    all_ok &= checkByte(s, 16, 0x11, "second byte");
+    all_ok &= check(!s.get(24, data), "byte within the spacing");
+    s.advance(32);
+    all_ok &= checkByte(s, 0, 0x12, "third byte");
+
+    s.setSpacing(0);
+    all_ok &= check(s.getSpacing() == 1, "minimum spacing");
+    return all_ok;
+}
+
+// a full queue drops whole messages
+bool
+testOverflow() {
+    MidiScheduler s;
+    uint32_t data = 0;
+    bool all_ok = true;
+    unsigned int i;
+
+    printMessage( "Checking the overflow handling...\n");
+
+    // fill the queue with note-on messages, up to 2 free places
+    for (i = 0; i < (MIDI_SCHEDULER_SIZE - 3) / 3; i++) {
+        s.put(0x90, 0);
+        s.put(0x40, 0);
+        s.put(0x7F, 0);
+    }
+    while (s.getFill() < MIDI_SCHEDULER_SIZE - 3) {
+        s.put(0xFE, 0);
+    }
+    unsigned int fill = s.getFill();
+    all_ok &= check(s.getOverflowCount() == 0, "overflows before overflow");
+    all_ok &= check(!s.isNewOverflow(), "no overflow reported");
+
+    // this message doesn't fit, none of it is queued
+    all_ok &= check(s.put(0x80, 0), "status byte of the message that doesn't fit");
+    all_ok &= check(s.put(0x41, 0), "first data byte of the message that doesn't fit");
+    all_ok &= check(!s.put(0x00, 0), "last data byte of the message that doesn't fit");
+    all_ok &= check(s.getFill() == fill, "fill after dropping the message");
+    all_ok &= check(s.getOverflowCount() == 3, "overflows after dropping the message");
+    all_ok &= check(s.isNewOverflow(), "overflow reported");
+    all_ok &= check(!s.isNewOverflow(), "overflow reported only once");
+
+    // running status bytes of the dropped message are refused
+    all_ok &= check(!s.put(0x42, 0), "running status byte after the overflow");
+    all_ok &= check(s.getOverflowCount() == 4, "overflows after running status");
+
+    // a real-time byte fits in
+    all_ok &= check(s.put(0xF8, 0), "real-time byte");
+    all_ok &= check(s.getFill() == fill + 1, "fill after real-time byte");
+
+    // the queue still starts with complete messages
+    all_ok &= checkByte(s, 0, 0x90, "status byte");
+    all_ok &= checkByte(s, 1, 0x40, "first data byte");
+    all_ok &= checkByte(s, 2, 0x7F, "second data byte");
+
+    // the next message is taken once there is room again
+    all_ok &= check(s.put(0x80, 0), "status byte after overflow");
+    all_ok &= check(s.put(0x43, 0), "data byte after overflow");
+    all_ok &= check(s.put(0x00, 0), "data byte after overflow");
+
+    // a message whose start was handed out can only lose its end
+    s.reset();
+    for (i = 0; i < MIDI_SCHEDULER_SIZE - 1; i++) {
+        s.put(i == 0 ? 0xF0 : 0x01, 0);
+    }
+    all_ok &= checkByte(s, 0, 0xF0, "sysex start");
+    all_ok &= check(s.put(0x02, 0), "sysex byte");
+    all_ok &= check(!s.put(0x03, 0), "sysex byte that doesn't fit");
+    all_ok &= check(!s.put(0xF7, 0), "sysex end after overflow");
+    all_ok &= check(s.getFill() == MIDI_SCHEDULER_SIZE - 1, "fill after the sysex overflow");
+    all_ok &= check(s.getOverflowCount() == 2, "overflows after the sysex overflow");
+
+    s.reset();
+    all_ok &= check(s.getFill() == 0, "fill after reset");
+    all_ok &= check(s.getOverflowCount() == 0, "overflows after reset");
+    all_ok &= check(!s.get(0, data), "empty queue after reset");
+    return all_ok;
+}
+
+// the frame counter wraps around
+bool
+testWrap() {
+    MidiScheduler s;
+    uint32_t data = 0;
+    bool all_ok = true;
+
+    printMessage( "Checking the frame counter wrap-around...\n");
+    s.advance(0xFFFFFFF0);
+    all_ok &= check(s.put(0x01000055, 0x20), "put");
+    all_ok &= check(!s.get(0x10, data), "byte before its frame");
+    s.advance(0x10);
+    all_ok &= check(!s.get(0x0F, data), "byte before its frame");
+    all_ok &= checkByte(s, 0x10, 0x55, "byte after the wrap-around");
+    return all_ok;
+}
+
+int
+main(int argc, char **argv) {
+    bool all_ok = true;
+
+    setDebugLevel(DEBUG_LEVEL_MESSAGE);
+
+    all_ok &= testPlacement();
+    all_ok &= testBlocks();
+    all_ok &= testSpacing();
+    all_ok &= testOverflow();
+    all_ok &= testWrap();
+
+    if (!all_ok) {
+        printMessage( "Test failed\n");
+        return -1;
+    }
+    printMessage( "All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "debugmodule/debugmodule.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#include "libieee1394/ieee1394service.h"
+
+#include <map>
+#include <set>
+
+typedef std::map<fb_nodeid_t, fb_nodeid_t> NodeMap;
+typedef std::set<fb_nodeid_t> NodeSet;
+
+static bool
+checkMapping(const NodeMap &m, fb_nodeid_t node, fb_nodeid_t expected) {
+    fb_nodeid_t result = Ieee1394Service::mapNodeId(m, node);
+    if (result != expected) {
+        printMessage( " bad mapping: %04X maps to %04X, should be %04X\n",
+                      node, result, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool
+checkSurvived(const NodeMap &m, const NodeSet &failed, fb_nodeid_t node, bool expected) {
+    bool result = Ieee1394Service::isoChannelsSurvived(m, failed, node);
+    if (result != expected) {
+        printMessage( " bad result: node %04X %s its channels, should %s\n",
+                      node, result ? "kept" : "lost", expected ? "keep" : "lose");
+        return false;
+    }
+    return true;
+}
+
+bool
+testMapNodeId() {
+    bool all_ok = true;
+    NodeMap m;
+
+    printMessage( "Checking node id mapping...\n");
+
+    // nodes that are not in the map keep their id
+    m[1] = 2;
+    all_ok &= checkMapping(m, 0xFFC0, 0xFFC0);
+    all_ok &= checkMapping(m, 0xFFC3, 0xFFC3);
+    all_ok &= checkMapping(m, 0x0003, 0x0003);
+
+    // a node that moved gets its new id, the bus id is kept
+    m[2] = 1;
+    all_ok &= checkMapping(m, 0xFFC1, 0xFFC2);
+    all_ok &= checkMapping(m, 0xFFC2, 0xFFC1);
+    all_ok &= checkMapping(m, 0x0041, 0x0042);
+    all_ok &= checkMapping(m, 0x0001, 0x0002);
+
+    // a node that kept its id can be in the map too
+    m[4] = 4;
+    all_ok &= checkMapping(m, 0xFFC4, 0xFFC4);
+
+    // a node that left the bus maps to INVALID_NODE_ID
+    m[1] = INVALID_NODE_ID;
+    all_ok &= checkMapping(m, 0xFFC1, INVALID_NODE_ID);
+    all_ok &= checkMapping(m, 0x0001, INVALID_NODE_ID);
+    all_ok &= checkMapping(m, 0xFFC2, 0xFFC1);
+
+    return all_ok;
+}
+
+bool
+testChannelsSurvived() {
+    bool all_ok = true;
+    NodeMap m;
+    NodeSet failed;
+
+    printMessage( "Checking which devices keep their iso channels...\n");
+
+    // node 1 moved to 2, node 2 left the bus, node 3 kept its id
+    m[1] = 2;
+    m[2] = INVALID_NODE_ID;
+    m[3] = 3;
+
+    // nothing failed: only the departed node is removed
+    all_ok &= checkSurvived(m, failed, 1, true);
+    all_ok &= checkSurvived(m, failed, 2, false);
+    all_ok &= checkSurvived(m, failed, 3, true);
+    all_ok &= checkSurvived(m, failed, 0xFFC1, true);
+
+    // a failed node doesn't affect the others, the failed node id is
+    // the one from before the bus reset
+    failed.insert(1);
+    all_ok &= checkSurvived(m, failed, 1, false);
+    all_ok &= checkSurvived(m, failed, 0xFFC1, false);
+    all_ok &= checkSurvived(m, failed, 3, true);
+
+    // a lost channel of unknown use affects everyone
+    failed.insert(INVALID_NODE_ID);
+    all_ok &= checkSurvived(m, failed, 3, false);
+
+    return all_ok;
+}
+
+int
+main(int argc, char **argv) {
+    bool all_ok = true;
+
+    setDebugLevel(DEBUG_LEVEL_MESSAGE);
+
+    all_ok &= testMapNodeId();
+    all_ok &= testChannelsSurvived();
+
+    if (!all_ok) {
+        printMessage( "Test failed\n");
+        return -1;
+    }
+    printMessage( "All checks passed\n");
+    return 0;
+}
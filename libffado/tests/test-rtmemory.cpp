@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "debugmodule/debugmodule.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#include "config.h"
+
+#include "libutil/RtMemory.h"
+
+#include <string.h>
+#include <stdint.h>
+
+using namespace Util;
+
+static bool
+isZero(char *p, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (p[i]) return false;
+    }
+    return true;
+}
+
+// the blocks come one after the other out of the first chunk, aligned
+// to a cache line and zeroed
+bool
+testAllocate() {
+    bool all_ok = true;
+
+    printMessage( "Checking allocation...\n");
+    char *a = (char *)RtMemory::allocate(100);
+    char *b = (char *)RtMemory::allocate(64);
+    char *c = (char *)RtMemory::allocate(1);
+    if (a == NULL || b == NULL || c == NULL) {
+        printMessage( " allocation failed\n");
+        return false;
+    }
+    if (((uintptr_t)a & 63) != 0) {
+        printMessage( " bad alignment: %p\n", a);
+        all_ok = false;
+    }
+    if (b != a + 128 || c != b + 64) {
+        printMessage( " bad layout: %p %p %p\n", a, b, c);
+        all_ok = false;
+    }
+    if (!isZero(a, 100) || !isZero(b, 64)) {
+        printMessage( " blocks not zeroed\n");
+        all_ok = false;
+    }
+    memset(a, 0xAA, 128);
+    memset(b, 0xBB, 64);
+    memset(c, 0xCC, 64);
+    RtMemory::release(c);
+    RtMemory::release(b);
+    RtMemory::release(a);
+    return all_ok;
+}
+
+// a released block is used again by the next allocation that fits,
+// and it is zeroed again
+bool
+testReuse() {
+    bool all_ok = true;
+
+    printMessage( "Checking reuse of released blocks...\n");
+    char *a = (char *)RtMemory::allocate(256);
+    char *b = (char *)RtMemory::allocate(256);
+    memset(a, 0x55, 256);
+    RtMemory::release(a);
+    char *c = (char *)RtMemory::allocate(128);
+    if (c != a) {
+        printMessage( " released block not reused: %p should be %p\n", c, a);
+        all_ok = false;
+    } else if (!isZero(c, 128)) {
+        printMessage( " reused block not zeroed\n");
+        all_ok = false;
+    }
+    // the rest of the released block comes next
+    char *d = (char *)RtMemory::allocate(128);
+    if (d != a + 128) {
+        printMessage( " rest of the released block not used: %p should be %p\n", d, a + 128);
+        all_ok = false;
+    }
+    RtMemory::release(b);
+    RtMemory::release(c);
+    RtMemory::release(d);
+    return all_ok;
+}
+
+// released neighbours are merged, in both directions
+bool
+testMerge() {
+    bool all_ok = true;
+
+    printMessage( "Checking merging of released blocks...\n");
+    char *a = (char *)RtMemory::allocate(128);
+    char *b = (char *)RtMemory::allocate(128);
+    char *c = (char *)RtMemory::allocate(128);
+    char *d = (char *)RtMemory::allocate(128);
+    if (b != a + 128 || c != b + 128 || d != c + 128) {
+        printMessage( " bad layout: %p %p %p %p\n", a, b, c, d);
+        all_ok = false;
+    }
+
+    // merge with the next free block
+    RtMemory::release(b);
+    RtMemory::release(a);
+    char *e = (char *)RtMemory::allocate(256);
+    if (e != a) {
+        printMessage( " not merged with the next block: %p should be %p\n", e, a);
+        all_ok = false;
+    }
+    RtMemory::release(e);
+
+    // merge with the previous free block, and with both
+    RtMemory::release(c);
+    char *f = (char *)RtMemory::allocate(384);
+    if (f != a) {
+        printMessage( " not merged with the previous block: %p should be %p\n", f, a);
+        all_ok = false;
+    }
+    RtMemory::release(f);
+    RtMemory::release(d);
+
+    // everything is one free block again
+    char *g = (char *)RtMemory::allocate(512);
+    if (g != a) {
+        printMessage( " not merged with both blocks: %p should be %p\n", g, a);
+        all_ok = false;
+    }
+    RtMemory::release(g);
+    return all_ok;
+}
+
+// blocks larger than a chunk get a chunk of their own
+bool
+testLarge() {
+    bool all_ok = true;
+
+    printMessage( "Checking blocks larger than a chunk...\n");
+    size_t size = RTMEMORY_CHUNK_SIZE * 2 + 1;
+    char *a = (char *)RtMemory::allocate(size);
+    if (a == NULL) {
+        printMessage( " allocation failed\n");
+        return false;
+    }
+    if (!isZero(a, size)) {
+        printMessage( " block not zeroed\n");
+        all_ok = false;
+    }
+    memset(a, 0x11, size);
+    RtMemory::release(a);
+    char *b = (char *)RtMemory::allocate(size);
+    if (b != a) {
+        printMessage( " chunk not reused: %p should be %p\n", b, a);
+        all_ok = false;
+    }
+    RtMemory::release(b);
+    // releasing NULL is allowed
+    RtMemory::release(NULL);
+    return all_ok;
+}
+
+int
+main(int argc, char **argv) {
+    bool all_ok = true;
+
+    setDebugLevel(DEBUG_LEVEL_MESSAGE);
+
+    // the layout of the huge page chunks differs
+    RtMemory::setUseHugePages(false);
+
+    all_ok &= testAllocate();
+    all_ok &= testReuse();
+    all_ok &= testMerge();
+    all_ok &= testLarge();
+
+    if (!all_ok) {
+        printMessage( "Test failed\n");
+        return -1;
+    }
+    printMessage( "All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "debugmodule/debugmodule.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#include "libstreaming/generic/SampleConversion.h"
+
+#include "libutil/SystemTimeSource.h"
+#include "libutil/Time.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+using namespace Streaming;
+
+// odd sizes and offsets, such that the scalar code has to finish the blocks
+#define NB_SAMPLES  1027
+#define OFFSET      3
+#define NB_BENCH_SAMPLES (1024 * 1024 * 4)
+#define NB_TESTS 10
+
+static const struct {
+    enum StreamProcessorManager::eADT_AudioDataType type;
+    const char *name;
+} formats[] = {
+    {StreamProcessorManager::eADT_Int24,   "int24"},
+    {StreamProcessorManager::eADT_Int32,   "int32"},
+    {StreamProcessorManager::eADT_Int16,   "int16"},
+    {StreamProcessorManager::eADT_Float,   "float"},
+    {StreamProcessorManager::eADT_Float64, "float64"},
+};
+#define NB_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+// 24 bit samples with garbage in the 8 MSB's, including the extremes
+static void
+generateInt24(int32_t *buffer, int nb_samples) {
+    for (int i = 0; i < nb_samples; i++) {
+        buffer[i] = (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+    }
+    buffer[0] = 0x007FFFFF;
+    buffer[1] = 0x00800000;
+    buffer[2] = 0xFF000000;
+}
+
+// client samples, including some outside of [-1.0..1.0]
+static void
+generateClient(enum StreamProcessorManager::eADT_AudioDataType t,
+               void *buffer, int nb_samples) {
+    for (int i = 0; i < nb_samples; i++) {
+        double v = (double)rand() / RAND_MAX * 2.4 - 1.2;
+        switch(t) {
+            case StreamProcessorManager::eADT_Int24:
+            case StreamProcessorManager::eADT_Int32:
+                ((uint32_t *)buffer)[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+                break;
+            case StreamProcessorManager::eADT_Int16:
+                ((int16_t *)buffer)[i] = (int16_t)rand();
+                break;
+            case StreamProcessorManager::eADT_Float:
+                ((float *)buffer)[i] = (float)v;
+                break;
+            case StreamProcessorManager::eADT_Float64:
+                ((double *)buffer)[i] = v;
+                break;
+        }
+    }
+}
+
+bool
+testToClient(enum StreamProcessorManager::eADT_AudioDataType t, const char *name) {
+    int32_t src[NB_SAMPLES];
+    unsigned int size = getAudioSampleSize(t);
+    unsigned int nb_bytes = (NB_SAMPLES + OFFSET) * size;
+    char *buffer = new char[nb_bytes];
+    char *buffer_ref = new char[nb_bytes];
+    bool all_ok = true;
+
+    generateInt24(src, NB_SAMPLES);
+    memset(buffer, 0, nb_bytes);
+    memset(buffer_ref, 0, nb_bytes);
+
+    convertInt24ToClientScalar(t, src, buffer_ref, OFFSET, 1, NB_SAMPLES);
+    convertInt24ToClient(t, src, buffer, OFFSET, 1, NB_SAMPLES);
+
+    for (unsigned int i = 0; i < NB_SAMPLES + OFFSET; i++) {
+        if (memcmp(buffer + i * size, buffer_ref + i * size, size)) {
+            printMessage( " bad %s result at %u for sample %08X\n",
+                          name, i, i >= OFFSET ? src[i - OFFSET] : 0);
+            all_ok = false;
+            break;
+        }
+    }
+
+    delete[] buffer;
+    delete[] buffer_ref;
+    return all_ok;
+}
+
+bool
+testFromClient(enum StreamProcessorManager::eADT_AudioDataType t, const char *name, bool clip) {
+    int32_t dst[NB_SAMPLES];
+    int32_t dst_ref[NB_SAMPLES];
+    char *buffer = new char[(NB_SAMPLES + OFFSET) * getAudioSampleSize(t)];
+    bool all_ok = true;
+
+    generateClient(t, buffer, NB_SAMPLES + OFFSET);
+
+    convertClientToInt24Scalar(t, buffer, OFFSET, 1, dst_ref, NB_SAMPLES, clip);
+    convertClientToInt24(t, buffer, OFFSET, 1, dst, NB_SAMPLES, clip);
+
+    for (unsigned int i = 0; i < NB_SAMPLES; i++) {
+        // without clipping the out-of-range floats give undefined results
+        if (!clip && (t == StreamProcessorManager::eADT_Float
+                      || t == StreamProcessorManager::eADT_Float64)) {
+            break;
+        }
+        if (dst[i] != dst_ref[i]) {
+            printMessage( " bad %s result at %u: %08X should be %08X\n",
+                          name, i, dst[i], dst_ref[i]);
+            all_ok = false;
+            break;
+        }
+    }
+
+    delete[] buffer;
+    return all_ok;
+}
+
+void
+benchmark(enum StreamProcessorManager::eADT_AudioDataType t, const char *name) {
+    int32_t *src = new int32_t[NB_BENCH_SAMPLES];
+    char *buffer = new char[NB_BENCH_SAMPLES * getAudioSampleSize(t)];
+    ffado_microsecs_t start;
+    ffado_microsecs_t elapsed_ref = 0;
+    ffado_microsecs_t elapsed = 0;
+
+    generateInt24(src, NB_BENCH_SAMPLES);
+    for (int test = 0; test < NB_TESTS; test++) {
+        start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        convertInt24ToClientScalar(t, src, buffer, 0, 1, NB_BENCH_SAMPLES);
+        elapsed_ref += Util::SystemTimeSource::getCurrentTimeAsUsecs() - start;
+
+        start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        convertInt24ToClient(t, src, buffer, 0, 1, NB_BENCH_SAMPLES);
+        elapsed += Util::SystemTimeSource::getCurrentTimeAsUsecs() - start;
+    }
+    printMessage( " %-8s to client: scalar %" PRI_FFADO_MICROSECS_T "usec, vector %" PRI_FFADO_MICROSECS_T "usec\n",
+                  name, elapsed_ref / NB_TESTS, elapsed / NB_TESTS);
+
+    elapsed_ref = 0;
+    elapsed = 0;
+    for (int test = 0; test < NB_TESTS; test++) {
+        start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        convertClientToInt24Scalar(t, buffer, 0, 1, src, NB_BENCH_SAMPLES, true);
+        elapsed_ref += Util::SystemTimeSource::getCurrentTimeAsUsecs() - start;
+
+        start = Util::SystemTimeSource::getCurrentTimeAsUsecs();
+        convertClientToInt24(t, buffer, 0, 1, src, NB_BENCH_SAMPLES, true);
+        elapsed += Util::SystemTimeSource::getCurrentTimeAsUsecs() - start;
+    }
+    printMessage( " %-8s from client: scalar %" PRI_FFADO_MICROSECS_T "usec, vector %" PRI_FFADO_MICROSECS_T "usec\n",
+                  name, elapsed_ref / NB_TESTS, elapsed / NB_TESTS);
+
+    delete[] src;
+    delete[] buffer;
+}
+
+int
+main(int argc, char **argv) {
+    bool all_ok = true;
+
+    setDebugLevel(DEBUG_LEVEL_MESSAGE);
+    srand(0);
+
+    printMessage( "Checking the conversions against the scalar reference...\n");
+    for (unsigned int i = 0; i < NB_FORMATS; i++) {
+        all_ok &= testToClient(formats[i].type, formats[i].name);
+        all_ok &= testFromClient(formats[i].type, formats[i].name, true);
+        all_ok &= testFromClient(formats[i].type, formats[i].name, false);
+    }
+
+    printMessage( "Timing the conversions...\n");
+    for (unsigned int i = 0; i < NB_FORMATS; i++) {
+        benchmark(formats[i].type, formats[i].name);
+    }
+
+    if (!all_ok) {
+        printMessage( "Test failed\n");
+        return -1;
+    }
+    printMessage( "All checks passed\n");
+    return 0;
+}
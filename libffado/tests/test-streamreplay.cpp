@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Replays a packet capture (see streaming.spm.capture_packets) through a
+ * receive stream processor, as fast as possible and without any 1394
+ * hardware. Reports the processing cost, the behaviour of the timestamp
+ * DLL and checksums of the decoded port data, such that decoder changes
+ * can be benchmarked and verified in a reproducible way.
+ */
+
+#include "config.h"
+
+#include <argp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "debugmodule/debugmodule.h"
+#include "devicemanager.h"
+#include "ffadodevice.h"
+
+#include "libieee1394/configrom.h"
+#include "libieee1394/ieee1394service.h"
+#include "libieee1394/cycletimer.h"
+
+#include "libstreaming/StreamProcessorManager.h"
+#include "libstreaming/generic/StreamProcessor.h"
+#include "libstreaming/generic/IsoStreamCapture.h"
+
+#ifdef ENABLE_GENERICAVC
+#include "libstreaming/amdtp/AmdtpReceiveStreamProcessor.h"
+#include "libstreaming/amdtp/AmdtpPort.h"
+#endif
+#ifdef ENABLE_MOTU
+#include "libstreaming/motu/MotuReceiveStreamProcessor.h"
+#include "libstreaming/motu/MotuPort.h"
+#include "motu/motu_avdevice.h"
+#endif
+#ifdef ENABLE_RME
+#include "libstreaming/rme/RmeReceiveStreamProcessor.h"
+#include "libstreaming/rme/RmePort.h"
+#endif
+#ifdef ENABLE_DIGIDESIGN
+#include "libstreaming/digidesign/DigidesignReceiveStreamProcessor.h"
+#include "libstreaming/digidesign/DigidesignPort.h"
+#endif
+
+#include <vector>
+#include <memory>
+
+using namespace Streaming;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+// the number of cycles between the stream being picked up and
+// the SP being switched to running
+#define REPLAY_STARTUP_CYCLES 100
+
+////////////////////////////////////////////////
+// arg parsing
+////////////////////////////////////////////////
+const char *argp_program_version = "test-streamreplay 0.1";
+const char *argp_program_bug_address = "<ffado-devel@lists.sf.net>";
+static char doc[] = "test-streamreplay -- replay a packet capture through a receive stream processor\n\n"
+                    "TYPE is one of amdtp, motu, rme, digidesign. The meaning of SIZE depends\n"
+                    "on the type: the AMDTP dimension (quadlets per event) or the event size\n"
+                    "in bytes for the other types.";
+static char args_doc[] = "FILE";
+static struct argp_option options[] = {
+    {"verbose",  'v', "level",   0,  "Verbose level" },
+    {"type",     't', "TYPE",    0,  "Stream type (amdtp)" },
+    {"size",     's', "SIZE",    0,  "Stream dimension or event size" },
+    {"model",    'm', "MODEL",   0,  "Device model (motu/rme only)" },
+    {"rate",     'r', "RATE",    0,  "Nominal sample rate (from capture)" },
+    {"period",   'p', "FRAMES",  0,  "Period size (512)" },
+    {"nbuffers", 'n', "NB",      0,  "Number of periods to buffer (3)" },
+    {"int24",    'i', 0,         0,  "Decode to int24 instead of float" },
+    { 0 }
+};
+
+struct arguments
+{
+    arguments()
+        : verbose( 0 )
+        , type( "amdtp" )
+        , size( 0 )
+        , model( 0 )
+        , rate( 0 )
+        , period( 512 )
+        , nb_buffers( 3 )
+        , int24( false )
+        {
+            args[0] = 0;
+        }
+
+    char* args[1];
+    int   verbose;
+    const char *type;
+    int   size;
+    int   model;
+    int   rate;
+    int   period;
+    int   nb_buffers;
+    bool  int24;
+} arguments;
+
+static bool
+parse_int( const char *name, char *arg, int &value )
+{
+    char* tail;
+    errno = 0;
+    value = strtol( arg, &tail, 0 );
+    if ( errno || *tail != 0 ) {
+        fprintf( stderr, "Could not parse '%s' argument\n", name );
+        return false;
+    }
+    return true;
+}
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+
+    switch (key) {
+    case 'v':
+        if ( !parse_int( "verbose", arg, arguments->verbose ) ) return ARGP_ERR_UNKNOWN;
+        break;
+    case 't':
+        arguments->type = arg;
+        break;
+    case 's':
+        if ( !parse_int( "size", arg, arguments->size ) ) return ARGP_ERR_UNKNOWN;
+        break;
+    case 'm':
+        if ( !parse_int( "model", arg, arguments->model ) ) return ARGP_ERR_UNKNOWN;
+        break;
+    case 'r':
+        if ( !parse_int( "rate", arg, arguments->rate ) ) return ARGP_ERR_UNKNOWN;
+        break;
+    case 'p':
+        if ( !parse_int( "period", arg, arguments->period ) ) return ARGP_ERR_UNKNOWN;
+        break;
+    case 'n':
+        if ( !parse_int( "nbuffers", arg, arguments->nb_buffers ) ) return ARGP_ERR_UNKNOWN;
+        break;
+    case 'i':
+        arguments->int24 = true;
+        break;
+    case ARGP_KEY_ARG:
+        if (state->arg_num >= 1) {
+            // Too many arguments.
+            argp_usage (state);
+        }
+        arguments->args[state->arg_num] = arg;
+        break;
+    case ARGP_KEY_END:
+        if (state->arg_num < 1) {
+            // Not enough arguments.
+            argp_usage (state);
+        }
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+///////////////////////////
+// the device the replayed SP is attached to
+///////////////////////////
+class ReplayDevice : public FFADODevice
+{
+public:
+    ReplayDevice( DeviceManager& d, std::auto_ptr<ConfigRom>( configRom ), int rate )
+        : FFADODevice( d, configRom )
+        , m_rate( rate )
+        {};
+    virtual ~ReplayDevice() {};
+
+    virtual bool discover() {return true;};
+    virtual bool setSamplingFrequency( int f ) {return f == m_rate;};
+    virtual int getSamplingFrequency( ) {return m_rate;};
+    virtual std::vector<int> getSupportedSamplingFrequencies( )
+        {return std::vector<int>(1, m_rate);};
+    virtual ClockSourceVector getSupportedClockSources() {return ClockSourceVector();};
+    virtual bool setActiveClockSource(ClockSource) {return false;};
+    virtual ClockSource getActiveClockSource() {return ClockSource();};
+    virtual bool lock() {return true;};
+    virtual bool unlock() {return true;};
+    virtual bool prepare() {return true;};
+    virtual int getStreamCount() {return 0;};
+    virtual StreamProcessor *getStreamProcessorByIndex(int i) {return NULL;};
+    virtual bool startStreamByIndex(int i) {return false;};
+    virtual bool stopStreamByIndex(int i) {return false;};
+private:
+    int m_rate;
+};
+
+static uint64_t
+nsecs_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// FNV-1a, over the port buffer contents
+static uint32_t
+checksum_add(uint32_t sum, const unsigned char *data, unsigned int len)
+{
+    for (unsigned int i=0; i<len; i++) {
+        sum ^= data[i];
+        sum *= 16777619U;
+    }
+    return sum;
+}
+
+static StreamProcessor *
+create_processor(FFADODevice &dev, struct arguments &args)
+{
+    StreamProcessor *p = NULL;
+    char name[64];
+    int i;
+
+#ifdef ENABLE_GENERICAVC
+    if (strcmp(args.type, "amdtp") == 0) {
+        // assume a stream of MBLA quadlets only
+        p = new AmdtpReceiveStreamProcessor(dev, args.size);
+        for (i=0; i<args.size; i++) {
+            snprintf(name, sizeof(name), "cap_%d", i);
+            new AmdtpAudioPort(*p, name, Port::E_Capture, i, 0, AmdtpPortInfo::E_MBLA);
+        }
+        return p;
+    }
+#endif
+#ifdef ENABLE_MOTU
+    if (strcmp(args.type, "motu") == 0) {
+        // audio starts after the SPH and the control bytes, 3 bytes per channel
+        int ofs = (args.model == Motu::MOTU_MODEL_828MkI ? 4 : 10);
+        p = new MotuReceiveStreamProcessor(dev, args.size, args.model);
+        for (i=0; ofs+3*i+3 <= args.size; i++) {
+            snprintf(name, sizeof(name), "cap_%d", i);
+            new MotuAudioPort(*p, name, Port::E_Capture, ofs+3*i, 0);
+        }
+        return p;
+    }
+#endif
+#ifdef ENABLE_RME
+    if (strcmp(args.type, "rme") == 0) {
+        p = new RmeReceiveStreamProcessor(dev, args.model, args.size);
+        for (i=0; 4*i+4 <= args.size; i++) {
+            snprintf(name, sizeof(name), "cap_%d", i);
+            new RmeAudioPort(*p, name, Port::E_Capture, 4*i, 0);
+        }
+        return p;
+    }
+#endif
+#ifdef ENABLE_DIGIDESIGN
+    if (strcmp(args.type, "digidesign") == 0) {
+        p = new DigidesignReceiveStreamProcessor(dev, args.size);
+        for (i=0; 4*i+4 <= args.size; i++) {
+            snprintf(name, sizeof(name), "cap_%d", i);
+            new DigidesignAudioPort(*p, name, Port::E_Capture, 4*i, 0);
+        }
+        return p;
+    }
+#endif
+    fprintf(stderr, "Unsupported stream type: %s\n", args.type);
+    return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+    // arg parsing
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        exit(-1);
+    }
+    setDebugLevel(arguments.verbose);
+
+    IsoStreamCapture capture;
+    capture.setVerboseLevel(arguments.verbose);
+    if (!capture.load(arguments.args[0])) {
+        fprintf(stderr, "Could not load capture %s\n", arguments.args[0]);
+        exit(-1);
+    }
+    int rate = arguments.rate ? arguments.rate : (int)capture.getNominalRate();
+    if (rate <= 0 || arguments.size <= 0 || arguments.period <= 0) {
+        fprintf(stderr, "Need a valid rate, stream size and period\n");
+        exit(-1);
+    }
+
+    DeviceManager *m = new DeviceManager();
+    Ieee1394Service *service = new Ieee1394Service();
+    ReplayDevice *dev = new ReplayDevice(*m, std::auto_ptr<ConfigRom>(new ConfigRom(*service, 0)), rate);
+
+    StreamProcessorManager &spm = m->getStreamProcessorManager();
+    spm.setVerboseLevel(arguments.verbose);
+    spm.setNominalRate(rate);
+    spm.setPeriodSize(arguments.period);
+    spm.setNbBuffers(arguments.nb_buffers);
+    spm.setAudioDataType(arguments.int24 ? StreamProcessorManager::eADT_Int24
+                                         : StreamProcessorManager::eADT_Float);
+
+    StreamProcessor *sp = create_processor(*dev, arguments);
+    if (sp == NULL) {
+        delete dev;
+        delete service;
+        delete m;
+        exit(-1);
+    }
+    sp->setVerboseLevel(arguments.verbose);
+
+    // attach a buffer to every port
+    unsigned int nb_ports = sp->getPortCount();
+    std::vector<uint32_t *> buffers;
+    std::vector<uint32_t> checksums(nb_ports, 2166136261U);
+    for (unsigned int i=0; i<nb_ports; i++) {
+        Port *port = sp->getPortAtIdx(i);
+        uint32_t *b = new uint32_t[arguments.period];
+        memset(b, 0, arguments.period * sizeof(uint32_t));
+        port->setBufferAddress(b);
+        port->enable();
+        buffers.push_back(b);
+    }
+
+    // the SP is only registered with the SPM, since there is no iso
+    // handler to attach it to
+    if (!spm.registerProcessor(sp) || !spm.setSyncSource(sp) || !spm.prepare()) {
+        fprintf(stderr, "Could not prepare the stream processor\n");
+        exit(-1);
+    }
+
+    // replay
+    uint64_t ns_packets = 0;
+    uint64_t ns_periods = 0;
+    unsigned int nb_packets = 0;
+    unsigned int nb_periods = 0;
+    unsigned int nb_xruns = 0;
+    float tpf_min = 1e9, tpf_max = 0;
+    double tpf_sum = 0;
+    bool run_scheduled = false;
+    bool was_running = false;
+
+    size_t pos = 0;
+    IsoStreamCapture::PacketHeader *h = capture.nextPacket(pos);
+    if (h == NULL) {
+        fprintf(stderr, "Empty capture\n");
+        exit(-1);
+    }
+    sp->scheduleStartOffline(CYCLE_TIMER_TO_TICKS(h->pkt_ctr));
+
+    uint64_t ns_start = nsecs_now();
+    for ( ; h; h = capture.nextPacket(pos)) {
+        uint64_t t0 = nsecs_now();
+        sp->putPacket(IsoStreamCapture::getPacketData(h), h->length,
+                      h->channel, h->tag, h->sy, h->pkt_ctr, h->dropped);
+        ns_packets += nsecs_now() - t0;
+        nb_packets++;
+
+        if (sp->isDryRunning() && !run_scheduled) {
+            uint64_t start = addTicks(CYCLE_TIMER_TO_TICKS(h->pkt_ctr),
+                                      REPLAY_STARTUP_CYCLES * TICKS_PER_CYCLE);
+            sp->scheduleStartRunning(start);
+            run_scheduled = true;
+        }
+        if (!sp->isRunning()) {
+            if (was_running) {
+                debugOutput(DEBUG_LEVEL_NORMAL, "xrun at packet %u\n", nb_packets);
+                nb_xruns++;
+                was_running = false;
+                run_scheduled = false;
+            }
+            continue;
+        }
+        was_running = true;
+
+        while (!sp->xrunOccurred() && sp->canConsumePeriod()) {
+            ffado_timestamp_t ts_head;
+            signed int fc;
+            sp->getBufferHeadTimestamp(&ts_head, &fc);
+            float tpf = sp->getTicksPerFrame();
+            int64_t ts = addTicks((uint64_t)ts_head, (uint64_t)(arguments.period * tpf));
+
+            t0 = nsecs_now();
+            sp->getFrames(arguments.period, ts);
+            ns_periods += nsecs_now() - t0;
+            nb_periods++;
+
+            if (tpf < tpf_min) tpf_min = tpf;
+            if (tpf > tpf_max) tpf_max = tpf;
+            tpf_sum += tpf;
+
+            for (unsigned int i=0; i<nb_ports; i++) {
+                checksums[i] = checksum_add(checksums[i], (unsigned char *)buffers[i],
+                                            arguments.period * sizeof(uint32_t));
+            }
+        }
+    }
+    uint64_t ns_total = nsecs_now() - ns_start;
+
+    // report
+    double secs_of_stream = (double)nb_packets / 8000.0;
+    printf("Replayed %u packets (%.3f s of stream) in %.3f ms: %.1fx real time\n",
+           nb_packets, secs_of_stream, ns_total / 1e6,
+           ns_total ? secs_of_stream * 1e9 / ns_total : 0.0);
+    printf(" putPacket    : %8.1f ns/packet\n",
+           nb_packets ? (double)ns_packets / nb_packets : 0.0);
+    printf(" getFrames    : %8.1f ns/period, %u periods of %d frames\n",
+           nb_periods ? (double)ns_periods / nb_periods : 0.0,
+           nb_periods, arguments.period);
+    printf(" xruns        : %u\n", nb_xruns);
+    if (nb_periods) {
+        double tpf_avg = tpf_sum / nb_periods;
+        double tpf_nom = (double)TICKS_PER_SECOND / rate;
+        printf(" DLL rate     : avg %.3f Hz, min %.3f Hz, max %.3f Hz (%.1f ppm off nominal)\n",
+               TICKS_PER_SECOND / tpf_avg, TICKS_PER_SECOND / tpf_max,
+               TICKS_PER_SECOND / tpf_min, (tpf_nom / tpf_avg - 1.0) * 1e6);
+    }
+    uint32_t total = 2166136261U;
+    for (unsigned int i=0; i<nb_ports; i++) {
+        debugOutput(DEBUG_LEVEL_VERBOSE, " port %2u      : %08X\n", i, checksums[i]);
+        total = checksum_add(total, (unsigned char *)&checksums[i], sizeof(uint32_t));
+    }
+    printf(" checksum     : %08X (%u ports)\n", total, nb_ports);
+
+    delete sp;
+    for (unsigned int i=0; i<nb_ports; i++) {
+        delete[] buffers[i];
+    }
+    delete dev;
+    delete service;
+    delete m;
+    return 0;
+}
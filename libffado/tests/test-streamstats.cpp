@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "debugmodule/debugmodule.h"
+
+#include "libutil/PosixSharedMemory.h"
+#include "libutil/StreamStatistics.h"
+
+#include <argp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace Util;
+using namespace Streaming;
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#define MAX_ARGS 1
+
+int run=1;
+static void sighandler (int sig)
+{
+    run = 0;
+}
+
+////////////////////////////////////////////////
+// arg parsing
+////////////////////////////////////////////////
+const char *argp_program_version = "test-streamstats 0.1";
+const char *argp_program_bug_address = "<ffado-devel@lists.sf.net>";
+static char doc[] = "test-streamstats -- dump the stream statistics published by a running FFADO process.";
+static char args_doc[] = "PID";
+static struct argp_option options[] = {
+    {"verbose",  'v', "level",    0,  "Produce verbose output" },
+    {"interval", 'i', "seconds",  0,  "Repeat every <seconds> (0 = once)" },
+   { 0 }
+};
+
+struct arguments
+{
+    arguments()
+        : nargs ( 0 )
+        , verbose( false )
+        , interval( 0 )
+        {
+            args[0] = 0;
+        }
+
+    char* args[MAX_ARGS];
+    int   nargs;
+    long int verbose;
+    long int interval;
+} arguments;
+
+// Parse a single option.
+static error_t
+parse_opt( int key, char* arg, struct argp_state* state )
+{
+    // Get the input argument from `argp_parse', which we
+    // know is a pointer to our arguments structure.
+    struct arguments* arguments = ( struct arguments* ) state->input;
+
+    char* tail;
+    errno = 0;
+    switch (key) {
+    case 'v':
+        if (arg) {
+            arguments->verbose = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'verbose' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case 'i':
+        if (arg) {
+            arguments->interval = strtol( arg, &tail, 0 );
+            if ( errno ) {
+                fprintf( stderr,  "Could not parse 'interval' argument\n" );
+                return ARGP_ERR_UNKNOWN;
+            }
+        }
+        break;
+    case ARGP_KEY_ARG:
+        if (state->arg_num >= MAX_ARGS) {
+            // Too many arguments.
+            argp_usage (state);
+        }
+        arguments->args[state->arg_num] = arg;
+        arguments->nargs++;
+        break;
+    case ARGP_KEY_END:
+        if(arguments->nargs <= 0) {
+            printMessage("not enough arguments\n");
+            return -1;
+        }
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+///////////////////////////
+// main
+//////////////////////////
+int
+main(int argc, char **argv)
+{
+    signal (SIGINT, sighandler);
+    signal (SIGPIPE, sighandler);
+
+    // arg parsing
+    if ( argp_parse ( &argp, argc, argv, 0, 0, &arguments ) ) {
+        fprintf( stderr, "Could not parse command line\n" );
+        exit(-1);
+    }
+
+    setDebugLevel(arguments.verbose);
+
+    errno = 0;
+    char* tail;
+    long int pid = strtol( arguments.args[0], &tail, 0 );
+    if ( errno ) {
+        fprintf( stderr,  "Could not parse pid argument\n" );
+        exit(-1);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "ffado-stats-%ld", pid);
+    unsigned int size = sizeof(struct sStatsSegmentHeader)
+                        + STREAMSTATISTICS_SHM_SLOTS * sizeof(struct sStatsHistogram);
+
+    PosixSharedMemory s = PosixSharedMemory(name, size);
+    s.setVerboseLevel(arguments.verbose);
+    if(!s.Open(PosixSharedMemory::eD_ReadOnly)) {
+        debugError("Could not open segment %s\n", name);
+        exit(-1);
+    }
+
+    struct sStatsSegmentHeader header;
+    if(s.Read(0, &header, sizeof(header)) != PosixSharedMemory::eR_OK) {
+        debugError("Could not read segment header\n");
+        exit(-1);
+    }
+    if(header.magic != STREAMSTATISTICS_SHM_MAGIC
+       || header.version != STREAMSTATISTICS_SHM_VERSION
+       || header.slot_size != sizeof(struct sStatsHistogram)
+       || header.nb_slots > STREAMSTATISTICS_SHM_SLOTS) {
+        debugError("Segment %s has an incompatible layout\n", name);
+        exit(-1);
+    }
+
+    struct sStatsHistogram h;
+    run=1;
+    while(run) {
+        printMessage("Stream statistics of process %u:\n", header.pid);
+        for (unsigned int i = 0; i < header.nb_slots; i++) {
+            unsigned int offset = sizeof(header) + i * header.slot_size;
+            // the writer doesn't stop, so the snapshot can be
+            // slightly inconsistent. That's fine for monitoring.
+            if(s.Read(offset, &h, sizeof(h)) != PosixSharedMemory::eR_OK) {
+                debugError("Could not read slot %u\n", i);
+                exit(-1);
+            }
+            if(!h.in_use || h.count == 0) continue;
+            h.name[sizeof(h.name) - 1] = 0;
+            h.unit[sizeof(h.unit) - 1] = 0;
+            printMessage(" %-48s cnt=%10" PRId64 " min=%8" PRId64 " p50=%8" PRId64
+                         " p99=%8" PRId64 " p99.9=%8" PRId64 " max=%8" PRId64 " %s\n",
+                         h.name, h.count, h.min, StreamStatistics::getPercentile(h, 50.0),
+                         StreamStatistics::getPercentile(h, 99.0),
+                         StreamStatistics::getPercentile(h, 99.9), h.max, h.unit);
+        }
+        if(arguments.interval <= 0) break;
+        sleep(arguments.interval);
+    }
+
+    return 0;
+}
@@ -587,6 +587,93 @@ int main(int argc, char *argv[])
         }
     }
 
+    debugOutput(DEBUG_LEVEL_NORMAL, "Start skipHeadFrames test...\n");
+    {
+        bool pass=true;
+        unsigned int nb_packets=10;
+        unsigned int nb_skip=2;
+        unsigned int nb_events=arguments.events_per_frame*arguments.frames_per_packet;
+        int dummyframe_in[nb_events];
+        int dummyframe_out[nb_events];
+
+        // the buffer has to hold the frames
+        t->setTransparent(false);
+        t->clearBuffer();
+
+        uint64_t timestamp=(arguments.start_at_cycle*3072) % arguments.wrap_at;
+        t->setBufferTailTimestamp(timestamp);
+
+        // every packet holds its own number
+        for (unsigned int p=0;p<nb_packets;p++) {
+            timestamp += (uint64_t)(arguments.rate * arguments.frames_per_packet);
+            if (timestamp >= arguments.wrap_at) {
+                timestamp -= arguments.wrap_at;
+            }
+            for (unsigned int i=0;i<nb_events;i++) {
+                dummyframe_in[i]=p;
+            }
+            t->writeFrames(arguments.frames_per_packet, (char *)&dummyframe_in, timestamp);
+        }
+
+        ffado_timestamp_t ts_head_before, ts_tail_before, ts_head_after, ts_tail_after;
+        signed int fc_before, fc_after;
+        t->getBufferHeadTimestamp(&ts_head_before, &fc_before);
+        t->getBufferTailTimestamp(&ts_tail_before, &fc_before);
+
+        if (!t->skipHeadFrames(nb_skip*arguments.frames_per_packet)) {
+            debugError(" skipHeadFrames failed\n");
+            pass=false;
+        }
+
+        t->getBufferHeadTimestamp(&ts_head_after, &fc_after);
+        t->getBufferTailTimestamp(&ts_tail_after, &fc_after);
+
+        // the head stays, the rest of the buffer moves back
+        uint64_t expected_tail=(uint64_t)ts_tail_before;
+        uint64_t shift=(uint64_t)(arguments.rate * nb_skip * arguments.frames_per_packet);
+        if (expected_tail < shift) {
+            expected_tail += arguments.wrap_at;
+        }
+        expected_tail -= shift;
+
+        if ((uint64_t)ts_head_after != (uint64_t)ts_head_before) {
+            debugError(" head moved: %011" PRIu64 " != %011" PRIu64 "\n",
+                       (uint64_t)ts_head_after, (uint64_t)ts_head_before);
+            pass=false;
+        }
+        if ((uint64_t)ts_tail_after != expected_tail) {
+            debugError(" tail: %011" PRIu64 " != %011" PRIu64 "\n",
+                       (uint64_t)ts_tail_after, expected_tail);
+            pass=false;
+        }
+        if (fc_after != fc_before - (signed int)(nb_skip*arguments.frames_per_packet)) {
+            debugError(" frame count: %d != %d\n",
+                       fc_after, fc_before - (signed int)(nb_skip*arguments.frames_per_packet));
+            pass=false;
+        }
+
+        // the reader gets the first packet after the skipped ones
+        t->readFrames(arguments.frames_per_packet, (char *)&dummyframe_out);
+        if (dummyframe_out[0] != (int)nb_skip || dummyframe_out[nb_events-1] != (int)nb_skip) {
+            debugError(" read packet %d, expected %u\n", dummyframe_out[0], nb_skip);
+            pass=false;
+        }
+        t->getBufferHeadTimestamp(&ts_head_after, &fc_after);
+        if (fc_after != fc_before - (signed int)((nb_skip+1)*arguments.frames_per_packet)) {
+            debugError(" frame count after read: %d\n", fc_after);
+            pass=false;
+        }
+
+        if(!pass) {
+            debugError("Test failed, exiting...\n");
+
+            delete t;
+            delete c;
+
+            return -1;
+        }
+    }
+
     delete t;
     delete c;
 
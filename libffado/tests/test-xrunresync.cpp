@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2005-2008 by Pieter Palmers
+ *
+ * This file is part of FFADO
+ * FFADO = Free Firewire (pro-)audio drivers for linux
+ *
+ * FFADO is based upon FreeBoB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "debugmodule/debugmodule.h"
+
+DECLARE_GLOBAL_DEBUG_MODULE;
+
+#include "libstreaming/StreamProcessorManager.h"
+#include "libstreaming/generic/StreamProcessor.h"
+
+#include <inttypes.h>
+
+using namespace Streaming;
+
+// 48kHz
+#define TICKS_PER_FRAME (24576000.0 / 48000.0)
+#define FRAMES_PER_PACKET 8
+#define PERIOD 256
+
+static bool
+checkLate(int64_t late_ticks, unsigned int nb_frames, unsigned int expected) {
+    unsigned int result = StreamProcessor::getNbLateFrames(late_ticks, TICKS_PER_FRAME,
+                                                           FRAMES_PER_PACKET, nb_frames);
+    if (result != expected) {
+        printMessage( " bad result: %" PRId64 " ticks late with %u frames skips %u, should be %u\n",
+                      late_ticks, nb_frames, result, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool
+checkExcess(int fill, unsigned int expected) {
+    unsigned int result = StreamProcessorManager::getResyncExcessFrames(fill, PERIOD);
+    if (result != expected) {
+        printMessage( " bad result: a fill of %d drops %u frames, should be %u\n",
+                      fill, result, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool
+checkMissing(int64_t gap_ticks, int64_t expected) {
+    int64_t period_ticks = (int64_t)(PERIOD * TICKS_PER_FRAME);
+    int64_t result = StreamProcessorManager::getResyncMissingPeriods(gap_ticks, period_ticks);
+    if (result != expected) {
+        printMessage( " bad result: a gap of %" PRId64 " ticks misses %" PRId64 " periods, should be %" PRId64 "\n",
+                      gap_ticks, result, expected);
+        return false;
+    }
+    return true;
+}
+
+bool
+testSkipLateFrames() {
+    bool all_ok = true;
+
+    printMessage( "Checking the skipping of late transmit frames...\n");
+
+    // even a single tick late skips the frame, hence a whole packet
+    all_ok &= checkLate(1, 64, FRAMES_PER_PACKET);
+    // exactly one packet late skips that packet and the next one's first frame
+    all_ok &= checkLate((int64_t)(FRAMES_PER_PACKET * TICKS_PER_FRAME), 64, 2 * FRAMES_PER_PACKET);
+    all_ok &= checkLate((int64_t)(FRAMES_PER_PACKET * TICKS_PER_FRAME) - 1, 64, FRAMES_PER_PACKET);
+    // a period late
+    all_ok &= checkLate((int64_t)(PERIOD * TICKS_PER_FRAME) - 1, 1024, PERIOD);
+
+    // never more than there are (whole packets of) frames in the buffer
+    all_ok &= checkLate((int64_t)(PERIOD * TICKS_PER_FRAME), 100, 96);
+    all_ok &= checkLate(1, 7, 0);
+    all_ok &= checkLate(1, 0, 0);
+
+    return all_ok;
+}
+
+bool
+testResyncStreams() {
+    bool all_ok = true;
+    int64_t period_ticks = (int64_t)(PERIOD * TICKS_PER_FRAME);
+
+    printMessage( "Checking the buffer realignment after an xrun...\n");
+
+    // the receive side keeps one period for the next transfer
+    all_ok &= checkExcess(0, 0);
+    all_ok &= checkExcess(PERIOD, 0);
+    all_ok &= checkExcess(2 * PERIOD - 1, 0);
+    all_ok &= checkExcess(2 * PERIOD, PERIOD);
+    all_ok &= checkExcess(4 * PERIOD + 10, 3 * PERIOD);
+
+    // the transmit side gets the missing periods rounded to the nearest one
+    all_ok &= checkMissing(0, 0);
+    all_ok &= checkMissing(period_ticks / 2 - 1, 0);
+    all_ok &= checkMissing(period_ticks / 2, 1);
+    all_ok &= checkMissing(period_ticks, 1);
+    all_ok &= checkMissing(3 * period_ticks + period_ticks / 3, 3);
+
+    // more than expected in the buffer, also when it's less than a period
+    all_ok &= checkMissing(-period_ticks / 3, 0);
+    all_ok &= checkMissing(-period_ticks + period_ticks / 3, -1);
+    all_ok &= checkMissing(-2 * period_ticks, -2);
+
+    return all_ok;
+}
+
+int
+main(int argc, char **argv) {
+    bool all_ok = true;
+
+    setDebugLevel(DEBUG_LEVEL_MESSAGE);
+
+    all_ok &= testSkipLateFrames();
+    all_ok &= testResyncStreams();
+
+    if (!all_ok) {
+        printMessage( "Test failed\n");
+        return -1;
+    }
+    printMessage( "All checks passed\n");
+    return 0;
+}